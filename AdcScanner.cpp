@@ -0,0 +1,266 @@
+/*
+ * AdcScanner.cpp
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "AdcScanner.h"
+
+#ifdef ARDUINO_ARCH_SAMD
+
+#include "wiring_private.h"
+
+#define ADC_SCAN_DMA_CHANNEL    0  // the DMAC isn't used by anything else
+#define ADC_SCAN_EVENT_CHANNEL  0
+#define ADC_SCAN_SAMPLEN        0x3f // sampling time like analogRead(), the pots have a high source impedance
+
+static DmacDescriptor dmaDescriptors[ADC_SCAN_DMA_CHANNEL + 1] __attribute__ ((aligned (16)));
+static DmacDescriptor dmaWriteback[ADC_SCAN_DMA_CHANNEL + 1] __attribute__ ((aligned (16)));
+static DmacDescriptor dmaLinks[2] __attribute__ ((aligned (16)));
+
+static uint16_t samples[2][ADC_SCAN_MAX_CHANNELS]; // written by the DMAC
+static volatile uint8_t latestBuffer;
+static volatile uint8_t fillingBuffer; // the half the DMAC currently writes
+static volatile uint32_t scanCount;
+static volatile uint32_t scanTime;
+
+static uint8_t scanPins[ADC_SCAN_MAX_PINS];
+static uint8_t scanOffsets[ADC_SCAN_MAX_PINS]; // position of the pin's channel within a scan
+static uint8_t numPins;
+static uint8_t firstChannel, numChannels;
+static uint8_t samplesShift; // log2 of the number of samples averaged per conversion (0-4)
+static uint16_t timerPeriod;
+static bool running;
+
+static void syncADC()
+{
+    while (ADC->STATUS.bit.SYNCBUSY);
+}
+
+/*
+ * A descriptor which fills buffer with one scan (one beat per channel), then
+ * continues with next.
+ */
+static void setDescriptor(DmacDescriptor *descriptor, uint8_t buffer, DmacDescriptor *next)
+{
+    descriptor->BTCTRL.reg = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BLOCKACT_INT | DMAC_BTCTRL_BEATSIZE_HWORD |
+            DMAC_BTCTRL_DSTINC | DMAC_BTCTRL_STEPSEL_DST | DMAC_BTCTRL_STEPSIZE_X1;
+    descriptor->BTCNT.reg = numChannels;
+    descriptor->SRCADDR.reg = (uint32_t) &ADC->RESULT.reg;
+    descriptor->DSTADDR.reg = (uint32_t) (samples[buffer] + numChannels); // the end address when incrementing
+    descriptor->DESCADDR.reg = (uint32_t) next;
+}
+
+/*
+ * Set up the scan of pins (analog inputs like A0) every interval microseconds, each
+ * conversion averaging 2^oversampling samples (0-4). The pins have to be on ADC
+ * channels no more than ADC_SCAN_MAX_CHANNELS apart, channels in between are converted
+ * too and ignored. TC3 and the DMAC are taken over, so analogWrite() is not available
+ * on the TC3 pins. Returns false if the pins can't be scanned.
+ */
+bool AdcScanner::begin(const uint8_t *pins, uint8_t count, uint32_t interval, uint8_t oversampling)
+{
+    uint8_t lastChannel = 0;
+
+    if (count == 0 || count > ADC_SCAN_MAX_PINS || oversampling > 4)
+        return false;
+
+    stop();
+    firstChannel = 0xff;
+    for (uint8_t i = 0; i < count; i++) {
+        int8_t channel = g_APinDescription[pins[i]].ulADCChannelNumber;
+        if (channel < 0)
+            return false;
+        firstChannel = min(firstChannel, (uint8_t) channel);
+        lastChannel = max(lastChannel, (uint8_t) channel);
+    }
+    if (lastChannel - firstChannel >= ADC_SCAN_MAX_CHANNELS)
+        return false;
+
+    numPins = count;
+    numChannels = lastChannel - firstChannel + 1;
+    for (uint8_t i = 0; i < count; i++) {
+        scanPins[i] = pins[i];
+        scanOffsets[i] = g_APinDescription[pins[i]].ulADCChannelNumber - firstChannel;
+        pinPeripheral(pins[i], PIO_ANALOG);
+    }
+    samplesShift = oversampling;
+
+    // TC3 runs on the 48MHz GCLK0 divided by 16 and fires one event per channel
+    uint32_t period = interval * 3 / numChannels;
+    timerPeriod = constrain(period, (uint32_t) 2, (uint32_t) 65536) - 1;
+
+    PM->APBCMASK.reg |= PM_APBCMASK_TC3 | PM_APBCMASK_EVSYS | PM_APBCMASK_ADC;
+    PM->AHBMASK.reg |= PM_AHBMASK_DMAC;
+    PM->APBBMASK.reg |= PM_APBBMASK_DMAC;
+    GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_TCC2_TC3 | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_CLKEN;
+    while (GCLK->STATUS.bit.SYNCBUSY);
+
+    // event channel: TC3 overflow starts a conversion
+    EVSYS->USER.reg = EVSYS_USER_USER(EVSYS_ID_USER_ADC_START) | EVSYS_USER_CHANNEL(ADC_SCAN_EVENT_CHANNEL + 1);
+    EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL(ADC_SCAN_EVENT_CHANNEL) | EVSYS_CHANNEL_PATH_ASYNCHRONOUS |
+            EVSYS_CHANNEL_EVGEN(EVSYS_ID_GEN_TC3_OVF);
+
+    DMAC->CTRL.bit.DMAENABLE = 0;
+    DMAC->BASEADDR.reg = (uint32_t) dmaDescriptors;
+    DMAC->WRBADDR.reg = (uint32_t) dmaWriteback;
+    DMAC->CTRL.reg = DMAC_CTRL_DMAENABLE | DMAC_CTRL_LVLEN(0xf);
+    NVIC_ClearPendingIRQ(DMAC_IRQn);
+    NVIC_EnableIRQ(DMAC_IRQn);
+
+    start();
+
+    // wait for the first scan, so there are samples when setup() returns
+    uint32_t startTime = micros();
+    while (scanCount == 0 && micros() - startTime < 2 * interval + 1000);
+    return scanCount > 0;
+}
+
+/*
+ * (Re-)start the scan with the configuration of begin(). The scan starts over at the
+ * first channel and with the first half of the double buffer.
+ */
+void AdcScanner::start()
+{
+    if (numPins == 0 || running)
+        return;
+
+    ADC->CTRLA.bit.ENABLE = 0;
+    syncADC();
+    ADC->CTRLB.reg = ADC_CTRLB_PRESCALER_DIV32 | (samplesShift ? ADC_CTRLB_RESSEL_16BIT : ADC_CTRLB_RESSEL_12BIT);
+    syncADC();
+    ADC->AVGCTRL.reg = ADC_AVGCTRL_SAMPLENUM(samplesShift) | ADC_AVGCTRL_ADJRES(samplesShift); // average to 12 bits
+    ADC->SAMPCTRL.reg = ADC_SAMPCTRL_SAMPLEN(ADC_SCAN_SAMPLEN);
+    ADC->INPUTCTRL.reg = ADC_INPUTCTRL_GAIN_DIV2 | ADC_INPUTCTRL_MUXNEG_GND | ADC_INPUTCTRL_MUXPOS(firstChannel) |
+            ADC_INPUTCTRL_INPUTSCAN(numChannels - 1) | ADC_INPUTCTRL_INPUTOFFSET(0);
+    syncADC();
+    ADC->EVCTRL.reg = ADC_EVCTRL_STARTEI;
+    ADC->INTFLAG.reg = ADC_INTFLAG_RESRDY;
+
+    // buffer 0 -> buffer 1 -> buffer 0 ... the channel's first descriptor is only used once
+    setDescriptor(&dmaDescriptors[ADC_SCAN_DMA_CHANNEL], 0, &dmaLinks[1]);
+    setDescriptor(&dmaLinks[0], 0, &dmaLinks[1]);
+    setDescriptor(&dmaLinks[1], 1, &dmaLinks[0]);
+    fillingBuffer = 0;
+
+    DMAC->CHID.reg = DMAC_CHID_ID(ADC_SCAN_DMA_CHANNEL);
+    DMAC->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+    while (DMAC->CHCTRLA.reg & DMAC_CHCTRLA_SWRST);
+    DMAC->CHCTRLB.reg = DMAC_CHCTRLB_LVL(0) | DMAC_CHCTRLB_TRIGSRC(ADC_DMAC_ID_RESRDY) | DMAC_CHCTRLB_TRIGACT_BEAT;
+    DMAC->CHINTENSET.reg = DMAC_CHINTENSET_TCMPL;
+    DMAC->CHCTRLA.reg = DMAC_CHCTRLA_ENABLE;
+
+    ADC->CTRLA.bit.ENABLE = 1;
+    syncADC();
+
+    TC3->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+    while (TC3->COUNT16.CTRLA.bit.SWRST);
+    TC3->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_WAVEGEN_MFRQ | TC_CTRLA_PRESCALER_DIV16;
+    TC3->COUNT16.CC[0].reg = timerPeriod;
+    while (TC3->COUNT16.STATUS.bit.SYNCBUSY);
+    TC3->COUNT16.EVCTRL.reg = TC_EVCTRL_OVFEO;
+    TC3->COUNT16.CTRLA.bit.ENABLE = 1;
+    while (TC3->COUNT16.STATUS.bit.SYNCBUSY);
+
+    running = true;
+}
+
+/*
+ * Stop the scan and leave the ADC configured the way analogRead() expects it.
+ * The latest samples stay available.
+ */
+void AdcScanner::stop()
+{
+    if (!running)
+        return;
+    running = false;
+
+    TC3->COUNT16.CTRLA.bit.ENABLE = 0;
+    while (TC3->COUNT16.STATUS.bit.SYNCBUSY);
+
+    DMAC->CHID.reg = DMAC_CHID_ID(ADC_SCAN_DMA_CHANNEL);
+    DMAC->CHCTRLA.reg = 0;
+    DMAC->CHINTENCLR.reg = DMAC_CHINTENCLR_TCMPL;
+
+    ADC->CTRLA.bit.ENABLE = 0;
+    syncADC();
+    ADC->EVCTRL.reg = 0;
+    ADC->CTRLB.reg = ADC_CTRLB_PRESCALER_DIV512 | ADC_CTRLB_RESSEL_10BIT;
+    syncADC();
+    ADC->AVGCTRL.reg = ADC_AVGCTRL_SAMPLENUM_1 | ADC_AVGCTRL_ADJRES(0);
+    ADC->INPUTCTRL.reg = ADC_INPUTCTRL_GAIN_DIV2 | ADC_INPUTCTRL_MUXNEG_GND;
+    syncADC();
+}
+
+bool AdcScanner::isRunning()
+{
+    return running;
+}
+
+/*
+ * The latest sample of a pin in the 10 bit range of analogRead(), -1 if the pin isn't
+ * scanned or there is no complete scan yet.
+ */
+int16_t AdcScanner::getSample(uint8_t pin)
+{
+    if (scanCount == 0)
+        return -1;
+    for (uint8_t i = 0; i < numPins; i++) {
+        if (scanPins[i] == pin)
+            return (samples[latestBuffer][scanOffsets[i]] + 2) >> 2;
+    }
+    return -1;
+}
+
+/*
+ * micros() when the latest scan completed.
+ */
+uint32_t AdcScanner::getScanTime()
+{
+    return scanTime;
+}
+
+uint32_t AdcScanner::getScanCount()
+{
+    return scanCount;
+}
+
+/*
+ * A scan is complete, the DMAC continues with the other half of the buffer.
+ */
+void DMAC_Handler()
+{
+    uint8_t channel = DMAC->CHID.reg; // restore it for code which was interrupted
+
+    DMAC->CHID.reg = DMAC_CHID_ID(ADC_SCAN_DMA_CHANNEL);
+    if (DMAC->CHINTFLAG.bit.TCMPL) {
+        DMAC->CHINTFLAG.reg = DMAC_CHINTFLAG_TCMPL;
+        latestBuffer = fillingBuffer;
+        fillingBuffer ^= 1;
+        scanCount++;
+        scanTime = micros();
+    }
+    DMAC->CHID.reg = channel;
+}
+
+#endif // ARDUINO_ARCH_SAMD
@@ -0,0 +1,52 @@
+/*
+ * AdcScanner.h
+ *
+ * Samples a set of analog inputs in the background. On the Feather M0 TC3 triggers
+ * the SAMD21 ADC through the event system, the ADC scans the inputs (with optional
+ * hardware oversampling) and the DMAC moves the results into one half of a double
+ * buffer while the other half holds the latest complete scan. Reading a sample is a
+ * RAM access. The host build provides a backend on the virtual clock.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ADC_SCANNER_H_
+#define ADC_SCANNER_H_
+
+#include <Arduino.h>
+
+#define ADC_SCAN_MAX_PINS     4 // inputs given to begin()
+#define ADC_SCAN_MAX_CHANNELS 8 // ADC channels covered by one scan (from the lowest to the highest AIN of the pins)
+
+class AdcScanner
+{
+public:
+    static bool begin(const uint8_t *pins, uint8_t count, uint32_t interval, uint8_t oversampling);
+    static void start();
+    static void stop();
+    static bool isRunning();
+    static int16_t getSample(uint8_t pin);
+    static uint32_t getScanTime();
+    static uint32_t getScanCount();
+};
+
+#endif /* ADC_SCANNER_H_ */
@@ -0,0 +1,319 @@
+/*
+ * CanFilterPlanner.cpp
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "CanFilterPlanner.h"
+
+CanFilterPlanner::CanFilterPlanner()
+{
+    clear();
+}
+
+/*
+ * Remove all subscriptions.
+ */
+void CanFilterPlanner::clear()
+{
+    numStd = 0;
+    numExt = 0;
+}
+
+/*
+ * Add a subscription: all frames of the given type with (frame id & mask) == (id & mask)
+ * must pass the hardware filter. If the list is full, the two closest subscriptions
+ * are merged to make room, so adding never fails (the filter just gets less tight).
+ */
+void CanFilterPlanner::add(uint32_t id, uint32_t mask, bool extended)
+{
+    Pattern *patterns = (extended ? extPatterns : stdPatterns);
+    uint8_t &count = (extended ? numExt : numStd);
+
+    if (count >= CAN_FILTER_MAX_PATTERNS)
+        reduce(patterns, count, CAN_FILTER_MAX_PATTERNS - 1, extended);
+
+    patterns[count].mask = mask & idBits(extended);
+    patterns[count].id = id & patterns[count].mask;
+    count++;
+}
+
+/*
+ * Compute the masks and filters for the subscriptions added so far.
+ *
+ * Standard and extended frames never share a buffer: with an extended mask the MCP2515
+ * would apply the EID bits to the first two data bytes of standard frames. If both types
+ * are wanted, one buffer gets each type and both ways round are tried.
+ *
+ * \retval number of ids the hardware will let pass (an upper bound, overlaps are counted twice)
+ */
+uint32_t CanFilterPlanner::plan(CanFilterPlan *plan)
+{
+    Pattern standard[CAN_FILTER_MAX_PATTERNS], extended[CAN_FILTER_MAX_PATTERNS];
+    CanFilterPlan other;
+    uint32_t cost, otherCost;
+
+    memset(plan, 0, sizeof(CanFilterPlan));
+
+    if (numStd == 0 && numExt == 0)
+    {
+        // nobody listens, pass only the lowest priority standard id
+        standard[0].id = standard[0].mask = 0x7FF;
+        return planSingle(plan, standard, 1, false);
+    }
+    if (numExt == 0)
+    {
+        memcpy(standard, stdPatterns, sizeof(Pattern) * numStd);
+        return planSingle(plan, standard, numStd, false);
+    }
+    if (numStd == 0)
+    {
+        memcpy(extended, extPatterns, sizeof(Pattern) * numExt);
+        return planSingle(plan, extended, numExt, true);
+    }
+
+    memcpy(standard, stdPatterns, sizeof(Pattern) * numStd);
+    memcpy(extended, extPatterns, sizeof(Pattern) * numExt);
+    cost = planMixed(plan, standard, numStd, false, extended, numExt, true);
+
+    memcpy(standard, stdPatterns, sizeof(Pattern) * numStd);
+    memcpy(extended, extPatterns, sizeof(Pattern) * numExt);
+    memset(&other, 0, sizeof(CanFilterPlan));
+    otherCost = planMixed(&other, extended, numExt, true, standard, numStd, false);
+
+    if (otherCost < cost)
+    {
+        *plan = other;
+        cost = otherCost;
+    }
+    return cost;
+}
+
+/*
+ * Compare two plans register by register.
+ */
+bool CanFilterPlanner::equals(CanFilterPlan *a, CanFilterPlan *b)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        if (a->extended[i] != b->extended[i] || a->mask[i] != b->mask[i])
+            return false;
+    }
+    for (int i = 0; i < 6; i++)
+    {
+        if (a->filter[i] != b->filter[i])
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Check whether a plan lets all frames of the given type with (frame id & mask) ==
+ * (id & mask) pass, i.e. one of its filters covers them on its own.
+ */
+bool CanFilterPlanner::passes(CanFilterPlan *plan, uint32_t id, uint32_t mask, bool extended)
+{
+    mask &= idBits(extended);
+    for (int i = 0; i < 6; i++)
+    {
+        int buffer = (i < 2 ? 0 : 1);
+        uint32_t filterMask = plan->mask[buffer];
+
+        if (plan->extended[buffer] == extended && (filterMask & ~mask) == 0 &&
+            ((id ^ plan->filter[i]) & filterMask) == 0)
+            return true;
+    }
+    return false;
+}
+
+uint32_t CanFilterPlanner::idBits(bool extended)
+{
+    return (extended ? 0x1FFFFFFFul : 0x7FFul);
+}
+
+/*
+ * Number of ids which pass a single filter with the given mask.
+ */
+uint32_t CanFilterPlanner::coverage(uint32_t mask, bool extended)
+{
+    return 1ul << __builtin_popcount(~mask & idBits(extended));
+}
+
+/*
+ * The tightest pattern which passes everything a and b pass: only the bits which are
+ * significant in both and on which their ids agree stay significant.
+ */
+CanFilterPlanner::Pattern CanFilterPlanner::merge(Pattern &a, Pattern &b)
+{
+    Pattern merged;
+
+    merged.mask = a.mask & b.mask & ~(a.id ^ b.id);
+    merged.id = a.id & merged.mask;
+    return merged;
+}
+
+/*
+ * Merge patterns until no more than max are left. Each step merges the pair whose
+ * union lets the fewest ids pass, so subscriptions contained in another one or
+ * differing in a single bit go first.
+ */
+void CanFilterPlanner::reduce(Pattern *patterns, uint8_t &count, uint8_t max, bool extended)
+{
+    while (count > max)
+    {
+        uint8_t bestA = 0, bestB = 1;
+        uint32_t best = 0xFFFFFFFF;
+
+        for (uint8_t a = 0; a < count; a++)
+        {
+            for (uint8_t b = a + 1; b < count; b++)
+            {
+                uint32_t cost = coverage(merge(patterns[a], patterns[b]).mask, extended);
+                if (cost < best)
+                {
+                    best = cost;
+                    bestA = a;
+                    bestB = b;
+                }
+            }
+        }
+        patterns[bestA] = merge(patterns[bestA], patterns[bestB]);
+        patterns[bestB] = patterns[--count];
+    }
+}
+
+/*
+ * Number of ids which pass a receive buffer holding the given patterns. All filters of
+ * a buffer share its mask, so the mask is the common part of all pattern masks and
+ * patterns which become equal under it occupy one filter only.
+ */
+uint32_t CanFilterPlanner::groupCost(Pattern **group, uint8_t count, bool extended, uint32_t *mask)
+{
+    uint8_t distinct = 0;
+
+    *mask = idBits(extended);
+    for (uint8_t i = 0; i < count; i++)
+        *mask &= group[i]->mask;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint8_t j = 0;
+        while (j < i && (group[j]->id & *mask) != (group[i]->id & *mask))
+            j++;
+        if (j == i)
+            distinct++;
+    }
+    return distinct * coverage(*mask, extended);
+}
+
+/*
+ * Write the mask and filters of one receive buffer into the plan. Unused filters repeat
+ * the first one. A buffer without patterns only passes the id of spare (a pattern of the
+ * other buffer), so it lets nothing through which isn't wanted anyway.
+ */
+void CanFilterPlanner::fillGroup(CanFilterPlan *plan, uint8_t buffer, Pattern **group, uint8_t count,
+                                 bool extended, uint32_t mask, Pattern *spare)
+{
+    uint8_t first = (buffer == 0 ? 0 : 2);
+    uint8_t last = (buffer == 0 ? 2 : 6);
+
+    plan->extended[buffer] = extended;
+    plan->mask[buffer] = (count ? mask : idBits(extended));
+    for (uint8_t i = first; i < last; i++)
+    {
+        Pattern *pattern = (count ? group[(i - first) < count ? (i - first) : 0] : spare);
+        plan->filter[i] = pattern->id & plan->mask[buffer];
+    }
+}
+
+/*
+ * Plan with one frame type per receive buffer.
+ */
+uint32_t CanFilterPlanner::planMixed(CanFilterPlan *plan, Pattern *buffer0, uint8_t count0, bool extended0,
+                                     Pattern *buffer1, uint8_t count1, bool extended1)
+{
+    Pattern *group0[2], *group1[4];
+    uint32_t mask0, mask1, cost;
+
+    reduce(buffer0, count0, 2, extended0);
+    reduce(buffer1, count1, 4, extended1);
+    for (uint8_t i = 0; i < count0; i++)
+        group0[i] = &buffer0[i];
+    for (uint8_t i = 0; i < count1; i++)
+        group1[i] = &buffer1[i];
+
+    cost = groupCost(group0, count0, extended0, &mask0) + groupCost(group1, count1, extended1, &mask1);
+    fillGroup(plan, 0, group0, count0, extended0, mask0, NULL);
+    fillGroup(plan, 1, group1, count1, extended1, mask1, NULL);
+    return cost;
+}
+
+/*
+ * Plan with both receive buffers for the same frame type. After merging down to the six
+ * filters, every split into at most two patterns for RXB0 and four for RXB1 is tried,
+ * as patterns with different masks pull each other's mask down when they share a buffer.
+ */
+uint32_t CanFilterPlanner::planSingle(CanFilterPlan *plan, Pattern *patterns, uint8_t count, bool extended)
+{
+    Pattern *group0[2], *group1[4];
+    uint32_t mask0, mask1, cost;
+    uint32_t best = 0xFFFFFFFF;
+    uint8_t bestSelection = 0;
+    uint8_t count0, count1;
+
+    reduce(patterns, count, 6, extended);
+
+    for (uint8_t selection = 0; selection < (1 << count); selection++)
+    {
+        count0 = count1 = 0;
+        if (__builtin_popcount(selection) > 2 || count - __builtin_popcount(selection) > 4)
+            continue;
+        for (uint8_t i = 0; i < count; i++)
+        {
+            if (selection & (1 << i))
+                group0[count0++] = &patterns[i];
+            else
+                group1[count1++] = &patterns[i];
+        }
+        cost = groupCost(group0, count0, extended, &mask0) + groupCost(group1, count1, extended, &mask1);
+        if (cost < best)
+        {
+            best = cost;
+            bestSelection = selection;
+        }
+    }
+
+    count0 = count1 = 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (bestSelection & (1 << i))
+            group0[count0++] = &patterns[i];
+        else
+            group1[count1++] = &patterns[i];
+    }
+    groupCost(group0, count0, extended, &mask0);
+    groupCost(group1, count1, extended, &mask1);
+    fillGroup(plan, 0, group0, count0, extended, mask0, &patterns[0]);
+    fillGroup(plan, 1, group1, count1, extended, mask1, &patterns[0]);
+    return best;
+}
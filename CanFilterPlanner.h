@@ -0,0 +1,82 @@
+/*
+ * CanFilterPlanner.h
+ *
+ * Computes the acceptance masks and filters of the MCP2515 from the (id, mask)
+ * subscriptions of the CanObservers. The controller only has two masks and six
+ * filters: mask 0 with filters 0-1 for RXB0 and mask 1 with filters 2-5 for RXB1.
+ * The subscriptions are merged until they fit and the assignment which lets the
+ * fewest ids pass is chosen, so unwanted traffic never reaches the SPI bus.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef CAN_FILTER_PLANNER_H_
+#define CAN_FILTER_PLANNER_H_
+
+#include <Arduino.h>
+
+#define CAN_FILTER_MAX_PATTERNS 16  // subscriptions per frame type kept before merging
+
+/*
+ * Register contents for the MCP2515. Filters 0-1 belong to mask 0 (RXB0), filters
+ * 2-5 to mask 1 (RXB1). All filters of a buffer are of the same frame type.
+ */
+struct CanFilterPlan
+{
+    bool extended[2];   // frame type of RXB0 / RXB1
+    uint32_t mask[2];   // 11 bit (standard) or 29 bit (extended) acceptance mask
+    uint32_t filter[6];
+};
+
+class CanFilterPlanner
+{
+public:
+    CanFilterPlanner();
+    void clear();
+    void add(uint32_t id, uint32_t mask, bool extended);
+    uint32_t plan(CanFilterPlan *plan);
+    static bool equals(CanFilterPlan *a, CanFilterPlan *b);
+    static bool passes(CanFilterPlan *plan, uint32_t id, uint32_t mask, bool extended);
+
+private:
+    struct Pattern {
+        uint32_t id;    // only the bits set in mask are significant (others are 0)
+        uint32_t mask;
+    };
+
+    Pattern stdPatterns[CAN_FILTER_MAX_PATTERNS];
+    Pattern extPatterns[CAN_FILTER_MAX_PATTERNS];
+    uint8_t numStd, numExt;
+
+    static uint32_t idBits(bool extended);
+    static uint32_t coverage(uint32_t mask, bool extended);
+    static Pattern merge(Pattern &a, Pattern &b);
+    static void reduce(Pattern *patterns, uint8_t &count, uint8_t max, bool extended);
+    static uint32_t groupCost(Pattern **group, uint8_t count, bool extended, uint32_t *mask);
+    static void fillGroup(CanFilterPlan *plan, uint8_t buffer, Pattern **group, uint8_t count, bool extended, uint32_t mask, Pattern *spare);
+    static uint32_t planMixed(CanFilterPlan *plan, Pattern *buffer0, uint8_t count0, bool extended0,
+                              Pattern *buffer1, uint8_t count1, bool extended1);
+    static uint32_t planSingle(CanFilterPlan *plan, Pattern *patterns, uint8_t count, bool extended);
+};
+
+#endif /* CAN_FILTER_PLANNER_H_ */
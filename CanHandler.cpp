@@ -30,223 +30,1340 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "CanHandler.h"
 #include "sys_io.h"
 
-mcp2515_can CAN(SPI_CS_PIN); // Set CS pin
+CanController CAN(SPI_CS_PIN); // Set CS pin
+#if CFG_CAN_NUM_BUSES > 1
+CanController CAN1(CAN1_CS_PIN);
+#endif
 CanHandler canHandler = CanHandler();
 
+static_assert(sizeof(CanHandler) <= CAN_RAM_BUDGET, "CanHandler exceeds its RAM budget (CFG_CAN_RAM_BUDGET), reduce its buffer sizes");
+
+#ifdef CFG_CAN_USE_INTERRUPT
+#if CFG_CAN_NUM_BUSES > 1
+static voidFuncPtr const canInterrupts[] = { canInterrupt, canInterrupt1 };
+#else
+static voidFuncPtr const canInterrupts[] = { canInterrupt };
+#endif
+#endif
+
+/*
+ * Constructor of the can handler
+ */
+CanHandler::CanHandler()
+{
+    for (int i = 0; i < CFG_CAN_NUM_GATEWAY_RULES; i++)
+    {
+        gatewayRules[i].used = false;
+    }
+    initBus(&buses[CAN_BUS_EV], 0, &CAN, CAN_INT_PIN, CFG_CAN0_SPEED, evDispatch);
+#if CFG_CAN_NUM_BUSES > 1
+#ifdef CFG_CAN1_DISPATCH_TABLE
+    initBus(&buses[CAN_BUS_CAR], 1, &CAN1, CAN1_INT_PIN, CFG_CAN1_SPEED, carDispatch);
+#else
+    initBus(&buses[CAN_BUS_CAR], 1, &CAN1, CAN1_INT_PIN, CFG_CAN1_SPEED, NULL);
+#endif
+#endif
+    initialized = false;
+    masterID = 0x05;
+}
+
+/*
+ * Bring the state of a bus into its initial state (no observers, buffers empty).
+ * Without a dispatch table (NULL), the observers of standard ids are matched one by one.
+ */
+void CanHandler::initBus(CanBus *canBus, uint8_t number, CanController *controller, uint8_t interruptPin, uint32_t speed, CanDispatchSet *dispatchTable)
+{
+    canBus->controller = controller;
+    canBus->stdDispatch = dispatchTable;
+    canBus->number = number;
+    canBus->interruptPin = interruptPin;
+    canBus->speed = speed;
+    for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++)
+    {
+        canBus->observerData[i].observer = NULL;
+    }
+    canBus->numRxMonitors = 0;
+    canBus->filtersProgrammed = false;
+    canBus->filtersHeld = false;
+    canBus->filterStep = -1;
+    canBus->state = CAN_STATE_INIT;
+    canBus->stateSince = 0;
+    canBus->lastErrorCheck = 0;
+    canBus->errorFlags = 0;
+    canBus->busOffs = 0;
+    rebuildDispatchTable(canBus);
+    rebuildGatewayTable(canBus);
+#ifdef CFG_CAN_USE_INTERRUPT
+    canBus->rxHead = canBus->rxTail = 0;
+    canBus->rxOverflows = 0;
+    canBus->rxHighWaterMark = 0;
+    canBus->reportedOverflows = 0;
+#ifdef CFG_CAN_MCP2518FD
+    canBus->rxFdHead = canBus->rxFdTail = 0;
+#endif
+#endif
+    for (int i = 0; i < CAN_TX_NUM_PRIORITIES; i++)
+    {
+        canBus->txHead[i] = canBus->txTail[i] = 0;
+    }
+    canBus->txOverflows = 0;
+    canBus->txHighWaterMark = 0;
+    canBus->reportedTxOverflows = 0;
+#ifdef CFG_CAN_MCP2518FD
+    canBus->txFdHead = canBus->txFdTail = 0;
+#endif
+}
+
+/*
+ * Get the state of a bus.
+ *
+ * \retval NULL if the bus is not configured (see CFG_CAN_NUM_BUSES)
+ */
+CanHandler::CanBus *CanHandler::getBus(CanBusId bus)
+{
+    if ((uint8_t)bus >= CFG_CAN_NUM_BUSES)
+    {
+        Logger::debug("CAN%d is not configured, increase CFG_CAN_NUM_BUSES", bus);
+        return NULL;
+    }
+    return &buses[bus];
+}
+
+/*
+ * Initialization of the CAN buses. Doesn't wait for the controllers: if one can't be
+ * initialized, process() retries in the background and the rest of the system runs.
+ */
+void CanHandler::setup()
+{
+    for (int i = 0; i < CFG_CAN_NUM_BUSES; i++)
+    {
+        CanBus *canBus = &buses[i];
+
+        if (initController(canBus))
+        {
+            setBusState(canBus, CAN_STATE_RUNNING);
+        }
+        else
+        {
+            Logger::info("CAN%d init fail, retrying every %d ms", canBus->number, CAN_INIT_RETRY_INTERVAL / 1000);
+            setBusState(canBus, CAN_STATE_INIT);
+        }
+    }
+
+    // masks and filters are cleared by begin(), they are set up by the first process()
+    // so the devices which attach during setup() don't trigger one re-programming each
+    initialized = true;
+}
+
+/*
+ * Start the controller of a bus with its configured speed and hook up its interrupt.
+ *
+ * \retval false if the controller didn't respond
+ */
+bool CanHandler::initController(CanBus *canBus)
+{
+    CanController *controller = canBus->controller;
+
+#ifdef CFG_CAN_MCP2518FD
+    // the data phase of CAN-FD frames runs CFG_CAN_FD_DATA_FACTOR times faster than the arbitration
+    if (CAN_OK != controller->begin(CANFD::BITRATE(canBus->speed * 1000UL, CFG_CAN_FD_DATA_FACTOR), MCP2518FD_40MHz))
+        return false;
+    controller->setMode(CAN_NORMAL_MODE); // the driver starts in CAN 2.0 only mode, normal mode mixes CAN 2.0 and CAN-FD
+#else
+    byte speedset;
+    switch (canBus->speed)
+    {
+    case 125: speedset = CAN_125KBPS; break;
+    case 250: speedset = CAN_250KBPS; break;
+    case 1000: speedset = CAN_1000KBPS; break;
+    default: speedset = CAN_500KBPS; break;
+    }
+    if (CAN_OK != controller->begin(speedset))
+        return false;
+#endif
+
+#ifdef CFG_CAN_USE_INTERRUPT
+    // the MCP2515 keeps INT low as long as a receive buffer is full -> level triggered
+    pinMode(canBus->interruptPin, INPUT_PULLUP);
+    SPI.usingInterrupt(digitalPinToInterrupt(canBus->interruptPin)); // keep the ISR off the bus during SPI transactions of loop()
+    controller->enableTxInterrupt(true); // refill the transmit buffers from the queue as soon as one is free
+    attachInterrupt(digitalPinToInterrupt(canBus->interruptPin), canInterrupts[canBus->number], LOW);
+#endif
+
+    canBus->filtersProgrammed = false;
+    canBus->filtersDirty = true;
+    canBus->filterStep = -1;
+
+    Logger::info("CAN%d init ok. Speed = %l kbit/s", canBus->number, canBus->speed);
+    return true;
+}
+
+/*
+ * Move a bus through its states: init -> running <-> error passive -> bus-off -> init.
+ * A controller which isn't initialized is retried every CAN_INIT_RETRY_INTERVAL. The
+ * error flags of a running one are read every CAN_ERROR_CHECK_INTERVAL. The drivers
+ * don't expose TEC and REC, but the flags tell which limit they passed (96 warning,
+ * 128 error passive, 256 bus-off). After bus-off the controller is left alone for
+ * CAN_BUS_OFF_RECOVERY_TIME and initialized again, which also clears the counters.
+ */
+void CanHandler::superviseBus(CanBus *canBus)
+{
+    uint32_t now = micros();
+    uint8_t flags = 0;
+
+    switch (canBus->state)
+    {
+    case CAN_STATE_INIT:
+        if (now - canBus->stateSince < CAN_INIT_RETRY_INTERVAL)
+            return;
+        if (initController(canBus))
+            setBusState(canBus, CAN_STATE_RUNNING);
+        else
+            canBus->stateSince = now;
+        break;
+
+    case CAN_STATE_BUS_OFF:
+        if (now - canBus->stateSince < CAN_BUS_OFF_RECOVERY_TIME)
+            return;
+        setBusState(canBus, initController(canBus) ? CAN_STATE_RUNNING : CAN_STATE_INIT);
+        break;
+
+    default:
+        if (now - canBus->lastErrorCheck < CAN_ERROR_CHECK_INTERVAL)
+            return;
+        canBus->lastErrorCheck = now;
+        canBus->controller->checkError(&flags);
+        canBus->errorFlags = flags;
+#ifdef CFG_CAN_MCP2518FD
+        if (flags & CAN_TX_BUS_OFF_STATE)
+#else
+        if (flags & MCP_EFLG_TXBO)
+#endif
+        {
+            canBus->busOffs++;
+            setBusState(canBus, CAN_STATE_BUS_OFF);
+        }
+#ifdef CFG_CAN_MCP2518FD
+        else if (flags & (CAN_TX_BUS_PASSIVE_STATE | CAN_RX_BUS_PASSIVE_STATE))
+#else
+        else if (flags & (MCP_EFLG_TXEP | MCP_EFLG_RXEP))
+#endif
+        {
+            if (canBus->state != CAN_STATE_ERROR_PASSIVE)
+                setBusState(canBus, CAN_STATE_ERROR_PASSIVE);
+        }
+        else if (canBus->state != CAN_STATE_RUNNING)
+        {
+            setBusState(canBus, CAN_STATE_RUNNING);
+        }
+        break;
+    }
+}
+
+/*
+ * Enter a new state. When the controller goes offline (init, bus-off), its interrupt is
+ * released and the buffered frames are discarded: they are stale once it's back.
+ */
+void CanHandler::setBusState(CanBus *canBus, CanBusState state)
+{
+    static const char *stateNames[] = { "init", "running", "error passive", "bus-off" };
+
+    if (state == CAN_STATE_INIT || state == CAN_STATE_BUS_OFF)
+    {
+#ifdef CFG_CAN_USE_INTERRUPT
+        detachInterrupt(digitalPinToInterrupt(canBus->interruptPin));
+        canBus->rxTail = canBus->rxHead;
+#ifdef CFG_CAN_MCP2518FD
+        canBus->rxFdTail = canBus->rxFdHead;
+#endif
+#endif
+        for (int i = 0; i < CAN_TX_NUM_PRIORITIES; i++)
+            canBus->txTail[i] = canBus->txHead[i];
+#ifdef CFG_CAN_MCP2518FD
+        canBus->txFdTail = canBus->txFdHead;
+#endif
+    }
+    if (state != canBus->state)
+        Logger::info("CAN%d %s", canBus->number, stateNames[state]);
+    canBus->state = state;
+    canBus->stateSince = micros();
+    canBus->lastErrorCheck = canBus->stateSince;
+}
+
+/*
+ * Check if the controller of a bus sends and receives (running or error passive).
+ */
+bool CanHandler::isOnline(CanBus *canBus)
+{
+    return (canBus->state == CAN_STATE_RUNNING || canBus->state == CAN_STATE_ERROR_PASSIVE);
+}
+
+/*
+ * Get the state of the controller of a bus.
+ */
+CanBusState CanHandler::getBusState(CanBusId bus)
+{
+    CanBus *canBus = getBus(bus);
+    return (canBus == NULL ? CAN_STATE_INIT : canBus->state);
+}
+
+/*
+ * Get the number of times the controller of a bus went bus-off.
+ */
+uint32_t CanHandler::getBusOffCount(CanBusId bus)
+{
+    CanBus *canBus = getBus(bus);
+    return (canBus == NULL ? 0 : canBus->busOffs);
+}
+
+/*
+ * Get the configured speed of a bus in kbit/s (0 if the bus is not configured).
+ */
+uint32_t CanHandler::getBusSpeed(CanBusId bus)
+{
+    CanBus *canBus = getBus(bus);
+    return (canBus == NULL ? 0 : canBus->speed);
+}
+
+/*
+ * Attach a CanObserver. Can frames which match the id/mask will be forwarded to the observer
+ * via the method handleCanFrame(RX_CAN_FRAME).
+ * CANopen observers get PDO and SDO frames instead: the PDOs which match id/mask (id 0 and
+ * mask 0 for all of them) and the SDO frames of their node id. Their CANopen mode and node
+ * id must be set before they attach.
+ *
+ *  \param observer - the observer object to register (must implement CanObserver class)
+ *  \param id - the id of the can frame to listen to
+ *  \param mask - the mask to be applied to the frames
+ *  \param extended - set if extended frames must be supported
+ *  \param bus - the bus to listen on
+ *  \retval false if all CFG_CAN_NUM_OBSERVERS entries of the bus are in use
+ */
+bool CanHandler::attach(CanObserver *observer, uint32_t id, uint32_t mask, bool extended, CanBusId bus)
+{
+    CanBus *canBus = getBus(bus);
+
+    if (canBus == NULL)
+        return false;
+
+    int8_t pos = findFreeObserverData(canBus);
+
+    if (pos == -1)
+    {
+        Logger::info("CAN%d: no free observer for id=%X, increase CFG_CAN_NUM_OBSERVERS", canBus->number, id);
+        return false;
+    }
+
+    CanObserverData *data = &canBus->observerData[pos];
+    data->id = id;
+    data->mask = mask;
+    data->extended = extended;
+    data->canOpen = observer->isCANOpen();
+    data->nodeID = observer->getNodeID();
+    data->observer = observer;
+    rebuildDispatchTable(canBus);
+
+    Logger::debug("attached CanObserver (%X) for id=%X, mask=%X on CAN%d", observer, id, mask, canBus->number);
+    return true;
+}
+
+/*
+ * Detaches a previously attached observer from this handler.
+ *
+ * \param observer - observer object to detach
+ * \param id - id of the observer to detach (required as one CanObserver may register itself several times)
+ * \param mask - mask of the observer to detach (dito)
+ * \param bus - the bus the observer attached to
+ */
+void CanHandler::detach(CanObserver *observer, uint32_t id, uint32_t mask, CanBusId bus)
+{
+    CanBus *canBus = getBus(bus);
+
+    if (canBus == NULL)
+        return;
+
+    for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++)
+    {
+        CanObserverData *data = &canBus->observerData[i];
+        if (data->observer == observer && data->id == id && data->mask == mask)
+        {
+            data->observer = NULL;
+        }
+    }
+    rebuildDispatchTable(canBus);
+}
+
+/*
+ * Keep the acceptance filters of a bus as they are, e.g. while the motor controller is
+ * enabled: writing them takes the controller off the bus for about 20ms per register.
+ * Meanwhile attach() and detach() only change the dispatch table. The EV bus always
+ * passes the default SYNC and RPDO ids of CANopen (see planFilters()), so these can
+ * still be enabled. Once released, the filters are re-planned if needed.
+ */
+void CanHandler::holdFilters(bool hold, CanBusId bus)
+{
+    CanBus *canBus = getBus(bus);
+
+    if (canBus != NULL && canBus->filtersHeld != hold)
+    {
+        canBus->filtersHeld = hold;
+        Logger::debug("CAN%d filters %s", canBus->number, (hold ? "held" : "released"));
+    }
+}
+
+/*
+ * Check whether the frames with (id & mask) would reach an observer which attaches now.
+ * That's only not the case if the filters are held (see holdFilters()) and don't pass
+ * all of them yet. Observers which may change their ids at runtime ask before attaching.
+ */
+bool CanHandler::canReceive(uint32_t id, uint32_t mask, bool extended, CanBusId bus)
+{
+    CanBus *canBus = getBus(bus);
+
+    if (canBus == NULL)
+        return false;
+    if (!canBus->filtersHeld || !canBus->filtersProgrammed) // not programmed = everything passes (cleared by begin())
+        return true;
+    return CanFilterPlanner::passes(&canBus->filterPlan, id, mask, extended);
+}
+
+/*
+ * Keep reception statistics for a CAN id and notify the observer via handleCanTimeout()
+ * when no frame with this id arrived within the timeout. The deadline is armed by the
+ * first frame, so an id which was never seen doesn't time out (its count stays 0). The
+ * observer is notified once per loss, the next frame arms the deadline again. Monitoring doesn't subscribe
+ * to the id, the observer still has to attach() for it.
+ *
+ * \param observer - the observer to notify (may be NULL for statistics only)
+ * \param id - the CAN id to monitor
+ * \param extended - set if id is an extended id
+ * \param timeout - max time between two frames in microseconds (0 = statistics only)
+ * \param bus - the bus the id is received on
+ * \retval false if CFG_CAN_NUM_RX_MONITORS ids are monitored already
+ */
+bool CanHandler::monitor(CanObserver *observer, uint32_t id, bool extended, uint32_t timeout, CanBusId bus)
+{
+    CanBus *canBus = getBus(bus);
+    int i;
+
+    if (canBus == NULL)
+        return false;
+
+    CanRxMonitor *rxMonitors = canBus->rxMonitors;
+    for (i = 0; i < canBus->numRxMonitors; i++)
+    {
+        if (rxMonitors[i].stats.id == id && rxMonitors[i].stats.extended == extended)
+            break;
+    }
+    if (i == canBus->numRxMonitors)
+    {
+        if (canBus->numRxMonitors >= CFG_CAN_NUM_RX_MONITORS)
+        {
+            Logger::debug("no free space in CanHandler::rxMonitors, increase its size via CFG_CAN_NUM_RX_MONITORS");
+            return false;
+        }
+        memset(&rxMonitors[i].stats, 0, sizeof(CanRxStatistics));
+        rxMonitors[i].armed = 0;
+        rxMonitors[i].stats.id = id;
+        rxMonitors[i].stats.extended = extended;
+        canBus->numRxMonitors++;
+    }
+    rxMonitors[i].stats.timeout = timeout;
+    rxMonitors[i].observer = observer;
+
+    Logger::debug("monitoring id=%X on CAN%d for CanObserver (%X), timeout=%l us", id, canBus->number, observer, timeout);
+    return true;
+}
+
+/*
+ * Stop monitoring a CAN id, its statistics are discarded.
+ *
+ * \param observer - observer which monitors the id
+ * \param id - the monitored CAN id
+ * \param extended - set if id is an extended id
+ * \param bus - the bus the id is monitored on
+ */
+void CanHandler::unmonitor(CanObserver *observer, uint32_t id, bool extended, CanBusId bus)
+{
+    CanBus *canBus = getBus(bus);
+
+    if (canBus == NULL)
+        return;
+
+    CanRxMonitor *rxMonitors = canBus->rxMonitors;
+    for (int i = 0; i < canBus->numRxMonitors; i++)
+    {
+        if (rxMonitors[i].observer == observer && rxMonitors[i].stats.id == id && rxMonitors[i].stats.extended == extended)
+        {
+            rxMonitors[i] = rxMonitors[--canBus->numRxMonitors];
+            return;
+        }
+    }
+}
+
+/*
+ * Get the number of monitored CAN ids of a bus.
+ */
+uint8_t CanHandler::getNumRxStatistics(CanBusId bus)
+{
+    CanBus *canBus = getBus(bus);
+    return (canBus == NULL ? 0 : canBus->numRxMonitors);
+}
+
+/*
+ * Get the reception statistics of a monitored CAN id (e.g. for a bus health report).
+ *
+ * \param index - 0 to getNumRxStatistics() - 1
+ * \param bus - the bus the id is monitored on
+ * \retval the statistics or NULL if index is out of range
+ */
+CanRxStatistics *CanHandler::getRxStatistics(uint8_t index, CanBusId bus)
+{
+    CanBus *canBus = getBus(bus);
+
+    if (canBus == NULL || index >= canBus->numRxMonitors)
+        return NULL;
+    return &canBus->rxMonitors[index].stats;
+}
+
+/*
+ * Forward frames from one bus to the other. Frames which match id/mask of the rule on
+ * the source bus are composed straight into the transmit queue of the target bus,
+ * before the observers of the source bus get them. The id can be replaced, the data
+ * bytes rearranged and the rate limited to one frame per minInterval. The ids are
+ * added to the acceptance filters of the source bus.
+ *
+ * \param rule - the rule to add (copied)
+ * \retval the index of the rule (for getGatewayStatistics() and removeGatewayRule()) or -1 on error
+ */
+int8_t CanHandler::addGatewayRule(CanGatewayRule *rule)
+{
+    CanBus *source = getBus(rule->source);
+    CanBus *target = getBus(rule->target);
+
+    if (source == NULL || target == NULL || source == target || rule->length > 8)
+    {
+        Logger::debug("CAN gateway: invalid rule for id=%X", rule->id);
+        return -1;
+    }
+
+    for (int i = 0; i < CFG_CAN_NUM_GATEWAY_RULES; i++)
+    {
+        CanGatewayEntry *entry = &gatewayRules[i];
+
+        if (entry->used)
+            continue;
+
+        entry->rule = *rule;
+        memset(&entry->stats, 0, sizeof(CanGatewayStatistics));
+        entry->lastForwarded = 0;
+        entry->used = true;
+        rebuildGatewayTable(source);
+
+        Logger::debug("CAN gateway: forwarding id=%X, mask=%X from CAN%d to CAN%d", rule->id, rule->mask, source->number, target->number);
+        return i;
+    }
+    Logger::debug("no free space in CanHandler::gatewayRules, increase its size via CFG_CAN_NUM_GATEWAY_RULES");
+    return -1;
+}
+
+/*
+ * Stop forwarding the frames of a gateway rule.
+ *
+ * \param index - the index returned by addGatewayRule()
+ */
+void CanHandler::removeGatewayRule(int8_t index)
+{
+    if (index < 0 || index >= CFG_CAN_NUM_GATEWAY_RULES || !gatewayRules[index].used)
+        return;
+
+    gatewayRules[index].used = false;
+    rebuildGatewayTable(&buses[gatewayRules[index].rule.source]);
+}
+
+/*
+ * Get the counters of a gateway rule.
+ *
+ * \param index - the index returned by addGatewayRule()
+ * \retval the counters or NULL if there is no such rule
+ */
+CanGatewayStatistics *CanHandler::getGatewayStatistics(int8_t index)
+{
+    if (index < 0 || index >= CFG_CAN_NUM_GATEWAY_RULES || !gatewayRules[index].used)
+        return NULL;
+    return &gatewayRules[index].stats;
+}
+
+/*
+ * Mark the standard ids of a bus which match a gateway rule, so a frame which isn't
+ * forwarded costs a single bit test. Extended ids are checked against the rules if
+ * any rule of the bus wants extended frames.
+ */
+void CanHandler::rebuildGatewayTable(CanBus *canBus)
+{
+    memset(canBus->gatewayIds, 0, sizeof(canBus->gatewayIds));
+    canBus->gatewayExtended = false;
+    canBus->filtersDirty = true;
+
+    for (int i = 0; i < CFG_CAN_NUM_GATEWAY_RULES; i++)
+    {
+        CanGatewayRule *rule = &gatewayRules[i].rule;
+
+        if (!gatewayRules[i].used || &buses[rule->source] != canBus)
+            continue;
+
+        if (rule->extended)
+        {
+            canBus->gatewayExtended = true;
+            continue;
+        }
+        uint16_t mask = rule->mask & 0x7FF;
+        uint16_t match = rule->id & mask;
+        for (uint16_t id = 0; id < 0x800; id++)
+        {
+            if ((id & mask) == match)
+                canBus->gatewayIds[id >> 3] |= 1 << (id & 7);
+        }
+    }
+}
+
+/*
+ * Apply the gateway rules of the bus to a received frame, which is still in the receive
+ * buffer. The forwarded frame is written directly into the transmit queue of the target.
+ */
+void CanHandler::forwardFrame(CanBus *canBus, CAN_FRAME &frame)
+{
+    if (frame.extended ? !canBus->gatewayExtended : !(canBus->gatewayIds[(frame.id & 0x7FF) >> 3] & (1 << (frame.id & 7))))
+        return;
+
+    for (int i = 0; i < CFG_CAN_NUM_GATEWAY_RULES; i++)
+    {
+        CanGatewayEntry *entry = &gatewayRules[i];
+        CanGatewayRule *rule = &entry->rule;
+
+        if (!entry->used || &buses[rule->source] != canBus || rule->extended != (bool)frame.extended ||
+            (frame.id & rule->mask) != (rule->id & rule->mask))
+            continue;
+
+        if (entry->stats.forwarded > 0 && frame.timestamp - entry->lastForwarded < rule->minInterval)
+        {
+            entry->stats.limited++;
+            continue;
+        }
+
+        CanBus *target = &buses[rule->target];
+        CAN_FRAME *forwarded = (isOnline(target) ? allocateTxFrame(target, rule->priority) : NULL);
+        if (forwarded == NULL)
+        {
+            entry->stats.dropped++;
+            target->txOverflows++;
+            continue;
+        }
+
+        if (rule->targetId == CAN_GATEWAY_SAME_ID)
+        {
+            forwarded->id = frame.id;
+            forwarded->extended = frame.extended;
+        }
+        else
+        {
+            forwarded->id = rule->targetId;
+            forwarded->extended = rule->targetExtended;
+        }
+        forwarded->rtr = frame.rtr;
+        if (rule->remapData)
+        {
+            forwarded->length = rule->length;
+            for (int j = 0; j < 8; j++)
+                forwarded->data.bytes[j] = (rule->remap[j] < 8 ? frame.data.bytes[rule->remap[j]] : 0);
+        }
+        else
+        {
+            forwarded->length = frame.length;
+            forwarded->data.value = frame.data.value;
+        }
+        queueTxFrame(target, rule->priority);
+
+        entry->lastForwarded = frame.timestamp;
+        entry->stats.forwarded++;
+    }
+}
+
+/*
+ * Pre-compute which observers get which frames, so dispatching a frame does not have to
+ * check every observer. Standard ids are resolved with a table holding the set of
+ * observers for each of the 2048 ids (one byte per id for the first 8 observers).
+ * Extended ids can't be tabulated, the few observers which want them are kept in a
+ * list and matched by id/mask. So are the standard ones beyond CAN_DISPATCH_OBSERVERS
+ * (attached last, e.g. RPDOs and ISO-TP sessions) and all of a bus without a table.
+ */
+void CanHandler::rebuildDispatchTable(CanBus *canBus)
+{
+    if (canBus->stdDispatch != NULL)
+        memset(canBus->stdDispatch, 0, 0x800 * sizeof(CanDispatchSet));
+    canBus->numStdObservers = 0;
+    canBus->numExtObservers = 0;
+    canBus->filtersDirty = true;
+
+    for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++)
+    {
+        CanObserverData *data = &canBus->observerData[i];
+        CanDispatchSet bit = (CanDispatchSet)1 << i;
+
+        if (data->observer == NULL)
+            continue;
+
+        if (data->extended && !data->canOpen)
+        {
+            canBus->extObservers[canBus->numExtObservers++] = i;
+        }
+        else if (canBus->stdDispatch == NULL || i >= CAN_DISPATCH_OBSERVERS)
+        {
+            canBus->stdObservers[canBus->numStdObservers++] = i;
+        }
+        else if (data->canOpen)
+        {
+            uint16_t mask = data->mask & 0x7FF;
+            uint16_t match = data->id & mask;
+            for (uint16_t id = 0x180; id < 0x580; id++) // PDOs
+            {
+                if ((id & mask) == match)
+                    canBus->stdDispatch[id] |= bit;
+            }
+            canBus->stdDispatch[0x600 + data->nodeID] |= bit;   // SDO request to the node
+            canBus->stdDispatch[0x580 + data->nodeID] |= bit;   // SDO reply to the node
+        }
+        else
+        {
+            uint16_t mask = data->mask & 0x7FF;
+            uint16_t match = data->id & mask;
+            for (uint16_t id = 0; id < 0x800; id++)
+            {
+                if ((id & mask) == match)
+                    canBus->stdDispatch[id] |= bit;
+            }
+        }
+    }
+}
+
+/*
+ * Let the MCP2515 pass only the frames which the observers (and CANIO) are interested in.
+ * CanFilterPlanner fits the subscriptions into the two masks and six filters. If the plan
+ * differs from the one the controller runs with, writeFilterRegister() writes it. The
+ * controller is held in config mode meanwhile (init_Mask/init_Filt return to the mode
+ * set last), so it never receives with a half written set of filters.
+ * On the EV bus the default SYNC and RPDO ids always pass, the dispatch table drops
+ * them while nobody listens.
+ */
+void CanHandler::planFilters(CanBus *canBus)
+{
+    CanFilterPlanner planner;
+    CanFilterPlan *plan = &canBus->pendingPlan;
+
+    if (canBus == &buses[CAN_BUS_EV])
+    {
+        planner.add(CAN_SWITCH, 0x7FF, false);
+        // pre-opened, so the SYNC and the RPDOs can be enabled while the filters are held
+        planner.add(0x080, 0x7FF, false);               // default SYNC
+        planner.add(0x200 + masterID, 0x67F, false);    // default RPDO 1 and 2
+        planner.add(0x400 + masterID, 0x67F, false);    // default RPDO 3 and 4
+    }
+    for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++)
+    {
+        CanObserverData *data = &canBus->observerData[i];
+
+        if (data->observer == NULL)
+            continue;
+
+        if (data->canOpen)
+        {
+            uint16_t match = data->id & data->mask & 0x7FF;
+            if ((data->mask & 0x7FF) == 0)
+            {
+                planner.add(0x180, 0x780, false);   // PDOs 0x180 - 0x1FF
+                planner.add(0x200, 0x600, false);   // PDOs 0x200 - 0x3FF
+                planner.add(0x400, 0x700, false);   // PDOs 0x400 - 0x4FF
+                planner.add(0x500, 0x780, false);   // PDOs 0x500 - 0x57F
+            }
+            else if (match >= 0x180 && match < 0x580)
+            {
+                planner.add(data->id, data->mask, false);
+            }
+            planner.add(0x600 + data->nodeID, 0x7FF, false);
+            planner.add(0x580 + data->nodeID, 0x7FF, false);
+        }
+        else
+        {
+            planner.add(data->id, data->mask, data->extended);
+        }
+    }
+    for (int i = 0; i < CFG_CAN_NUM_GATEWAY_RULES; i++)
+    {
+        CanGatewayRule *rule = &gatewayRules[i].rule;
+
+        if (gatewayRules[i].used && &buses[rule->source] == canBus)
+            planner.add(rule->id, rule->mask, rule->extended);
+    }
+    uint32_t accepted = planner.plan(plan);
+    canBus->filtersDirty = false;
+
+    if (canBus->filtersProgrammed && CanFilterPlanner::equals(plan, &canBus->filterPlan))
+        return;
+
+    Logger::debug("CAN%d filters: RXB0 mask=%X filter=%X,%X RXB1 mask=%X filter=%X,%X,%X,%X (%l ids pass)",
+                  canBus->number, plan->mask[0], plan->filter[0], plan->filter[1], plan->mask[1],
+                  plan->filter[2], plan->filter[3], plan->filter[4], plan->filter[5], accepted);
+    canBus->filterStep = 0;
+    canBus->filtersOk = true;
+#ifndef CFG_CAN_MCP2518FD
+    canBus->filterMode = canBus->controller->getMode();
+    canBus->controller->setMode(MODE_CONFIG);
+#endif
+}
+
+/*
+ * Write the next changed register of the pending filter plan. Each register write blocks
+ * for about 20ms in the driver, so only one is written per call: process() drains the
+ * receive buffers of all buses in between and a second controller can't overrun them.
+ * Once all are written, the controller returns to its previous mode.
+ */
+void CanHandler::writeFilterRegister(CanBus *canBus)
+{
+    CanController *controller = canBus->controller;
+    CanFilterPlan *plan = &canBus->pendingPlan;
+    CanFilterPlan *current = &canBus->filterPlan;
+    bool programmed = canBus->filtersProgrammed;
+
+    for (; canBus->filterStep < CAN_FILTER_REGISTERS; canBus->filterStep++)
+    {
+        int step = canBus->filterStep;
+#ifdef CFG_CAN_MCP2518FD
+        // each filter of the MCP2518FD has its own mask, it gets the one of its MCP2515 receive buffer
+        // (init_Mask/init_Filt switch to config mode and back by themselves)
+        int buffer = (step < 2 ? 0 : 1);
+        if (programmed && plan->extended[buffer] == current->extended[buffer] &&
+            plan->mask[buffer] == current->mask[buffer] && plan->filter[step] == current->filter[step])
+            continue;
+        canBus->filtersOk &= (controller->init_Mask(step, plan->extended[buffer], plan->mask[buffer]) == CAN_OK);
+        canBus->filtersOk &= (controller->init_Filt(step, plan->extended[buffer], plan->filter[step]) == CAN_OK);
+#else
+        if (step < 2) // RXM0, RXM1
+        {
+            if (programmed && plan->extended[step] == current->extended[step] && plan->mask[step] == current->mask[step])
+                continue;
+            canBus->filtersOk &= (controller->init_Mask(step, plan->extended[step], plan->mask[step]) == MCP2515_OK);
+        }
+        else // RXF0 - RXF5
+        {
+            int filter = step - 2;
+            int buffer = (filter < 2 ? 0 : 1);
+            if (programmed && plan->extended[buffer] == current->extended[buffer] && plan->filter[filter] == current->filter[filter])
+                continue;
+            canBus->filtersOk &= (controller->init_Filt(filter, plan->extended[buffer], plan->filter[filter]) == MCP2515_OK);
+        }
+#endif
+        canBus->filterStep++;
+        return;
+    }
+
+#ifndef CFG_CAN_MCP2518FD
+    controller->setMode(canBus->filterMode);
+#endif
+    *current = *plan;
+    canBus->filtersProgrammed = canBus->filtersOk;
+    canBus->filterStep = -1;
+    uint32_t now = micros();
+    for (int i = 0; i < canBus->numRxMonitors; i++)
+        canBus->rxMonitors[i].armed = now; // give each monitored id a full timeout again
+    if (!canBus->filtersOk)
+        Logger::info("CAN%d: unable to program the acceptance filters", canBus->number);
+}
+
+/*
+ * Logs the content of a received can frame
+ *
+ * \param frame - the received can frame to log
+ */
+void CanHandler::logFrame(CAN_FRAME &frame)
+{
+    if (Logger::isDebug())
+    {
+        Logger::debug("CAN: dlc=%X fid=%X id=%X ide=%X rtr=%X data=%X,%X,%X,%X,%X,%X,%X,%X",
+                      frame.length, frame.fid, frame.id, frame.extended, frame.rtr,
+                      frame.data.bytes[0], frame.data.bytes[1], frame.data.bytes[2], frame.data.bytes[3],
+                      frame.data.bytes[4], frame.data.bytes[5], frame.data.bytes[6], frame.data.bytes[7]);
+    }
+}
+
 /*
- * Constructor of the can handler
+ * Find a observerData entry of a bus which is not in use.
+ *
+ * \retval array index of the next unused entry in observerData[]
  */
-CanHandler::CanHandler()
+int8_t CanHandler::findFreeObserverData(CanBus *canBus)
 {
-
     for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++)
     {
-        observerData[i].observer = NULL;
+        if (canBus->observerData[i].observer == NULL)
+        {
+            return i;
+        }
     }
-    masterID = 0x05;
-    busSpeed = 0;
+
+    return -1;
 }
 
+#ifdef CFG_CAN_USE_INTERRUPT
 /*
- * Initialization of the CAN bus
+ * Interrupt service routine of the INT line of the CAN0 controller.
  */
-void CanHandler::setup()
+void canInterrupt()
+{
+    canHandler.handleInterrupt(CAN_BUS_EV);
+}
+
+#if CFG_CAN_NUM_BUSES > 1
+/*
+ * Interrupt service routine of the INT line of the CAN1 controller.
+ */
+void canInterrupt1()
+{
+    canHandler.handleInterrupt(CAN_BUS_CAR);
+}
+#endif
+
+#ifdef CFG_CAN_MCP2518FD
+/*
+ * Drain the receive FIFO of the MCP2518FD. Frames of up to 8 bytes go to rxBuffer,
+ * longer CAN-FD frames to rxFdBuffer. Each frame is read straight into the free slot
+ * at rxFdHead (a ring buffer always keeps one) and only copied if it's a short one.
+ * The transmit FIFO is filled from process().
+ */
+void CanHandler::handleInterrupt(CanBusId bus)
 {
-    while (CAN_OK != CAN.begin(16)) // TODO move to config
+    CanBus *canBus = &buses[bus];
+    CanController *controller = canBus->controller;
+    unsigned long id;
+    byte ext, rtr, len;
+
+    while (controller->readRxTxStatus() & CAN_RX_FIFO_NOT_EMPTY_EVENT)
     {
-        SERIAL_PORT_MONITOR.println("CAN init fail, retry...");
-        delay(200);
+        CAN_FRAME_FD *fdFrame = &canBus->rxFdBuffer[canBus->rxFdHead];
+
+        if (controller->readMsgBufID(0, &id, &ext, &rtr, &len, fdFrame->data.uint8) != CAN_OK)
+            break;
+
+        if (len > 8)
+        {
+            uint16_t next = (canBus->rxFdHead + 1) % CFG_CAN_FD_RX_BUFFER_SIZE;
+            if (next == canBus->rxFdTail)
+            {
+                canBus->rxOverflows++;
+                continue;
+            }
+            fdFrame->id = id;
+            fdFrame->extended = ext;
+            fdFrame->fdMode = 1;
+            fdFrame->length = len;
+            fdFrame->timestamp = micros();
+            canBus->rxFdHead = next;
+            continue;
+        }
+
+        uint16_t next = (canBus->rxHead + 1) % CFG_CAN_RX_BUFFER_SIZE;
+        if (next == canBus->rxTail)
+        {
+            canBus->rxOverflows++;
+            continue;
+        }
+        CAN_FRAME *frame = &canBus->rxBuffer[canBus->rxHead];
+        frame->id = id;
+        frame->extended = ext;
+        frame->rtr = rtr;
+        frame->length = len;
+        memcpy(frame->data.bytes, fdFrame->data.uint8, 8);
+        frame->timestamp = micros();
+        canBus->rxHead = next;
+
+        uint16_t used = (canBus->rxHead + CFG_CAN_RX_BUFFER_SIZE - canBus->rxTail) % CFG_CAN_RX_BUFFER_SIZE;
+        if (used > canBus->rxHighWaterMark)
+            canBus->rxHighWaterMark = used;
     }
+}
+#else
+/*
+ * Drain both receive buffers of the MCP2515 into rxBuffer and refill the transmit
+ * buffers which became free from the transmit queues. This is the only writer
+ * of rxHead, process() is the only writer of rxTail. If rxBuffer is full, the frame
+ * is still read (so the controller releases INT) but dropped and counted.
+ */
+void CanHandler::handleInterrupt(CanBusId bus)
+{
+    static CAN_FRAME overflowFrame;
+    CanBus *canBus = &buses[bus];
+    CanController *controller = canBus->controller;
+    unsigned long id;
+    byte ext, rtr, len;
+    byte status;
+
+    while ((status = controller->readRxTxStatus()) != 0)
+    {
+        if (status & MCP_TX_INT)
+        {
+            controller->clearBufferTransmitIfFlags(status);
+            transmitQueued(canBus);
+        }
+        status &= (MCP_RX0IF | MCP_RX1IF);
+        if (status == 0)
+            continue;
+
+        uint16_t next = (canBus->rxHead + 1) % CFG_CAN_RX_BUFFER_SIZE;
+        CAN_FRAME *frame = (next == canBus->rxTail ? &overflowFrame : &canBus->rxBuffer[canBus->rxHead]);
+
+        if (controller->readMsgBufID(status, &id, &ext, &rtr, &len, frame->data.bytes) != CAN_OK)
+            break;
+        frame->id = id;
+        frame->extended = ext;
+        frame->rtr = rtr;
+        frame->length = len;
+        frame->timestamp = micros();
+
+        if (frame == &overflowFrame)
+        {
+            canBus->rxOverflows++;
+            continue;
+        }
+        canBus->rxHead = next;
 
+        uint16_t used = (canBus->rxHead + CFG_CAN_RX_BUFFER_SIZE - canBus->rxTail) % CFG_CAN_RX_BUFFER_SIZE;
+        if (used > canBus->rxHighWaterMark)
+            canBus->rxHighWaterMark = used;
+    }
+}
+#endif
 
-    Logger::info("CAN init ok. Speed = %i", CAN_500KBPS);
+/*
+ * Get the number of received frames of a bus which were dropped because rxBuffer was full.
+ */
+uint32_t CanHandler::getRxOverflowCount(CanBusId bus)
+{
+    CanBus *canBus = getBus(bus);
+    return (canBus == NULL ? 0 : canBus->rxOverflows);
 }
 
-uint32_t CanHandler::getBusSpeed()
+/*
+ * Get the maximum number of frames which were waiting in rxBuffer of a bus at the same time.
+ */
+uint16_t CanHandler::getRxHighWaterMark(CanBusId bus)
 {
-    return busSpeed;
+    CanBus *canBus = getBus(bus);
+    return (canBus == NULL ? 0 : canBus->rxHighWaterMark);
 }
 
 /*
- * Attach a CanObserver. Can frames which match the id/mask will be forwarded to the observer
- * via the method handleCanFrame(RX_CAN_FRAME).
- *
- *  \param observer - the observer object to register (must implement CanObserver class)
- *  \param id - the id of the can frame to listen to
- *  \param mask - the mask to be applied to the frames
- *  \param extended - set if extended frames must be supported
+ * Forward the frames buffered by the interrupt to the registered observers.
+ * At most one buffer full is handled per call so a flooded bus can't lock up loop().
  */
-void CanHandler::attach(CanObserver *observer, uint32_t id, uint32_t mask, bool extended)
+void CanHandler::receiveFrames(CanBus *canBus)
 {
-    int8_t pos = findFreeObserverData();
+    for (int i = 0; i < CFG_CAN_RX_BUFFER_SIZE && canBus->rxTail != canBus->rxHead; i++)
+    {
+        dispatchFrame(canBus, canBus->rxBuffer[canBus->rxTail]);
+        canBus->rxTail = (canBus->rxTail + 1) % CFG_CAN_RX_BUFFER_SIZE;
+    }
+#ifdef CFG_CAN_MCP2518FD
+    for (int i = 0; i < CFG_CAN_FD_RX_BUFFER_SIZE && canBus->rxFdTail != canBus->rxFdHead; i++)
+    {
+        dispatchFrameFD(canBus, canBus->rxFdBuffer[canBus->rxFdTail]);
+        canBus->rxFdTail = (canBus->rxFdTail + 1) % CFG_CAN_FD_RX_BUFFER_SIZE;
+    }
+#endif
 
-    if (pos == -1)
+    if (canBus->rxOverflows != canBus->reportedOverflows)
     {
-        Logger::debug("no free space in CanHandler::observerData, increase its size via CFG_CAN_NUM_OBSERVERS");
-        return;
+        Logger::info("CAN%d receive buffer overflow, %d frames lost", canBus->number, canBus->rxOverflows - canBus->reportedOverflows);
+        canBus->reportedOverflows = canBus->rxOverflows;
     }
+}
+#else
+/*
+ * If a message is available, read it and forward it to registered observers.
+ */
+void CanHandler::receiveFrames(CanBus *canBus)
+{
+    static CAN_FRAME frame;
+    CanController *controller = canBus->controller;
 
-    observerData[pos].id = id;
-    observerData[pos].mask = mask;
-    observerData[pos].extended = extended;
-    observerData[pos].observer = observer;
+    unsigned char len = 8;
+    unsigned char buf[CAN_MAX_DATA_LENGTH];
+
+    if (CAN_MSGAVAIL == controller->checkReceive())
+    {
+        controller->readMsgBuf(&len, buf); // read data,  len: data length, buf: data buf
+#ifdef CFG_CAN_MCP2518FD
+        if (len > 8)
+        {
+            static CAN_FRAME_FD fdFrame;
+
+            fdFrame.id = controller->getCanId();
+            fdFrame.extended = (bool)controller->isExtendedFrame();
+            fdFrame.fdMode = 1;
+            fdFrame.length = len;
+            memcpy(fdFrame.data.uint8, buf, len);
+            fdFrame.timestamp = micros();
+            dispatchFrameFD(canBus, fdFrame);
+            return;
+        }
+#endif
 
-    CAN.init_Filt(pos, extended, id);
-    CAN.init_Mask(pos, extended, (unsigned long)mask);
+        frame.length = (uint8_t)len;
+        for (int i = 0; i < len; i++)
+        {
+            frame.data.bytes[i] = uint8_t(buf[i]);
+        }
+        frame.id = controller->getCanId();
+        frame.extended = (bool)controller->isExtendedFrame();
+        frame.rtr = controller->isRemoteRequest();
+        frame.timestamp = micros();
 
-    Logger::debug("attached CanObserver (%X) for id=%X, mask=%X", observer, id, mask);
+        dispatchFrame(canBus, frame);
+    }
 }
+#endif
 
 /*
- * Detaches a previously attached observer from this handler.
- *
- * \param observer - observer object to detach
- * \param id - id of the observer to detach (required as one CanObserver may register itself several times)
- * \param mask - mask of the observer to detach (dito)
+ * Handle received frames and send queued ones of all buses. To be called from loop().
+ * The EV bus is served first, so its control frames don't wait for the car bus.
  */
-void CanHandler::detach(CanObserver *observer, uint32_t id, uint32_t mask)
+void CanHandler::process()
 {
-    for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++)
+    bool programming = false; // the filters of one bus at a time, the others keep receiving
+
+    for (int i = 0; i < CFG_CAN_NUM_BUSES; i++)
     {
-        if (observerData[i].observer == observer &&
-            observerData[i].id == id &&
-            observerData[i].mask == mask)
+        CanBus *canBus = &buses[i];
+
+        superviseBus(canBus);
+        if (!isOnline(canBus))
+        {
+            checkRxDeadlines(canBus); // the observers learn about the loss of their frames
+            continue;
+        }
+
+        if (!programming)
+        {
+            if (canBus->filterStep >= 0)
+                writeFilterRegister(canBus);
+            else if (canBus->filtersDirty && initialized && !canBus->filtersHeld)
+                planFilters(canBus);
+            programming = (canBus->filterStep >= 0);
+        }
+
+        receiveFrames(canBus);
+        checkRxDeadlines(canBus);
+        serviceTransmit(canBus);
+
+        if (canBus->txOverflows != canBus->reportedTxOverflows)
         {
-            observerData[i].observer = NULL;
+            Logger::info("CAN%d transmit queue overflow, %d frames lost", canBus->number, canBus->txOverflows - canBus->reportedTxOverflows);
+            canBus->reportedTxOverflows = canBus->txOverflows;
         }
     }
 }
 
 /*
- * Logs the content of a received can frame
- *
- * \param frame - the received can frame to log
+ * Get the set of observers of a standard id: the ones of the dispatch table plus those
+ * which aren't in it, matched like the table is built in rebuildDispatchTable().
  */
-void CanHandler::logFrame(CAN_FRAME &frame)
+CanObserverSet CanHandler::findStdObservers(CanBus *canBus, uint16_t id)
 {
-    if (Logger::isDebug())
+    CanObserverSet observers = (canBus->stdDispatch != NULL ? canBus->stdDispatch[id] : 0);
+
+    for (int j = 0; j < canBus->numStdObservers; j++)
     {
-        Logger::debug("CAN: dlc=%X fid=%X id=%X ide=%X rtr=%X data=%X,%X,%X,%X,%X,%X,%X,%X",
-                      frame.length, frame.fid, frame.id, frame.extended, frame.rtr,
-                      frame.data.bytes[0], frame.data.bytes[1], frame.data.bytes[2], frame.data.bytes[3],
-                      frame.data.bytes[4], frame.data.bytes[5], frame.data.bytes[6], frame.data.bytes[7]);
+        CanObserverData *data = &canBus->observerData[canBus->stdObservers[j]];
+        uint16_t mask = data->mask & 0x7FF;
+        bool match = (id & mask) == (data->id & mask);
+
+        if (data->canOpen)
+            match = (match && id >= 0x180 && id < 0x580) || id == 0x600 + data->nodeID || id == 0x580 + data->nodeID;
+        if (match)
+            observers |= (CanObserverSet)1 << canBus->stdObservers[j];
     }
+    return observers;
 }
 
 /*
- * Find a observerData entry which is not in use.
- *
- * \retval array index of the next unused entry in observerData[]
+ * Forward a received frame to all observers of the bus which registered for its id.
  */
-int8_t CanHandler::findFreeObserverData()
+void CanHandler::dispatchFrame(CanBus *canBus, CAN_FRAME &frame)
 {
-    for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++)
+    logFrame(frame);
+    updateRxStatistics(canBus, frame.id, frame.extended, frame.timestamp);
+    forwardFrame(canBus, frame);
+
+    if (frame.id == CAN_SWITCH && canBus == &buses[CAN_BUS_EV])
+        CANIO(frame);
+
+    if (!frame.extended)
     {
-        if (observerData[i].observer == NULL)
+        CanObserverSet observers = findStdObservers(canBus, frame.id & 0x7FF);
+        while (observers)
         {
-            return i;
+            int i = __builtin_ctz(observers);
+            observers &= observers - 1; // clear lowest bit
+            deliverFrame(&canBus->observerData[i], frame);
+        }
+    }
+    else
+    {
+        for (int j = 0; j < canBus->numExtObservers; j++)
+        {
+            CanObserverData *data = &canBus->observerData[canBus->extObservers[j]];
+            if ((frame.id & data->mask) == (data->id & data->mask))
+                deliverFrame(data, frame);
         }
     }
-
-    return -1;
 }
 
 /*
- * If a message is available, read it and forward it to registered observers.
+ * Forward a received CAN-FD frame to the observers of the bus which registered for its id.
+ * CANopen observers don't get CAN-FD frames.
  */
-void CanHandler::process()
+void CanHandler::dispatchFrameFD(CanBus *canBus, CAN_FRAME_FD &frame)
 {
-    static CAN_FRAME frame;
-    static SDO_FRAME sFrame;
-
-    CanObserver *observer;
-
-    unsigned char len = 8;
-    unsigned char buf[8];
+    updateRxStatistics(canBus, frame.id, frame.extended, frame.timestamp);
 
-    if (CAN_MSGAVAIL == CAN.checkReceive())
+    if (!frame.extended)
     {
-        CAN.readMsgBuf(&len, buf); // read data,  len: data length, buf: data buf
-
-        frame.length = (uint8_t)len;
-        for (int i = 0; i < len; i++)
+        CanObserverSet observers = findStdObservers(canBus, frame.id & 0x7FF);
+        while (observers)
         {
-            frame.data.bytes[i] = uint8_t(buf[i]);
+            int i = __builtin_ctz(observers);
+            observers &= observers - 1; // clear lowest bit
+            if (!canBus->observerData[i].canOpen)
+                canBus->observerData[i].observer->handleCanFDFrame(&frame);
+        }
+    }
+    else
+    {
+        for (int j = 0; j < canBus->numExtObservers; j++)
+        {
+            CanObserverData *data = &canBus->observerData[canBus->extObservers[j]];
+            if ((frame.id & data->mask) == (data->id & data->mask))
+                data->observer->handleCanFDFrame(&frame);
         }
-        frame.id = CAN.getCanId();
-        frame.extended = (bool)CAN.isExtendedFrame();
-        frame.rtr = CAN.isRemoteRequest();
+    }
+}
 
-        Logger::info("RECEIVED CAN:%d dlc=%X fid=%X id=%X ide=%X rtr=%X data=%X,%X,%X,%X,%X,%X,%X,%X", 0,
-                      frame.length, frame.fid, frame.id, frame.extended, frame.rtr,
-                      frame.data.bytes[0], frame.data.bytes[1], frame.data.bytes[2], frame.data.bytes[3],
-                      frame.data.bytes[4], frame.data.bytes[5], frame.data.bytes[6], frame.data.bytes[7]);
+/*
+ * Update the statistics of a monitored id with the receive timestamp of a frame. The
+ * period and its deviation are tracked as exponential moving averages, so no history
+ * has to be kept. The gap in front of a frame which ends a timeout is not a period.
+ */
+void CanHandler::updateRxStatistics(CanBus *canBus, uint32_t id, bool extended, uint32_t timestamp)
+{
+    for (int i = 0; i < canBus->numRxMonitors; i++)
+    {
+        CanRxMonitor *rxMonitor = &canBus->rxMonitors[i];
+        CanRxStatistics *stats = &rxMonitor->stats;
 
-        if (frame.id == CAN_SWITCH)
-            CANIO(frame);
+        if (stats->id != id || stats->extended != extended)
+            continue;
 
-        for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++)
+        // a period which spans a filter update (the controller was deaf) doesn't count
+        if (stats->count > 0 && !stats->timedOut && rxMonitor->armed == stats->lastSeen)
         {
-            observer = observerData[i].observer;
-            if (observer != NULL)
+            int32_t period = timestamp - stats->lastSeen;
+
+            if (stats->meanPeriod == 0) // the first period
+                stats->meanPeriod = period;
+            else
             {
-                // Apply mask to frame.id and observer.id. If they match, forward the frame to the observer
-                if (observer->isCANOpen())
-                {
-                    if (frame.id > 0x17F && frame.id < 0x580)
-                    {
-                        observer->handlePDOFrame(&frame);
-                    }
-
-                    if (frame.id == 0x600 + observer->getNodeID()) // SDO request targetted to our ID
-                    {
-                        sFrame.nodeID = observer->getNodeID();
-                        sFrame.index = frame.data.byte[1] + (frame.data.byte[2] * 256);
-                        sFrame.subIndex = frame.data.byte[3];
-                        sFrame.cmd = (SDO_COMMAND)(frame.data.byte[0] & 0xF0);
-
-                        if ((frame.data.byte[0] != 0x40) && (frame.data.byte[0] != 0x60))
-                        {
-                            sFrame.dataLength = (3 - ((frame.data.byte[0] & 0xC) >> 2)) + 1;
-                        }
-                        else
-                            sFrame.dataLength = 0;
-
-                        for (int x = 0; x < sFrame.dataLength; x++)
-                            sFrame.data[x] = frame.data.byte[4 + x];
-                        observer->handleSDORequest(&sFrame);
-                    }
-
-                    if (frame.id == 0x580 + observer->getNodeID()) // SDO reply to our ID
-                    {
-                        sFrame.nodeID = observer->getNodeID();
-                        sFrame.index = frame.data.byte[1] + (frame.data.byte[2] * 256);
-                        sFrame.subIndex = frame.data.byte[3];
-                        sFrame.cmd = (SDO_COMMAND)(frame.data.byte[0] & 0xF0);
-
-                        if ((frame.data.byte[0] != 0x40) && (frame.data.byte[0] != 0x60))
-                        {
-                            sFrame.dataLength = (3 - ((frame.data.byte[0] & 0xC) >> 2)) + 1;
-                        }
-                        else
-                            sFrame.dataLength = 0;
-
-                        for (int x = 0; x < sFrame.dataLength; x++)
-                            sFrame.data[x] = frame.data.byte[4 + x];
-
-                        observer->handleSDOResponse(&sFrame);
-                    }
-                }
-                else // raw canbus
-                {
-                    if ((frame.id & observerData[i].mask) == (observerData[i].id & observerData[i].mask))
-                    {
-                        observer->handleCanFrame(&frame);
-                    }
-                }
+                int32_t error = period - (int32_t) stats->meanPeriod;
+                stats->meanPeriod = (int32_t) stats->meanPeriod + (error >> CAN_RX_STATS_WEIGHT);
             }
+            int32_t deviation = abs(period - (int32_t) stats->meanPeriod);
+            int32_t error = deviation - (int32_t) stats->jitter;
+            stats->jitter = (int32_t) stats->jitter + (error >> CAN_RX_STATS_WEIGHT);
         }
+        stats->lastSeen = timestamp;
+        rxMonitor->armed = timestamp;
+        stats->count++;
+        stats->timedOut = false;
+        return;
+    }
+}
+
+/*
+ * Notify the observers of the monitored ids whose deadline passed. Called after the
+ * received frames were dispatched, so a frame waiting in the buffer can't time out.
+ * While the filters are written the controller receives nothing, so the deadlines are
+ * suspended and writeFilterRegister() restarts them afterwards.
+ */
+void CanHandler::checkRxDeadlines(CanBus *canBus)
+{
+    uint32_t now = micros();
+
+    if (canBus->filterStep >= 0)
+        return;
+
+    for (int i = 0; i < canBus->numRxMonitors; i++)
+    {
+        CanRxMonitor *rxMonitor = &canBus->rxMonitors[i];
+        CanRxStatistics *stats = &rxMonitor->stats;
+
+        if (stats->timeout == 0 || stats->count == 0 || stats->timedOut || now - rxMonitor->armed <= stats->timeout)
+            continue;
+
+        stats->timedOut = true;
+        stats->timeouts++;
+        Logger::debug("CAN%d: id %X not received for %l us", canBus->number, stats->id, now - stats->lastSeen);
+        if (rxMonitor->observer != NULL)
+            rxMonitor->observer->handleCanTimeout(stats->id);
+    }
+}
+
+/*
+ * Hand a frame to one observer, decoding SDO frames for CANopen observers.
+ */
+void CanHandler::deliverFrame(CanObserverData *data, CAN_FRAME &frame)
+{
+    static SDO_FRAME sFrame;
+
+    if (!data->canOpen) // raw canbus
+    {
+        data->observer->handleCanFrame(&frame);
+        return;
+    }
+
+    if (frame.id > 0x17F && frame.id < 0x580)
+    {
+        data->observer->handlePDOFrame(&frame);
+        return;
+    }
+
+    // SDO request to our ID or SDO reply to our ID
+    sFrame.nodeID = data->nodeID;
+    sFrame.index = frame.data.byte[1] + (frame.data.byte[2] * 256);
+    sFrame.subIndex = frame.data.byte[3];
+    sFrame.cmd = (SDO_COMMAND)(frame.data.byte[0] & 0xF0);
+
+    // expedited transfers and aborts carry data, the segmented ones (and requests) don't
+    if ((frame.data.byte[0] & 0x02) || sFrame.cmd == SDO_ABORT)
+    {
+        sFrame.dataLength = (3 - ((frame.data.byte[0] & 0xC) >> 2)) + 1;
     }
+    else
+        sFrame.dataLength = 0;
+
+    for (int x = 0; x < sFrame.dataLength; x++)
+        sFrame.data[x] = frame.data.byte[4 + x];
+
+    if (frame.id == 0x600u + data->nodeID)
+        data->observer->handleSDORequest(&sFrame);
+    else
+        data->observer->handleSDOResponse(&sFrame);
 }
 
 /*
@@ -301,7 +1418,7 @@ void CanHandler::CANIO(CAN_FRAME &frame)
             CANioFrame.data.bytes[i] = 0xFF;
     }
 
-    this->sendFrame(CANioFrame);
+    this->sendFrame(CANioFrame, CAN_TX_DIAGNOSTIC);
 
     CANioFrame.id = CAN_ANALOG_INPUTS;
     i = 0;
@@ -314,7 +1431,7 @@ void CanHandler::CANIO(CAN_FRAME &frame)
         CANioFrame.data.bytes[j + 1] = lowByte(anaVal);
     }
 
-    this->sendFrame(CANioFrame);
+    this->sendFrame(CANioFrame, CAN_TX_DIAGNOSTIC);
 
     CANioFrame.id = CAN_DIGITAL_INPUTS;
     CANioFrame.length = 4;
@@ -327,89 +1444,248 @@ void CanHandler::CANIO(CAN_FRAME &frame)
             CANioFrame.data.bytes[i] = 0xff;
     }
 
-    this->sendFrame(CANioFrame);
+    this->sendFrame(CANioFrame, CAN_TX_DIAGNOSTIC);
+}
+
+/*
+ * Queue a frame for transmission. If a suitable transmit buffer of the MCP2515 is free,
+ * the frame is handed over right away, otherwise it follows from the TX interrupt (or
+ * process()) as soon as the queued frames of the same and higher priority are out.
+ * A control frame replaces a queued one with the same id, the old command is stale.
+ * Never waits for the bus, if the queue is full the frame is dropped and counted. While
+ * the controller is offline (not initialized or bus-off), frames are dropped right away.
+ *
+ * \param frame - the frame to send, length and rtr are respected
+ * \param priority - the transmit queue to use
+ * \param bus - the bus to send the frame on
+ * \retval false if the frame was dropped
+ */
+bool CanHandler::sendFrame(CAN_FRAME &frame, CanTxPriority priority, CanBusId bus)
+{
+    CanBus *canBus = getBus(bus);
+
+    if (canBus == NULL || !isOnline(canBus))
+        return false;
+
+    if (priority == CAN_TX_CONTROL)
+    {
+        bool replaced = false;
+#ifdef CFG_CAN_USE_INTERRUPT
+        noInterrupts(); // the TX interrupt must not take the frame while it's updated
+#endif
+        for (uint16_t i = canBus->txTail[priority]; i != canBus->txHead[priority] && !replaced; i = (i + 1) % CFG_CAN_TX_BUFFER_SIZE)
+        {
+            CAN_FRAME *queued = &canBus->txBuffer[priority][i];
+            if (queued->id == frame.id && queued->extended == frame.extended)
+            {
+                *queued = frame;
+                replaced = true;
+            }
+        }
+#ifdef CFG_CAN_USE_INTERRUPT
+        interrupts();
+#endif
+        if (replaced)
+            return true;
+    }
+
+    CAN_FRAME *queued = allocateTxFrame(canBus, priority);
+    if (queued == NULL)
+    {
+        canBus->txOverflows++;
+        return false;
+    }
+    *queued = frame;
+    queueTxFrame(canBus, priority);
+    return true;
+}
+
+/*
+ * Get the free slot at the head of a transmit queue, so a frame can be composed in place.
+ * It's only sent once queueTxFrame() was called.
+ *
+ * \retval NULL if the queue is full
+ */
+CAN_FRAME *CanHandler::allocateTxFrame(CanBus *canBus, CanTxPriority priority)
+{
+    uint16_t next = (canBus->txHead[priority] + 1) % CFG_CAN_TX_BUFFER_SIZE;
+
+    if (next == canBus->txTail[priority])
+        return NULL;
+    return &canBus->txBuffer[priority][canBus->txHead[priority]];
 }
 
-//(whatever happens to be open) or queue it to send (if nothing is open)
-void CanHandler::sendFrame(CAN_FRAME &frame)
+/*
+ * Append the frame composed in the slot of allocateTxFrame() to the transmit queue
+ * and hand it to the controller if a transmit buffer is free.
+ */
+void CanHandler::queueTxFrame(CanBus *canBus, CanTxPriority priority)
 {
+    canBus->txHead[priority] = (canBus->txHead[priority] + 1) % CFG_CAN_TX_BUFFER_SIZE;
 
-    // Logger::debug("CANIO %d msg: %X   %X   %X   %X   %X   %X   %X   %X  %X", 0, frame.id, frame.data.bytes[0],
-    //              frame.data.bytes[1], frame.data.bytes[2], frame.data.bytes[3], frame.data.bytes[4],
-    //              frame.data.bytes[5], frame.data.bytes[6], frame.data.bytes[7]);
+    uint16_t used = 0;
+    for (int i = 0; i < CAN_TX_NUM_PRIORITIES; i++)
+        used += (canBus->txHead[i] + CFG_CAN_TX_BUFFER_SIZE - canBus->txTail[i]) % CFG_CAN_TX_BUFFER_SIZE;
+    if (used > canBus->txHighWaterMark)
+        canBus->txHighWaterMark = used;
 
-    CAN.MCP_CAN::sendMsgBuf(frame.id, frame.extended, 8, frame.data.bytes);
+    serviceTransmit(canBus);
 }
 
-void CanHandler::sendISOTP(int id, int length, uint8_t *data)
+/*
+ * Queue a CAN-FD frame with up to 64 bytes, its data phase is sent with bit rate
+ * switching. CAN-FD frames have a queue of their own which is served after the classic
+ * frames of all priorities. Frames of up to 8 bytes are sent as classic frames with
+ * normal priority (the MCP2518FD driver only sets FDF for longer ones). Without a
+ * CAN-FD controller (CFG_CAN_MCP2518FD), longer frames can't be sent and are dropped.
+ *
+ * \param frame - the frame to send, the payload is padded with 0 up to the next DLC
+ * \param bus - the bus to send the frame on
+ * \retval false if the frame was dropped
+ */
+bool CanHandler::sendFrameFD(CAN_FRAME_FD &frame, CanBusId bus)
 {
-    CAN_FRAME frame;
+    if (frame.length <= 8)
+    {
+        CAN_FRAME classic;
+        classic.id = frame.id;
+        classic.extended = frame.extended;
+        classic.rtr = 0;
+        classic.length = frame.length;
+        memcpy(classic.data.bytes, frame.data.uint8, 8);
+        return sendFrame(classic, CAN_TX_NORMAL, bus);
+    }
 
-    frame.extended = false;
-    frame.id = id;
-    frame.rtr = 0;
+#ifdef CFG_CAN_MCP2518FD
+    CanBus *canBus = getBus(bus);
+
+    if (canBus == NULL || !isOnline(canBus))
+        return false;
 
-    if (length < 8) // single frame
+    uint16_t next = (canBus->txFdHead + 1) % CFG_CAN_FD_TX_BUFFER_SIZE;
+
+    if (frame.length > 64 || next == canBus->txFdTail)
     {
-        frame.length = length + 1;
-        frame.data.byte[0] = SINGLE + (length << 4);
-        for (int i = 0; i < length; i++)
-            frame.data.byte[i + 1] = data[i];
-        this->sendFrame(frame);
+        canBus->txOverflows++;
+        return false;
     }
-    else // multi-frame sending
+    CAN_FRAME_FD *queued = &canBus->txFdBuffer[canBus->txFdHead];
+    *queued = frame;
+    byte padded = CANFD::dlc2len(CANFD::len2dlc(frame.length)); // e.g. 20 bytes for 17
+    memset(&queued->data.uint8[frame.length], 0, padded - frame.length);
+    canBus->txFdHead = next;
+
+    serviceTransmit(canBus);
+    return true;
+#else
+    Logger::debug("CAN: no CAN-FD controller, frame with id %X and %d bytes dropped", frame.id, frame.length);
+    return false;
+#endif
+}
+
+/*
+ * Move queued frames to the controller from the main loop. The TX interrupt works on
+ * the same queues, so it's held off meanwhile.
+ */
+void CanHandler::serviceTransmit(CanBus *canBus)
+{
+#ifdef CFG_CAN_USE_INTERRUPT
+    noInterrupts();
+    transmitQueued(canBus);
+    interrupts();
+#else
+    transmitQueued(canBus);
+#endif
+}
+
+/*
+ * Hand queued frames to free transmit buffers of the MCP2515, highest priority first.
+ * Only control frames may use TXB2, all others are limited to TXB0 and TXB1. So a
+ * control frame never waits for a buffer held by a diagnostic reply and, as the
+ * controller sends the highest buffer number first, it also leaves the chip first.
+ * The MCP2518FD has a single transmit FIFO (8 frames) instead, which keeps the order
+ * the frames were handed over in. Its driver waits for room in the FIFO itself and
+ * can't report it full, so every queued frame is handed over right away.
+ * While the filters of an MCP2515 are written it is in configuration mode and wouldn't
+ * send, the frames stay queued until writeFilterRegister() restores the mode.
+ */
+void CanHandler::transmitQueued(CanBus *canBus)
+{
+    CanController *controller = canBus->controller;
+
+#ifndef CFG_CAN_MCP2518FD
+    if (canBus->filterStep >= 0)
+        return;
+#endif
+
+    for (int priority = 0; priority < CAN_TX_NUM_PRIORITIES; priority++)
     {
-        int temp = length;
-        uint8_t idx = 0;
-        int base;
-        frame.length = 8;
-        frame.data.byte[0] = FIRST + (length >> 8);
-        frame.data.byte[1] = (length & 0xFF);
-        for (int i = 0; i < 6; i++)
-            frame.data.byte[i + 2] = data[i];
-        this->sendFrame(frame);
-        temp -= 6;
-        base = 6;
-        while (temp > 7)
+        while (canBus->txTail[priority] != canBus->txHead[priority])
         {
-            frame.length = 8;
-            frame.data.byte[0] = CONSEC + (idx << 4);
-            idx = (idx + 1) & 0xF;
-            for (int i = 0; i < 7; i++)
-                frame.data.byte[i + 1] = data[i + base];
-            this->sendFrame(frame);
-            temp -= 7;
-            base += 7;
-        }
-        if (temp > 0)
-        {
-            frame.length = temp + 1;
-            frame.data.byte[0] = CONSEC + (idx << 4);
-            for (int i = 0; i < temp; i++)
-                frame.data.byte[i + 1] = data[i + base];
-            this->sendFrame(frame);
+            CAN_FRAME *frame = &canBus->txBuffer[priority][canBus->txTail[priority]];
+            byte len = (frame->length > 8 ? 8 : frame->length);
+            bool sent;
+
+            if (priority == CAN_TX_CONTROL)
+                sent = (controller->trySendMsgBuf(frame->id, frame->extended, frame->rtr, len, frame->data.bytes, 2) == CAN_OK ||
+                        controller->trySendMsgBuf(frame->id, frame->extended, frame->rtr, len, frame->data.bytes) == CAN_OK);
+            else
+                sent = (controller->trySendMsgBuf(frame->id, frame->extended, frame->rtr, len, frame->data.bytes, 0) == CAN_OK ||
+                        controller->trySendMsgBuf(frame->id, frame->extended, frame->rtr, len, frame->data.bytes, 1) == CAN_OK);
+
+            if (!sent)
+                return; // no buffer left for this priority, none for the lower ones either
+            canBus->txTail[priority] = (canBus->txTail[priority] + 1) % CFG_CAN_TX_BUFFER_SIZE;
         }
     }
+#ifdef CFG_CAN_MCP2518FD
+    while (canBus->txFdTail != canBus->txFdHead)
+    {
+        CAN_FRAME_FD *frame = &canBus->txFdBuffer[canBus->txFdTail];
+
+        if (controller->trySendMsgBuf(frame->id, frame->extended, 0, CANFD::len2dlc(frame->length), frame->data.uint8) != CAN_OK)
+            return;
+        canBus->txFdTail = (canBus->txFdTail + 1) % CFG_CAN_FD_TX_BUFFER_SIZE;
+    }
+#endif
+}
+
+/*
+ * Get the number of frames of a bus which were dropped because their transmit queue was full.
+ */
+uint32_t CanHandler::getTxOverflowCount(CanBusId bus)
+{
+    CanBus *canBus = getBus(bus);
+    return (canBus == NULL ? 0 : canBus->txOverflows);
+}
+
+/*
+ * Get the maximum number of frames which were waiting in the transmit queues of a bus at the same time.
+ */
+uint16_t CanHandler::getTxHighWaterMark(CanBusId bus)
+{
+    CanBus *canBus = getBus(bus);
+    return (canBus == NULL ? 0 : canBus->txHighWaterMark);
 }
 
 void CanHandler::sendNodeStart(int id)
 {
-    sendNMTMsg(id, 1);
+    sendNMTMsg(id, NMT_START);
 }
 
 void CanHandler::sendNodePreop(int id)
 {
-    sendNMTMsg(id, 0x80);
+    sendNMTMsg(id, NMT_ENTER_PRE_OPERATIONAL);
 }
 
 void CanHandler::sendNodeReset(int id)
 {
-    sendNMTMsg(id, 0x81);
+    sendNMTMsg(id, NMT_RESET_NODE);
 }
 
 void CanHandler::sendNodeStop(int id)
 {
-    sendNMTMsg(id, 2);
+    sendNMTMsg(id, NMT_STOP);
 }
 
 void CanHandler::sendPDOMessage(int id, int length, unsigned char *data)
@@ -448,7 +1724,7 @@ void CanHandler::sendSDORequest(SDO_FRAME *sframe)
         frame.data.byte[3] = sframe->subIndex;
         for (int x = 0; x < sframe->dataLength; x++)
             frame.data.byte[4 + x] = sframe->data[x];
-        this->sendFrame(frame);
+        this->sendFrame(frame, CAN_TX_DIAGNOSTIC);
     }
 }
 
@@ -462,7 +1738,7 @@ void CanHandler::sendSDOResponse(SDO_FRAME *sframe)
     if (sframe->dataLength <= 4)
     {
         frame.data.byte[0] = sframe->cmd;
-        if (sframe->dataLength > 0) // responding with data
+        if (sframe->dataLength > 0 && sframe->cmd != SDO_ABORT) // responding with data
         {
             frame.data.byte[0] |= 0x0F - ((sframe->dataLength - 1) * 4);
         }
@@ -471,21 +1747,27 @@ void CanHandler::sendSDOResponse(SDO_FRAME *sframe)
         frame.data.byte[3] = sframe->subIndex;
         for (int x = 0; x < sframe->dataLength; x++)
             frame.data.byte[4 + x] = sframe->data[x];
-        this->sendFrame(frame);
+        this->sendFrame(frame, CAN_TX_DIAGNOSTIC);
     }
 }
 
-void CanHandler::sendHeartbeat()
+/*
+ * Send the heartbeat (or with NMT_BOOTUP the boot-up message) of the EVCU.
+ *
+ * \param state - the NMT state of the EVCU (see NmtHandler)
+ * \retval false if the frame was dropped
+ */
+bool CanHandler::sendHeartbeat(NMT_STATE state)
 {
     CAN_FRAME frame;
     frame.id = 0x700 + masterID;
     frame.length = 1;
     frame.extended = false;
-    frame.data.byte[0] = 5; // we're always operational
-    this->sendFrame(frame);
+    frame.data.byte[0] = state;
+    return this->sendFrame(frame);
 }
 
-void CanHandler::sendNMTMsg(int id, int cmd)
+void CanHandler::sendNMTMsg(int id, NMT_COMMAND cmd)
 {
     id &= 0x7F;
     CAN_FRAME frame;
@@ -503,6 +1785,11 @@ void CanHandler::setMasterID(int id)
     masterID = id;
 }
 
+int CanHandler::getMasterID()
+{
+    return masterID;
+}
+
 CanObserver::CanObserver()
 {
     canOpenMode = false;
@@ -539,6 +1826,11 @@ void CanObserver::handleCanFrame(CAN_FRAME *frame)
     Logger::debug("CanObserver does not implement handleCanFrame(), frame.id=%d", frame->id);
 }
 
+void CanObserver::handleCanFDFrame(CAN_FRAME_FD *frame)
+{
+    Logger::debug("CanObserver does not implement handleCanFDFrame(), frame.id=%d", frame->id);
+}
+
 void CanObserver::handlePDOFrame(CAN_FRAME *frame)
 {
     Logger::debug("CanObserver does not implement handlePDOFrame(), frame.id=%d", frame->id);
@@ -553,3 +1845,8 @@ void CanObserver::handleSDOResponse(SDO_FRAME *frame)
 {
     Logger::debug("CanObserver does not implement handleSDOResponse(), frame.id=%d", frame->nodeID);
 }
+
+void CanObserver::handleCanTimeout(uint32_t id)
+{
+    Logger::debug("CanObserver does not implement handleCanTimeout(), id=%X", id);
+}
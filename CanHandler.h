@@ -27,19 +27,115 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define CAN_HANDLER_H_
 
 #include <Arduino.h>
-#include "evTimer.h"
 #include "Logger.h"
 #include "can_common.h"
+#include "CanFilterPlanner.h"
 
+#ifdef CFG_CAN_MCP2518FD
+#include "mcp2518fd_can.h"
+typedef mcp2518fd CanController;
+#define CAN_MAX_DATA_LENGTH 64
+#define CAN_FILTER_REGISTERS 6  // filters with their own mask
+#else
 #include "mcp2515_can.h"
+typedef mcp2515_can CanController;
+#define CAN_MAX_DATA_LENGTH 8
+#define CAN_FILTER_REGISTERS 8  // two masks, six filters
+#endif
 
 #define SPI_CS_PIN 5
+#define CAN_INT_PIN 6 // INT output of the CAN controller
+#define CAN1_CS_PIN 10  // chip select of the second controller (car bus)
+#define CAN1_INT_PIN 11 // INT output of the second controller
+
+#if CFG_CAN_NUM_BUSES < 1 || CFG_CAN_NUM_BUSES > 2
+#error "CFG_CAN_NUM_BUSES must be 1 or 2"
+#endif
+
+#if CFG_CAN_NUM_OBSERVERS <= 8
+typedef uint8_t CanObserverSet;     // one bit per entry of CanHandler::observerData
+#elif CFG_CAN_NUM_OBSERVERS <= 16
+typedef uint16_t CanObserverSet;
+#elif CFG_CAN_NUM_OBSERVERS <= 32
+typedef uint32_t CanObserverSet;
+#else
+#error "CFG_CAN_NUM_OBSERVERS must not exceed 32"
+#endif
+
+#define CAN_DISPATCH_OBSERVERS 8        // entries of observerData resolved by a dispatch table, the others are matched one by one
+typedef uint8_t CanDispatchSet;         // one bit per entry of observerData below CAN_DISPATCH_OBSERVERS
+
+/*
+ * The RAM CanHandler may take, checked when compiling: CFG_CAN_RAM_BUDGET with the MCP2515,
+ * plus what the options need by design.
+ */
+#ifdef CFG_CAN1_DISPATCH_TABLE
+#define CAN_RAM_BUDGET_CAN1_TABLE 2048  // the dispatch table of the car bus, one byte per standard id
+#else
+#define CAN_RAM_BUDGET_CAN1_TABLE 0
+#endif
+#ifdef CFG_CAN_MCP2518FD
+#define CAN_RAM_BUDGET_FD 2304          // the CAN-FD buffers of two buses, 12 frames of about 90 bytes each
+#else
+#define CAN_RAM_BUDGET_FD 0
+#endif
+#define CAN_RAM_BUDGET (CFG_CAN_RAM_BUDGET + CAN_RAM_BUDGET_CAN1_TABLE + CAN_RAM_BUDGET_FD)
+
+/*
+ * The CAN buses of the EVCU. Each one has its own controller, observers, receive
+ * buffer, transmit queues and statistics, so the traffic of one bus never delays
+ * the frames of the other.
+ */
+enum CanBusId
+{
+    CAN_BUS_EV = 0,     // CAN0: motor controller, charger, BMS
+    CAN_BUS_CAR = 1,    // CAN1: body bus of the vehicle (dash, ABS, OBD)
+};
+
+#define CAN_INIT_RETRY_INTERVAL 200000      // time between two attempts to initialize a controller (in us)
+#define CAN_BUS_OFF_RECOVERY_TIME 100000    // time a controller is left bus-off before it's initialized again (in us)
+#define CAN_ERROR_CHECK_INTERVAL 10000      // interval in which the error flags of a running controller are read (in us)
+
+/*
+ * State of the controller of a bus (see CanHandler::superviseBus()).
+ */
+enum CanBusState
+{
+    CAN_STATE_INIT = 0,         // not initialized (yet), begin() is retried every CAN_INIT_RETRY_INTERVAL
+    CAN_STATE_RUNNING = 1,      // error active (TEC and REC below 128)
+    CAN_STATE_ERROR_PASSIVE = 2,// TEC or REC reached 128, the controller still sends and receives
+    CAN_STATE_BUS_OFF = 3,      // TEC passed 255, the controller is initialized again after CAN_BUS_OFF_RECOVERY_TIME
+};
 
 enum SDO_COMMAND
 {
     SDO_WRITE = 0x20,
     SDO_READ = 0x40,
     SDO_WRITEACK = 0x60,
+    SDO_ABORT = 0x80,
+};
+
+/*
+ * NMT commands (byte 0 of a frame with id 0, byte 1 is the node id or 0 for all)
+ */
+enum NMT_COMMAND
+{
+    NMT_START = 0x01,
+    NMT_STOP = 0x02,
+    NMT_ENTER_PRE_OPERATIONAL = 0x80,
+    NMT_RESET_NODE = 0x81,
+    NMT_RESET_COMMUNICATION = 0x82,
+};
+
+/*
+ * NMT states, as sent in the heartbeat (0x700 + node id)
+ */
+enum NMT_STATE
+{
+    NMT_BOOTUP = 0x00,
+    NMT_STOPPED = 0x04,
+    NMT_OPERATIONAL = 0x05,
+    NMT_PRE_OPERATIONAL = 0x7F,
 };
 
 struct SDO_FRAME
@@ -52,12 +148,65 @@ struct SDO_FRAME
     uint8_t data[4];
 };
 
-enum ISOTP_MODE
+/*
+ * Transmit priority of a frame. The queue of a higher priority is always emptied first,
+ * frames of the same priority are sent in the order they were queued.
+ */
+enum CanTxPriority
 {
-    SINGLE = 0,
-    FIRST = 1,
-    CONSEC = 2,
-    FLOW = 3
+    CAN_TX_CONTROL = 0,     // cyclic control frames (e.g. the torque command to the motor controller)
+    CAN_TX_NORMAL = 1,      // status frames, CANopen
+    CAN_TX_DIAGNOSTIC = 2,  // replies to diagnostic requests (PID, ISO-TP, CANIO, SDO)
+};
+#define CAN_TX_NUM_PRIORITIES 3
+
+#define CAN_RX_STATS_WEIGHT 3 // the moving averages of period and jitter follow each new period by 1/8
+
+/*
+ * Reception statistics of one monitored CAN id (see CanHandler::monitor()).
+ * All times are in microseconds.
+ */
+struct CanRxStatistics
+{
+    uint32_t id;
+    bool extended;
+    uint32_t timeout;       // the observer is notified if the id isn't received for this long (0 = never)
+    uint32_t lastSeen;      // timestamp of the last frame
+    uint32_t count;         // number of frames received
+    uint32_t meanPeriod;    // moving average of the time between two frames
+    uint32_t jitter;        // moving average of the deviation of the period from meanPeriod
+    uint32_t timeouts;      // number of times the deadline passed
+    bool timedOut;          // the deadline passed and no frame was received since
+};
+
+#define CAN_GATEWAY_SAME_ID 0xFFFFFFFF   // CanGatewayRule::targetId: keep the id of the received frame
+#define CAN_GATEWAY_ZERO 0xFF           // CanGatewayRule::remap: the byte is 0
+
+/*
+ * A rule of the gateway which forwards frames from one bus to the other
+ * (see CanHandler::addGatewayRule()).
+ */
+struct CanGatewayRule
+{
+    CanBusId source;        // the bus the frames are received on
+    uint32_t id;            // frames whose id matches id/mask are forwarded
+    uint32_t mask;
+    bool extended;
+    CanBusId target;        // the bus the frames are sent on
+    uint32_t targetId;      // the id on the target bus (CAN_GATEWAY_SAME_ID = unchanged)
+    bool targetExtended;    // frame type on the target bus if targetId is set
+    bool remapData;         // if set, byte i of the forwarded frame is byte remap[i] of the received one
+    uint8_t remap[8];       // source byte of each byte of the forwarded frame (CAN_GATEWAY_ZERO = 0)
+    uint8_t length;         // length of the forwarded frame if remapData is set
+    uint32_t minInterval;   // min time between two forwarded frames in microseconds (0 = forward all)
+    CanTxPriority priority; // the transmit queue on the target bus
+};
+
+struct CanGatewayStatistics
+{
+    uint32_t forwarded;     // frames queued on the target bus
+    uint32_t limited;       // frames dropped because they followed the last one within minInterval
+    uint32_t dropped;       // frames dropped because the transmit queue of the target bus was full
 };
 
 class CanObserver
@@ -65,9 +214,11 @@ class CanObserver
 public:
     CanObserver();
     virtual void handleCanFrame(CAN_FRAME *frame);
+    virtual void handleCanFDFrame(CAN_FRAME_FD *frame);
     virtual void handlePDOFrame(CAN_FRAME *frame);
     virtual void handleSDORequest(SDO_FRAME *frame);
     virtual void handleSDOResponse(SDO_FRAME *frame);
+    virtual void handleCanTimeout(uint32_t id);
     void setCANOpenMode(bool en);
     bool isCANOpen();
     void setNodeID(int id);
@@ -84,14 +235,32 @@ public:
 
     CanHandler( );
     void setup();
-    uint32_t getBusSpeed();
-    void attach(CanObserver *observer, uint32_t id, uint32_t mask, bool extended);
-    void detach(CanObserver *observer, uint32_t id, uint32_t mask);
+    uint32_t getBusSpeed(CanBusId bus = CAN_BUS_EV);
+    CanBusState getBusState(CanBusId bus = CAN_BUS_EV);
+    uint32_t getBusOffCount(CanBusId bus = CAN_BUS_EV);
+    bool attach(CanObserver *observer, uint32_t id, uint32_t mask, bool extended, CanBusId bus = CAN_BUS_EV);
+    void detach(CanObserver *observer, uint32_t id, uint32_t mask, CanBusId bus = CAN_BUS_EV);
+    void holdFilters(bool hold, CanBusId bus = CAN_BUS_EV);
+    bool canReceive(uint32_t id, uint32_t mask, bool extended, CanBusId bus = CAN_BUS_EV);
+    bool monitor(CanObserver *observer, uint32_t id, bool extended, uint32_t timeout, CanBusId bus = CAN_BUS_EV);
+    void unmonitor(CanObserver *observer, uint32_t id, bool extended, CanBusId bus = CAN_BUS_EV);
+    uint8_t getNumRxStatistics(CanBusId bus = CAN_BUS_EV);
+    CanRxStatistics *getRxStatistics(uint8_t index, CanBusId bus = CAN_BUS_EV);
+    int8_t addGatewayRule(CanGatewayRule *rule);
+    void removeGatewayRule(int8_t index);
+    CanGatewayStatistics *getGatewayStatistics(int8_t index);
     void process();
+#ifdef CFG_CAN_USE_INTERRUPT
+    void handleInterrupt(CanBusId bus); // must be public when called from the non-class ISR
+    uint32_t getRxOverflowCount(CanBusId bus = CAN_BUS_EV);
+    uint16_t getRxHighWaterMark(CanBusId bus = CAN_BUS_EV);
+#endif
+    uint32_t getTxOverflowCount(CanBusId bus = CAN_BUS_EV);
+    uint16_t getTxHighWaterMark(CanBusId bus = CAN_BUS_EV);
     void prepareOutputFrame(CAN_FRAME *frame, uint32_t id);
     void CANIO(CAN_FRAME& frame);
-    void sendFrame(CAN_FRAME& frame);
-    void sendISOTP(int id, int length, uint8_t *data);
+    bool sendFrame(CAN_FRAME& frame, CanTxPriority priority = CAN_TX_NORMAL, CanBusId bus = CAN_BUS_EV);
+    bool sendFrameFD(CAN_FRAME_FD& frame, CanBusId bus = CAN_BUS_EV);
 
     //canopen support functions
     void sendNodeStart(int id = 0);
@@ -101,8 +270,9 @@ public:
     void sendPDOMessage(int, int, unsigned char *);
     void sendSDORequest(SDO_FRAME *frame);
     void sendSDOResponse(SDO_FRAME *frame);
-    void sendHeartbeat();
-    void setMasterID(int id);   
+    bool sendHeartbeat(NMT_STATE state);
+    void setMasterID(int id);
+    int getMasterID();
 
 protected:
 
@@ -111,20 +281,126 @@ private:
         uint32_t id;    // what id to listen to
         uint32_t mask;  // the CAN frame mask to listen to
         bool extended;  // are extended frames expected
+        bool canOpen;   // observer was in CANopen mode when it attached
+        uint8_t nodeID; // CANopen node id of the observer
         CanObserver *observer;  // the observer object (e.g. a device)
     };
 
-    CanObserverData observerData[CFG_CAN_NUM_OBSERVERS];    // Can observers
-    uint32_t busSpeed;
+    struct CanRxMonitor {
+        CanRxStatistics stats;
+        CanObserver *observer;  // gets handleCanTimeout() when the deadline passes
+        uint32_t armed;         // the deadline runs from here: lastSeen or the end of a filter update
+    };
+
+    struct CanGatewayEntry {
+        CanGatewayRule rule;
+        CanGatewayStatistics stats;
+        uint32_t lastForwarded; // receive timestamp of the last forwarded frame
+        bool used;
+    };
+
+    /*
+     * Everything which belongs to one bus and its controller.
+     */
+    struct CanBus {
+        CanController *controller;
+        uint8_t number;         // 0 = CAN0, 1 = CAN1 (for the log)
+        uint8_t interruptPin;   // INT output of the controller
+        uint32_t speed;         // in kbit/s
+        CanBusState state;
+        uint32_t stateSince;    // when the state was entered (in us)
+        uint32_t lastErrorCheck; // when the error flags were read the last time (in us)
+        uint8_t errorFlags;     // error flags of the controller as read the last time
+        uint32_t busOffs;       // number of times the controller went bus-off
+        CanObserverData observerData[CFG_CAN_NUM_OBSERVERS];    // Can observers
+        CanRxMonitor rxMonitors[CFG_CAN_NUM_RX_MONITORS];   // monitored ids, in use are the first numRxMonitors
+        uint8_t numRxMonitors;
+        CanDispatchSet *stdDispatch;    // observers per standard frame id, rebuilt on attach/detach (NULL = use stdObservers)
+        uint8_t stdObservers[CFG_CAN_NUM_OBSERVERS]; // observerData entries which listen to standard frames, not in the table
+        uint8_t numStdObservers;
+        uint8_t extObservers[CFG_CAN_NUM_OBSERVERS]; // observerData entries which listen to extended frames
+        uint8_t numExtObservers;
+        uint8_t gatewayIds[0x800 / 8];  // one bit per standard id which matches a gateway rule of the bus
+        bool gatewayExtended;   // a gateway rule of the bus matches extended frames
+        CanFilterPlan filterPlan;   // masks and filters the controller is programmed with
+        bool filtersProgrammed;     // filterPlan is valid (the controller runs and got its filters)
+        bool filtersDirty;          // the observers changed, the filters have to be re-planned
+        bool filtersHeld;           // don't re-plan the filters (see holdFilters())
+        CanFilterPlan pendingPlan;  // plan which is being written to the controller
+        int8_t filterStep;          // next register of pendingPlan to write (-1 = none)
+        bool filtersOk;             // all registers of pendingPlan written so far were accepted
+        byte filterMode;            // mode to return to once pendingPlan is written
+#ifdef CFG_CAN_USE_INTERRUPT
+        CAN_FRAME rxBuffer[CFG_CAN_RX_BUFFER_SIZE];
+        volatile uint16_t rxHead, rxTail;
+        volatile uint32_t rxOverflows;  // frames dropped because rxBuffer was full
+        volatile uint16_t rxHighWaterMark; // max number of frames waiting in rxBuffer
+        uint32_t reportedOverflows;
+#ifdef CFG_CAN_MCP2518FD
+        CAN_FRAME_FD rxFdBuffer[CFG_CAN_FD_RX_BUFFER_SIZE]; // received frames with more than 8 bytes
+        volatile uint16_t rxFdHead, rxFdTail;
+#endif
+#endif
+        CAN_FRAME txBuffer[CAN_TX_NUM_PRIORITIES][CFG_CAN_TX_BUFFER_SIZE];
+        volatile uint16_t txHead[CAN_TX_NUM_PRIORITIES], txTail[CAN_TX_NUM_PRIORITIES];
+        uint32_t txOverflows;   // frames dropped because their transmit queue was full
+        uint16_t txHighWaterMark; // max number of frames waiting in the transmit queues
+        uint32_t reportedTxOverflows;
+#ifdef CFG_CAN_MCP2518FD
+        CAN_FRAME_FD txFdBuffer[CFG_CAN_FD_TX_BUFFER_SIZE]; // CAN-FD frames, sent after all classic frames
+        volatile uint16_t txFdHead, txFdTail;
+#endif
+    };
+
+    CanBus buses[CFG_CAN_NUM_BUSES];
+    CanDispatchSet evDispatch[0x800];   // the dispatch table of the EV bus
+#if CFG_CAN_NUM_BUSES > 1 && defined(CFG_CAN1_DISPATCH_TABLE)
+    CanDispatchSet carDispatch[0x800];  // the dispatch table of the car bus
+#endif
+    CanGatewayEntry gatewayRules[CFG_CAN_NUM_GATEWAY_RULES];
+    bool initialized;
 
+    CanBus *getBus(CanBusId bus);
+    void initBus(CanBus *canBus, uint8_t number, CanController *controller, uint8_t interruptPin, uint32_t speed, CanDispatchSet *dispatchTable);
+    bool initController(CanBus *canBus);
+    void superviseBus(CanBus *canBus);
+    void setBusState(CanBus *canBus, CanBusState state);
+    bool isOnline(CanBus *canBus);
     void logFrame(CAN_FRAME& frame);
-    int8_t findFreeObserverData();
+    void receiveFrames(CanBus *canBus);
+    void dispatchFrame(CanBus *canBus, CAN_FRAME& frame);
+    void dispatchFrameFD(CanBus *canBus, CAN_FRAME_FD& frame);
+    CanObserverSet findStdObservers(CanBus *canBus, uint16_t id);
+    void deliverFrame(CanObserverData *data, CAN_FRAME& frame);
+    void updateRxStatistics(CanBus *canBus, uint32_t id, bool extended, uint32_t timestamp);
+    void checkRxDeadlines(CanBus *canBus);
+    void rebuildDispatchTable(CanBus *canBus);
+    void rebuildGatewayTable(CanBus *canBus);
+    void forwardFrame(CanBus *canBus, CAN_FRAME& frame);
+    CAN_FRAME *allocateTxFrame(CanBus *canBus, CanTxPriority priority);
+    void queueTxFrame(CanBus *canBus, CanTxPriority priority);
+    void planFilters(CanBus *canBus);
+    void writeFilterRegister(CanBus *canBus);
+    void transmitQueued(CanBus *canBus);
+    void serviceTransmit(CanBus *canBus);
+    int8_t findFreeObserverData(CanBus *canBus);
 
     //canopen support functions
-    void sendNMTMsg(int, int);
+    void sendNMTMsg(int, NMT_COMMAND);
     int masterID; //what is our ID as the master node?      
 };
 
+#ifdef CFG_CAN_USE_INTERRUPT
+void canInterrupt();
+#if CFG_CAN_NUM_BUSES > 1
+void canInterrupt1();
+#endif
+#endif
+
 extern CanHandler canHandler;
+extern CanController CAN;
+#if CFG_CAN_NUM_BUSES > 1
+extern CanController CAN1;
+#endif
 
 #endif /* CAN_HANDLER_H_ */
\ No newline at end of file
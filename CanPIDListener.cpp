@@ -136,7 +136,7 @@ void CanPIDListener::handleCanFrame(CAN_FRAME *frame) {
         //here is where we'd send out response. Right now it sends over canbus but when we support other
         //alteratives they'll be sending here too.
         if (ret) {
-            canHandler.sendFrame(outputFrame);
+            canHandler.sendFrame(outputFrame, CAN_TX_DIAGNOSTIC);
         }
     }
 }
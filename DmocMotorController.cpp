@@ -44,7 +44,6 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "DmocMotorController.h"
 
 extern bool runThrottle; //TODO: remove use of global variables !
-long ms;
 Ble::BleData *btData;
 
 DmocMotorController::DmocMotorController(Ble::BleData *bleData) : MotorController() {
@@ -53,8 +52,8 @@ DmocMotorController::DmocMotorController(Ble::BleData *bleData) : MotorControlle
     selectedGear = NEUTRAL;
     operationState = DISABLED;
     actualState = DISABLED;
-    online = 0;
-    activityCount = 0;
+    online = false;
+    statusCount = 0;
 //	maxTorque = 2000;
     commonName = "DMOC645 Inverter";
     btData = bleData;
@@ -71,14 +70,18 @@ void DmocMotorController::setup() {
     // register ourselves as observer of 0x23x and 0x65x can frames
     canHandler.attach(this, 0x230, 0x7f0, false);
     canHandler.attach(this, 0x650, 0x7f0, false);
+    // the loss of the status frame takes the DMOC offline, the others are monitored for diagnostics only
+    canHandler.monitor(this, 0x23B, false, DMOC_STATUS_TIMEOUT);
+    canHandler.monitor(this, 0x23A, false, 0);
+    canHandler.monitor(this, 0x650, false, 0);
+    canHandler.monitor(this, 0x651, false, 0);
 
     running = false;
     setPowerMode(modeTorque);
     setSelectedGear(NEUTRAL);
     setOpState(DISABLED );
-    ms=millis();
 
-    tickHandler.attach(this, CFG_TICK_INTERVAL_MOTOR_CONTROLLER_DMOC);
+    tickHandler.attach(this, CFG_TICK_INTERVAL_MOTOR_CONTROLLER_DMOC, TICK_STAGE_CONTROL);
 }
 
 /*
@@ -92,9 +95,8 @@ void DmocMotorController::setup() {
 void DmocMotorController::handleCanFrame(CAN_FRAME *frame) {
     int RotorTemp, invTemp, StatorTemp;
     int temp;
-    online = true; //if a frame got to here then it passed the filter and must have been from the DMOC
 
-    Logger::info("DMOC CAN received: %X  %X  %X  %X  %X  %X  %X  %X  %X", frame->id,frame->data.bytes[0] ,frame->data.bytes[1],frame->data.bytes[2],frame->data.bytes[3],frame->data.bytes[4],frame->data.bytes[5],frame->data.bytes[6],frame->data.bytes[70]);
+    Logger::info("DMOC CAN received: %X  %X  %X  %X  %X  %X  %X  %X  %X", frame->id,frame->data.bytes[0] ,frame->data.bytes[1],frame->data.bytes[2],frame->data.bytes[3],frame->data.bytes[4],frame->data.bytes[5],frame->data.bytes[6],frame->data.bytes[7]);
 
 
     switch (frame->id) {
@@ -112,15 +114,16 @@ void DmocMotorController::handleCanFrame(CAN_FRAME *frame) {
         }
         btData->resMotorTemp = temperatureMotor;
         btData->resInvTemp = temperatureInverter;
-        activityCount++;
         break;
     case 0x23A: //torque report
         torqueActual = ((frame->data.bytes[0] * 256) + frame->data.bytes[1]) - 30000;
         btData->resTorque = torqueActual;
-        activityCount++;
         break;
 
     case 0x23B: //speed and current operation status
+        // like the activity count before, a run of status frames takes the DMOC online, not a single one
+        if (statusCount < DMOC_ONLINE_FRAMES && ++statusCount == DMOC_ONLINE_FRAMES)
+            online = true;
         speedActual = abs(((frame->data.bytes[0] * 256) + frame->data.bytes[1]) - 20000);
         temp = (OperationState) (frame->data.bytes[6] >> 4);
         //actually, the above is an operation status report which doesn't correspond
@@ -173,7 +176,6 @@ void DmocMotorController::handleCanFrame(CAN_FRAME *frame) {
 
         btData->resSpeed = speedActual;
         btData->resState = actualState;
-        activityCount++;
         break;
 
         //case 0x23E: //electrical status
@@ -187,11 +189,22 @@ void DmocMotorController::handleCanFrame(CAN_FRAME *frame) {
         btData->resDcVolt = dcVoltage;
         btData->resDcCurrent = dcCurrent;
 
-        activityCount++;
         break;
     }
 }
 
+/*
+ * CanHandler reports that the status frame of the DMOC didn't arrive in time.
+ * The next handleTick() takes us to NEUTRAL and turns the running light off.
+ */
+void DmocMotorController::handleCanTimeout(uint32_t)
+{
+    if (online)
+        Logger::info("DMOC: no status for %d ms, offline", DMOC_STATUS_TIMEOUT / 1000);
+    online = false;
+    statusCount = 0;
+}
+
 /*Do note that the DMOC expects all three command frames and it expect them to happen at least twice a second. So, probably it'd be ok to essentially
  rotate through all of them, one per tick. That gives us a time frame of 30ms for each command frame. That should be plenty fast.
 */
@@ -199,33 +212,18 @@ void DmocMotorController::handleTick() {
 
     MotorController::handleTick(); //kick the ball up to papa
 
-    if (activityCount > 0)
+    if (online)
     {
-        activityCount--;
-        if (activityCount > 60) activityCount = 60;
-        if (activityCount > 40) //If we are receiving regular CAN messages from DMOC, this will very quickly get to over 40. We'll limit
-            // it to 60 so if we lose communications, within 20 ticks we will decrement below this value.
-        {
-            Logger::debug("Enable Input Active? %T         Reverse Input Active? %T" ,systemIO.getDigitalIn(getEnableIn()),systemIO.getDigitalIn(getReverseIn()));
-            if(getEnableIn()<0)setOpState(ENABLE); //If we HAVE an enableinput 0-3, we'll let that handle opstate. Otherwise set it to ENABLE
-            if(getReverseIn()<0)setSelectedGear(DRIVE); //If we HAVE a reverse input, we'll let that determine forward/reverse.  Otherwise set it to DRIVE
-        }
+        running = true;
+        Logger::debug("Enable Input Active? %T         Reverse Input Active? %T" ,systemIO.getDigitalIn(getEnableIn()),systemIO.getDigitalIn(getReverseIn()));
+        if(getEnableIn()<0)setOpState(ENABLE); //If we HAVE an enableinput 0-3, we'll let that handle opstate. Otherwise set it to ENABLE
+        if(getReverseIn()<0)setSelectedGear(DRIVE); //If we HAVE a reverse input, we'll let that determine forward/reverse.  Otherwise set it to DRIVE
     }
     else {
-        setSelectedGear(NEUTRAL); //We will stay in NEUTRAL until we get at least 40 frames ahead indicating continous communications.
-    }
-
-    if(!online)  //This routine checks to see if we have received any frames from the inverter.  If so, ONLINE would be true and
-    {   //we set the RUNNING light on.  If no frames are received for 2 seconds, we set running OFF.
-        if ((millis()-ms)>2000)
-        {
-            running=false; // We haven't received any frames for over 2 seconds.  Otherwise online would be true.
-            ms=millis();   //Reset our 2 second timer
-        }
+        running = false;
+        setSelectedGear(NEUTRAL); //We will stay in NEUTRAL until the DMOC reports its status again.
     }
-    else running=true;
-    online=false;//This flag will be set to 1 by received frames.
-
+    canHandler.holdFilters(running); // re-programming the filters would cut us off from the DMOC
 
     sendCmd1();  //This actually sets our GEAR and our actualstate cycle
     sendCmd2();  //This is our torque command
@@ -233,6 +231,8 @@ void DmocMotorController::handleTick() {
     //sendCmd4();  //These appear to be not needed.
     //sendCmd5();  //But we'll keep them for future reference
 
+    updateControlCycles();
+
 
 }
 
@@ -248,7 +248,7 @@ void DmocMotorController::sendCmd1() {
     output.rtr = 0;
 
     if (throttleRequested > 0 && operationState == ENABLE && selectedGear != NEUTRAL && powerMode == modeSpeed)
-        speedRequested = 20000 + (((long) throttleRequested * (long) config->speedMax) / 1000);
+        speedRequested = 20000 + q16Mul(throttleRequested, speedScale);
     else
         speedRequested = 20000;
     output.data.bytes[0] = (speedRequested & 0xFF00) >> 8;
@@ -282,7 +282,7 @@ void DmocMotorController::sendCmd1() {
     Logger::debug("DMOC 0x232 tx: %X %X %X %X %X %X %X %X", output.data.bytes[0], output.data.bytes[1], output.data.bytes[2], output.data.bytes[3],
                   output.data.bytes[4], output.data.bytes[5], output.data.bytes[6], output.data.bytes[7]);
 
-    canHandler.sendFrame(output);
+    canHandler.sendFrame(output, CAN_TX_CONTROL);
 }
 
 void DmocMotorController::taperRegen()
@@ -290,9 +290,8 @@ void DmocMotorController::taperRegen()
     DmocMotorControllerConfiguration *config = (DmocMotorControllerConfiguration *)getConfiguration();
     if (speedActual < config->regenTaperLower) torqueRequested = 0;
     else {        
-        int32_t range = config->regenTaperUpper - config->regenTaperLower; //next phase is to not hard code this
-        int32_t taper = speedActual - config->regenTaperLower;
-        int32_t calc = (torqueRequested * taper) / range;
+        int32_t taper = speedActual - config->regenTaperLower; // divided by (regenTaperUpper - regenTaperLower)
+        int32_t calc = mulShift(torqueRequested * taper, taperReciprocal, 24);
         torqueRequested = (int16_t)calc;
     }
 }
@@ -316,11 +315,11 @@ void DmocMotorController::sendCmd2() {
     torqueRequested=0;
     if (actualState == ENABLE) { //don't even try sending torque commands until the DMOC reports it is ready
         if (selectedGear == DRIVE) {
-            torqueRequested = (((long) throttleRequested * (long) config->torqueMax) / 1000L);
+            torqueRequested = q16Mul16(throttleRequested, torqueScale);
             //if (speedActual < config->regenTaperUpper && torqueRequested < 0) taperRegen();
         }
         if (selectedGear == REVERSE) {
-            torqueRequested = (((long) throttleRequested * -1 *(long) config->torqueMax) / 1000L);//If reversed, regen becomes positive torque and positive pedal becomes regen.  Let's reverse this by reversing the sign.  In this way, we'll have gradually diminishing positive torque (in reverse, regen) followed by gradually increasing regen (positive torque in reverse.)
+            torqueRequested = q16Mul16(-throttleRequested, torqueScale);//If reversed, regen becomes positive torque and positive pedal becomes regen.  Let's reverse this by reversing the sign.  In this way, we'll have gradually diminishing positive torque (in reverse, regen) followed by gradually increasing regen (positive torque in reverse.)
             //if (speedActual < config->regenTaperUpper && torqueRequested > 0) taperRegen();
         }
     }
@@ -331,7 +330,7 @@ void DmocMotorController::sendCmd2() {
             torqueCommand+=torqueRequested;   //If actual rpm is less than max rpm, add torque to offset
         }
         else {
-            torqueCommand += torqueRequested /1.3;   // else torque is reduced
+            torqueCommand += q16Mul(torqueRequested, Q16(1 / 1.3));   // else torque is reduced
         }
         output.data.bytes[0] = (torqueCommand & 0xFF00) >> 8;
         output.data.bytes[1] = (torqueCommand & 0x00FF);
@@ -360,7 +359,8 @@ void DmocMotorController::sendCmd2() {
 
     //Logger::debug("requested torque: %i",(((long) throttleRequested * (long) maxTorque) / 1000L));
 
-    canHandler.sendFrame(output);
+    canHandler.sendFrame(output, CAN_TX_CONTROL);
+    updatePedalLatency();
     timestamp();
     Logger::debug("Torque command: %X  %X  %X  %X  %X  %X  %X  CRC: %X",output.data.bytes[0],
                   output.data.bytes[1],output.data.bytes[2],output.data.bytes[3],output.data.bytes[4],output.data.bytes[5],output.data.bytes[6],output.data.bytes[7]);
@@ -390,7 +390,7 @@ void DmocMotorController::sendCmd3() {
     btData->reqRegen = regenCalc;
     btData->reqAccel = accelCalc;
 
-    canHandler.sendFrame(output);
+    canHandler.sendFrame(output, CAN_TX_CONTROL);
 }
 
 //challenge/response frame 1 - Really doesn't contain anything we need I dont think
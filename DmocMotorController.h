@@ -37,6 +37,9 @@
 #include "TickHandler.h"
 #include "CanHandler.h"
 
+#define DMOC_STATUS_TIMEOUT 30000 // the DMOC is offline if 0x23B (sent every 10ms) is missing for this long (in microseconds)
+#define DMOC_ONLINE_FRAMES  40    // status frames (0x23B) in a row which take the DMOC online
+
 /*
  * Class for DMOC specific configuration parameters
  */
@@ -64,6 +67,7 @@ public:
 public:
     virtual void handleTick();
     virtual void handleCanFrame(CAN_FRAME *frame);
+    virtual void handleCanTimeout(uint32_t id);
     virtual void setup();
     void setGear(Gears gear);
 
@@ -77,9 +81,9 @@ private:
 
     OperationState actualState; //what the controller is reporting it is
     int step;
-    byte online; //counter for whether DMOC appears to be operating
+    bool online; // the DMOC reports its status (0x23B) in time
+    uint8_t statusCount; // status frames received since the last timeout (up to DMOC_ONLINE_FRAMES)
     byte alive;
-    int activityCount;
     uint16_t torqueCommand;
     void timestamp();
 
@@ -0,0 +1,116 @@
+/*
+ * FixedPoint.h
+ *
+ * Division free fixed point arithmetic for the control path. The SAMD21 (Cortex-M0+)
+ * has neither an FPU nor a hardware divider: every division calls a library routine
+ * and a floating point operation is emulated in software. Scale factors are therefore
+ * converted to Q16.16 factors or reciprocals once (e.g. in loadConfiguration()) and
+ * the tick only multiplies and shifts. Results saturate instead of wrapping around.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef FIXED_POINT_H_
+#define FIXED_POINT_H_
+
+#include <Arduino.h>
+
+typedef int32_t q16_t; // signed Q16.16: 16 integer and 16 fractional bits
+
+#define Q16_SHIFT 16
+#define Q16_ONE   ((q16_t) 1 << Q16_SHIFT)
+#define Q16(x)    ((q16_t) ((x) * Q16_ONE + ((x) < 0 ? -0.5 : 0.5))) // for constants only, folded by the compiler
+#define RECIPROCAL(divisor, shift) ((int32_t) ((((int64_t) 1 << (shift)) + (divisor) / 2) / (divisor))) // see reciprocal(), for constant divisors
+
+/*
+ * Limit a value to the range of int16_t.
+ */
+static inline int16_t saturate16(int32_t value) {
+    if (value > INT16_MAX)
+        return INT16_MAX;
+    if (value < INT16_MIN)
+        return INT16_MIN;
+    return value;
+}
+
+/*
+ * Limit a value to the range of int32_t.
+ */
+static inline int32_t saturate32(int64_t value) {
+    if (value > INT32_MAX)
+        return INT32_MAX;
+    if (value < INT32_MIN)
+        return INT32_MIN;
+    return value;
+}
+
+static inline int16_t addSat16(int16_t a, int16_t b) {
+    return saturate16((int32_t) a + b);
+}
+
+static inline int16_t subSat16(int16_t a, int16_t b) {
+    return saturate16((int32_t) a - b);
+}
+
+/*
+ * value * factor / 2^shift, rounded to nearest and saturated.
+ */
+static inline int32_t mulShift(int32_t value, int32_t factor, uint8_t shift) {
+    return saturate32(((int64_t) value * factor + ((int64_t) 1 << (shift - 1))) >> shift);
+}
+
+/*
+ * value * factor with a Q16.16 factor, rounded to nearest and saturated.
+ */
+static inline int32_t q16Mul(int32_t value, q16_t factor) {
+    return mulShift(value, factor, Q16_SHIFT);
+}
+
+static inline int16_t q16Mul16(int32_t value, q16_t factor) {
+    return saturate16(q16Mul(value, factor));
+}
+
+/*
+ * numerator / denominator as Q16.16 factor (saturated, 0 if the denominator is 0).
+ * This divides, so call it when the configuration is loaded, not in the tick.
+ */
+static inline q16_t q16Ratio(int32_t numerator, int32_t denominator) {
+    if (denominator == 0)
+        return 0;
+    int64_t scaled = (int64_t) numerator << Q16_SHIFT;
+    int64_t half = (denominator > 0 ? denominator : -denominator) / 2;
+    return saturate32((scaled + (scaled < 0 ? -half : half)) / denominator);
+}
+
+/*
+ * The reciprocal of a divisor for mulShift(): value / divisor is approximated by
+ * mulShift(value, reciprocal(divisor, shift), shift). A larger shift is more precise,
+ * value * reciprocal has to fit in 64 bits. Call it when the configuration is loaded.
+ */
+static inline int32_t reciprocal(int32_t divisor, uint8_t shift) {
+    if (divisor == 0)
+        return 0;
+    int64_t one = (int64_t) 1 << shift;
+    return saturate32((one + (divisor > 0 ? divisor : -divisor) / 2) / divisor);
+}
+
+#endif /* FIXED_POINT_H_ */
@@ -0,0 +1,521 @@
+/*
+ * IsoTp.cpp
+ *
+ * A session connects a pair of CAN ids (the one we send with and the one we listen to)
+ * with an IsoTpObserver. Transmission and reception of a session run independently,
+ * so a request may arrive while the previous reply is still being sent. Everything
+ * which depends on time (STmin pacing, N_As/N_Bs/N_Cr) is handled by process().
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "IsoTp.h"
+
+IsoTpHandler isoTpHandler;
+
+IsoTpHandler::IsoTpHandler() : CanObserver()
+{
+    for (int i = 0; i < CFG_ISOTP_NUM_SESSIONS; i++)
+    {
+        sessions[i].observer = NULL;
+    }
+}
+
+/*
+ * Open a session and subscribe to its receive id.
+ *
+ * \param observer - gets the received messages and the results of the transmissions
+ * \param txId - CAN id of the frames we send (e.g. 0x7E8)
+ * \param rxId - CAN id of the frames we receive (e.g. 0x7E0)
+ * \param extended - set if both ids are extended ids
+ * \param rxBuffer - messages are reassembled in here, it must stay valid until close()
+ * \param rxSize - size of rxBuffer, longer messages are rejected with an overflow flow control
+ * \retval the session or -1 if all CFG_ISOTP_NUM_SESSIONS sessions or all CAN observers
+ *         are in use or the CAN filters are held (the motor runs) and don't pass rxId
+ */
+int8_t IsoTpHandler::open(IsoTpObserver *observer, uint32_t txId, uint32_t rxId, bool extended, uint8_t *rxBuffer, uint16_t rxSize)
+{
+    if (!canHandler.canReceive(rxId, (extended ? 0x1FFFFFFF : 0x7FF), extended))
+    {
+        Logger::info("ISO-TP: id %X can't be received while the CAN filters are held", rxId);
+        return -1;
+    }
+
+    for (int8_t i = 0; i < CFG_ISOTP_NUM_SESSIONS; i++)
+    {
+        Session *session = &sessions[i];
+
+        if (session->observer != NULL)
+            continue;
+
+        session->observer = observer;
+        session->txId = txId;
+        session->rxId = rxId;
+        session->extended = extended;
+        session->txState = TX_IDLE;
+        session->txData = NULL;
+        session->rxState = RX_IDLE;
+        session->rxBuffer = rxBuffer;
+        session->rxSize = rxSize;
+        if (!canHandler.attach(this, rxId, (extended ? 0x1FFFFFFF : 0x7FF), extended))
+        {
+            session->observer = NULL;
+            return -1;
+        }
+        return i;
+    }
+    Logger::debug("no free ISO-TP session, increase CFG_ISOTP_NUM_SESSIONS");
+    return -1;
+}
+
+/*
+ * Close a session, a transmission or reception in progress is dropped silently.
+ * While the CAN filters are held, they keep passing rxId until they are released.
+ */
+void IsoTpHandler::close(int8_t session)
+{
+    if (session < 0 || session >= CFG_ISOTP_NUM_SESSIONS || sessions[session].observer == NULL)
+        return;
+
+    canHandler.detach(this, sessions[session].rxId, (sessions[session].extended ? 0x1FFFFFFF : 0x7FF));
+    sessions[session].observer = NULL;
+}
+
+/*
+ * Start sending a message. The data is not copied, it must not change until the
+ * observer's handleIsoTpSent() is called. A single frame is queued right away.
+ *
+ * \param session - the session to send on
+ * \param data - the message
+ * \param length - 1 to ISOTP_MAX_LENGTH bytes
+ * \retval false if the session is still sending or the length is out of range
+ */
+bool IsoTpHandler::send(int8_t session, const uint8_t *data, uint16_t length)
+{
+    if (session < 0 || session >= CFG_ISOTP_NUM_SESSIONS || sessions[session].observer == NULL)
+        return false;
+    Session *s = &sessions[session];
+    if (s->txState != TX_IDLE || length == 0 || length > ISOTP_MAX_LENGTH)
+        return false;
+
+    uint32_t now = micros();
+    s->txData = data;
+    s->txLength = length;
+    s->txOffset = 0;
+    s->txState = TX_SEND_FIRST;
+    s->txDeadline = now + ISOTP_TIMEOUT_N_AS;
+    processTransmit(session, now);
+    return true;
+}
+
+/*
+ * Check if a message is being sent on a session.
+ */
+bool IsoTpHandler::isSending(int8_t session)
+{
+    if (session < 0 || session >= CFG_ISOTP_NUM_SESSIONS || sessions[session].observer == NULL)
+        return false;
+    return sessions[session].txState != TX_IDLE;
+}
+
+/*
+ * Send the frames which are due and check the timeouts. To be called from loop().
+ */
+void IsoTpHandler::process()
+{
+    uint32_t now = micros();
+
+    for (int8_t i = 0; i < CFG_ISOTP_NUM_SESSIONS; i++)
+    {
+        if (sessions[i].observer == NULL)
+            continue;
+        processTransmit(i, now);
+        processReceive(i, now);
+    }
+}
+
+/*
+ * Advance the transmission of a session: queue the single or first frame, watch for
+ * the flow control and queue the consecutive frames once STmin passed. A full transmit
+ * queue is retried on the next call until N_As expires.
+ */
+void IsoTpHandler::processTransmit(int8_t index, uint32_t now)
+{
+    Session *s = &sessions[index];
+    CAN_FRAME frame;
+
+    switch (s->txState)
+    {
+    case TX_IDLE:
+        break;
+
+    case TX_SEND_FIRST:
+        prepareFrame(s, &frame);
+        if (s->txLength < 8)
+        {
+            frame.data.bytes[0] = ISOTP_SINGLE | s->txLength;
+            memcpy(&frame.data.bytes[1], s->txData, s->txLength);
+            if (canHandler.sendFrame(frame, CAN_TX_DIAGNOSTIC))
+            {
+                finishTransmit(index, ISOTP_OK);
+                return;
+            }
+        }
+        else
+        {
+            frame.data.bytes[0] = ISOTP_FIRST | (s->txLength >> 8);
+            frame.data.bytes[1] = s->txLength & 0xFF;
+            memcpy(&frame.data.bytes[2], s->txData, 6);
+            if (canHandler.sendFrame(frame, CAN_TX_DIAGNOSTIC))
+            {
+                s->txOffset = 6;
+                s->txSequence = 1;
+                s->txWaitCount = 0;
+                s->txState = TX_WAIT_FLOW;
+                s->txDeadline = now + ISOTP_TIMEOUT_N_BS;
+                return;
+            }
+        }
+        if ((int32_t)(now - s->txDeadline) > 0)
+            finishTransmit(index, ISOTP_TIMEOUT_A);
+        break;
+
+    case TX_WAIT_FLOW:
+        if ((int32_t)(now - s->txDeadline) > 0)
+            finishTransmit(index, ISOTP_TIMEOUT_BS);
+        break;
+
+    case TX_SEND_CONSECUTIVE:
+        for (int i = 0; i < ISOTP_MAX_FRAMES_PER_PASS; i++)
+        {
+            if ((int32_t)(now - s->txTime) < 0)
+                return; // STmin not over yet
+
+            uint16_t count = s->txLength - s->txOffset;
+            if (count > 7)
+                count = 7;
+            prepareFrame(s, &frame);
+            frame.data.bytes[0] = ISOTP_CONSECUTIVE | s->txSequence;
+            memcpy(&frame.data.bytes[1], s->txData + s->txOffset, count);
+            if (!canHandler.sendFrame(frame, CAN_TX_DIAGNOSTIC))
+            {
+                if ((int32_t)(now - s->txDeadline) > 0)
+                    finishTransmit(index, ISOTP_TIMEOUT_A);
+                return;
+            }
+
+            s->txOffset += count;
+            s->txSequence = (s->txSequence + 1) & 0x0F;
+            s->txTime = now + s->txSeparation;
+            s->txDeadline = now + ISOTP_TIMEOUT_N_AS;
+            if (s->txOffset >= s->txLength)
+            {
+                finishTransmit(index, ISOTP_OK);
+                return;
+            }
+            if (s->txBlockSize != 0 && ++s->txBlockCount >= s->txBlockSize)
+            {
+                s->txState = TX_WAIT_FLOW;
+                s->txDeadline = now + ISOTP_TIMEOUT_N_BS;
+                return;
+            }
+        }
+        break;
+    }
+}
+
+/*
+ * Retry a flow control frame which didn't fit into the transmit queue and watch N_Cr.
+ */
+void IsoTpHandler::processReceive(int8_t index, uint32_t now)
+{
+    Session *s = &sessions[index];
+
+    switch (s->rxState)
+    {
+    case RX_IDLE:
+        break;
+
+    case RX_SEND_FLOW:
+        if (sendFlowControl(s))
+        {
+            s->rxState = RX_WAIT_CONSECUTIVE;
+            s->rxDeadline = now + ISOTP_TIMEOUT_N_CR;
+        }
+        else if ((int32_t)(now - s->rxDeadline) > 0)
+            abortReceive(index, ISOTP_TIMEOUT_A);
+        break;
+
+    case RX_WAIT_CONSECUTIVE:
+        if ((int32_t)(now - s->rxDeadline) > 0)
+            abortReceive(index, ISOTP_TIMEOUT_CR);
+        break;
+    }
+}
+
+/*
+ * Route a received frame to the session listening to its id.
+ */
+void IsoTpHandler::handleCanFrame(CAN_FRAME *frame)
+{
+    if (frame->length == 0)
+        return;
+
+    for (int8_t i = 0; i < CFG_ISOTP_NUM_SESSIONS; i++)
+    {
+        Session *s = &sessions[i];
+
+        if (s->observer == NULL || s->rxId != frame->id || s->extended != (bool)frame->extended)
+            continue;
+
+        switch (frame->data.bytes[0] & 0xF0)
+        {
+        case ISOTP_SINGLE:
+            handleSingleFrame(i, frame);
+            break;
+        case ISOTP_FIRST:
+            handleFirstFrame(i, frame);
+            break;
+        case ISOTP_CONSECUTIVE:
+            handleConsecutiveFrame(i, frame);
+            break;
+        case ISOTP_FLOW_CONTROL:
+            handleFlowControl(i, frame);
+            break;
+        }
+    }
+}
+
+/*
+ * The receiver tells us how to go on after a first frame or a block of consecutive
+ * frames. The first consecutive frame of a block is sent right away.
+ */
+void IsoTpHandler::handleFlowControl(int8_t index, CAN_FRAME *frame)
+{
+    Session *s = &sessions[index];
+    uint32_t now = micros();
+
+    if (s->txState != TX_WAIT_FLOW || frame->length < 3)
+        return;
+
+    switch (frame->data.bytes[0] & 0x0F)
+    {
+    case ISOTP_CONTINUE_TO_SEND:
+        s->txBlockSize = frame->data.bytes[1];
+        s->txBlockCount = 0;
+        s->txSeparation = separationTime(frame->data.bytes[2]);
+        s->txWaitCount = 0;
+        s->txState = TX_SEND_CONSECUTIVE;
+        s->txTime = now;
+        s->txDeadline = now + ISOTP_TIMEOUT_N_AS;
+        processTransmit(index, now);
+        break;
+    case ISOTP_WAIT:
+        if (++s->txWaitCount > ISOTP_MAX_WAIT_FRAMES)
+            finishTransmit(index, ISOTP_WFT_OVRN);
+        else
+            s->txDeadline = now + ISOTP_TIMEOUT_N_BS;
+        break;
+    case ISOTP_OVERFLOW:
+        finishTransmit(index, ISOTP_BUFFER_OVFLW);
+        break;
+    default:
+        finishTransmit(index, ISOTP_INVALID_FS);
+        break;
+    }
+}
+
+/*
+ * A complete message in one frame. It interrupts a message being received, the observer
+ * learns about that (or about a message too long for the buffer) by one receive error.
+ */
+void IsoTpHandler::handleSingleFrame(int8_t index, CAN_FRAME *frame)
+{
+    Session *s = &sessions[index];
+    uint8_t length = frame->data.bytes[0] & 0x0F;
+
+    if (length == 0 || length > frame->length - 1)
+        return; // invalid, to be ignored
+    if (length > s->rxSize)
+    {
+        abortReceive(index, (s->rxState != RX_IDLE ? ISOTP_UNEXP_PDU : ISOTP_BUFFER_OVFLW));
+        return;
+    }
+    if (s->rxState != RX_IDLE)
+        abortReceive(index, ISOTP_UNEXP_PDU);
+
+    memcpy(s->rxBuffer, &frame->data.bytes[1], length);
+    s->observer->handleIsoTpMessage(index, s->rxBuffer, length);
+}
+
+/*
+ * Start reassembling a segmented message and ask the sender for the consecutive frames.
+ * If it doesn't fit into the buffer, the sender is told so by an overflow flow control.
+ * A message being received is dropped, the observer gets one receive error either way.
+ */
+void IsoTpHandler::handleFirstFrame(int8_t index, CAN_FRAME *frame)
+{
+    Session *s = &sessions[index];
+    uint16_t length = ((frame->data.bytes[0] & 0x0F) << 8) | frame->data.bytes[1];
+    uint32_t now = micros();
+
+    if (frame->length < 8 || length < 8)
+        return; // invalid, to be ignored
+    if (length > s->rxSize)
+    {
+        s->rxFlowStatus = ISOTP_OVERFLOW;
+        sendFlowControl(s);
+        abortReceive(index, (s->rxState != RX_IDLE ? ISOTP_UNEXP_PDU : ISOTP_BUFFER_OVFLW));
+        return;
+    }
+    if (s->rxState != RX_IDLE)
+        abortReceive(index, ISOTP_UNEXP_PDU);
+
+    memcpy(s->rxBuffer, &frame->data.bytes[2], 6);
+    s->rxLength = length;
+    s->rxOffset = 6;
+    s->rxSequence = 1;
+    s->rxBlockCount = 0;
+    s->rxFlowStatus = ISOTP_CONTINUE_TO_SEND;
+    s->rxState = RX_SEND_FLOW;
+    s->rxDeadline = now + ISOTP_TIMEOUT_N_AS;
+    processReceive(index, now);
+}
+
+/*
+ * Append a consecutive frame to the message. After CFG_ISOTP_BLOCK_SIZE frames the
+ * sender waits for the next flow control.
+ */
+void IsoTpHandler::handleConsecutiveFrame(int8_t index, CAN_FRAME *frame)
+{
+    Session *s = &sessions[index];
+    uint32_t now = micros();
+
+    if (s->rxState != RX_WAIT_CONSECUTIVE)
+        return; // not expected, to be ignored
+    if ((frame->data.bytes[0] & 0x0F) != s->rxSequence)
+    {
+        abortReceive(index, ISOTP_WRONG_SN);
+        return;
+    }
+
+    uint16_t count = s->rxLength - s->rxOffset;
+    if (count > 7)
+        count = 7;
+    if (frame->length - 1 < count)
+        return; // too short, to be ignored
+
+    memcpy(s->rxBuffer + s->rxOffset, &frame->data.bytes[1], count);
+    s->rxOffset += count;
+    s->rxSequence = (s->rxSequence + 1) & 0x0F;
+    s->rxDeadline = now + ISOTP_TIMEOUT_N_CR;
+
+    if (s->rxOffset >= s->rxLength)
+    {
+        s->rxState = RX_IDLE;
+        s->observer->handleIsoTpMessage(index, s->rxBuffer, s->rxLength);
+    }
+    else if (CFG_ISOTP_BLOCK_SIZE != 0 && ++s->rxBlockCount >= CFG_ISOTP_BLOCK_SIZE)
+    {
+        s->rxBlockCount = 0;
+        s->rxState = RX_SEND_FLOW;
+        s->rxDeadline = now + ISOTP_TIMEOUT_N_AS;
+        processReceive(index, now);
+    }
+}
+
+/*
+ * Fill in id and padding of a frame of the session.
+ */
+void IsoTpHandler::prepareFrame(Session *session, CAN_FRAME *frame)
+{
+    frame->id = session->txId;
+    frame->extended = session->extended;
+    frame->rtr = 0;
+    frame->length = 8;
+    memset(frame->data.bytes, ISOTP_PADDING, 8);
+}
+
+/*
+ * Queue a flow control frame with our block size and STmin.
+ *
+ * \retval false if the transmit queue is full
+ */
+bool IsoTpHandler::sendFlowControl(Session *session)
+{
+    CAN_FRAME frame;
+
+    prepareFrame(session, &frame);
+    frame.data.bytes[0] = ISOTP_FLOW_CONTROL | session->rxFlowStatus;
+    frame.data.bytes[1] = CFG_ISOTP_BLOCK_SIZE;
+    frame.data.bytes[2] = CFG_ISOTP_STMIN;
+    return canHandler.sendFrame(frame, CAN_TX_DIAGNOSTIC);
+}
+
+void IsoTpHandler::finishTransmit(int8_t index, IsoTpResult result)
+{
+    Session *s = &sessions[index];
+
+    s->txState = TX_IDLE;
+    s->txData = NULL;
+    if (result != ISOTP_OK)
+        Logger::debug("ISO-TP: transmission on id %X failed (%d)", s->txId, result);
+    s->observer->handleIsoTpSent(index, result);
+}
+
+void IsoTpHandler::abortReceive(int8_t index, IsoTpResult result)
+{
+    Session *s = &sessions[index];
+
+    s->rxState = RX_IDLE;
+    Logger::debug("ISO-TP: reception on id %X failed (%d)", s->rxId, result);
+    s->observer->handleIsoTpReceiveError(index, result);
+}
+
+/*
+ * Convert the STmin parameter of a flow control frame to microseconds: 0-127ms, or
+ * 100-900us for 0xF1-0xF9. Reserved values mean the longest time (127ms).
+ */
+uint32_t IsoTpHandler::separationTime(uint8_t stMin)
+{
+    if (stMin <= 0x7F)
+        return stMin * 1000;
+    if (stMin >= 0xF1 && stMin <= 0xF9)
+        return (stMin - 0xF0) * 100;
+    return 127000;
+}
+
+void IsoTpObserver::handleIsoTpMessage(int8_t session, uint8_t *, uint16_t)
+{
+    Logger::debug("IsoTpObserver does not implement handleIsoTpMessage(), session=%d", session);
+}
+
+void IsoTpObserver::handleIsoTpReceiveError(int8_t session, IsoTpResult)
+{
+    Logger::debug("IsoTpObserver does not implement handleIsoTpReceiveError(), session=%d", session);
+}
+
+void IsoTpObserver::handleIsoTpSent(int8_t session, IsoTpResult)
+{
+    Logger::debug("IsoTpObserver does not implement handleIsoTpSent(), session=%d", session);
+}
@@ -0,0 +1,160 @@
+/*
+ * IsoTp.h
+ *
+ * ISO 15765-2 transport protocol (ISO-TP) on top of CanHandler: messages of up to
+ * 4095 bytes are segmented into a first frame and consecutive frames, paced by the
+ * block size and STmin of the receiver's flow control frames. Received messages are
+ * reassembled in place into a buffer provided by the owner of the session.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef ISO_TP_H_
+#define ISO_TP_H_
+
+#include <Arduino.h>
+#include "config.h"
+#include "CanHandler.h"
+
+#define ISOTP_MAX_LENGTH            4095    // the longest message the 12 bit length of a first frame can announce
+#define ISOTP_PADDING               0xCC    // value of the unused bytes, all frames are sent with 8 bytes
+#define ISOTP_TIMEOUT_N_AS          1000000 // max time until a frame is taken by the transmit queue (in microseconds)
+#define ISOTP_TIMEOUT_N_BS          1000000 // max time to wait for a flow control frame (in microseconds)
+#define ISOTP_TIMEOUT_N_CR          1000000 // max time to wait for a consecutive frame (in microseconds)
+#define ISOTP_MAX_WAIT_FRAMES       10      // max number of flow control frames with "wait" in a row (N_WFTmax)
+#define ISOTP_MAX_FRAMES_PER_PASS   4       // consecutive frames queued per session and call of process() (if STmin is 0)
+
+/*
+ * Protocol control information, the upper nibble of the first data byte.
+ */
+enum IsoTpFrameType
+{
+    ISOTP_SINGLE = 0x00,
+    ISOTP_FIRST = 0x10,
+    ISOTP_CONSECUTIVE = 0x20,
+    ISOTP_FLOW_CONTROL = 0x30
+};
+
+enum IsoTpFlowStatus
+{
+    ISOTP_CONTINUE_TO_SEND = 0,
+    ISOTP_WAIT = 1,
+    ISOTP_OVERFLOW = 2
+};
+
+/*
+ * Outcome of a transmission or reception (the N_Result of ISO 15765-2).
+ */
+enum IsoTpResult
+{
+    ISOTP_OK = 0,
+    ISOTP_TIMEOUT_A,        // a frame couldn't be queued for transmission in time
+    ISOTP_TIMEOUT_BS,       // the receiver didn't send a flow control frame in time
+    ISOTP_TIMEOUT_CR,       // the sender didn't send the next consecutive frame in time
+    ISOTP_WRONG_SN,         // a consecutive frame with an unexpected sequence number was received
+    ISOTP_INVALID_FS,       // a flow control frame with an unknown flow status was received
+    ISOTP_UNEXP_PDU,        // a new message started before the current one was complete
+    ISOTP_WFT_OVRN,         // the receiver sent more than ISOTP_MAX_WAIT_FRAMES "wait" flow controls
+    ISOTP_BUFFER_OVFLW      // the message doesn't fit into the receive buffer
+};
+
+class IsoTpObserver
+{
+public:
+    virtual void handleIsoTpMessage(int8_t session, uint8_t *data, uint16_t length);
+    virtual void handleIsoTpReceiveError(int8_t session, IsoTpResult result);
+    virtual void handleIsoTpSent(int8_t session, IsoTpResult result);
+};
+
+class IsoTpHandler : public CanObserver
+{
+public:
+    IsoTpHandler();
+    int8_t open(IsoTpObserver *observer, uint32_t txId, uint32_t rxId, bool extended, uint8_t *rxBuffer, uint16_t rxSize);
+    void close(int8_t session);
+    bool send(int8_t session, const uint8_t *data, uint16_t length);
+    bool isSending(int8_t session);
+    void process();
+    void handleCanFrame(CAN_FRAME *frame);
+
+private:
+    enum TxState {
+        TX_IDLE,
+        TX_SEND_FIRST,      // the single or first frame waits for room in the transmit queue
+        TX_WAIT_FLOW,       // the first frame or a block is out, waiting for flow control
+        TX_SEND_CONSECUTIVE // sending consecutive frames, paced by STmin
+    };
+
+    enum RxState {
+        RX_IDLE,
+        RX_SEND_FLOW,       // a flow control frame waits for room in the transmit queue
+        RX_WAIT_CONSECUTIVE // waiting for the next consecutive frame
+    };
+
+    struct Session {
+        IsoTpObserver *observer;    // NULL if the session is not in use
+        uint32_t txId;
+        uint32_t rxId;
+        bool extended;
+
+        TxState txState;
+        const uint8_t *txData;      // the message being sent, owned by the observer
+        uint16_t txLength;
+        uint16_t txOffset;          // bytes of txData sent so far
+        uint8_t txSequence;         // sequence number of the next consecutive frame
+        uint8_t txBlockSize;        // consecutive frames until the next flow control (0 = unlimited)
+        uint8_t txBlockCount;       // consecutive frames sent in the current block
+        uint8_t txWaitCount;        // "wait" flow controls received in a row
+        uint32_t txSeparation;      // STmin of the receiver in microseconds
+        uint32_t txTime;            // when the next frame may be sent
+        uint32_t txDeadline;        // N_As or N_Bs
+
+        RxState rxState;
+        uint8_t *rxBuffer;          // the reassembly buffer, owned by the observer
+        uint16_t rxSize;
+        uint16_t rxLength;          // length announced by the first frame
+        uint16_t rxOffset;          // bytes received so far
+        uint8_t rxSequence;         // expected sequence number of the next consecutive frame
+        uint8_t rxBlockCount;       // consecutive frames received in the current block
+        IsoTpFlowStatus rxFlowStatus; // flow status of the pending flow control frame
+        uint32_t rxDeadline;        // N_Cr (or N_Ar while the flow control is pending)
+    };
+
+    Session sessions[CFG_ISOTP_NUM_SESSIONS];
+
+    void prepareFrame(Session *session, CAN_FRAME *frame);
+    bool sendFlowControl(Session *session);
+    void processTransmit(int8_t index, uint32_t now);
+    void processReceive(int8_t index, uint32_t now);
+    void handleFlowControl(int8_t index, CAN_FRAME *frame);
+    void handleSingleFrame(int8_t index, CAN_FRAME *frame);
+    void handleFirstFrame(int8_t index, CAN_FRAME *frame);
+    void handleConsecutiveFrame(int8_t index, CAN_FRAME *frame);
+    void finishTransmit(int8_t index, IsoTpResult result);
+    void abortReceive(int8_t index, IsoTpResult result);
+    static uint32_t separationTime(uint8_t stMin);
+};
+
+extern IsoTpHandler isoTpHandler;
+
+#endif /* ISO_TP_H_ */
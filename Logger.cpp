@@ -28,6 +28,14 @@
 
 Logger::LogLevel Logger::logLevel = Logger::Info;
 uint32_t Logger::lastLogTime = 0;
+#ifdef CFG_LOG_DEFERRED
+boolean Logger::deferred = false;
+Logger::LogRecord Logger::buffer[CFG_LOG_BUFFER_SIZE];
+volatile uint16_t Logger::bufferHead = 0;
+volatile uint16_t Logger::bufferTail = 0;
+volatile uint32_t Logger::dropped = 0;
+uint32_t Logger::reportedDropped = 0;
+#endif
 
 /*
  * Output a debug message with a variable amount of parameters.
@@ -84,12 +92,12 @@ void Logger::info(DeviceId deviceId, const char *message, ...) {
 
 /*
  * Output a comnsole message with a variable amount of parameters
- * printf() style, see Logger::logMessage()
+ * printf() style, see Logger::log()
  */
 void Logger::console(const char *message, ...) {
     va_list args;
     va_start(args, message);
-    Logger::logMessage(message, args);
+    Logger::log((DeviceId) NULL, Console, message, args);
     va_end(args);
 }
 
@@ -122,14 +130,64 @@ boolean Logger::isDebug() {
 }
 
 /*
- * Output a log message (called by debug(), info(), warn(), error(), console())
+ * Enable or disable deferred logging (only with CFG_LOG_DEFERRED). While deferred,
+ * messages are only recorded and printed later by process() from loop(), so logging
+ * from a tick or the CAN handler costs a few microseconds instead of the time it takes
+ * to push the text through the serial port. setup() logs synchronously so nothing
+ * is lost before loop() runs.
+ */
+void Logger::setDeferred(boolean enable) {
+#ifdef CFG_LOG_DEFERRED
+    if (!enable)
+        while (bufferTail != bufferHead)
+            process();
+    deferred = enable;
+#else
+    (void) enable;
+#endif
+}
+
+/*
+ * Print up to CFG_LOG_RECORDS_PER_PASS deferred messages. To be called from loop()
+ * when the time critical work is done.
+ */
+void Logger::process() {
+#ifdef CFG_LOG_DEFERRED
+    for (int i = 0; i < CFG_LOG_RECORDS_PER_PASS && bufferTail != bufferHead; i++) {
+        printRecord(&buffer[bufferTail]); // producers never write the tail slot, no need to lock
+        bufferTail = (bufferTail + 1) % CFG_LOG_BUFFER_SIZE;
+    }
+    uint32_t lost = dropped;
+    if (lost != reportedDropped) {
+        reportedDropped = lost;
+        Serial.print(millis());
+        Serial.print(" - INFO: log buffer overflow, ");
+        Serial.print(lost);
+        Serial.println(" messages lost");
+    }
+#endif
+}
+
+/*
+ * Get the number of deferred messages lost because the log buffer was full.
+ */
+uint32_t Logger::getDroppedCount() {
+#ifdef CFG_LOG_DEFERRED
+    return dropped;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Output a log message (called by debug(), info(), console())
  *
  * Supports printf() like syntax:
  *
  * %% - outputs a '%' character
  * %s - prints the next parameter as string
  * %d - prints the next parameter as decimal
- * %f - prints the next parameter as double float
+ * %f - prints the next parameter (a double) with 2 decimals, recorded as float (about 7 digits)
  * %x - prints the next parameter as hex value
  * %X - prints the next parameter as hex value with '0x' added before
  * %b - prints the next parameter as binary value
@@ -138,47 +196,86 @@ boolean Logger::isDebug() {
  * %c - prints the next parameter as a character
  * %t - prints the next parameter as boolean ('T' or 'F')
  * %T - prints the next parameter as boolean ('true' or 'false')
+ *
+ * When deferred, the format and the strings passed for %s are printed later, so they
+ * have to stay valid (e.g. string literals).
  */
-void Logger::log(DeviceId deviceId, LogLevel level, const char *format, va_list args) {
+void Logger::log(DeviceId deviceId, uint8_t level, const char *format, va_list args) {
+    LogRecord record;
+
     lastLogTime = millis();
-    Serial.print(lastLogTime);
-    Serial.print(" - ");
+    record.time = lastLogTime;
+    record.format = format;
+    record.deviceId = deviceId;
+    record.level = level;
+    record.numArgs = captureArgs(format, args, record.args);
 
-    switch (level) {
-    case Debug:
-        Serial.print("DEBUG");
-        break;
-    case Info:
-        Serial.print("INFO");
-        break;
+#ifdef CFG_LOG_DEFERRED
+    if (deferred) {
+        uint32_t primask = __get_PRIMASK(); // may be called from an interrupt
+        __disable_irq();
+        uint16_t next = (bufferHead + 1) % CFG_LOG_BUFFER_SIZE;
+        if (next == bufferTail) {
+            dropped++;
+        } else {
+            buffer[bufferHead] = record;
+            bufferHead = next;
+        }
+        __set_PRIMASK(primask);
+        return;
     }
-    Serial.print(": ");
+#endif
+    printRecord(&record);
+}
 
-    if (deviceId)
-        printDeviceName(deviceId);
+/*
+ * Fetch the parameters referenced by the format from the argument list.
+ */
+uint8_t Logger::captureArgs(const char *format, va_list args, LogArg *out) {
+    uint8_t count = 0;
 
-    logMessage(format, args);
+    for (; *format != 0 && count < CFG_LOG_MAX_ARGS; ++format) {
+        if (*format != '%')
+            continue;
+        ++format;
+        switch (*format) {
+        case '\0':
+            return count;
+        case 's':
+            out[count++].s = va_arg(args, const char *);
+            break;
+        case 'f':
+            out[count++].f = (float) va_arg(args, double); // see LogArg
+            break;
+        case 'd': case 'i': case 'x': case 'X': case 'b': case 'B':
+        case 'c': case 't': case 'T':
+            out[count++].i = va_arg(args, int);
+            break;
+        case 'l':
+            out[count++].i = va_arg(args, int32_t);
+            break;
+        }
+    }
+    return count;
 }
 
 /*
- * Output a log message (called by log(), console())
- *
- * Supports printf() like syntax:
- *
- * %% - outputs a '%' character
- * %s - prints the next parameter as string
- * %d - prints the next parameter as decimal
- * %f - prints the next parameter as double float
- * %x - prints the next parameter as hex value
- * %X - prints the next parameter as hex value with '0x' added before
- * %b - prints the next parameter as binary value
- * %B - prints the next parameter as binary value with '0b' added before
- * %l - prints the next parameter as long
- * %c - prints the next parameter as a character
- * %t - prints the next parameter as boolean ('T' or 'F')
- * %T - prints the next parameter as boolean ('true' or 'false')
+ * Put together the text of a log message and print it to the serial port.
  */
-void Logger::logMessage(const char *format, va_list args) {
+void Logger::printRecord(LogRecord *record) {
+    const char *format = record->format;
+    LogArg *arg = record->args;
+    LogArg *end = record->args + record->numArgs;
+
+    if (record->level != Console) {
+        Serial.print(record->time);
+        Serial.print(" - ");
+        Serial.print(record->level == Debug ? "DEBUG" : "INFO");
+        Serial.print(": ");
+        if (record->deviceId)
+            printDeviceName(record->deviceId);
+    }
+
     for (; *format != 0; ++format) {
         if (*format == '%') {
             ++format;
@@ -188,48 +285,49 @@ void Logger::logMessage(const char *format, va_list args) {
                 Serial.print(*format);
                 continue;
             }
+            if (strchr("sfdixXbBlctT", *format) != NULL && arg == end)
+                continue; // more parameters than CFG_LOG_MAX_ARGS
             if (*format == 's') {
-                register char *s = (char *) va_arg( args, int );
-                Serial.print(s);
+                Serial.print((arg++)->s);
                 continue;
             }
             if (*format == 'd' || *format == 'i') {
-                Serial.print(va_arg( args, int ), DEC);
+                Serial.print((arg++)->i, DEC);
                 continue;
             }
             if (*format == 'f') {
-                Serial.print(va_arg( args, double ), 2);
+                Serial.print((arg++)->f, 2);
                 continue;
             }
             if (*format == 'x') {
-                Serial.print(va_arg( args, int ), HEX);
+                Serial.print((arg++)->i, HEX);
                 continue;
             }
             if (*format == 'X') {
                 Serial.print("0x");
-                Serial.print(va_arg( args, int ), HEX);
+                Serial.print((arg++)->i, HEX);
                 continue;
             }
             if (*format == 'b') {
-                Serial.print(va_arg( args, int ), BIN);
+                Serial.print((arg++)->i, BIN);
                 continue;
             }
             if (*format == 'B') {
                 Serial.print("0b");
-                Serial.print(va_arg( args, int ), BIN);
+                Serial.print((arg++)->i, BIN);
                 continue;
             }
             if (*format == 'l') {
-                Serial.print(va_arg( args, long ), DEC);
+                Serial.print((long) (arg++)->i, DEC);
                 continue;
             }
 
             if (*format == 'c') {
-                Serial.print(va_arg( args, int ));
+                Serial.print((arg++)->i);
                 continue;
             }
             if (*format == 't') {
-                if (va_arg( args, int ) == 1) {
+                if ((arg++)->i == 1) {
                     Serial.print("T");
                 } else {
                     Serial.print("F");
@@ -237,7 +335,7 @@ void Logger::logMessage(const char *format, va_list args) {
                 continue;
             }
             if (*format == 'T') {
-                if (va_arg( args, int ) == 1) {
+                if ((arg++)->i == 1) {
                     Serial.print(Constants::trueStr);
                 } else {
                     Serial.print(Constants::falseStr);
@@ -45,12 +45,51 @@ public:
     static LogLevel getLogLevel();
     static uint32_t getLastLogTime();
     static boolean isDebug();
+    static void setDeferred(boolean);
+    static void process();
+    static uint32_t getDroppedCount();
 private:
+    enum {
+        Console = 0xFF // level of console messages (printed without header)
+    };
+
+    /*
+     * A recorded parameter. %f is kept as float, a double would double the size of every
+     * parameter in the log buffer. The printed value is exact to about 7 significant
+     * digits, e.g. up to 16777216 or to the 2nd decimal up to 65536.
+     */
+    union LogArg {
+        int32_t i;
+        float f;
+        const char *s;
+    };
+
+    /*
+     * A log message as recorded by the caller: the format is only parsed to pick up
+     * the parameters, the text is put together by printRecord().
+     */
+    struct LogRecord {
+        uint32_t time;
+        const char *format;
+        DeviceId deviceId;
+        uint8_t level;
+        uint8_t numArgs;
+        LogArg args[CFG_LOG_MAX_ARGS];
+    };
+
     static LogLevel logLevel;
     static uint32_t lastLogTime;
+#ifdef CFG_LOG_DEFERRED
+    static boolean deferred;
+    static LogRecord buffer[CFG_LOG_BUFFER_SIZE];
+    static volatile uint16_t bufferHead, bufferTail;
+    static volatile uint32_t dropped;
+    static uint32_t reportedDropped;
+#endif
 
-    static void log(DeviceId, LogLevel, const char *format, va_list);
-    static void logMessage(const char *format, va_list args);
+    static void log(DeviceId, uint8_t level, const char *format, va_list);
+    static uint8_t captureArgs(const char *format, va_list args, LogArg *out);
+    static void printRecord(LogRecord *record);
     static void printDeviceName(DeviceId);
 };
 
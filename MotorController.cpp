@@ -53,6 +53,13 @@ MotorController::MotorController() : Device() {
     torqueActual = 10;
     torqueAvailable = 0;
     mechanicalPower = 0;
+    pedalLatency = 0;
+    maxPedalLatency = 0;
+    controlCycles = 0;
+    speedScale = 0;
+    torqueScale = 0;
+    taperReciprocal = 0;
+    maxControlCycles = 0;
 
     selectedGear = NEUTRAL;
     operationState = ENABLE;
@@ -86,6 +93,27 @@ void MotorController::setup(Ble::BleData *bleData) {
     premillis = millis();
     bluetoothData = bleData;
 
+    // loadConfiguration() runs before bluetoothData is known, so mirror the config here
+    bluetoothData->configSpeedMax = config->speedMax;
+    bluetoothData->configTorqueMax = config->torqueMax;
+    bluetoothData->configSpeedSlewRate = config->speedSlewRate;
+    bluetoothData->configTorqueSlewRate = config->torqueSlewRate;
+    bluetoothData->configReversePercent = config->reversePercent;
+    bluetoothData->configKilowattHrs = config->kilowattHrs;
+    bluetoothData->configPrechargeR = config->prechargeR;
+    bluetoothData->configNominalVolt = config->nominalVolt;
+    bluetoothData->configPrechargeRelay = config->prechargeRelay;
+    bluetoothData->configMainContactorRelay = config->mainContactorRelay;
+    bluetoothData->configCoolFan = config->coolFan;
+    bluetoothData->configCoolOn = config->coolOn;
+    bluetoothData->configCoolOff = config->coolOff;
+    bluetoothData->configBrakeLight = config->brakeLight;
+    bluetoothData->configRevLight = config->revLight;
+    bluetoothData->configEnableIn = config->enableIn;
+    bluetoothData->configReverseIn = config->reverseIn;
+    bluetoothData->configRegenTaperLower = config->regenTaperLower;
+    bluetoothData->configRegenTaperUpper = config->regenTaperUpper;
+
     if(config->prechargeR == 12345)
     {
         torqueActual = 2;
@@ -124,7 +152,7 @@ void MotorController::handleTick() {
     else statusBitfield1 &= ~(1 <<9);
 
     //Calculate killowatts and kilowatt hours
-    mechanicalPower = dcVoltage * dcCurrent / 10000; //In kilowatts. DC voltage is x10
+    mechanicalPower = mulShift((int32_t) dcVoltage * dcCurrent, RECIPROCAL(10000, 32), 32); //In kilowatts. DC voltage is x10
     
     if (dcVoltage > nominalVolts && torqueActual > 0) {
         kiloWattHours = 1;   //If our voltage is higher than fully charged with no regen, zero our kwh meter
@@ -281,7 +309,7 @@ void MotorController::coolingcheck()
 
     if(coolfan>=0 and coolfan<MAX_PIN)    //We have 8 outputs 0-7 If they entered something else, there is no point in doing this check.
     {
-        if(temperatureInverter/10>getCoolOn())  //If inverter temperature greater than COOLON, we want to turn on the coolingoutput
+        if(temperatureInverter >= (getCoolOn() + 1) * 10)  //If inverter temperature greater than COOLON, we want to turn on the coolingoutput
         {
             if(!coolflag)
             {
@@ -292,7 +320,7 @@ void MotorController::coolingcheck()
             }
         }
 
-        if(temperatureInverter/10<getCoolOff()) //If inverter temperature falls below COOLOFF, we want to turn cooling off.
+        if(temperatureInverter < getCoolOff() * 10) //If inverter temperature falls below COOLOFF, we want to turn cooling off.
         {
             if(coolflag)
             {
@@ -603,27 +631,66 @@ void MotorController::loadConfiguration() {
     config->regenTaperLower = RegenTaperLower;
     config->regenTaperUpper = RegenTaperUpper;
 
-    //TODO send config to bt once
-    bluetoothData->configSpeedMax = MaxRPMValue;
-    bluetoothData->configTorqueMax = MaxTorqueValue;
-    bluetoothData->configSpeedSlewRate = RPMSlewRateValue;
-    bluetoothData->configTorqueSlewRate = TorqueSlewRateValue;
-    bluetoothData->configReversePercent = ReversePercent;
-    bluetoothData->configKilowattHrs = KilowattHrs;
-    bluetoothData->configPrechargeR = PrechargeR;
-    bluetoothData->configNominalVolt = NominalVolt;
-    bluetoothData->configPrechargeRelay = PrechargeRelay;
-    bluetoothData->configMainContactorRelay = MainContactorRelay;
-    bluetoothData->configCoolFan = CoolFan;
-    bluetoothData->configCoolOn = CoolOn;
-    bluetoothData->configCoolOff = CoolOff;
-    bluetoothData->configBrakeLight = BrakeLight;
-    bluetoothData->configRevLight = RevLight;
-    bluetoothData->configEnableIn = EnableIn;
-    bluetoothData->configReverseIn = ReverseIn;
-    bluetoothData->configRegenTaperLower = RegenTaperLower;
-    bluetoothData->configRegenTaperUpper = RegenTaperUpper;
+    Logger::info("MaxTorque: %i MaxRPM: %i", config->torqueMax, config->speedMax);
 
+    updateScaling();
+}
 
-    Logger::info("MaxTorque: %i MaxRPM: %i", config->torqueMax, config->speedMax);
+/*
+ * Pre-calculate the factors so the control tick gets by without divisions. Must be
+ * called again whenever speedMax, torqueMax or the regen taper limits change.
+ */
+void MotorController::updateScaling() {
+    MotorControllerConfiguration *config = (MotorControllerConfiguration *)getConfiguration();
+
+    speedScale = q16Ratio(config->speedMax, 1000);
+    torqueScale = q16Ratio(config->torqueMax, 1000);
+    taperReciprocal = reciprocal(config->regenTaperUpper - config->regenTaperLower, 24);
+}
+
+/*
+ * Measure the time from sampling the accelerator pedal to handing the torque
+ * command based on it to the CAN controller. To be called by the sub-class right
+ * after it sent the command.
+ */
+void MotorController::updatePedalLatency() {
+    Throttle *accelerator = deviceManager.getAccelerator();
+
+    if (accelerator == NULL || accelerator->getSampleTime() == 0)
+        return;
+    pedalLatency = micros() - accelerator->getSampleTime();
+    if (pedalLatency > maxPedalLatency)
+        maxPedalLatency = pedalLatency;
+}
+
+/*
+ * Measure the cycles (see TickTimer::cycles()) the control pipeline took from
+ * sampling the accelerator to the end of the motor controller's tick. To be called
+ * by the sub-class at the end of its tick.
+ */
+void MotorController::updateControlCycles() {
+    Throttle *accelerator = deviceManager.getAccelerator();
+
+    if (accelerator == NULL || accelerator->getSampleTime() == 0)
+        return;
+    uint32_t cycles = TickTimer::cycles() - accelerator->getSampleCycles();
+    if (cycles > maxControlCycles)
+        maxControlCycles = cycles;
+    controlCycles += ((int32_t) (cycles - controlCycles)) >> 4; // average over ~16 ticks
+}
+
+uint32_t MotorController::getControlCycles() {
+    return controlCycles;
+}
+
+uint32_t MotorController::getMaxControlCycles() {
+    return maxControlCycles;
+}
+
+uint32_t MotorController::getPedalLatency() {
+    return pedalLatency;
+}
+
+uint32_t MotorController::getMaxPedalLatency() {
+    return maxPedalLatency;
 }
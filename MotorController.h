@@ -34,6 +34,7 @@
 #include "ble.h"
 #include "Device.h"
 #include "Throttle.h"
+#include "FixedPoint.h"
 #include "DeviceManager.h"
 #include "sys_io.h"
 
@@ -95,6 +96,7 @@ public:
     uint32_t getTickInterval();
 
     void loadConfiguration();
+    void updateScaling();
 
     void coolingcheck();
     void checkBrakeLight();
@@ -158,6 +160,10 @@ public:
     int16_t getTemperatureMotor();
     int16_t getTemperatureInverter();
     int16_t getTemperatureSystem();
+    uint32_t getPedalLatency();
+    uint32_t getMaxPedalLatency();
+    uint32_t getControlCycles();
+    uint32_t getMaxControlCycles();
 
 
     int milliseconds  ;
@@ -198,6 +204,18 @@ protected:
     int16_t temperatureMotor; // temperature of motor in 0.1 degree C
     int16_t temperatureInverter; // temperature of inverter power stage in 0.1 degree C
     int16_t temperatureSystem; // temperature of controller in 0.1 degree C
+    uint32_t pedalLatency; // time from sampling the accelerator to sending the torque command in us
+    uint32_t maxPedalLatency; // highest pedalLatency seen since start-up in us
+
+    uint32_t controlCycles; // moving average of the cycles from sampling the accelerator to the end of the control tick
+    uint32_t maxControlCycles;
+
+    q16_t speedScale; // speedMax / 1000, maps throttleRequested to rpm
+    q16_t torqueScale; // torqueMax / 1000, maps throttleRequested to 0.1 Nm
+    int32_t taperReciprocal; // reciprocal(regenTaperUpper - regenTaperLower, 24)
+
+    void updatePedalLatency();
+    void updateControlCycles();
 
 
 
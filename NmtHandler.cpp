@@ -0,0 +1,401 @@
+/*
+ * NmtHandler.cpp
+ *
+ * The EVCU is a self-starting node: it sends its boot-up message once the EV bus runs
+ * and enters operational right away. NMT commands of another master still move it
+ * between the states, a reset only restarts the communication (boot-up again).
+ *
+ * The supervised nodes whose heartbeat runs are kept in a min-heap on their deadline,
+ * so a supervision tick without a due deadline costs a single comparison. A heartbeat
+ * only updates the receive time of its node (the node id is looked up in a table), the
+ * heap entry is refreshed lazily when its old deadline comes up.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "NmtHandler.h"
+
+NmtHandler nmtHandler;
+
+static const char *stateName(uint8_t state)
+{
+    switch (state)
+    {
+    case NMT_BOOTUP: return "boot-up";
+    case NMT_STOPPED: return "stopped";
+    case NMT_OPERATIONAL: return "operational";
+    case NMT_PRE_OPERATIONAL: return "pre-operational";
+    default: return "unknown";
+    }
+}
+
+NmtHandler::NmtHandler() : CanObserver()
+{
+    memset(&parameters, 0, sizeof(parameters));
+    memset(nodes, 0, sizeof(nodes));
+    memset(timeouts, 0, sizeof(timeouts));
+    memset(deadlines, 0, sizeof(deadlines));
+    memset(slots, 0, sizeof(slots));
+    state = NMT_BOOTUP;
+    bootPending = true;
+    lastHeartbeat = 0;
+    heapSize = 0;
+}
+
+/*
+ * Listen to the NMT commands and to the heartbeats of all nodes (only the supervised
+ * ones are looked at) and start the supervision tick.
+ */
+void NmtHandler::setup()
+{
+    parameters.heartbeatTime = CFG_CANOPEN_HEARTBEAT_TIME;
+    rebuild();
+    if (!canHandler.attach(this, 0, 0x7FF, false))  // NMT commands
+        Logger::info("NMT: commands of the master are not received");
+    if (!canHandler.attach(this, 0x700, 0x780, false)) // heartbeats and boot-up messages
+        Logger::info("NMT: heartbeats are not received, no node is supervised");
+    tickHandler.attach(this, CFG_TICK_INTERVAL_NMT);
+    Logger::info("NMT: node %d, heartbeat %dms, %d nodes supervised", canHandler.getMasterID(), parameters.heartbeatTime,
+                 CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS);
+}
+
+/*
+ * Send the boot-up message as soon as the bus runs, then our heartbeat, and check the
+ * deadlines of the supervised nodes.
+ */
+void NmtHandler::handleTick()
+{
+    uint32_t now = micros();
+
+    if (bootPending)
+    {
+        if (canHandler.getBusState(CAN_BUS_EV) == CAN_STATE_RUNNING && canHandler.sendHeartbeat(NMT_BOOTUP))
+        {
+            bootPending = false;
+            lastHeartbeat = now;
+            enterState(NMT_OPERATIONAL);
+        }
+    }
+    else if (parameters.heartbeatTime != 0)
+    {
+        uint32_t period = parameters.heartbeatTime * 1000UL;
+        if (now - lastHeartbeat >= period)
+        {
+            lastHeartbeat += period;
+            if (now - lastHeartbeat >= period)
+                lastHeartbeat = now; // more than a period late (or the time was changed), don't catch up
+            canHandler.sendHeartbeat(state);
+        }
+    }
+    supervise(now);
+}
+
+/*
+ * Hand an NMT command or the heartbeat of a supervised node to its handler.
+ */
+void NmtHandler::handleCanFrame(CAN_FRAME *frame)
+{
+    if (frame->id == 0)
+    {
+        handleCommand(frame);
+        return;
+    }
+
+    uint8_t slot = slots[frame->id & 0x7F];
+    if (slot != 0 && frame->length >= 1)
+        handleHeartbeat(slot - 1, frame);
+}
+
+/*
+ * Follow an NMT command to us or to all nodes.
+ */
+void NmtHandler::handleCommand(CAN_FRAME *frame)
+{
+    if (frame->length < 2 || (frame->data.bytes[1] != 0 && frame->data.bytes[1] != canHandler.getMasterID()))
+        return;
+
+    switch (frame->data.bytes[0])
+    {
+    case NMT_START:
+        enterState(NMT_OPERATIONAL);
+        break;
+    case NMT_STOP:
+        enterState(NMT_STOPPED);
+        break;
+    case NMT_ENTER_PRE_OPERATIONAL:
+        enterState(NMT_PRE_OPERATIONAL);
+        break;
+    case NMT_RESET_NODE:
+    case NMT_RESET_COMMUNICATION:
+        enterState(NMT_BOOTUP);
+        bootPending = true; // the next tick sends the boot-up message again
+        break;
+    }
+}
+
+void NmtHandler::enterState(NMT_STATE newState)
+{
+    if (newState == state)
+        return;
+    state = newState;
+    Logger::info("NMT: %s", stateName(state));
+}
+
+/*
+ * Track the state a supervised node reports and (re-)start its supervision. Its restart
+ * policy may start it, at most once per heartbeat time.
+ */
+void NmtHandler::handleHeartbeat(uint8_t slot, CAN_FRAME *frame)
+{
+    NmtNodeStatus *node = &nodes[slot];
+    NMT_STATE reported = (NMT_STATE) (frame->data.bytes[0] & 0x7F); // bit 7 is the toggle bit of node guarding
+    bool supervised = (node->seen && !node->lost);
+
+    if (!supervised || reported != node->state)
+        Logger::info("NMT: node %d %s%s", node->nodeId, (node->lost ? "is back, " : ""), stateName(reported));
+
+    noInterrupts(); // the supervision may run in the tick interrupt
+    node->lastSeen = frame->timestamp;
+    node->state = reported;
+    node->seen = true;
+    node->lost = false;
+    if (!supervised)
+    {
+        deadlines[slot] = node->lastSeen + timeouts[slot];
+        heapInsert(slot);
+    }
+    interrupts();
+
+    if (parameters.restartPolicy[slot] >= NMT_RESTART_START && (reported == NMT_BOOTUP || reported == NMT_PRE_OPERATIONAL))
+        restart(slot, false, frame->timestamp);
+}
+
+/*
+ * Report the nodes whose deadline passed without a heartbeat. The deadline of a node
+ * which sent a heartbeat meanwhile is moved and it goes back into the heap.
+ */
+void NmtHandler::supervise(uint32_t now)
+{
+    while (heapSize > 0)
+    {
+        uint8_t slot = heap[0];
+
+        if ((int32_t) (now - deadlines[slot]) < 0)
+            return;
+
+        NmtNodeStatus *node = &nodes[slot];
+        if ((int32_t) (now - node->lastSeen) < (int32_t) timeouts[slot])
+        {
+            deadlines[slot] = node->lastSeen + timeouts[slot];
+            siftDown(0);
+            continue;
+        }
+        heapRemove(0);
+        nodeLost(slot, now);
+    }
+}
+
+void NmtHandler::nodeLost(uint8_t slot, uint32_t now)
+{
+    NmtNodeStatus *node = &nodes[slot];
+
+    node->lost = true;
+    node->timeouts++;
+    node->detectionDelay = now - node->lastSeen;
+    Logger::info("NMT: heartbeat of node %d lost, none for %l us", node->nodeId, node->detectionDelay);
+    if (parameters.restartPolicy[slot] == NMT_RESTART_RESET)
+        restart(slot, true, now);
+}
+
+/*
+ * Start or reset a node, unless its policy did so less than a heartbeat time ago (a
+ * node needs some time to follow and report its new state).
+ */
+void NmtHandler::restart(uint8_t slot, bool reset, uint32_t now)
+{
+    NmtNodeStatus *node = &nodes[slot];
+
+    if (node->restarts != 0 && now - node->lastRestart < timeouts[slot])
+        return;
+    if (reset)
+        canHandler.sendNodeReset(node->nodeId);
+    else
+        canHandler.sendNodeStart(node->nodeId);
+    node->restarts++;
+    node->lastRestart = now;
+}
+
+/*
+ * Check a parameter after the object dictionary stored it. A node may only be in one
+ * consumer entry, and neither be 0 nor the EVCU itself.
+ *
+ * \param entry - the entry which was written (0x1016, 0x1017 or 0x2200)
+ * \retval an SDO abort code, SDO_ABORT_NONE if the parameter was applied
+ */
+uint32_t NmtHandler::configure(const OdEntry *entry)
+{
+    if (entry->index == 0x2200)
+        return (parameters.restartPolicy[entry->subIndex - 1] > NMT_RESTART_MAX ? SDO_ABORT_VALUE_RANGE : SDO_ABORT_NONE);
+    if (entry->index != 0x1016)
+        return SDO_ABORT_NONE; // the heartbeat time is used from the next tick on
+
+    uint32_t consumer = parameters.consumers[entry->subIndex - 1];
+    uint8_t nodeId = (consumer >> 16) & 0xFF;
+    if ((consumer & 0xFFFF) != 0)
+    {
+        if ((consumer & 0xFF000000) || nodeId == 0 || nodeId >= NMT_NUM_NODES || nodeId == canHandler.getMasterID())
+            return SDO_ABORT_VALUE_RANGE;
+        for (uint8_t i = 0; i < CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS; i++)
+        {
+            if (i != entry->subIndex - 1 && (parameters.consumers[i] & 0xFFFF) != 0 && ((parameters.consumers[i] >> 16) & 0xFF) == nodeId)
+                return SDO_ABORT_INCOMPATIBLE;
+        }
+    }
+    rebuild();
+    return SDO_ABORT_NONE;
+}
+
+/*
+ * Set up the node table and the heap from the consumer entries. The statistics of a
+ * node are kept if its entry still refers to it, its supervision starts over with its
+ * next heartbeat.
+ */
+void NmtHandler::rebuild()
+{
+    noInterrupts();
+    memset(slots, 0, sizeof(slots));
+    heapSize = 0;
+    for (uint8_t i = 0; i < CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS; i++)
+    {
+        uint8_t nodeId = (parameters.consumers[i] >> 16) & 0x7F;
+        uint16_t time = parameters.consumers[i] & 0xFFFF;
+
+        if (time == 0 || nodeId == 0)
+            nodeId = 0;
+        if (nodes[i].nodeId != nodeId)
+        {
+            memset(&nodes[i], 0, sizeof(NmtNodeStatus));
+            nodes[i].nodeId = nodeId;
+        }
+        nodes[i].seen = false;
+        nodes[i].lost = false;
+        timeouts[i] = time * 1000UL;
+        if (nodeId != 0)
+            slots[nodeId] = i + 1;
+    }
+    interrupts();
+}
+
+NmtParameters *NmtHandler::getParameters()
+{
+    return &parameters;
+}
+
+/*
+ * Get our own NMT state. PDOs are only exchanged while operational.
+ */
+NMT_STATE NmtHandler::getState()
+{
+    return state;
+}
+
+/*
+ * Get the status of the node in a consumer entry (0 - CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS - 1).
+ */
+NmtNodeStatus *NmtHandler::getNodeStatus(uint8_t index)
+{
+    return (index < CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS ? &nodes[index] : NULL);
+}
+
+/*
+ * Get the NMT state of the node in a consumer entry as it is currently known.
+ *
+ * \retval the reported state, NMT_STATE_UNKNOWN if the node wasn't seen yet or its heartbeat is lost
+ */
+uint8_t NmtHandler::getNodeState(uint8_t index)
+{
+    NmtNodeStatus *node = getNodeStatus(index);
+    return (node == NULL || !node->seen || node->lost ? NMT_STATE_UNKNOWN : node->state);
+}
+
+/*
+ * Heap order: earlier deadline first (wrap safe), the lower entry on a tie.
+ */
+bool NmtHandler::isBefore(uint8_t a, uint8_t b)
+{
+    int32_t diff = (int32_t) (deadlines[a] - deadlines[b]);
+    return diff < 0 || (diff == 0 && a < b);
+}
+
+void NmtHandler::heapInsert(uint8_t slot)
+{
+    heap[heapSize] = slot;
+    siftUp(heapSize++);
+}
+
+void NmtHandler::heapRemove(uint8_t position)
+{
+    heap[position] = heap[--heapSize];
+    if (position < heapSize)
+    {
+        siftDown(position);
+        siftUp(position);
+    }
+}
+
+void NmtHandler::siftDown(uint8_t position)
+{
+    for (;;)
+    {
+        uint8_t smallest = position;
+        uint8_t left = 2 * position + 1;
+        uint8_t right = left + 1;
+
+        if (left < heapSize && isBefore(heap[left], heap[smallest]))
+            smallest = left;
+        if (right < heapSize && isBefore(heap[right], heap[smallest]))
+            smallest = right;
+        if (smallest == position)
+            return;
+
+        uint8_t temp = heap[position];
+        heap[position] = heap[smallest];
+        heap[smallest] = temp;
+        position = smallest;
+    }
+}
+
+void NmtHandler::siftUp(uint8_t position)
+{
+    while (position > 0)
+    {
+        uint8_t parent = (position - 1) / 2;
+        if (!isBefore(heap[position], heap[parent]))
+            return;
+
+        uint8_t temp = heap[position];
+        heap[position] = heap[parent];
+        heap[parent] = temp;
+        position = parent;
+    }
+}
@@ -0,0 +1,126 @@
+/*
+ * NmtHandler.h
+ *
+ * CANopen network management of the EVCU: its own NMT state and heartbeat (0x1017), and
+ * the supervision of the heartbeats of other nodes (0x1016) with their NMT states and a
+ * restart policy per node (0x2200).
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef NMT_HANDLER_H_
+#define NMT_HANDLER_H_
+
+#include <Arduino.h>
+#include "config.h"
+#include "CanHandler.h"
+#include "TickHandler.h"
+#include "ObjectDictionary.h"
+
+#define NMT_NUM_NODES 128
+#define NMT_STATE_UNKNOWN 0xFF // a supervised node which wasn't seen yet or whose heartbeat is lost
+
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS < 1 || CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 8
+#error "the object dictionary has entries for 1 to 8 heartbeat consumers"
+#endif
+
+/*
+ * What the EVCU does about a supervised node (sub-index of 0x2200 = the one of 0x1016)
+ */
+enum NmtRestartPolicy
+{
+    NMT_RESTART_NONE = 0,   // only track its state and report a lost heartbeat
+    NMT_RESTART_START = 1,  // start it when it reports boot-up or pre-operational
+    NMT_RESTART_RESET = 2,  // also reset it when its heartbeat is lost
+    NMT_RESTART_MAX = NMT_RESTART_RESET
+};
+
+/*
+ * The entries 0x1016 (consumer heartbeat time), 0x1017 (producer heartbeat time) and
+ * 0x2200 (restart policy) of the object dictionary.
+ */
+struct NmtParameters
+{
+    uint16_t heartbeatTime;     // our heartbeat period in ms, 0 = none
+    uint32_t consumers[CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS]; // 0x00NNTTTT: node id and its heartbeat time in ms, time 0 = unused
+    uint8_t restartPolicy[CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS]; // NmtRestartPolicy of each consumer entry
+};
+
+/*
+ * What is known about a supervised node. All times are in microseconds.
+ */
+struct NmtNodeStatus
+{
+    uint8_t nodeId;             // 0 = the entry is unused
+    bool seen;                  // a heartbeat was received, the supervision runs
+    bool lost;                  // no heartbeat within the heartbeat time
+    NMT_STATE state;            // as reported by the last heartbeat
+    uint32_t lastSeen;          // receive time of the last heartbeat
+    uint32_t timeouts;          // number of times the heartbeat was lost
+    uint32_t restarts;          // NMT commands sent to the node by its restart policy
+    uint32_t lastRestart;       // time of the last of them
+    uint32_t detectionDelay;    // time from the last heartbeat to the detection of the last loss
+};
+
+class NmtHandler : public CanObserver, public TickObserver
+{
+public:
+    NmtHandler();
+    void setup();
+    void handleTick();
+    void handleCanFrame(CAN_FRAME *frame);
+    uint32_t configure(const OdEntry *entry);
+    NmtParameters *getParameters();
+    NMT_STATE getState();
+    NmtNodeStatus *getNodeStatus(uint8_t index);
+    uint8_t getNodeState(uint8_t index);
+
+private:
+    NmtParameters parameters;
+    NMT_STATE state;
+    bool bootPending;           // the boot-up message wasn't sent yet
+    uint32_t lastHeartbeat;     // when our heartbeat was due the last time (in us)
+    NmtNodeStatus nodes[CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS];
+    uint32_t timeouts[CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS]; // heartbeat time of each entry (in us)
+    uint32_t deadlines[CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS]; // key of each entry in the heap (in us)
+    uint8_t slots[NMT_NUM_NODES];   // consumer entry + 1 of each node id, 0 = not supervised
+    uint8_t heap[CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS]; // entries which were seen and not lost, as min-heap on the deadline
+    uint8_t heapSize;
+
+    void enterState(NMT_STATE newState);
+    void handleCommand(CAN_FRAME *frame);
+    void handleHeartbeat(uint8_t slot, CAN_FRAME *frame);
+    void supervise(uint32_t now);
+    void nodeLost(uint8_t slot, uint32_t now);
+    void restart(uint8_t slot, bool reset, uint32_t now);
+    void rebuild();
+    bool isBefore(uint8_t a, uint8_t b);
+    void heapInsert(uint8_t slot);
+    void heapRemove(uint8_t position);
+    void siftDown(uint8_t position);
+    void siftUp(uint8_t position);
+};
+
+extern NmtHandler nmtHandler;
+
+#endif /* NMT_HANDLER_H_ */
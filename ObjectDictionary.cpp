@@ -0,0 +1,567 @@
+/*
+ * ObjectDictionary.cpp
+ *
+ * The entries are listed in a constexpr table, a static_assert checks that it is sorted
+ * when it is compiled. New entries must be inserted at their place in the order.
+ *
+ * Index ranges (CiA 301):
+ * 0x1000 - 0x1FFF communication profile area (0x1005/0x1006 SYNC, see SyncHandler,
+ *                 0x1016/0x1017 heartbeat, see NmtHandler, 0x1400 - 0x1BFF PDO parameters,
+ *                 see PdoHandler)
+ * 0x2000 - 0x5FFF manufacturer specific area: 0x2000 motor controller, 0x2010 accelerator,
+ *                 0x2100 state of the drive (read only, to be mapped into TPDOs),
+ *                 0x2200 restart policy and 0x2201 NMT state of the supervised nodes
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+ */
+
+#include <stddef.h>
+#include "ObjectDictionary.h"
+#include "DeviceManager.h"
+#include "PdoHandler.h"
+#include "SyncHandler.h"
+#include "NmtHandler.h"
+
+ObjectDictionary objectDictionary;
+
+static uint32_t readErrorRegister(const OdEntry *entry);
+static uint32_t readDriveState(const OdEntry *entry);
+static uint32_t readNodeState(const OdEntry *entry);
+static uint32_t writeNmtParameter(const OdEntry *entry, uint32_t value);
+static uint32_t writeSyncParameter(const OdEntry *entry, uint32_t value);
+static uint32_t writePdoParameter(const OdEntry *entry, uint32_t value);
+static uint32_t writeMotorConfiguration(const OdEntry *entry, uint32_t value);
+static uint32_t writeAcceleratorConfiguration(const OdEntry *entry, uint32_t value);
+
+#define OD_CONST(index, subIndex, type, value) \
+    { index, subIndex, type, OD_RO, OD_OBJECT_NONE, value, NULL, NULL }
+#define OD_MOTOR(subIndex, type, field) \
+    { 0x2000, subIndex, type, OD_RW, OD_OBJECT_MOTOR_CONFIGURATION, offsetof(MotorControllerConfiguration, field), NULL, writeMotorConfiguration }
+#define OD_ACCELERATOR(subIndex, type, field) \
+    { 0x2010, subIndex, type, OD_RW, OD_OBJECT_ACCELERATOR_CONFIGURATION, offsetof(ThrottleConfiguration, field), NULL, writeAcceleratorConfiguration }
+#define OD_DRIVE(subIndex, type) \
+    { 0x2100, subIndex, type, OD_RO, OD_OBJECT_NONE, 0, readDriveState, NULL }
+#define OD_SYNC(index, field) \
+    { index, 0, OD_UINT32, OD_RW, OD_OBJECT_SYNC_PARAMETERS, offsetof(SyncParameters, field), NULL, writeSyncParameter }
+#define OD_NMT(index, subIndex, type, field) \
+    { index, subIndex, type, OD_RW, OD_OBJECT_NMT_PARAMETERS, offsetof(NmtParameters, field), NULL, writeNmtParameter }
+#define OD_HEARTBEAT_CONSUMER(n) \
+    OD_NMT(0x1016, n, OD_UINT32, consumers[n - 1])
+#define OD_RESTART_POLICY(n) \
+    OD_NMT(0x2200, n, OD_UINT8, restartPolicy[n - 1])
+#define OD_NODE_STATE(n) \
+    { 0x2201, n, OD_UINT8, OD_RO, OD_OBJECT_NONE, 0, readNodeState, NULL }
+#define OD_PDO(index, subIndex, type, field) \
+    { index, subIndex, type, OD_RW, OD_OBJECT_PDO_PARAMETERS, offsetof(PdoParameterSet, field), NULL, writePdoParameter }
+#define OD_PDO_MAPPING(index, pdo) \
+    OD_PDO(index, 0, OD_UINT8, pdo.numMapped), \
+    OD_PDO(index, 1, OD_UINT32, pdo.mapping[0]), \
+    OD_PDO(index, 2, OD_UINT32, pdo.mapping[1]), \
+    OD_PDO(index, 3, OD_UINT32, pdo.mapping[2]), \
+    OD_PDO(index, 4, OD_UINT32, pdo.mapping[3]), \
+    OD_PDO(index, 5, OD_UINT32, pdo.mapping[4]), \
+    OD_PDO(index, 6, OD_UINT32, pdo.mapping[5]), \
+    OD_PDO(index, 7, OD_UINT32, pdo.mapping[6]), \
+    OD_PDO(index, 8, OD_UINT32, pdo.mapping[7])
+#define OD_RPDO_COMMUNICATION(n) \
+    OD_CONST(0x1400 + n, 0, OD_UINT8, 2), \
+    OD_PDO(0x1400 + n, 1, OD_UINT32, rpdo[n].cobId), \
+    OD_PDO(0x1400 + n, 2, OD_UINT8, rpdo[n].transmissionType)
+#define OD_TPDO_COMMUNICATION(n) \
+    OD_CONST(0x1800 + n, 0, OD_UINT8, 5), \
+    OD_PDO(0x1800 + n, 1, OD_UINT32, tpdo[n].cobId), \
+    OD_PDO(0x1800 + n, 2, OD_UINT8, tpdo[n].transmissionType), \
+    OD_PDO(0x1800 + n, 3, OD_UINT16, tpdo[n].inhibitTime), \
+    OD_PDO(0x1800 + n, 5, OD_UINT16, tpdo[n].eventTimer)
+
+static constexpr OdEntry entries[] = {
+    OD_CONST(0x1000, 0, OD_UINT32, 0),              // device type: no standardized device profile
+    { 0x1001, 0, OD_UINT8, OD_RO, OD_OBJECT_NONE, 0, readErrorRegister, NULL }, // error register
+    OD_SYNC(0x1005, cobId),                         // COB-ID SYNC, bit 30: we produce it
+    OD_SYNC(0x1006, cyclePeriod),                   // communication cycle period in us
+    OD_CONST(0x1016, 0, OD_UINT8, CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS), // consumer heartbeat time: node id << 16 | ms
+    OD_HEARTBEAT_CONSUMER(1),
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 1
+    OD_HEARTBEAT_CONSUMER(2),
+#endif
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 2
+    OD_HEARTBEAT_CONSUMER(3),
+#endif
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 3
+    OD_HEARTBEAT_CONSUMER(4),
+#endif
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 4
+    OD_HEARTBEAT_CONSUMER(5),
+#endif
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 5
+    OD_HEARTBEAT_CONSUMER(6),
+#endif
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 6
+    OD_HEARTBEAT_CONSUMER(7),
+#endif
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 7
+    OD_HEARTBEAT_CONSUMER(8),
+#endif
+    OD_NMT(0x1017, 0, OD_UINT16, heartbeatTime),   // producer heartbeat time in ms
+    OD_CONST(0x1018, 0, OD_UINT8, 3),               // identity: highest sub-index
+    OD_CONST(0x1018, 1, OD_UINT32, 0),              // vendor id (none assigned)
+    OD_CONST(0x1018, 2, OD_UINT32, 0),              // product code
+    OD_CONST(0x1018, 3, OD_UINT32, CFG_BUILD_NUM),  // revision number
+
+    OD_RPDO_COMMUNICATION(0),
+#if CFG_CANOPEN_NUM_RPDOS > 1
+    OD_RPDO_COMMUNICATION(1),
+#endif
+#if CFG_CANOPEN_NUM_RPDOS > 2
+    OD_RPDO_COMMUNICATION(2),
+#endif
+#if CFG_CANOPEN_NUM_RPDOS > 3
+    OD_RPDO_COMMUNICATION(3),
+#endif
+    OD_PDO_MAPPING(0x1600, rpdo[0]),
+#if CFG_CANOPEN_NUM_RPDOS > 1
+    OD_PDO_MAPPING(0x1601, rpdo[1]),
+#endif
+#if CFG_CANOPEN_NUM_RPDOS > 2
+    OD_PDO_MAPPING(0x1602, rpdo[2]),
+#endif
+#if CFG_CANOPEN_NUM_RPDOS > 3
+    OD_PDO_MAPPING(0x1603, rpdo[3]),
+#endif
+    OD_TPDO_COMMUNICATION(0),
+#if CFG_CANOPEN_NUM_TPDOS > 1
+    OD_TPDO_COMMUNICATION(1),
+#endif
+#if CFG_CANOPEN_NUM_TPDOS > 2
+    OD_TPDO_COMMUNICATION(2),
+#endif
+#if CFG_CANOPEN_NUM_TPDOS > 3
+    OD_TPDO_COMMUNICATION(3),
+#endif
+    OD_PDO_MAPPING(0x1A00, tpdo[0]),
+#if CFG_CANOPEN_NUM_TPDOS > 1
+    OD_PDO_MAPPING(0x1A01, tpdo[1]),
+#endif
+#if CFG_CANOPEN_NUM_TPDOS > 2
+    OD_PDO_MAPPING(0x1A02, tpdo[2]),
+#endif
+#if CFG_CANOPEN_NUM_TPDOS > 3
+    OD_PDO_MAPPING(0x1A03, tpdo[3]),
+#endif
+
+    OD_CONST(0x2000, 0, OD_UINT8, 20),
+    OD_MOTOR(1, OD_UINT16, speedMax),
+    OD_MOTOR(2, OD_UINT16, torqueMax),
+    OD_MOTOR(3, OD_UINT16, torqueSlewRate),
+    OD_MOTOR(4, OD_UINT16, speedSlewRate),
+    OD_MOTOR(5, OD_UINT8, reversePercent),
+    OD_MOTOR(6, OD_UINT16, kilowattHrs),
+    OD_MOTOR(7, OD_UINT16, prechargeR),
+    OD_MOTOR(8, OD_UINT16, nominalVolt),
+    OD_MOTOR(9, OD_UINT8, prechargeRelay),
+    OD_MOTOR(10, OD_UINT8, mainContactorRelay),
+    OD_MOTOR(11, OD_UINT8, coolFan),
+    OD_MOTOR(12, OD_UINT8, coolOn),
+    OD_MOTOR(13, OD_UINT8, coolOff),
+    OD_MOTOR(14, OD_UINT8, brakeLight),
+    OD_MOTOR(15, OD_UINT8, revLight),
+    OD_MOTOR(16, OD_UINT8, enableIn),
+    OD_MOTOR(17, OD_UINT8, reverseIn),
+    OD_MOTOR(18, OD_UINT8, capacity),
+    OD_MOTOR(19, OD_UINT16, regenTaperUpper),
+    OD_MOTOR(20, OD_UINT16, regenTaperLower),
+
+    OD_CONST(0x2010, 0, OD_UINT8, 7),
+    OD_ACCELERATOR(1, OD_UINT16, positionRegenMaximum),
+    OD_ACCELERATOR(2, OD_UINT16, positionRegenMinimum),
+    OD_ACCELERATOR(3, OD_UINT16, positionForwardMotionStart),
+    OD_ACCELERATOR(4, OD_UINT16, positionHalfPower),
+    OD_ACCELERATOR(5, OD_UINT8, maximumRegen),
+    OD_ACCELERATOR(6, OD_UINT8, minimumRegen),
+    OD_ACCELERATOR(7, OD_UINT8, creep),
+
+    OD_CONST(0x2100, 0, OD_UINT8, 11),
+    OD_DRIVE(1, OD_INT16),      // actual torque in 0.1 Nm
+    OD_DRIVE(2, OD_INT16),      // actual speed in rpm
+    OD_DRIVE(3, OD_UINT16),     // DC voltage in 0.1 V
+    OD_DRIVE(4, OD_INT16),      // DC current in 0.1 A
+    OD_DRIVE(5, OD_UINT8),      // selected gear (MotorController::Gears)
+    OD_DRIVE(6, OD_UINT8),      // operation state (MotorController::OperationState)
+    OD_DRIVE(7, OD_UINT8),      // faults: bit 0 motor controller faulted, bit 1 warning, bit 2 accelerator faulted
+    OD_DRIVE(8, OD_INT16),      // requested torque in 0.1 Nm
+    OD_DRIVE(9, OD_INT16),      // throttle level in 0.1 %
+    OD_DRIVE(10, OD_INT16),     // motor temperature in 0.1 C
+    OD_DRIVE(11, OD_INT16),     // inverter temperature in 0.1 C
+
+    OD_CONST(0x2200, 0, OD_UINT8, CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS), // NmtRestartPolicy of each 0x1016 entry
+    OD_RESTART_POLICY(1),
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 1
+    OD_RESTART_POLICY(2),
+#endif
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 2
+    OD_RESTART_POLICY(3),
+#endif
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 3
+    OD_RESTART_POLICY(4),
+#endif
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 4
+    OD_RESTART_POLICY(5),
+#endif
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 5
+    OD_RESTART_POLICY(6),
+#endif
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 6
+    OD_RESTART_POLICY(7),
+#endif
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 7
+    OD_RESTART_POLICY(8),
+#endif
+    OD_CONST(0x2201, 0, OD_UINT8, CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS), // NMT state of each 0x1016 node (0xFF = unknown)
+    OD_NODE_STATE(1),
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 1
+    OD_NODE_STATE(2),
+#endif
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 2
+    OD_NODE_STATE(3),
+#endif
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 3
+    OD_NODE_STATE(4),
+#endif
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 4
+    OD_NODE_STATE(5),
+#endif
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 5
+    OD_NODE_STATE(6),
+#endif
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 6
+    OD_NODE_STATE(7),
+#endif
+#if CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS > 7
+    OD_NODE_STATE(8),
+#endif
+};
+
+#define OD_NUM_ENTRIES (sizeof(entries) / sizeof(entries[0]))
+
+static constexpr bool isSorted(const OdEntry *entry, size_t count)
+{
+    return count < 2 || ((entry[0].index < entry[1].index || (entry[0].index == entry[1].index && entry[0].subIndex < entry[1].subIndex))
+                         && isSorted(entry + 1, count - 1));
+}
+
+static_assert(isSorted(entries, OD_NUM_ENTRIES), "the entries of the object dictionary must be sorted by index and sub-index");
+
+/*
+ * Find the first entry which isn't below index/subIndex (binary search).
+ *
+ * \retval the position of the entry, OD_NUM_ENTRIES if all entries are below
+ */
+uint16_t ObjectDictionary::lowerBound(uint16_t index, uint8_t subIndex)
+{
+    uint32_t key = ((uint32_t) index << 8) | subIndex;
+    uint16_t low = 0, high = OD_NUM_ENTRIES;
+
+    while (low < high)
+    {
+        uint16_t middle = (low + high) / 2;
+        if ((((uint32_t) entries[middle].index << 8) | entries[middle].subIndex) < key)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+/*
+ * Look up an entry.
+ *
+ * \retval the entry or NULL if there is none with this index and sub-index
+ */
+const OdEntry *ObjectDictionary::find(uint16_t index, uint8_t subIndex)
+{
+    uint16_t pos = lowerBound(index, subIndex);
+
+    if (pos < OD_NUM_ENTRIES && entries[pos].index == index && entries[pos].subIndex == subIndex)
+        return &entries[pos];
+    return NULL;
+}
+
+/*
+ * Check if there is any entry with the index, e.g. to tell a missing object from a
+ * missing sub-index.
+ */
+bool ObjectDictionary::hasIndex(uint16_t index)
+{
+    uint16_t pos = lowerBound(index, 0);
+    return (pos < OD_NUM_ENTRIES && entries[pos].index == index);
+}
+
+uint16_t ObjectDictionary::getNumEntries()
+{
+    return OD_NUM_ENTRIES;
+}
+
+/*
+ * The number of bytes of a value of a data type.
+ */
+uint8_t ObjectDictionary::getSize(OdType type)
+{
+    switch (type)
+    {
+    case OD_INT8:
+    case OD_UINT8:
+        return 1;
+    case OD_INT16:
+    case OD_UINT16:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+/*
+ * Locate the value of an entry in its object.
+ *
+ * \retval NULL if the entry has no value in an object or the object doesn't exist (yet)
+ */
+void *ObjectDictionary::locate(const OdEntry *entry)
+{
+    Device *device;
+
+    switch (entry->object)
+    {
+    case OD_OBJECT_MOTOR_CONFIGURATION:
+        device = deviceManager.getMotorController();
+        break;
+    case OD_OBJECT_ACCELERATOR_CONFIGURATION:
+        device = deviceManager.getAccelerator();
+        break;
+    case OD_OBJECT_PDO_PARAMETERS:
+        return (uint8_t *) pdoHandler.getParameters() + entry->value;
+    case OD_OBJECT_SYNC_PARAMETERS:
+        return (uint8_t *) syncHandler.getParameters() + entry->value;
+    case OD_OBJECT_NMT_PARAMETERS:
+        return (uint8_t *) nmtHandler.getParameters() + entry->value;
+    default:
+        return NULL;
+    }
+    if (device == NULL || device->getConfiguration() == NULL)
+        return NULL;
+    return (uint8_t *) device->getConfiguration() + entry->value;
+}
+
+/*
+ * Read the value of an entry. Signed values are sign-extended to 32 bits.
+ *
+ * \param entry - the entry, as returned by find()
+ * \param value - receives the value
+ * \retval an SDO abort code, SDO_ABORT_NONE if the value was read
+ */
+uint32_t ObjectDictionary::read(const OdEntry *entry, uint32_t *value)
+{
+    if (!(entry->access & OD_RO))
+        return SDO_ABORT_WRITE_ONLY;
+    if (entry->read != NULL)
+    {
+        *value = entry->read(entry);
+        return SDO_ABORT_NONE;
+    }
+    if (entry->object == OD_OBJECT_NONE)
+    {
+        *value = entry->value;
+        return SDO_ABORT_NONE;
+    }
+
+    void *data = locate(entry);
+    if (data == NULL)
+        return SDO_ABORT_DEVICE_STATE;
+
+    switch (entry->type)
+    {
+    case OD_INT8: *value = (int32_t) *(int8_t *) data; break;
+    case OD_UINT8: *value = *(uint8_t *) data; break;
+    case OD_INT16: *value = (int32_t) *(int16_t *) data; break;
+    case OD_UINT16: *value = *(uint16_t *) data; break;
+    default: *value = *(uint32_t *) data; break;
+    }
+    return SDO_ABORT_NONE;
+}
+
+/*
+ * Write the value of an entry and let its write callback check and apply it.
+ *
+ * \param entry - the entry, as returned by find()
+ * \param value - the new value, only the bytes of the entry's data type are used
+ * \retval an SDO abort code, SDO_ABORT_NONE if the value was written
+ */
+uint32_t ObjectDictionary::write(const OdEntry *entry, uint32_t value)
+{
+    if (!(entry->access & OD_WO))
+        return SDO_ABORT_READ_ONLY;
+    if (entry->object == OD_OBJECT_NONE)
+        return (entry->write != NULL ? entry->write(entry, value) : SDO_ABORT_READ_ONLY);
+
+    void *data = locate(entry);
+    if (data == NULL)
+        return SDO_ABORT_DEVICE_STATE;
+
+    uint32_t old;
+    switch (entry->type)
+    {
+    case OD_INT8:
+    case OD_UINT8:
+        old = *(uint8_t *) data;
+        *(uint8_t *) data = value;
+        break;
+    case OD_INT16:
+    case OD_UINT16:
+        old = *(uint16_t *) data;
+        *(uint16_t *) data = value;
+        break;
+    default:
+        old = *(uint32_t *) data;
+        *(uint32_t *) data = value;
+        break;
+    }
+
+    uint32_t abortCode = (entry->write != NULL ? entry->write(entry, value) : SDO_ABORT_NONE);
+    if (abortCode != SDO_ABORT_NONE)
+    {
+        switch (getSize(entry->type))
+        {
+        case 1: *(uint8_t *) data = old; break;
+        case 2: *(uint16_t *) data = old; break;
+        default: *(uint32_t *) data = old; break;
+        }
+    }
+    return abortCode;
+}
+
+/*
+ * 0x1001 error register: bit 0 (generic error) is set while the motor controller is faulted.
+ */
+static uint32_t readErrorRegister(const OdEntry *)
+{
+    MotorController *motorController = deviceManager.getMotorController();
+    return (motorController != NULL && motorController->isFaulted() ? 0x01 : 0x00);
+}
+
+/*
+ * Check a changed parameter of the motor controller and re-calculate the factors
+ * which depend on the configuration.
+ */
+static uint32_t writeMotorConfiguration(const OdEntry *, uint32_t)
+{
+    MotorController *motorController = deviceManager.getMotorController();
+    MotorControllerConfiguration *config = (MotorControllerConfiguration *) motorController->getConfiguration();
+
+    if (config->reversePercent > 100)
+        return SDO_ABORT_VALUE_RANGE;
+    if (config->regenTaperUpper < config->regenTaperLower)
+        return SDO_ABORT_INCOMPATIBLE;
+    motorController->updateScaling();
+    return SDO_ABORT_NONE;
+}
+
+/*
+ * Check a changed parameter of the accelerator pedal against the pre-condition of
+ * Throttle::mapPedalPosition() and rebuild the pedal map.
+ */
+static uint32_t writeAcceleratorConfiguration(const OdEntry *, uint32_t)
+{
+    Throttle *accelerator = deviceManager.getAccelerator();
+    ThrottleConfiguration *config = (ThrottleConfiguration *) accelerator->getConfiguration();
+
+    if (config->maximumRegen > 100 || config->minimumRegen > 100 || config->creep > 100)
+        return SDO_ABORT_VALUE_RANGE;
+    if (config->positionRegenMaximum > config->positionRegenMinimum
+            || config->positionRegenMinimum > config->positionForwardMotionStart
+            || config->positionForwardMotionStart > config->positionHalfPower
+            || config->positionHalfPower > 1000)
+        return SDO_ABORT_INCOMPATIBLE;
+    accelerator->updateScaling();
+    return SDO_ABORT_NONE;
+}
+
+/*
+ * 0x2100: the state of the drive as the motor controller and the accelerator report it.
+ */
+static uint32_t readDriveState(const OdEntry *entry)
+{
+    MotorController *motorController = deviceManager.getMotorController();
+    Throttle *accelerator = deviceManager.getAccelerator();
+
+    if (motorController == NULL)
+        return 0;
+
+    switch (entry->subIndex)
+    {
+    case 1: return motorController->getTorqueActual();
+    case 2: return motorController->getSpeedActual();
+    case 3: return motorController->getDcVoltage();
+    case 4: return motorController->getDcCurrent();
+    case 5: return motorController->getSelectedGear();
+    case 6: return motorController->getOpState();
+    case 7:
+        return (motorController->isFaulted() ? 0x01 : 0) | (motorController->isWarning() ? 0x02 : 0)
+               | (accelerator != NULL && accelerator->isFaulted() ? 0x04 : 0);
+    case 8: return motorController->getTorqueRequested();
+    case 9: return motorController->getThrottle();
+    case 10: return motorController->getTemperatureMotor();
+    case 11: return motorController->getTemperatureInverter();
+    default: return 0;
+    }
+}
+
+/*
+ * 0x2201: the NMT state of a supervised node.
+ */
+static uint32_t readNodeState(const OdEntry *entry)
+{
+    return nmtHandler.getNodeState(entry->subIndex - 1);
+}
+
+/*
+ * 0x1016/0x1017/0x2200: a heartbeat time or a restart policy changed.
+ */
+static uint32_t writeNmtParameter(const OdEntry *entry, uint32_t)
+{
+    return nmtHandler.configure(entry);
+}
+
+/*
+ * 0x1005/0x1006: the SYNC id or period changed, switch between producer and consumer.
+ */
+static uint32_t writeSyncParameter(const OdEntry *entry, uint32_t)
+{
+    return syncHandler.configure(entry);
+}
+
+/*
+ * 0x1400 - 0x1BFF: a communication or mapping parameter of a PDO changed, compile it.
+ */
+static uint32_t writePdoParameter(const OdEntry *entry, uint32_t)
+{
+    return pdoHandler.configure(entry);
+}
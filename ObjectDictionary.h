@@ -0,0 +1,130 @@
+/*
+ * ObjectDictionary.h
+ *
+ * The CANopen object dictionary of the EVCU: every parameter which can be read or
+ * written over the bus (e.g. by the SDO server) is an entry with an index, a sub-index,
+ * a data type and access rights. The entries form a constant table sorted by index and
+ * sub-index, so a lookup is a binary search and the table itself stays in flash.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+ */
+
+#ifndef OBJECT_DICTIONARY_H_
+#define OBJECT_DICTIONARY_H_
+
+#include <Arduino.h>
+#include "config.h"
+
+/*
+ * SDO abort codes (CiA 301) returned by read() and write(), 0 means success.
+ */
+#define SDO_ABORT_NONE              0x00000000
+#define SDO_ABORT_COMMAND           0x05040001  // client/server command specifier not valid or unknown
+#define SDO_ABORT_OUT_OF_MEMORY     0x05040005  // out of memory
+#define SDO_ABORT_WRITE_ONLY        0x06010001  // attempt to read a write only object
+#define SDO_ABORT_READ_ONLY         0x06010002  // attempt to write a read only object
+#define SDO_ABORT_NO_OBJECT         0x06020000  // object does not exist in the object dictionary
+#define SDO_ABORT_NOT_MAPPABLE      0x06040041  // object cannot be mapped to the PDO
+#define SDO_ABORT_PDO_LENGTH        0x06040042  // the number and length of the mapped objects exceed the PDO length
+#define SDO_ABORT_INCOMPATIBLE      0x06040043  // general parameter incompatibility
+#define SDO_ABORT_LENGTH            0x06070010  // length of the data does not match the data type
+#define SDO_ABORT_NO_SUBINDEX       0x06090011  // sub-index does not exist
+#define SDO_ABORT_VALUE_RANGE       0x06090030  // value range of parameter exceeded
+#define SDO_ABORT_DEVICE_STATE      0x08000022  // data can't be transferred because of the present device state
+
+/*
+ * Data types of the entries, the values are the indices of the types in CiA 301.
+ */
+enum OdType
+{
+    OD_INT8 = 0x02,
+    OD_INT16 = 0x03,
+    OD_INT32 = 0x04,
+    OD_UINT8 = 0x05,
+    OD_UINT16 = 0x06,
+    OD_UINT32 = 0x07
+};
+
+enum OdAccess
+{
+    OD_RO = 1,  // read only
+    OD_WO = 2,  // write only
+    OD_RW = 3   // read and write
+};
+
+/*
+ * The object an entry's value is part of. The objects are created at run time (e.g. the
+ * configuration of a device), so an entry only holds the offset of its value in there.
+ */
+enum OdObject
+{
+    OD_OBJECT_NONE = 0,                 // a constant or an entry with callbacks only
+    OD_OBJECT_MOTOR_CONFIGURATION,      // MotorControllerConfiguration of the motor controller
+    OD_OBJECT_ACCELERATOR_CONFIGURATION,// ThrottleConfiguration of the accelerator pedal
+    OD_OBJECT_PDO_PARAMETERS,           // PdoParameterSet of the PdoHandler
+    OD_OBJECT_SYNC_PARAMETERS,          // SyncParameters of the SyncHandler
+    OD_OBJECT_NMT_PARAMETERS            // NmtParameters of the NmtHandler
+};
+
+struct OdEntry;
+
+/*
+ * A read callback returns the value of an entry which is computed (e.g. a status).
+ * A write callback runs after the value was stored, so it can check it against the
+ * other parameters and apply it. If it returns an abort code, the old value is restored.
+ * For an entry without a value in an object, the write callback is the only setter.
+ */
+typedef uint32_t (*OdReadCallback)(const OdEntry *entry);
+typedef uint32_t (*OdWriteCallback)(const OdEntry *entry, uint32_t value);
+
+struct OdEntry
+{
+    uint16_t index;
+    uint8_t subIndex;
+    OdType type;
+    OdAccess access;
+    OdObject object;
+    uint32_t value;         // offset of the value in the object, or the value of a constant (OD_OBJECT_NONE)
+    OdReadCallback read;    // NULL: the value is read from the object (or is the constant)
+    OdWriteCallback write;  // NULL: the value is stored without further checks
+};
+
+class ObjectDictionary
+{
+public:
+    const OdEntry *find(uint16_t index, uint8_t subIndex);
+    bool hasIndex(uint16_t index);
+    uint32_t read(const OdEntry *entry, uint32_t *value);
+    uint32_t write(const OdEntry *entry, uint32_t value);
+    void *locate(const OdEntry *entry);
+    uint16_t getNumEntries();
+    static uint8_t getSize(OdType type);
+
+private:
+    uint16_t lowerBound(uint16_t index, uint8_t subIndex);
+};
+
+extern ObjectDictionary objectDictionary;
+
+#endif /* OBJECT_DICTIONARY_H_ */
@@ -0,0 +1,454 @@
+/*
+ * PdoHandler.cpp
+ *
+ * Mapped entries must be whole bytes (8, 16 or 32 bits, the size of their data type).
+ * A mapping is changed the CANopen way: write 0 to sub-index 0, write the entries,
+ * then write their number to sub-index 0, which compiles and activates the new plan.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+ */
+
+#include "PdoHandler.h"
+#include "NmtHandler.h"
+
+PdoHandler pdoHandler;
+
+PdoHandler::PdoHandler() : CanObserver()
+{
+    memset(&parameters, 0, sizeof(parameters));
+    memset(tpdos, 0, sizeof(tpdos));
+    memset(rpdos, 0, sizeof(rpdos));
+    for (int i = 0; i < CFG_CANOPEN_NUM_RPDOS; i++)
+        rpdos[i].attachedId = PDO_COB_ID_INVALID;
+}
+
+/*
+ * Load the default mapping and start sending the TPDOs.
+ */
+void PdoHandler::setup()
+{
+    setDefaults();
+    for (uint8_t i = 0; i < CFG_CANOPEN_NUM_TPDOS; i++)
+    {
+        if (compile(&parameters.tpdo[i], true, &tpdos[i].plan) != SDO_ABORT_NONE)
+        {
+            Logger::info("TPDO%d: invalid mapping, disabled", i + 1);
+            parameters.tpdo[i].cobId |= PDO_COB_ID_INVALID;
+        }
+    }
+    for (uint8_t i = 0; i < CFG_CANOPEN_NUM_RPDOS; i++)
+    {
+        if (compile(&parameters.rpdo[i], false, &rpdos[i].plan) != SDO_ABORT_NONE)
+        {
+            Logger::info("RPDO%d: invalid mapping, disabled", i + 1);
+            parameters.rpdo[i].cobId |= PDO_COB_ID_INVALID;
+        }
+        if (!listen(i, receiveId(&parameters.rpdo[i], &rpdos[i].plan)))
+        {
+            Logger::info("RPDO%d: no free CAN observer, disabled", i + 1);
+            parameters.rpdo[i].cobId |= PDO_COB_ID_INVALID;
+        }
+    }
+    Logger::info("PDO: %d TPDOs, %d RPDOs", CFG_CANOPEN_NUM_TPDOS, CFG_CANOPEN_NUM_RPDOS);
+}
+
+/*
+ * The PDOs the EVCU publishes unless a tool re-configures them (all others are disabled):
+ * TPDO1 - torque, speed, DC voltage and current every 100 ms
+ * TPDO2 - gear, operation state and faults on change (at most every 100 ms, at least every second)
+ * TPDO3 - requested torque, throttle and temperatures with every SYNC (disabled, to be enabled with a SYNC producer)
+ */
+void PdoHandler::setDefaults()
+{
+    uint8_t node = canHandler.getMasterID();
+
+    for (uint8_t i = 0; i < CFG_CANOPEN_NUM_RPDOS; i++)
+    {
+        parameters.rpdo[i].cobId = (0x200 + 0x100 * i + node) | PDO_COB_ID_INVALID;
+        parameters.rpdo[i].transmissionType = PDO_TYPE_ON_CHANGE;
+    }
+    for (uint8_t i = 0; i < CFG_CANOPEN_NUM_TPDOS; i++)
+    {
+        parameters.tpdo[i].cobId = (0x180 + 0x100 * i + node) | PDO_COB_ID_INVALID;
+        parameters.tpdo[i].transmissionType = PDO_TYPE_ON_CHANGE;
+    }
+
+    PdoParameters *tpdo = &parameters.tpdo[0];
+    tpdo->cobId &= ~PDO_COB_ID_INVALID;
+    tpdo->transmissionType = PDO_TYPE_CYCLIC;
+    tpdo->eventTimer = 100;
+    tpdo->mapping[0] = 0x21000110; // torque
+    tpdo->mapping[1] = 0x21000210; // speed
+    tpdo->mapping[2] = 0x21000310; // DC voltage
+    tpdo->mapping[3] = 0x21000410; // DC current
+    tpdo->numMapped = 4;
+
+#if CFG_CANOPEN_NUM_TPDOS > 1
+    tpdo = &parameters.tpdo[1];
+    tpdo->cobId &= ~PDO_COB_ID_INVALID;
+    tpdo->transmissionType = PDO_TYPE_ON_CHANGE;
+    tpdo->inhibitTime = 1000;
+    tpdo->eventTimer = 1000;
+    tpdo->mapping[0] = 0x21000508; // gear
+    tpdo->mapping[1] = 0x21000608; // operation state
+    tpdo->mapping[2] = 0x21000708; // faults
+    tpdo->numMapped = 3;
+#endif
+
+#if CFG_CANOPEN_NUM_TPDOS > 2
+    tpdo = &parameters.tpdo[2];
+    tpdo->transmissionType = 1;
+    tpdo->mapping[0] = 0x21000810; // requested torque
+    tpdo->mapping[1] = 0x21000910; // throttle
+    tpdo->mapping[2] = 0x21000A10; // motor temperature
+    tpdo->mapping[3] = 0x21000B10; // inverter temperature
+    tpdo->numMapped = 4;
+#endif
+}
+
+/*
+ * Turn the mapping of a PDO into a packing plan. The values of TPDO entries which live
+ * in an object are located once here, so they're copied straight from there.
+ *
+ * \param params - the parameters of the PDO
+ * \param transmit - true for a TPDO (entries must be readable), false for an RPDO (writable)
+ * \param plan - receives the plan
+ * \retval an SDO abort code, SDO_ABORT_NONE if the mapping is valid
+ */
+uint32_t PdoHandler::compile(PdoParameters *params, bool transmit, Plan *plan)
+{
+    if (params->numMapped > PDO_MAX_MAPPED)
+        return SDO_ABORT_VALUE_RANGE;
+
+    plan->numSteps = 0;
+    plan->length = 0;
+    for (uint8_t i = 0; i < params->numMapped; i++)
+    {
+        uint32_t mapping = params->mapping[i];
+        const OdEntry *entry = objectDictionary.find(mapping >> 16, (mapping >> 8) & 0xFF);
+
+        if (entry == NULL)
+            return SDO_ABORT_NO_OBJECT;
+        uint8_t size = ObjectDictionary::getSize(entry->type);
+        if ((mapping & 0xFF) != size * 8 || !(entry->access & (transmit ? OD_RO : OD_WO)))
+            return SDO_ABORT_NOT_MAPPABLE;
+        if (plan->length + size > 8)
+            return SDO_ABORT_PDO_LENGTH;
+
+        PlanStep *step = &plan->steps[plan->numSteps++];
+        step->entry = entry;
+        step->source = (transmit && entry->read == NULL ? (const uint8_t *) objectDictionary.locate(entry) : NULL);
+        step->offset = plan->length;
+        step->size = size;
+        plan->length += size;
+    }
+    return SDO_ABORT_NONE;
+}
+
+/*
+ * Check and apply a parameter of a PDO after the object dictionary stored it.
+ *
+ * \param entry - the entry which was written (0x1400 - 0x1BFF)
+ * \retval an SDO abort code, SDO_ABORT_NONE if the PDO was re-configured
+ */
+uint32_t PdoHandler::configure(const OdEntry *entry)
+{
+    bool transmit = (entry->index >= 0x1800);
+    bool mapping = (entry->index & 0x0200);
+    uint8_t number = entry->index & 0xFF;
+    PdoParameters *params = (transmit ? &parameters.tpdo[number] : &parameters.rpdo[number]);
+    Plan plan;
+
+    if (mapping && entry->subIndex != 0 && params->numMapped != 0)
+        return SDO_ABORT_DEVICE_STATE; // sub-index 0 must be 0 while the entries change
+    if (mapping && entry->subIndex != 0)
+    {
+        // check the single entry now, it becomes active when sub-index 0 is written
+        PdoParameters single = *params;
+        single.mapping[0] = params->mapping[entry->subIndex - 1];
+        single.numMapped = (single.mapping[0] == 0 ? 0 : 1);
+        return compile(&single, transmit, &plan);
+    }
+    if (params->cobId & 0x3FFFF800)
+        return SDO_ABORT_VALUE_RANGE; // only 11 bit ids (PDO_COB_ID_NO_RTR is accepted, RTRs aren't answered anyway)
+    if (params->transmissionType > PDO_TYPE_SYNC_MAX && params->transmissionType < PDO_TYPE_CYCLIC)
+        return SDO_ABORT_VALUE_RANGE;
+
+    uint32_t abortCode = compile(params, transmit, &plan);
+    if (abortCode != SDO_ABORT_NONE)
+        return abortCode;
+    if (!transmit && receiveId(params, &plan) != PDO_COB_ID_INVALID && !canHandler.canReceive(params->cobId & 0x7FF, 0x7FF, false))
+        return SDO_ABORT_DEVICE_STATE; // the filters are held while the motor runs and don't pass the id
+
+    if (transmit)
+    {
+        Tpdo *tpdo = &tpdos[number];
+        tpdo->plan = plan;
+        tpdo->sentOnce = false;
+        tpdo->syncCount = 0;
+    }
+    else
+    {
+        if (!listen(number, receiveId(params, &plan)))
+            return SDO_ABORT_OUT_OF_MEMORY; // all CFG_CAN_NUM_OBSERVERS are in use, the RPDO keeps its previous id
+        rpdos[number].plan = plan;
+        rpdos[number].hasPending = false;
+    }
+    return SDO_ABORT_NONE;
+}
+
+/*
+ * The id an RPDO receives, PDO_COB_ID_INVALID if it is disabled or maps nothing.
+ */
+uint32_t PdoHandler::receiveId(PdoParameters *params, Plan *plan)
+{
+    return ((params->cobId & PDO_COB_ID_INVALID) || plan->numSteps == 0 ? PDO_COB_ID_INVALID : params->cobId & 0x7FF);
+}
+
+/*
+ * Attach to the id of an RPDO (and detach from the previous one) if it changed.
+ *
+ * \retval false if CanHandler has no free observer, the RPDO stays on its previous id
+ */
+bool PdoHandler::listen(uint8_t number, uint32_t id)
+{
+    Rpdo *rpdo = &rpdos[number];
+
+    if (id == rpdo->attachedId)
+        return true;
+    if (rpdo->attachedId != PDO_COB_ID_INVALID)
+        canHandler.detach(this, rpdo->attachedId, 0x7FF);
+    if (id != PDO_COB_ID_INVALID && !canHandler.attach(this, id, 0x7FF, false))
+    {
+        if (rpdo->attachedId != PDO_COB_ID_INVALID)
+            canHandler.attach(this, rpdo->attachedId, 0x7FF, false); // takes the entry just freed
+        return false;
+    }
+    rpdo->attachedId = id;
+    return true;
+}
+
+/*
+ * Send the TPDOs which are cyclic or on change and due. On-change TPDOs are packed
+ * and compared at most every PDO_SAMPLE_INTERVAL, and not before their inhibit time
+ * passed. PDOs are only exchanged while the EVCU is operational. To be called from loop().
+ */
+void PdoHandler::process()
+{
+    uint32_t now = micros();
+    uint8_t data[8];
+
+    if (nmtHandler.getState() != NMT_OPERATIONAL)
+        return;
+
+    for (uint8_t i = 0; i < CFG_CANOPEN_NUM_TPDOS; i++)
+    {
+        PdoParameters *params = &parameters.tpdo[i];
+        Tpdo *tpdo = &tpdos[i];
+
+        if ((params->cobId & PDO_COB_ID_INVALID) || tpdo->plan.numSteps == 0 || params->transmissionType <= PDO_TYPE_SYNC_MAX)
+            continue;
+        if (tpdo->sentOnce && now - tpdo->lastSent < params->inhibitTime * 100UL)
+            continue;
+
+        bool due = (!tpdo->sentOnce || (params->eventTimer != 0 && now - tpdo->lastSent >= params->eventTimer * 1000UL));
+        if (params->transmissionType == PDO_TYPE_CYCLIC)
+        {
+            if (!due)
+                continue;
+            pack(tpdo, data);
+        }
+        else
+        {
+            if (!due && now - tpdo->lastSample < PDO_SAMPLE_INTERVAL)
+                continue;
+            tpdo->lastSample = now;
+            pack(tpdo, data);
+            if (!due && memcmp(data, tpdo->last, tpdo->plan.length) == 0)
+                continue;
+        }
+        transmit(i, data);
+    }
+}
+
+/*
+ * A SYNC was received (or sent): send the synchronous TPDOs which are due and apply
+ * the data the synchronous RPDOs received since the last SYNC. Called by the
+ * SyncHandler from the control tick.
+ */
+void PdoHandler::sync()
+{
+    uint8_t data[8];
+
+    if (nmtHandler.getState() != NMT_OPERATIONAL)
+        return;
+
+    for (uint8_t i = 0; i < CFG_CANOPEN_NUM_TPDOS; i++)
+    {
+        PdoParameters *params = &parameters.tpdo[i];
+        Tpdo *tpdo = &tpdos[i];
+
+        if ((params->cobId & PDO_COB_ID_INVALID) || tpdo->plan.numSteps == 0 || params->transmissionType > PDO_TYPE_SYNC_MAX)
+            continue;
+        if (params->transmissionType == PDO_TYPE_SYNC_ACYCLIC)
+        {
+            pack(tpdo, data);
+            if (tpdo->sentOnce && memcmp(data, tpdo->last, tpdo->plan.length) == 0)
+                continue;
+        }
+        else
+        {
+            if (++tpdo->syncCount < params->transmissionType)
+                continue;
+            pack(tpdo, data);
+        }
+        transmit(i, data);
+    }
+
+    for (uint8_t i = 0; i < CFG_CANOPEN_NUM_RPDOS; i++)
+    {
+        if (rpdos[i].hasPending)
+        {
+            apply(&rpdos[i], rpdos[i].pending);
+            rpdos[i].hasPending = false;
+        }
+    }
+}
+
+/*
+ * Fill the data of a TPDO according to its plan. CANopen is little endian, like the
+ * SAMD21 (and the host), so values in objects are copied as they are.
+ */
+void PdoHandler::pack(Tpdo *tpdo, uint8_t *data)
+{
+    for (uint8_t i = 0; i < tpdo->plan.numSteps; i++)
+    {
+        PlanStep *step = &tpdo->plan.steps[i];
+
+        if (step->source != NULL)
+        {
+            memcpy(&data[step->offset], step->source, step->size);
+        }
+        else
+        {
+            uint32_t value = 0;
+            objectDictionary.read(step->entry, &value);
+            for (uint8_t j = 0; j < step->size; j++)
+                data[step->offset + j] = value >> (8 * j);
+        }
+    }
+}
+
+void PdoHandler::transmit(uint8_t number, uint8_t *data)
+{
+    Tpdo *tpdo = &tpdos[number];
+    CAN_FRAME frame;
+
+    frame.id = parameters.tpdo[number].cobId & 0x7FF;
+    frame.length = tpdo->plan.length;
+    memcpy(frame.data.bytes, data, tpdo->plan.length);
+
+    tpdo->lastSent = micros();
+    tpdo->syncCount = 0;
+    if (!canHandler.sendFrame(frame, CAN_TX_NORMAL))
+    {
+        tpdo->stats.dropped++; // an on-change TPDO is tried again after the inhibit time
+        return;
+    }
+    memcpy(tpdo->last, data, tpdo->plan.length);
+    tpdo->sentOnce = true;
+    tpdo->stats.count++;
+}
+
+/*
+ * Write the data of an RPDO into the mapped entries. An entry which already holds the
+ * value is skipped, so its write callback (e.g. rebuilding the pedal map) only runs
+ * when the value changes, not with every frame. Write only entries are always written.
+ */
+void PdoHandler::apply(Rpdo *rpdo, uint8_t *data)
+{
+    for (uint8_t i = 0; i < rpdo->plan.numSteps; i++)
+    {
+        PlanStep *step = &rpdo->plan.steps[i];
+        uint32_t value = 0, current;
+        uint32_t mask = (step->size >= 4 ? 0xFFFFFFFF : (1ul << (8 * step->size)) - 1);
+
+        for (uint8_t j = 0; j < step->size; j++)
+            value |= (uint32_t) data[step->offset + j] << (8 * j);
+        if (objectDictionary.read(step->entry, &current) == SDO_ABORT_NONE && ((current ^ value) & mask) == 0)
+            continue;
+        objectDictionary.write(step->entry, value);
+    }
+}
+
+/*
+ * An RPDO was received.
+ */
+void PdoHandler::handleCanFrame(CAN_FRAME *frame)
+{
+    if (nmtHandler.getState() != NMT_OPERATIONAL)
+        return;
+
+    for (uint8_t i = 0; i < CFG_CANOPEN_NUM_RPDOS; i++)
+    {
+        Rpdo *rpdo = &rpdos[i];
+
+        if (frame->extended || frame->id != rpdo->attachedId)
+            continue;
+        if (frame->length < rpdo->plan.length)
+        {
+            rpdo->stats.dropped++;
+            return;
+        }
+        rpdo->stats.count++;
+        if (parameters.rpdo[i].transmissionType <= PDO_TYPE_SYNC_MAX)
+        {
+            memcpy(rpdo->pending, frame->data.bytes, 8);
+            rpdo->hasPending = true;
+        }
+        else
+        {
+            apply(rpdo, frame->data.bytes);
+        }
+        return;
+    }
+}
+
+PdoParameterSet *PdoHandler::getParameters()
+{
+    return &parameters;
+}
+
+/*
+ * Get the number of frames sent (TPDO) or received (RPDO) of a PDO.
+ *
+ * \param transmit - true for a TPDO, false for an RPDO
+ * \param number - the PDO, counting from 0
+ */
+PdoStatistics *PdoHandler::getStatistics(bool transmit, uint8_t number)
+{
+    if (transmit)
+        return (number < CFG_CANOPEN_NUM_TPDOS ? &tpdos[number].stats : NULL);
+    return (number < CFG_CANOPEN_NUM_RPDOS ? &rpdos[number].stats : NULL);
+}
@@ -0,0 +1,152 @@
+/*
+ * PdoHandler.h
+ *
+ * CANopen process data objects: a TPDO packs entries of the object dictionary into
+ * one frame which is sent cyclically, on change or on SYNC, an RPDO writes the
+ * bytes of a received frame into entries. Which entries go where is set by the
+ * mapping parameters (0x1600/0x1A00), which are compiled into a packing plan
+ * whenever they change, so sending a PDO is a short copy loop.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+ */
+
+#ifndef PDO_HANDLER_H_
+#define PDO_HANDLER_H_
+
+#include <Arduino.h>
+#include "config.h"
+#include "CanHandler.h"
+#include "ObjectDictionary.h"
+
+#define PDO_MAX_MAPPED          8           // entries per PDO (each at least one byte)
+#define PDO_COB_ID_INVALID      0x80000000  // bit 31 of the COB-ID: the PDO is disabled
+#define PDO_COB_ID_NO_RTR       0x40000000  // bit 30 of the COB-ID: no RTR allowed on the PDO
+#define PDO_SAMPLE_INTERVAL     1000        // min time between two checks of an on-change TPDO for changes (in us)
+
+#if CFG_CANOPEN_NUM_RPDOS < 1 || CFG_CANOPEN_NUM_RPDOS > 4 || CFG_CANOPEN_NUM_TPDOS < 1 || CFG_CANOPEN_NUM_TPDOS > 4
+#error "the object dictionary has entries for 1 to 4 RPDOs and TPDOs"
+#endif
+
+/*
+ * Transmission types (sub-index 2 of the communication parameter)
+ * 0:       synchronous, acyclic - sent with the next SYNC if the data changed (RPDO: applied at the next SYNC)
+ * 1 - 240: synchronous, cyclic - sent with every n-th SYNC (RPDO: applied at the next SYNC)
+ * 254:     cyclic - sent every event timer
+ * 255:     on change - sent when the data changed, at most once per inhibit time and at
+ *          least once per event timer (if set) (RPDO 254/255: applied on reception)
+ */
+#define PDO_TYPE_SYNC_ACYCLIC   0
+#define PDO_TYPE_SYNC_MAX       240
+#define PDO_TYPE_CYCLIC         254
+#define PDO_TYPE_ON_CHANGE      255
+
+/*
+ * Communication and mapping parameter of one PDO, the entries 0x1400/0x1600 (RPDO)
+ * and 0x1800/0x1A00 (TPDO) of the object dictionary.
+ */
+struct PdoParameters
+{
+    uint32_t cobId;             // the CAN id, PDO_COB_ID_INVALID set = disabled
+    uint8_t transmissionType;
+    uint16_t inhibitTime;       // min time between two transmissions in 100 us (TPDO only)
+    uint16_t eventTimer;        // in ms, 0 = none (TPDO only)
+    uint8_t numMapped;          // number of valid entries in mapping
+    uint32_t mapping[PDO_MAX_MAPPED]; // 0xIIIISSLL: index, sub-index and length in bits of each mapped entry
+};
+
+struct PdoParameterSet
+{
+    PdoParameters rpdo[CFG_CANOPEN_NUM_RPDOS];
+    PdoParameters tpdo[CFG_CANOPEN_NUM_TPDOS];
+};
+
+struct PdoStatistics
+{
+    uint32_t count;             // frames sent or received
+    uint32_t dropped;           // TPDO: frames the transmit queue didn't take, RPDO: frames which were too short
+};
+
+class PdoHandler : public CanObserver
+{
+public:
+    PdoHandler();
+    void setup();
+    void process();
+    void sync();
+    void handleCanFrame(CAN_FRAME *frame);
+    uint32_t configure(const OdEntry *entry);
+    PdoParameterSet *getParameters();
+    PdoStatistics *getStatistics(bool transmit, uint8_t number);
+
+private:
+    /*
+     * One step of a packing plan: copy an entry from/to the frame.
+     */
+    struct PlanStep {
+        const OdEntry *entry;
+        const uint8_t *source;  // TPDO: the value in its object (read directly), NULL = use the dictionary
+        uint8_t offset;         // position in the frame
+        uint8_t size;           // in bytes
+    };
+
+    struct Plan {
+        PlanStep steps[PDO_MAX_MAPPED];
+        uint8_t numSteps;
+        uint8_t length;         // length of the frame
+    };
+
+    struct Tpdo {
+        Plan plan;
+        uint8_t last[8];        // data sent the last time
+        bool sentOnce;
+        uint32_t lastSent;      // in us
+        uint32_t lastSample;    // when an on-change TPDO was last checked for changes
+        uint8_t syncCount;      // SYNCs since the last transmission
+        PdoStatistics stats;
+    };
+
+    struct Rpdo {
+        Plan plan;
+        uint32_t attachedId;    // the id we listen to, PDO_COB_ID_INVALID = none
+        uint8_t pending[8];     // data received for a synchronous RPDO, applied at the next SYNC
+        bool hasPending;
+        PdoStatistics stats;
+    };
+
+    PdoParameterSet parameters;
+    Tpdo tpdos[CFG_CANOPEN_NUM_TPDOS];
+    Rpdo rpdos[CFG_CANOPEN_NUM_RPDOS];
+
+    void setDefaults();
+    uint32_t compile(PdoParameters *params, bool transmit, Plan *plan);
+    uint32_t receiveId(PdoParameters *params, Plan *plan);
+    bool listen(uint8_t number, uint32_t id);
+    void pack(Tpdo *tpdo, uint8_t *data);
+    void transmit(uint8_t number, uint8_t *data);
+    void apply(Rpdo *rpdo, uint8_t *data);
+};
+
+extern PdoHandler pdoHandler;
+
+#endif /* PDO_HANDLER_H_ */
@@ -0,0 +1,104 @@
+/*
+ * PedalMap.cpp
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "PedalMap.h"
+
+PedalMap::PedalMap()
+{
+    clear();
+}
+
+/*
+ * Remove all points. Until points are added and build() is called, everything maps to 0.
+ */
+void PedalMap::clear()
+{
+    numPoints = 0;
+    for (uint16_t i = 0; i < PEDAL_MAP_SIZE; i++)
+        index[i] = 0;
+}
+
+/*
+ * Add a point of the curve. The positions have to be in ascending order and within
+ * 0-1000, a step is described by two points one permille apart.
+ * Returns false if the point was rejected.
+ */
+bool PedalMap::addPoint(int16_t position, int16_t level)
+{
+    if (numPoints >= PEDAL_MAP_MAX_POINTS || position < 0 || position > 1000)
+        return false;
+    if (numPoints > 0 && position <= points[numPoints - 1].position)
+        return false;
+    points[numPoints].position = position;
+    points[numPoints].level = level;
+    points[numPoints].slope = 0;
+    numPoints++;
+    return true;
+}
+
+/*
+ * Calculate the slopes of the segments and the index. Call it after the last addPoint(),
+ * i.e. whenever the parameters of the curve change - not in the tick, this divides.
+ */
+void PedalMap::build()
+{
+    for (uint8_t i = 1; i < numPoints; i++)
+        points[i].slope = q16Ratio(points[i].level - points[i - 1].level, points[i].position - points[i - 1].position);
+
+    uint8_t point = 0;
+    for (uint16_t i = 0; i < PEDAL_MAP_SIZE; i++) {
+        while (point < numPoints && points[point].position < (int16_t) (i * PEDAL_MAP_STEP))
+            point++;
+        index[i] = point;
+    }
+}
+
+/*
+ * Map a position (0-1000 permille, clamped) to the level of the curve: linear between
+ * the points, the level of the first/last point before/after them.
+ */
+int16_t PedalMap::map(int16_t position)
+{
+    position = constrain(position, (int16_t) 0, (int16_t) 1000);
+    if (numPoints == 0)
+        return 0;
+
+    // only points within the interval of the index entry can lie before the position
+    uint8_t i = index[position >> PEDAL_MAP_SHIFT];
+    while (i < numPoints && points[i].position < position)
+        i++;
+
+    if (i == numPoints)
+        return points[numPoints - 1].level;
+    if (i == 0 || points[i].position == position)
+        return points[i].level;
+
+    return addSat16(points[i - 1].level, q16Mul16(position - points[i - 1].position, points[i].slope));
+}
+
+uint8_t PedalMap::getNumPoints()
+{
+    return numPoints;
+}
@@ -0,0 +1,66 @@
+/*
+ * PedalMap.h
+ *
+ * A piecewise linear curve which maps a pedal position (0-1000 permille) to a level.
+ * The curve is given as up to PEDAL_MAP_MAX_POINTS points. build() stores the slope of
+ * each segment (Q16) and, for every PEDAL_MAP_STEP permille, the first point at or after
+ * that position, so map() finds its segment with one lookup and a step of at most a few
+ * points and then needs one multiplication. The points themselves are hit exactly, a
+ * step in the curve (two points one permille apart) stays a step.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PEDAL_MAP_H_
+#define PEDAL_MAP_H_
+
+#include <Arduino.h>
+#include "FixedPoint.h"
+
+#define PEDAL_MAP_MAX_POINTS 16  // points of the curve
+#define PEDAL_MAP_SHIFT      3   // index resolution: one entry every 2^PEDAL_MAP_SHIFT permille
+#define PEDAL_MAP_STEP       (1 << PEDAL_MAP_SHIFT)
+#define PEDAL_MAP_SIZE       ((1000 >> PEDAL_MAP_SHIFT) + 1)
+
+class PedalMap
+{
+public:
+    PedalMap();
+    void clear();
+    bool addPoint(int16_t position, int16_t level);
+    void build();
+    int16_t map(int16_t position);
+    uint8_t getNumPoints();
+
+private:
+    struct Point {
+        int16_t position; // 0-1000, ascending
+        int16_t level;
+        q16_t slope; // slope of the segment from the previous point to this one
+    };
+
+    Point points[PEDAL_MAP_MAX_POINTS];
+    uint8_t numPoints;
+    uint8_t index[PEDAL_MAP_SIZE]; // first point at or after position i * PEDAL_MAP_STEP
+};
+
+#endif /* PEDAL_MAP_H_ */
@@ -32,6 +32,7 @@
  */
 PotBrake::PotBrake() : Throttle() {
     commonName = "Potentiometer (analog) brake";
+    scale = 0;
 }
 
 /*
@@ -48,7 +49,7 @@ void PotBrake::setup() {
     //pinMode(THROTTLE_INPUT_BRAKELIGHT, INPUT_PULLUP); //Brake light switch
 
     loadConfiguration();
-    tickHandler.attach(this, CFG_TICK_INTERVAL_POT_THROTTLE);
+    tickHandler.attach(this, CFG_TICK_INTERVAL_POT_THROTTLE, TICK_STAGE_INPUT);
 }
 
 /*
@@ -68,44 +69,36 @@ RawSignalData *PotBrake::acquireRawSignal() {
 }
 
 /*
- * Perform sanity check on the ADC input values.
+ * Perform sanity check on the ADC input value and convert it to a range from 0 to 1000
+ * (per mille) according to the specified range, in one pass.
  */
-bool PotBrake::validateSignal(RawSignalData *rawSignal) {
+bool PotBrake::evaluateSignal(RawSignalData *rawSignal, int16_t *position) {
     PotBrakeConfiguration *config = (PotBrakeConfiguration *) getConfiguration();
+    int16_t calcBrake1;
 
     if (rawSignal->input1 > (config->maximumLevel1 + CFG_THROTTLE_TOLERANCE)) {
         if (status == OK)
             Logger::debug(POTBRAKEPEDAL, (char *)Constants::valueOutOfRange, rawSignal->input1);
         status = ERR_HIGH_T1;
-        return true; // even if it's too high, let it process and apply full regen !
-    }
-    if (rawSignal->input1 < (config->minimumLevel1 - CFG_THROTTLE_TOLERANCE)) {
+        // even if it's too high, let it process and apply full regen !
+    } else if (rawSignal->input1 < (config->minimumLevel1 - CFG_THROTTLE_TOLERANCE)) {
         if (status == OK)
             Logger::debug(POTBRAKEPEDAL, (char *)Constants::valueOutOfRange, rawSignal->input1);
         status = ERR_LOW_T1;
         return false;
+    } else {
+        // all checks passed -> brake is OK
+        if (status != OK)
+            Logger::info(POTBRAKEPEDAL, (char *)Constants::normalOperation);
+        status = OK;
     }
 
-    // all checks passed -> brake is OK
-    if (status != OK)
-        Logger::info(POTBRAKEPEDAL, (char *)Constants::normalOperation);
-    status = OK;
-    return true;
-}
-
-/*
- * Convert the raw ADC values to a range from 0 to 1000 (per mille) according
- * to the specified range and the type of potentiometer.
- */
-int16_t PotBrake::calculatePedalPosition(RawSignalData *rawSignal) {
-    PotBrakeConfiguration *config = (PotBrakeConfiguration *) getConfiguration();
-    uint16_t calcBrake1, clampedLevel;
-
-    if (config->maximumLevel1 == 0) //brake processing disabled if max is 0
-        return 0;
+    if (config->maximumLevel1 == 0) { //brake processing disabled if max is 0
+        *position = 0;
+        return true;
+    }
 
-    clampedLevel = constrain(rawSignal->input1, config->minimumLevel1, config->maximumLevel1);
-    calcBrake1 = map(clampedLevel, config->minimumLevel1, config->maximumLevel1, (uint16_t) 0, (uint16_t) 1000);
+    calcBrake1 = normalizeAndConstrainInput(rawSignal->input1, config->minimumLevel1, scale);
 
     //This prevents flutter in the ADC readings of the brake from slamming regen on intermittently
     // just because the value fluttered a couple of numbers. This makes sure that we're actually
@@ -114,23 +107,8 @@ int16_t PotBrake::calculatePedalPosition(RawSignalData *rawSignal) {
     if (calcBrake1 < 15)
         calcBrake1 = 0;
 
-    return calcBrake1;
-}
-
-/*
- * Overrides the standard implementation of throttle mapping as different rules apply to
- * brake based regen.
- */
-int16_t PotBrake::mapPedalPosition(int16_t pedalPosition) {
-    ThrottleConfiguration *config = (ThrottleConfiguration *) getConfiguration();
-    int16_t brakeLevel, range;
-
-    range = config->maximumRegen - config->minimumRegen;
-    brakeLevel = -10 * range * pedalPosition / 1000;
-    brakeLevel -= 10 * config->minimumRegen;
-    //Logger::debug(POTBRAKEPEDAL, "level: %d", level);
-
-    return brakeLevel;
+    *position = calcBrake1;
+    return true;
 }
 
 /*
@@ -165,7 +143,24 @@ void PotBrake::loadConfiguration() {
     config->minimumLevel1 = BrakeMinValue;
     config->maximumLevel1 = BrakeMaxValue;
     config->AdcPin1 = BrakeADC;
-    
+
+    updateScaling();
+}
+
+/*
+ * Pre-calculate the factor to normalize the ADC value and build the pedal map.
+ * Different rules than for the throttle apply to brake based regen: it ramps linearly
+ * from minimumRegen with the pedal released to maximumRegen with the pedal fully pressed.
+ */
+void PotBrake::updateScaling() {
+    PotBrakeConfiguration *config = (PotBrakeConfiguration *) getConfiguration();
+
+    scale = normalizeScale(config->minimumLevel1, config->maximumLevel1);
+
+    pedalMap.clear();
+    pedalMap.addPoint(0, -10 * config->minimumRegen);
+    pedalMap.addPoint(1000, -10 * config->maximumRegen);
+    pedalMap.build();
 }
 
 
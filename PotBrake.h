@@ -57,14 +57,14 @@ public:
     RawSignalData *acquireRawSignal();
 
     void loadConfiguration();
+    void updateScaling();
 
 protected:
-    bool validateSignal(RawSignalData *);
-    int16_t calculatePedalPosition(RawSignalData *);
-    int16_t mapPedalPosition(int16_t);
+    bool evaluateSignal(RawSignalData *, int16_t *);
 
 private:
     RawSignalData rawSignal;
+    q16_t scale; // normalizeScale() of the pot
 };
 
 #endif /* POT_BRAKE_H_ */
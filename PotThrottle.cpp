@@ -31,6 +31,8 @@
  */
 PotThrottle::PotThrottle() : Throttle() {
     commonName = "Potentiometer (analog) accelerator";
+    scale1 = 0;
+    scale2 = 0;
 }
 
 /*
@@ -48,7 +50,7 @@ void PotThrottle::setup() {
     //set digital ports to inputs and pull them up all inputs currently active low
     //pinMode(THROTTLE_INPUT_BRAKELIGHT, INPUT_PULLUP); //Brake light switch
 
-    tickHandler.attach(this, CFG_TICK_INTERVAL_POT_THROTTLE);
+    tickHandler.attach(this, CFG_TICK_INTERVAL_POT_THROTTLE, TICK_STAGE_INPUT);
 }
 
 /*
@@ -70,36 +72,38 @@ RawSignalData *PotThrottle::acquireRawSignal() {
 }
 
 /*
- * Perform sanity check on the ADC input values. The values are normalized (without constraining them)
- * and the checks are performed on a 0-1000 scale with a percentage tolerance
+ * Perform sanity check on the ADC input values and convert them to a range from 0 to 1000
+ * (per mille) according to the specified range and the type of potentiometer, in one pass.
+ * The values are normalized (without constraining them) and the checks are performed on a
+ * 0-1000 scale with a percentage tolerance.
  */
-bool PotThrottle::validateSignal(RawSignalData *rawSignal) {
+bool PotThrottle::evaluateSignal(RawSignalData *rawSignal, int16_t *position) {
     PotThrottleConfiguration *config = (PotThrottleConfiguration *) getConfiguration();
-    int32_t calcThrottle1, calcThrottle2;
+    int32_t calcThrottle1, calcThrottle2, checkThrottle1;
 
-    calcThrottle1 = normalizeInput(rawSignal->input1, config->minimumLevel1, config->maximumLevel1);
+    calcThrottle1 = normalizeInput(rawSignal->input1, config->minimumLevel1, scale1);
+    checkThrottle1 = calcThrottle1;
     if (config->numberPotMeters == 1 && config->throttleSubType == 2) { // inverted
-        calcThrottle1 = 1000 - calcThrottle1;
+        checkThrottle1 = 1000 - calcThrottle1;
     }
 
-
-    if (calcThrottle1 > (1000 + CFG_THROTTLE_TOLERANCE))
+    if (checkThrottle1 > (1000 + CFG_THROTTLE_TOLERANCE))
     {
         if (status == OK)
-            Logger::debug(POTACCELPEDAL, "ERR_HIGH_T1: throttle 1 value out of range: %l", calcThrottle1);
+            Logger::debug(POTACCELPEDAL, "ERR_HIGH_T1: throttle 1 value out of range: %l", checkThrottle1);
         status = ERR_HIGH_T1;
         return false;
     }
 
-    if (calcThrottle1 < (0 - CFG_THROTTLE_TOLERANCE)) {
+    if (checkThrottle1 < (0 - CFG_THROTTLE_TOLERANCE)) {
         if (status == OK)
-            Logger::debug(POTACCELPEDAL, "ERR_LOW_T1: throttle 1 value out of range: %l ", calcThrottle1);
+            Logger::debug(POTACCELPEDAL, "ERR_LOW_T1: throttle 1 value out of range: %l ", checkThrottle1);
         status = ERR_LOW_T1;
         return false;
     }
 
     if (config->numberPotMeters > 1) {
-        calcThrottle2 = normalizeInput(rawSignal->input2, config->minimumLevel2, config->maximumLevel2);
+        calcThrottle2 = normalizeInput(rawSignal->input2, config->minimumLevel2, scale2);
 
         if (calcThrottle2 > (1000 + CFG_THROTTLE_TOLERANCE)) {
             if (status == OK)
@@ -124,6 +128,7 @@ bool PotThrottle::validateSignal(RawSignalData *rawSignal) {
                 status = ERR_MISMATCH;
                 return false;
             }
+            calcThrottle2 = 1000 - calcThrottle2;
         } else {
             if ((calcThrottle1 - ThrottleMaxErrValue) > calcThrottle2) { //then throttle1 is too large compared to 2
                 if (status == OK)
@@ -138,34 +143,17 @@ bool PotThrottle::validateSignal(RawSignalData *rawSignal) {
                 return false;
             }
         }
+        calcThrottle1 = (calcThrottle1 + calcThrottle2) / 2; // now the average of the two
     }
 
     // all checks passed -> throttle is ok
     if (status != OK)
         if (status != ERR_MISC) Logger::info(POTACCELPEDAL, (char *)Constants::normalOperation);
     status = OK;
+    *position = calcThrottle1;
     return true;
 }
 
-/*
- * Convert the raw ADC values to a range from 0 to 1000 (per mille) according
- * to the specified range and the type of potentiometer.
- */
-int16_t PotThrottle::calculatePedalPosition(RawSignalData *rawSignal) {
-    PotThrottleConfiguration *config = (PotThrottleConfiguration *) getConfiguration();
-    uint16_t calcThrottle1, calcThrottle2;
-
-    calcThrottle1 = normalizeInput(rawSignal->input1, config->minimumLevel1, config->maximumLevel1);
-
-    if (config->numberPotMeters > 1) {
-        calcThrottle2 = normalizeInput(rawSignal->input2, config->minimumLevel2, config->maximumLevel2);
-        if (config->throttleSubType == 2) // inverted
-            calcThrottle2 = 1000 - calcThrottle2;
-        calcThrottle1 = (calcThrottle1 + calcThrottle2) / 2; // now the average of the two
-    }
-    return calcThrottle1;
-}
-
 /*
  * Return the device ID
  */
@@ -200,5 +188,18 @@ void PotThrottle::loadConfiguration() {
     Logger::debug(POTACCELPEDAL, "# of pots: %d       subtype: %d", config->numberPotMeters, config->throttleSubType);
     Logger::debug(POTACCELPEDAL, "T1 MIN: %l MAX: %l      T2 MIN: %l MAX: %l", config->minimumLevel1, config->maximumLevel1, config->minimumLevel2,
                   config->maximumLevel2);
+
+    updateScaling();
+}
+
+/*
+ * Pre-calculate the factors to normalize the ADC values of the pots.
+ */
+void PotThrottle::updateScaling() {
+    PotThrottleConfiguration *config = (PotThrottleConfiguration *) getConfiguration();
+
+    Throttle::updateScaling();
+    scale1 = normalizeScale(config->minimumLevel1, config->maximumLevel1);
+    scale2 = normalizeScale(config->minimumLevel2, config->maximumLevel2);
 }
 
@@ -63,13 +63,14 @@ public:
     RawSignalData *acquireRawSignal();
 
     void loadConfiguration();
+    void updateScaling();
 
 protected:
-    bool validateSignal(RawSignalData *);
-    int16_t calculatePedalPosition(RawSignalData *);
+    bool evaluateSignal(RawSignalData *, int16_t *);
 
 private:
     RawSignalData rawSignal;
+    q16_t scale1, scale2; // normalizeScale() of pot 1 and 2
 };
 
 #endif /* POT_THROTTLE_H_ */
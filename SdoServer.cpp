@@ -0,0 +1,151 @@
+/*
+ * SdoServer.cpp
+ *
+ * All entries of the object dictionary are at most 4 bytes long, so they fit into an
+ * expedited transfer. Segmented and block transfers are answered with an abort.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+ */
+
+#include "SdoServer.h"
+#include "NmtHandler.h"
+
+SdoServer sdoServer;
+
+SdoServer::SdoServer() : CanObserver()
+{
+    requests = 0;
+    aborts = 0;
+}
+
+/*
+ * Listen to the SDO requests to our node id (the one we send the heartbeat with) on the EV bus.
+ */
+void SdoServer::setup()
+{
+    setCANOpenMode(true);
+    setNodeID(canHandler.getMasterID());
+    canHandler.attach(this, 0, 0x7FF, false); // id 0 isn't a PDO, so only the SDO frames of the node
+    Logger::info("SDO server on node %d, %d objects", getNodeID(), objectDictionary.getNumEntries());
+}
+
+/*
+ * Answer a request with the value read, a write acknowledge or an abort.
+ */
+void SdoServer::handleSDORequest(SDO_FRAME *frame)
+{
+    SDO_FRAME response;
+
+    if (frame->cmd == SDO_ABORT)
+        return; // nothing to abort, every transfer is completed with one request
+    if (nmtHandler.getState() == NMT_STOPPED)
+        return; // a stopped node only listens to NMT commands
+
+    requests++;
+    uint32_t abortCode = serve(frame, &response);
+    if (abortCode != SDO_ABORT_NONE)
+    {
+        sendAbort(frame, abortCode);
+        return;
+    }
+    canHandler.sendSDOResponse(&response);
+}
+
+/*
+ * Look up the entry of a request and read or write it.
+ *
+ * \param frame - the request
+ * \param response - filled with the response if the request succeeds
+ * \retval an SDO abort code, SDO_ABORT_NONE if the request succeeded
+ */
+uint32_t SdoServer::serve(SDO_FRAME *frame, SDO_FRAME *response)
+{
+    uint32_t value = 0;
+    uint32_t abortCode;
+
+    if (frame->cmd != SDO_READ && frame->cmd != SDO_WRITE)
+        return SDO_ABORT_COMMAND;
+
+    const OdEntry *entry = objectDictionary.find(frame->index, frame->subIndex);
+    if (entry == NULL)
+        return (objectDictionary.hasIndex(frame->index) ? SDO_ABORT_NO_SUBINDEX : SDO_ABORT_NO_OBJECT);
+    uint8_t size = ObjectDictionary::getSize(entry->type);
+
+    response->nodeID = getNodeID();
+    response->index = frame->index;
+    response->subIndex = frame->subIndex;
+
+    if (frame->cmd == SDO_READ)
+    {
+        abortCode = objectDictionary.read(entry, &value);
+        response->cmd = SDO_READ;
+        response->dataLength = size;
+        for (uint8_t i = 0; i < size && i < sizeof(value); i++) // the OD types are 4 bytes at most
+            response->data[i] = value >> (8 * i);
+        return abortCode;
+    }
+
+    if (frame->dataLength == 0)
+        return SDO_ABORT_COMMAND; // a segmented download
+    if (frame->dataLength != size)
+        return SDO_ABORT_LENGTH;
+    for (int i = 0; i < size; i++)
+        value |= (uint32_t) frame->data[i] << (8 * i);
+    response->cmd = SDO_WRITEACK;
+    response->dataLength = 0;
+    return objectDictionary.write(entry, value);
+}
+
+void SdoServer::sendAbort(SDO_FRAME *frame, uint32_t abortCode)
+{
+    SDO_FRAME response;
+
+    aborts++;
+    response.nodeID = getNodeID();
+    response.cmd = SDO_ABORT;
+    response.index = frame->index;
+    response.subIndex = frame->subIndex;
+    response.dataLength = 4;
+    for (int i = 0; i < 4; i++)
+        response.data[i] = abortCode >> (8 * i);
+    canHandler.sendSDOResponse(&response);
+    Logger::debug("SDO abort %X for %X sub %d", abortCode, frame->index, frame->subIndex);
+}
+
+/*
+ * Responses of other SDO servers to our node id are of no interest, we don't send requests.
+ */
+void SdoServer::handleSDOResponse(SDO_FRAME *)
+{
+}
+
+uint32_t SdoServer::getRequestCount()
+{
+    return requests;
+}
+
+uint32_t SdoServer::getAbortCount()
+{
+    return aborts;
+}
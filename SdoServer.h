@@ -0,0 +1,60 @@
+/*
+ * SdoServer.h
+ *
+ * CANopen SDO server of the EVCU: answers the expedited SDO requests to our node id
+ * (0x600 + id) from the object dictionary, so a service tool can read and change the
+ * parameters of the devices at run time.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+ */
+
+#ifndef SDO_SERVER_H_
+#define SDO_SERVER_H_
+
+#include <Arduino.h>
+#include "config.h"
+#include "CanHandler.h"
+#include "ObjectDictionary.h"
+
+class SdoServer : public CanObserver
+{
+public:
+    SdoServer();
+    void setup();
+    void handleSDORequest(SDO_FRAME *frame);
+    void handleSDOResponse(SDO_FRAME *frame);
+    uint32_t getRequestCount();
+    uint32_t getAbortCount();
+
+private:
+    uint32_t requests;  // requests answered
+    uint32_t aborts;    // of which were answered with an abort
+
+    uint32_t serve(SDO_FRAME *frame, SDO_FRAME *response);
+    void sendAbort(SDO_FRAME *frame, uint32_t abortCode);
+};
+
+extern SdoServer sdoServer;
+
+#endif /* SDO_SERVER_H_ */
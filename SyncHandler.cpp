@@ -0,0 +1,230 @@
+/*
+ * SyncHandler.cpp
+ *
+ * The SYNC period must be a multiple of the control tick. A consumer handles at most one
+ * SYNC per control tick, further ones are counted as overruns. Its control tick is moved
+ * by at most 1/8 of an interval per SYNC, so the pedals and the motor controller never
+ * see a sudden jump in their timing.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "SyncHandler.h"
+#include "TickTimer.h"
+#include "PdoHandler.h"
+#include "NmtHandler.h"
+
+SyncHandler syncHandler;
+
+SyncHandler::SyncHandler() : CanObserver()
+{
+    parameters.cobId = SYNC_COB_ID_DEFAULT;
+    parameters.cyclePeriod = 0;
+    producer = false;
+    attachedId = 0;
+    ticksPerSync = 0;
+    tickCount = 0;
+    pending = false;
+    lost = false;
+    lastSync = 0;
+    syncs = 0;
+    overruns = 0;
+    phaseError = 0;
+}
+
+/*
+ * Produce the SYNC if a period is configured (CFG_CANOPEN_SYNC_PERIOD), otherwise listen
+ * to the SYNC of another node. Both are driven by the control tick, in which the
+ * synchronous PDOs are handled after the pedals were sampled and before the motor
+ * controller computes its command.
+ */
+void SyncHandler::setup()
+{
+    parameters.cobId = SYNC_COB_ID_DEFAULT | (CFG_CANOPEN_SYNC_PERIOD ? SYNC_COB_ID_PRODUCER : 0);
+    parameters.cyclePeriod = CFG_CANOPEN_SYNC_PERIOD;
+    if (!listen())
+        Logger::info("SYNC: no free CAN observer, the SYNC is not received");
+    tickHandler.attach(this, SYNC_TICK_INTERVAL, TICK_STAGE_INPUT);
+    Logger::info("SYNC: %s id %X, period %l us", (producer ? "producer" : "consumer"), parameters.cobId & 0x7FF, parameters.cyclePeriod);
+}
+
+/*
+ * Send the SYNC every n-th control tick (producer) or handle the one received since the
+ * last tick (consumer). A consumer with a cycle period reports once when the SYNC stays
+ * away for 1.5 periods.
+ */
+void SyncHandler::handleTick()
+{
+    uint32_t now = micros();
+
+    if (nmtHandler.getState() == NMT_STOPPED)
+    {
+        pending = false; // no SYNC while stopped
+        return;
+    }
+
+    if (producer)
+    {
+        if (++tickCount < ticksPerSync)
+            return;
+        tickCount = 0;
+
+        CAN_FRAME frame;
+        frame.id = parameters.cobId & 0x7FF;
+        frame.length = 0;
+        if (!canHandler.sendFrame(frame, CAN_TX_CONTROL))
+            return; // nobody got it, so no synchronous PDOs either
+        syncs++;
+        lastSync = now;
+        pdoHandler.sync();
+        return;
+    }
+
+    if (pending)
+    {
+        pending = false;
+        pdoHandler.sync();
+    }
+    else if (!lost && syncs > 0 && parameters.cyclePeriod != 0 && now - lastSync > parameters.cyclePeriod / 2 * 3)
+    {
+        lost = true;
+        Logger::info("SYNC: lost, none received for %l us", now - lastSync);
+    }
+}
+
+/*
+ * A SYNC was received: mark it for the next control tick and pull the phase of the
+ * control tick towards CFG_CANOPEN_SYNC_DELAY after its reception. The receive time
+ * is converted from micros() to the time base of the TickTimer via its age.
+ */
+void SyncHandler::handleCanFrame(CAN_FRAME *frame)
+{
+    if (frame->length > 1) // a SYNC has no data or a counter
+        return;
+
+    if (pending)
+    {
+        overruns++; // SYNCs faster than the control tick, only the first one per tick counts
+        return;
+    }
+    pending = true;
+    syncs++;
+    lastSync = frame->timestamp;
+    if (lost)
+    {
+        lost = false;
+        Logger::info("SYNC: received again");
+    }
+
+    uint32_t received = TickTimer::now() - (micros() - frame->timestamp);
+    phaseError = tickHandler.align(SYNC_TICK_INTERVAL, received + CFG_CANOPEN_SYNC_DELAY, SYNC_TICK_INTERVAL / 8);
+}
+
+/*
+ * Check and apply the COB-ID or the cycle period after the object dictionary stored it
+ * (0x1005 or 0x1006 was written, both are checked as they depend on each other).
+ *
+ * \retval an SDO abort code, SDO_ABORT_NONE if the SYNC was re-configured
+ */
+uint32_t SyncHandler::configure(const OdEntry *)
+{
+    if ((parameters.cobId & ~(SYNC_COB_ID_PRODUCER | 0x7FF)) || (parameters.cobId & 0x7FF) == 0)
+        return SDO_ABORT_VALUE_RANGE; // only 11 bit ids, 0 is NMT
+    if (parameters.cyclePeriod % SYNC_TICK_INTERVAL || parameters.cyclePeriod / SYNC_TICK_INTERVAL > 0xFFFF)
+        return SDO_ABORT_VALUE_RANGE;
+    bool consumer = !(parameters.cobId & SYNC_COB_ID_PRODUCER) || parameters.cyclePeriod == 0;
+    if (consumer && !canHandler.canReceive(parameters.cobId & 0x7FF, 0x7FF, false))
+        return SDO_ABORT_DEVICE_STATE; // the filters are held while the motor runs and don't pass the id
+
+    if (!listen())
+        return SDO_ABORT_OUT_OF_MEMORY; // all CFG_CAN_NUM_OBSERVERS are in use
+    Logger::info("SYNC: %s id %X, period %l us", (producer ? "producer" : "consumer"), parameters.cobId & 0x7FF, parameters.cyclePeriod);
+    return SDO_ABORT_NONE;
+}
+
+/*
+ * Switch between producer and consumer and attach to the SYNC id (and detach from the
+ * previous one) if it changed.
+ *
+ * \retval false if CanHandler has no free observer, nothing changed then
+ */
+bool SyncHandler::listen()
+{
+    bool produce = (parameters.cobId & SYNC_COB_ID_PRODUCER) && parameters.cyclePeriod != 0;
+    uint32_t id = (produce ? 0 : parameters.cobId & 0x7FF);
+
+    if (id != attachedId)
+    {
+        if (attachedId != 0)
+            canHandler.detach(this, attachedId, 0x7FF);
+        if (id != 0 && !canHandler.attach(this, id, 0x7FF, false))
+        {
+            if (attachedId != 0)
+                canHandler.attach(this, attachedId, 0x7FF, false); // takes the entry just freed
+            return false;
+        }
+        attachedId = id;
+    }
+
+    producer = produce;
+    ticksPerSync = parameters.cyclePeriod / SYNC_TICK_INTERVAL;
+    tickCount = 0;
+    pending = false;
+    lost = false;
+    return true;
+}
+
+SyncParameters *SyncHandler::getParameters()
+{
+    return &parameters;
+}
+
+bool SyncHandler::isProducer()
+{
+    return producer;
+}
+
+/*
+ * Get the number of SYNCs sent (producer) or received (consumer).
+ */
+uint32_t SyncHandler::getSyncCount()
+{
+    return syncs;
+}
+
+/*
+ * Get the number of received SYNCs which came before the previous one was handled by a control tick.
+ */
+uint32_t SyncHandler::getOverrunCount()
+{
+    return overruns;
+}
+
+/*
+ * Get how far the control tick was off its target phase when the last SYNC was received
+ * (in us, positive if the tick came too early), before it was corrected.
+ */
+int32_t SyncHandler::getPhaseError()
+{
+    return phaseError;
+}
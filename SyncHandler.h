@@ -0,0 +1,90 @@
+/*
+ * SyncHandler.h
+ *
+ * CANopen SYNC producer and consumer. The SYNC is bound to the control tick (the tick
+ * the pedals and the motor controller share): as producer the EVCU sends it from that
+ * tick, as consumer it shifts the phase of that tick towards the received SYNC. Either
+ * way the synchronous PDOs are sampled and applied in the control tick.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef SYNC_HANDLER_H_
+#define SYNC_HANDLER_H_
+
+#include <Arduino.h>
+#include "config.h"
+#include "CanHandler.h"
+#include "TickHandler.h"
+#include "ObjectDictionary.h"
+
+#define SYNC_TICK_INTERVAL      CFG_TICK_INTERVAL_POT_THROTTLE // the control tick
+#define SYNC_COB_ID_DEFAULT     0x80
+#define SYNC_COB_ID_PRODUCER    0x40000000  // bit 30 of the COB-ID: we produce the SYNC
+
+#if CFG_CANOPEN_SYNC_PERIOD % SYNC_TICK_INTERVAL != 0
+#error "the SYNC period has to be a multiple of the control tick"
+#endif
+
+/*
+ * The entries 0x1005 (COB-ID SYNC) and 0x1006 (communication cycle period) of the object dictionary.
+ */
+struct SyncParameters
+{
+    uint32_t cobId;             // the CAN id, SYNC_COB_ID_PRODUCER set = we send the SYNC
+    uint32_t cyclePeriod;       // in us, 0 = no SYNC produced and none expected
+};
+
+class SyncHandler : public CanObserver, public TickObserver
+{
+public:
+    SyncHandler();
+    void setup();
+    void handleTick();
+    void handleCanFrame(CAN_FRAME *frame);
+    uint32_t configure(const OdEntry *entry);
+    SyncParameters *getParameters();
+    bool isProducer();
+    uint32_t getSyncCount();
+    uint32_t getOverrunCount();
+    int32_t getPhaseError();
+
+private:
+    SyncParameters parameters;
+    bool producer;
+    uint32_t attachedId;        // the id we listen to, 0 = none
+    uint16_t ticksPerSync;      // control ticks per SYNC period (producer)
+    uint16_t tickCount;         // control ticks since the last SYNC (producer)
+    volatile bool pending;      // a SYNC was received, the next control tick handles it
+    bool lost;                  // no SYNC for 1.5 periods
+    uint32_t lastSync;          // time the last SYNC was sent or received (in us)
+    uint32_t syncs;             // SYNCs sent or received
+    uint32_t overruns;          // SYNCs received while the previous one was still pending
+    int32_t phaseError;         // phase of the control tick against the last received SYNC (in us)
+
+    bool listen();
+};
+
+extern SyncHandler syncHandler;
+
+#endif /* SYNC_HANDLER_H_ */
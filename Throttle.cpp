@@ -32,6 +32,8 @@
  */
 Throttle::Throttle() : Device() {
     level = 0;
+    sampleTime = 0;
+    sampleCycles = 0;
     status = OK;
 }
 
@@ -44,11 +46,13 @@ Throttle::Throttle() : Device() {
 void Throttle::handleTick() {
     Device::handleTick();
 
+    sampleTime = micros();
+    sampleCycles = TickTimer::cycles();
     RawSignalData *rawSignals = acquireRawSignal(); // get raw data from the throttle device
-    if (validateSignal(rawSignals)) { // validate the raw data
-        int16_t position = calculatePedalPosition(rawSignals); // bring the raw data into a range of 0-1000 (without mapping)
+    int16_t position;
+    if (evaluateSignal(rawSignals, &position)) // validate the raw data and bring it into a range of 0-1000 (without mapping)
         level = mapPedalPosition(position); // apply mapping of the 0-1000 range to the user defined settings
-    } else
+    else
         level = 0;
 }
 
@@ -60,6 +64,7 @@ void Throttle::handleTick() {
  * MotorController class to calculate commanded torque or speed. Positive numbers result in
  * acceleration, negative numbers in regeneration. 0 will result in no force applied by
  * the motor.
+ * The curve is compiled into pedalMap by updateScaling(), so the mapping needs no division.
  *
  * Configuration parameters:
  * positionRegenMaximum: The pedal position (0-1000) where maximumRegen will be applied. If not 0, then
@@ -80,39 +85,15 @@ void Throttle::handleTick() {
  * 0 <= positionRegenMaximum <= positionRegenMinimum <= positionForwardMotionStart <= positionHalfPower
  */
 int16_t Throttle::mapPedalPosition(int16_t pedalPosition) {
-    int16_t throttleLevel, range, value;
-    ThrottleConfiguration *config = (ThrottleConfiguration *) getConfiguration();
+    int16_t throttleLevel;
 
-    throttleLevel = 0;
+    // a position outside 0-1000 (the raw value is within the tolerance of evaluateSignal())
+    // is extrapolated by the formula as before, the checks below catch a level too high
+    if (pedalPosition < 0 || pedalPosition > 1000)
+        throttleLevel = calculateLevel(pedalPosition);
+    else
+        throttleLevel = pedalMap.map(pedalPosition);
 
-    if (pedalPosition == 0 && config->creep > 0) {
-        throttleLevel = 10 * config->creep;
-    } else if (pedalPosition <= config->positionRegenMinimum) {
-        if (pedalPosition >= config->positionRegenMaximum) {
-            range = config->positionRegenMinimum - config->positionRegenMaximum;
-            value = pedalPosition - config->positionRegenMaximum;
-            if (range != 0) // prevent div by zero, should result in 0 throttle if min==max
-                throttleLevel = -10 * config->minimumRegen + (config->maximumRegen - config->minimumRegen) * (100 - value * 100 / range) / -10;
-        } else {
-            // no ramping yet below positionRegenMaximum, just drop to 0
-//			range = config->positionRegenMaximum;
-//			value = pedalPosition;
-//			throttleLevel = -10 * config->maximumRegen * value / range;
-        }
-    }
-
-    if (pedalPosition >= config->positionForwardMotionStart) {
-        if (pedalPosition <= config->positionHalfPower) {
-            range = config->positionHalfPower - config->positionForwardMotionStart;
-            value = pedalPosition - config->positionForwardMotionStart;
-            if (range != 0) // prevent div by zero, should result in 0 throttle if half==startFwd
-                throttleLevel = 500 * value / range;
-        } else {
-            range = 1000 - config->positionHalfPower;
-            value = pedalPosition - config->positionHalfPower;
-            throttleLevel = 500 + 500 * value / range;
-        }
-    }
     Logger::debug("throttle level: %d", throttleLevel);
     
     //check to see if an invalid throttle level was generated by some fluke. Do not accept this condition!
@@ -140,15 +121,23 @@ int16_t Throttle::mapPedalPosition(int16_t pedalPosition) {
  * Make sure input level stays within margins (min/max) then map the constrained
  * level linearly to a value from 0 to 1000.
  */
-int16_t Throttle::normalizeAndConstrainInput(int32_t input, int32_t min, int32_t max) {
-    return constrain(normalizeInput(input, min, max), (int32_t) 0, (int32_t) 1000);
+int16_t Throttle::normalizeAndConstrainInput(int32_t input, int32_t min, q16_t scale) {
+    return constrain(normalizeInput(input, min, scale), (int32_t) 0, (int32_t) 1000);
 }
 
 /*
- * Map the constrained level linearly to a signed value from 0 to 1000.
+ * Map the level linearly to a signed value from 0 to 1000 (at min resp. max), scale is
+ * the factor calculated by normalizeScale(min, max).
  */
-int32_t Throttle::normalizeInput(int32_t input, int32_t min, int32_t max) {
-    return map(input, min, max, (int32_t) 0, (int32_t) 1000);
+int32_t Throttle::normalizeInput(int32_t input, int32_t min, q16_t scale) {
+    return q16Mul(input - min, scale);
+}
+
+/*
+ * The factor for normalizeInput() to map min..max to 0..1000.
+ */
+q16_t Throttle::normalizeScale(int32_t min, int32_t max) {
+    return q16Ratio(1000, max - min);
 }
 
 /*
@@ -179,18 +168,33 @@ DeviceType Throttle::getType() {
     return DEVICE_THROTTLE;
 }
 
+/*
+ * Time (micros()) at which the raw signal behind the current level was acquired.
+ */
+uint32_t Throttle::getSampleTime() {
+    return sampleTime;
+}
+
+/*
+ * TickTimer::cycles() at which the raw signal behind the current level was acquired.
+ */
+uint32_t Throttle::getSampleCycles() {
+    return sampleCycles;
+}
+
 RawSignalData* Throttle::acquireRawSignal() {
     return NULL;
 }
 
-bool Throttle::validateSignal(RawSignalData*) {
+/*
+ * Validate the raw signal and, if it's plausible, convert it to the pedal position
+ * (0-1000 permille, without mapping). Sub-classes do both in one pass over the
+ * signal. Returns false (and sets status) if the signal is invalid.
+ */
+bool Throttle::evaluateSignal(RawSignalData*, int16_t*) {
     return false;
 }
 
-int16_t Throttle::calculatePedalPosition(RawSignalData*) {
-    return 0;
-}
-
 /*
  * Load the config parameters which are required by all throttles
  */
@@ -210,4 +214,76 @@ void Throttle::loadConfiguration() {
     Logger::debug(THROTTLE, "RegenMax: %l RegenMin: %l Fwd: %l Map: %l", config->positionRegenMaximum, config->positionRegenMinimum,
                   config->positionForwardMotionStart, config->positionHalfPower);
     Logger::debug(THROTTLE, "MinRegen: %d MaxRegen: %d", config->minimumRegen, config->maximumRegen);
-}
\ No newline at end of file
+}
+
+/*
+ * The throttle level at a pedal position according to the mapping parameters, see
+ * mapPedalPosition(). Used by updateScaling() to build the pedal map and for positions
+ * outside of it, this divides.
+ */
+int16_t Throttle::calculateLevel(int16_t pedalPosition) {
+    ThrottleConfiguration *config = (ThrottleConfiguration *) getConfiguration();
+    int16_t throttleLevel, range, value;
+
+    throttleLevel = 0;
+
+    if (pedalPosition == 0 && config->creep > 0) {
+        throttleLevel = 10 * config->creep;
+    } else if (pedalPosition <= config->positionRegenMinimum) {
+        if (pedalPosition >= config->positionRegenMaximum) {
+            range = config->positionRegenMinimum - config->positionRegenMaximum;
+            value = pedalPosition - config->positionRegenMaximum;
+            if (range != 0) // should result in 0 throttle if min==max
+                throttleLevel = -10 * config->maximumRegen + (config->maximumRegen - config->minimumRegen) * 10 * value / range;
+        } else {
+            // no ramping yet below positionRegenMaximum, just drop to 0
+        }
+    }
+
+    if (pedalPosition >= config->positionForwardMotionStart) {
+        if (pedalPosition <= config->positionHalfPower) {
+            range = config->positionHalfPower - config->positionForwardMotionStart;
+            value = pedalPosition - config->positionForwardMotionStart;
+            if (range != 0)
+                throttleLevel = 500 * value / range;
+        } else {
+            range = 1000 - config->positionHalfPower;
+            value = pedalPosition - config->positionHalfPower;
+            throttleLevel = 500 + 500 * value / range;
+        }
+    }
+    return throttleLevel;
+}
+
+/*
+ * Build the pedal map from the configuration. Every position where calculateLevel()
+ * switches between creep, regen, coasting and the two forward slopes becomes a point
+ * of the curve, in between it is linear anyway.
+ * Sub-classes call this at the end of loadConfiguration() and whoever changes the
+ * configuration afterwards (e.g. ThrottleDetector) has to call it again.
+ */
+void Throttle::updateScaling() {
+    ThrottleConfiguration *config = (ThrottleConfiguration *) getConfiguration();
+    int16_t positions[] = { 0, 1,
+            (int16_t) (config->positionRegenMaximum - 1), (int16_t) config->positionRegenMaximum,
+            (int16_t) config->positionRegenMinimum, (int16_t) (config->positionRegenMinimum + 1),
+            (int16_t) (config->positionForwardMotionStart - 1), (int16_t) config->positionForwardMotionStart,
+            (int16_t) config->positionHalfPower, 1000 };
+    uint8_t count = sizeof(positions) / sizeof(positions[0]);
+
+    // sort the positions (insertion sort, they're almost in order already)
+    for (uint8_t i = 1; i < count; i++) {
+        int16_t position = positions[i];
+        uint8_t j = i;
+        for (; j > 0 && positions[j - 1] > position; j--)
+            positions[j] = positions[j - 1];
+        positions[j] = position;
+    }
+
+    pedalMap.clear();
+    for (uint8_t i = 0; i < count; i++) {
+        if (positions[i] >= 0 && positions[i] <= 1000 && (i == 0 || positions[i] != positions[i - 1]))
+            pedalMap.addPoint(positions[i], calculateLevel(positions[i]));
+    }
+    pedalMap.build();
+}
@@ -35,6 +35,9 @@
 #include <Arduino.h>
 #include "config.h"
 #include "Device.h"
+#include "TickTimer.h"
+#include "FixedPoint.h"
+#include "PedalMap.h"
 
 /*
  * Data structure to hold raw signal(s) of the throttle.
@@ -80,20 +83,27 @@ public:
     virtual ThrottleStatus getStatus();
     virtual bool isFaulted();
     virtual DeviceType getType();
+    uint32_t getSampleTime();
+    uint32_t getSampleCycles();
 
     virtual RawSignalData *acquireRawSignal();
     void loadConfiguration();
+    virtual void updateScaling();
 
 protected:
     ThrottleStatus status;
-    virtual bool validateSignal(RawSignalData *);
-    virtual int16_t calculatePedalPosition(RawSignalData *);
-    virtual int16_t mapPedalPosition(int16_t);
-    int16_t normalizeAndConstrainInput(int32_t, int32_t, int32_t);
-    int32_t normalizeInput(int32_t, int32_t, int32_t);
+    PedalMap pedalMap; // mapPedalPosition()'s curve, built by updateScaling()
+    virtual bool evaluateSignal(RawSignalData *, int16_t *);
+    int16_t mapPedalPosition(int16_t);
+    int16_t normalizeAndConstrainInput(int32_t, int32_t, q16_t);
+    int32_t normalizeInput(int32_t, int32_t, q16_t);
+    static q16_t normalizeScale(int32_t, int32_t);
+    int16_t calculateLevel(int16_t);
 
 private:
     int16_t level; // the final signed throttle level. [-1000, 1000] in permille of maximum
+    uint32_t sampleTime; // micros() when the signal of the current level was acquired (0 = not yet)
+    uint32_t sampleCycles; // TickTimer::cycles() at the same moment
 };
 
 #endif
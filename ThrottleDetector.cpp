@@ -83,12 +83,14 @@ void ThrottleDetector::detect() {
 
     // reset stats
     sampleCount = 0;
+    throttle1Mean = 0;
+    throttle2Mean = 0;
+    throttle1M2 = 0;
+    throttle2M2 = 0;
+    coMoment = 0;
+    restSamples = 0;
     linearCount = 0;
     inverseCount = 0;
-    for (int i = 0; i < 200; i++) {
-        throttle1Values[i] = 0;
-        throttle2Values[i] = 0;
-    }
 
     // we wait for 2 seconds so kick this off
     startTime = millis();
@@ -123,6 +125,10 @@ void ThrottleDetector::detectMinCalibrate() {
         throttle1MaxRest = throttle1Max;
         throttle2MinRest = throttle2Min;
         throttle2MaxRest = throttle2Max;
+        restSamples = sampleCount;
+        pressed1Max = throttle1MaxRest;
+        pressed2Min = throttle2MinRest;
+        pressed2Max = throttle2MaxRest;
 
         Logger::console("\nSmoothly depress the pedal until fully depressed");
         Logger::console("and hold the pedal until complete");
@@ -220,21 +226,20 @@ void ThrottleDetector::detectMaxCalibrate() {
             throttle2MaxFluctuationPercent = 0;
         }
 
-        // Determine throttle subtype by examining the data sampled
-        for (int i = 0; i < sampleCount; i++) {
-            // normalize the values to a 0-1000 scale using the found min/max
-            uint16_t value1 = normalize(throttle1Values[i], throttle1Min, throttle1Max, 0, 1000);
-            uint16_t value2 = normalize(throttle2Values[i], throttle2Min, throttle2Max, 0, 1000);
-
-            // see if they match known subtypes
-            linearCount += checkLinear(value1, value2);
-            inverseCount += checkInverse(value1, value2);
-
-            //Logger::debug("T1: %d, T2: %d = NT1: %d, NT2: %d, L: %d, I: %d", throttle1Values[i], throttle2Values[i], value1, value2, linearCount, inverseCount);
+        // Determine throttle subtype by examining the data sampled. The samples at rest lie
+        // within the rest min/max, so they all match the type of T2's direction if the
+        // fluctuation at rest is within the tolerance.
+        if (normalize(throttle1MinFluctuation, 0, abs(throttle1Max - throttle1Min), 0, 1000) < maxThrottleReadingDeviationPercent
+                && normalize(throttle2MinFluctuation, 0, abs(throttle2Max - throttle2Min), 0, 1000) < maxThrottleReadingDeviationPercent) {
+            if (throttle2Inverse) {
+                inverseCount += restSamples;
+            } else {
+                linearCount += restSamples;
+            }
         }
 
         throttleSubType = 0;
-        if (potentiometerCount > 1) {
+        if (potentiometerCount > 1 && sampleCount > 0) {
             // For dual pots, we trust the detection of >75%
             if ((linearCount * 100) / sampleCount > 75) {
                 throttleSubType = 1;
@@ -258,10 +263,10 @@ void ThrottleDetector::detectMaxCalibrate() {
         }
 
         if ( Logger::isDebug()) {
-            Logger::console("\n----- RAW values ----");
-            for (int i = 0; i < sampleCount; i++) {
-                Logger::console("T1: %d, T2: %d", throttle1Values[i], throttle2Values[i]);
-            }
+            Logger::console("\n----- RAW statistics ----");
+            Logger::console("T1: mean %f, variance %f", throttle1Mean, sampleCount ? throttle1M2 / sampleCount : 0);
+            Logger::console("T2: mean %f, variance %f", throttle2Mean, sampleCount ? throttle2M2 / sampleCount : 0);
+            Logger::console("covariance %f", sampleCount ? coMoment / sampleCount : 0);
         }
 
         Logger::console("\n=======================================");
@@ -295,6 +300,7 @@ void ThrottleDetector::detectMaxCalibrate() {
             config->maximumLevel2 = 0;
         }
         config->throttleSubType = throttleSubType;
+        throttle->updateScaling();
 
         // Done!
         state = DoNothing;
@@ -322,9 +328,7 @@ void ThrottleDetector::resetValues() {
  */
 void ThrottleDetector::readThrottleValues() {
     RawSignalData *rawSignal = throttle->acquireRawSignal();
-    throttle1Values[sampleCount] = rawSignal->input1;
-    throttle2Values[sampleCount] = rawSignal->input2;
-    sampleCount++;
+    addSample(rawSignal->input1, rawSignal->input2);
 
     // record the minimum sensor value
     if (rawSignal->input1 < throttle1Min) {
@@ -345,6 +349,52 @@ void ThrottleDetector::readThrottleValues() {
     if (rawSignal->input2 > throttle2Max) {
         throttle2Max = rawSignal->input2;
     }
+
+    if (state == DetectMaxWait || state == DetectMaxCalibrate) {
+        checkPressedSample(rawSignal->input1, rawSignal->input2);
+    }
+}
+
+/*
+ * Update the streaming statistics with a sample of both throttles (Welford's algorithm
+ * extended by the co-moment of the two signals).
+ */
+void ThrottleDetector::addSample(int32_t value1, int32_t value2) {
+    sampleCount++;
+    float delta1 = value1 - throttle1Mean;
+    float delta2 = value2 - throttle2Mean;
+    throttle1Mean += delta1 / sampleCount;
+    throttle2Mean += delta2 / sampleCount;
+    throttle1M2 += delta1 * (value1 - throttle1Mean);
+    throttle2M2 += delta2 * (value2 - throttle2Mean);
+    coMoment += delta1 * (value2 - throttle2Mean);
+}
+
+/*
+ * Count whether a sample of the pressed pedal matches a linear or an inverse throttle.
+ * The samples aren't kept, so they are normalized with the rest values and the extremes
+ * reached so far instead of the final min/max. For inverse, T2 runs from its rest maximum
+ * down to its lowest reading. A sample within the rest min/max (the pedal isn't pressed
+ * yet) is checked with the ones at rest.
+ */
+void ThrottleDetector::checkPressedSample(uint16_t value1, uint16_t value2) {
+    if (value1 >= throttle1MinRest && value1 <= throttle1MaxRest && value2 >= throttle2MinRest && value2 <= throttle2MaxRest) {
+        restSamples++;
+        return;
+    }
+    if (value1 > pressed1Max) {
+        pressed1Max = value1;
+    }
+    if (value2 < pressed2Min) {
+        pressed2Min = value2;
+    }
+    if (value2 > pressed2Max) {
+        pressed2Max = value2;
+    }
+
+    uint16_t normalized1 = normalize(value1, throttle1MinRest, pressed1Max, 0, 1000);
+    linearCount += checkLinear(normalized1, normalize(value2, throttle2MinRest, pressed2Max, 0, 1000));
+    inverseCount += checkInverse(normalized1, normalize(value2, pressed2Min, throttle2MaxRest, 0, 1000));
 }
 
 /*
@@ -382,8 +432,8 @@ void ThrottleDetector::displayCalibratedValues(bool minPedal) {
  * Map and constrain the value to the given range
  */
 uint16_t ThrottleDetector::normalize(uint16_t sensorValue, uint16_t sensorMin, uint16_t sensorMax, uint16_t constrainMin, uint16_t constrainMax) {
+    if (sensorMin == sensorMax)
+        return constrainMin;
     int value = map(sensorValue, sensorMin, sensorMax, constrainMin, constrainMax);
     return constrain(value, constrainMin, constrainMax);
 }
-
-
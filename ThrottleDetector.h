@@ -4,6 +4,8 @@
  * This class can detect up to two potentiometers and determine their min/max values,
  * whether they read low to high or high to low, and if the second potentiometer is
  * the inverse of the first.
+ * It runs as a state machine driven by the TickHandler and keeps streaming statistics
+ * of the samples (Welford's algorithm) instead of the samples themselves.
  *
  Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
 
@@ -61,6 +63,8 @@ private:
     void displayCalibratedValues(bool minPedal);
     void resetValues();
     void readThrottleValues();
+    void addSample(int32_t value1, int32_t value2);
+    void checkPressedSample(uint16_t value1, uint16_t value2);
     int checkLinear(uint16_t, uint16_t);
     int checkInverse(uint16_t, uint16_t);
     uint16_t normalize(uint16_t sensorValue, uint16_t sensorMin, uint16_t sensorMax, uint16_t constrainMin, uint16_t constrainMax);
@@ -87,28 +91,19 @@ private:
     int throttle2MinFluctuationPercent;
     int throttle2MaxFluctuationPercent;
     int maxThrottleReadingDeviationPercent;
-    // stats/counters when sampling
-    static const int maxSamples = 300;
+    // stats when sampling, over all samples of the detection
+    static const int maxSamples = 300; // the phases end after this many samples at the latest
     int sampleCount;
-    int linearCount;
-    int inverseCount;
-    uint16_t throttle1Values[maxSamples];
-    uint16_t throttle2Values[maxSamples];
+    float throttle1Mean, throttle2Mean; // mean of the raw values
+    float throttle1M2, throttle2M2; // sum of the squared differences from the mean
+    float coMoment; // sum of the products of the differences of both throttles from their mean
+    int restSamples; // samples within the rest min/max, checked against the rest fluctuation at the end
+    int linearCount; // samples matching a linear throttle
+    int inverseCount; // samples matching an inverse throttle
+    uint16_t pressed1Max, pressed2Min, pressed2Max; // extremes since the pedal is pressed, the final ones are not known yet
 
 };
 
-extern evTimer Timer;
-
-extern evTimer Timer0;
-extern evTimer Timer1;
-extern evTimer Timer2;
-extern evTimer Timer3;
-extern evTimer Timer4;
-extern evTimer Timer5;
-extern evTimer Timer6;
-extern evTimer Timer7;
-extern evTimer Timer8;
-
 #endif /* THROTTLE_DETECTOR_H_ */
 
 
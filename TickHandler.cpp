@@ -5,6 +5,8 @@
  * on a certain interval.
  * TickObserver with the same interval are grouped to the same timer
  * and triggered in sequence per timer interrupt.
+ * The timers are kept in a min-heap ordered by their next deadline, the
+ * compare interrupt of the TickTimer is always set to the earliest one.
  *
  * NOTE: The initialize() method must be called before a observer is registered !
  *
@@ -43,91 +45,190 @@ TickHandler::TickHandler()
             timerEntry[i].observer[j] = NULL;
         }
     }
+    heapSize = 0;
+    timerStarted = false;
+    missedTicks = 0;
 #ifdef CFG_TIMER_USE_QUEUING
     bufferHead = bufferTail = 0;
 #endif
 }
 
 /**
- * Register an observer to be triggered in a certain interval.
+ * Register an observer to be triggered in a certain interval (in microseconds).
  * TickObservers with the same interval are grouped to one timer to save timers.
  * A TickObserver may be registered multiple times with different intervals.
  *
  * First a timer with the same interval is looked up. If none found, a free one is
- * used. Then a free TickObserver slot (of max CFG_MAX_TICK_OBSERVERS) is looked up. If all went
- * well, the timer is configured and (re)started.
+ * used and its first tick is scheduled one interval from now. Then the observer is
+ * inserted behind all observers of the same or an earlier stage (of max
+ * CFG_TIMER_NUM_OBSERVERS). Observers joining a running timer keep its phase.
  */
-void TickHandler::attach(TickObserver *observer, uint32_t interval)
+void TickHandler::attach(TickObserver *observer, uint32_t interval, TickStage stage)
 {
+    if (interval == 0)
+        return;
+
+    if (!timerStarted)
+    {
+        TickTimer::begin(tickInterrupt);
+        timerStarted = true;
+    }
+
+    noInterrupts();
     int timer = findTimer(interval);
     if (timer == -1)
     {
         timer = findTimer(0); // no timer with given tick interval exist -> look for unused (interval == 0)
         if (timer == -1)
         {
+            interrupts();
             Logger::debug("No free timer available for interval=%d", interval);
             return;
         }
         timerEntry[timer].interval = interval;
+        timerEntry[timer].deadline = TickTimer::now() + interval;
+        heapInsert(timer);
+        TickTimer::setAlarm(timerEntry[heap[0]].deadline);
     }
 
+    TimerEntry *entry = &timerEntry[timer];
     int observerIndex = findObserver(timer, 0);
     if (observerIndex == -1)
     {
+        interrupts();
         Logger::debug("No free observer slot for timer %d with interval %d", timer, timerEntry[timer].interval);
         return;
     }
-    timerEntry[timer].observer[observerIndex] = observer;
-    Logger::debug("attached TickObserver (%X) as number %d to timer %d, %dus interval", observer, observerIndex, timer, interval);
-
-    switch (timer)
-    { // restarting a timer which would already be running is no problem (see evTimer.cpp)
-    case 0:
-        Timer0.setInterval(interval/1000, timer0Interrupt);
-        break;
-    case 1:
-        Timer1.setInterval(interval/1000, timer1Interrupt);
-        break;
-    case 2:
-        Timer2.setInterval(interval/1000, timer2Interrupt);
-        break;
-    case 3:
-        Timer3.setInterval(interval/1000, timer3Interrupt);
-        break;
-    case 4:
-        Timer4.setInterval(interval/1000, timer4Interrupt);
-        break;
-    case 5:
-        Timer5.setInterval(interval/1000, timer5Interrupt);
-        break;
-    case 6:
-        Timer6.setInterval(interval/1000, timer6Interrupt);
-        break;
-    case 7:
-        Timer7.setInterval(interval/1000, timer7Interrupt);
-        break;
-    case 8:
-        Timer8.setInterval(interval/1000, timer8Interrupt);
-        break;
+    while (observerIndex > 0 && entry->stage[observerIndex - 1] > stage)
+    {
+        entry->observer[observerIndex] = entry->observer[observerIndex - 1];
+        entry->stage[observerIndex] = entry->stage[observerIndex - 1];
+        observerIndex--;
     }
+    entry->observer[observerIndex] = observer;
+    entry->stage[observerIndex] = stage;
+    interrupts();
+    Logger::debug("attached TickObserver (%X) as number %d to timer %d, %dus interval", observer, observerIndex, timer, interval);
 }
 
 /**
  * Remove an observer from all timers where it was registered.
+ * Timers without observers are stopped and become free again.
  */
 void TickHandler::detach(TickObserver *observer)
 {
     for (int timer = 0; timer < NUM_TIMERS; timer++)
     {
+        bool used = false;
+        int removed = -1;
+
+        noInterrupts(); // the interrupt walks the observers and the heap
         for (int observerIndex = 0; observerIndex < CFG_TIMER_NUM_OBSERVERS; observerIndex++)
         {
             if (timerEntry[timer].observer[observerIndex] == observer)
             {
-                Logger::debug("removing TickObserver (%X) as number %d from timer %d", observer, observerIndex, timer);
                 timerEntry[timer].observer[observerIndex] = NULL;
+                removed = observerIndex;
             }
+            used |= (timerEntry[timer].observer[observerIndex] != NULL);
+        }
+        compactObservers(&timerEntry[timer]);
+        if (!used && timerEntry[timer].interval != 0)
+        {
+            for (uint8_t i = 0; i < heapSize; i++)
+            {
+                if (heap[i] == timer)
+                {
+                    heapRemove(i);
+                    break;
+                }
+            }
+            timerEntry[timer].interval = 0;
+        }
+        interrupts();
+
+        if (removed != -1)
+            Logger::debug("removing TickObserver (%X) as number %d from timer %d", observer, removed, timer);
+    }
+}
+
+/*
+ * Shift the phase of a timer towards a reference time (e.g. the reception of a CANopen
+ * SYNC), so its ticks fall on reference + n * interval. The shift per call is limited
+ * to maxStep, so an interval is never shortened or stretched by more than that and a
+ * jittering reference only moves the phase a little. The next tick is never moved into
+ * the past.
+ *
+ * \param interval - the interval of the timer to align
+ * \param reference - a TickTimer time the ticks should fall on
+ * \param maxStep - the maximum shift in microseconds
+ * \retval the phase error before the shift (positive if the ticks come too early), 0 if there's no such timer
+ */
+int32_t TickHandler::align(uint32_t interval, uint32_t reference, uint32_t maxStep)
+{
+    noInterrupts();
+    int timer = findTimer(interval);
+    if (timer == -1)
+    {
+        interrupts();
+        return 0;
+    }
+
+    TimerEntry *entry = &timerEntry[timer];
+    int32_t error = (int32_t) (reference - entry->deadline) % (int32_t) interval;
+    if (error > (int32_t) (interval / 2))
+        error -= interval;
+    else if (error <= -(int32_t) (interval / 2))
+        error += interval;
+
+    int32_t shift = error;
+    if (shift > (int32_t) maxStep)
+        shift = maxStep;
+    if (shift < -(int32_t) maxStep)
+        shift = -(int32_t) maxStep;
+    int32_t ahead = (int32_t) (entry->deadline - TickTimer::now());
+    if (shift < 0 && ahead + shift < 0)
+        shift = (ahead > 0 ? -ahead : 0);
+    entry->deadline += shift;
+
+    for (uint8_t i = 0; i < heapSize; i++)
+    {
+        if (heap[i] == timer)
+        {
+            siftDown(i);
+            siftUp(i);
+            break;
         }
     }
+    if (shift < 0 && heap[0] == timer) // a later alarm is fine, handleInterrupt() re-arms it
+    {
+        TickTimer::setAlarm(entry->deadline);
+        if ((int32_t) (TickTimer::now() - entry->deadline) >= 0)
+            handleInterrupt(); // the deadline passed while the alarm was set
+    }
+    interrupts();
+    return error;
+}
+
+/*
+ * Close the gaps left by detached observers so free slots are always at the end and
+ * the stage order is kept.
+ */
+void TickHandler::compactObservers(TimerEntry *entry)
+{
+    int used = 0;
+
+    for (int i = 0; i < CFG_TIMER_NUM_OBSERVERS; i++)
+    {
+        if (entry->observer[i] != NULL)
+        {
+            entry->observer[used] = entry->observer[i];
+            entry->stage[used] = entry->stage[i];
+            used++;
+        }
+    }
+    while (used < CFG_TIMER_NUM_OBSERVERS)
+        entry->observer[used++] = NULL;
 }
 
 /**
@@ -137,7 +238,7 @@ int TickHandler::findTimer(long interval)
 {
     for (int i = 0; i < NUM_TIMERS; i++)
     {
-        if (timerEntry[i].interval == interval)
+        if (timerEntry[i].interval == (uint32_t) interval)
             return i;
     }
     return -1;
@@ -156,6 +257,15 @@ int TickHandler::findObserver(int timer, TickObserver *observer)
     return -1;
 }
 
+/*
+ * Get the number of ticks which were skipped because a timer was already more than
+ * one interval late (or, with queuing, because the tick buffer was full).
+ */
+uint32_t TickHandler::getMissedTickCount()
+{
+    return missedTicks;
+}
+
 #ifdef CFG_TIMER_USE_QUEUING
 /*
  * Check if a tick is available, forward it to registered observers.
@@ -178,88 +288,135 @@ void TickHandler::cleanBuffer()
 #endif // CFG_TIMER_USE_QUEUING
 
 /*
- * Handle the interrupt of any timer.
- * All the registered TickObservers of the timer are called.
+ * Handle the compare interrupt of the TickTimer. This is the only place where ticks
+ * are generated: all timers which are due are dispatched in deadline order and
+ * re-scheduled exactly one interval later, so their phase does not drift with the
+ * interrupt latency. A timer which is more than one interval late skips the ticks it
+ * missed instead of firing them in a burst.
  */
-void TickHandler::handleInterrupt(int timerNumber)
+void TickHandler::handleInterrupt()
 {
-    for (int i = 0; i < CFG_TIMER_NUM_OBSERVERS; i++)
+    uint32_t now = TickTimer::now();
+
+    while (heapSize > 0)
     {
-        if (timerEntry[timerNumber].observer[i] != NULL)
+        TimerEntry *entry = &timerEntry[heap[0]];
+        int32_t late = (int32_t) (now - entry->deadline);
+
+        if (late < 0)
         {
-#ifdef CFG_TIMER_USE_QUEUING
-            tickBuffer[bufferHead] = timerEntry[timerNumber].observer[i];
-            bufferHead = (bufferHead + 1) % CFG_TIMER_BUFFER_SIZE;
-// Logger::debug("bufferHead=%d, bufferTail=%d, observer=%d", bufferHead, bufferTail, timerEntry[timerNumber].observer[i]);
-#else
-            timerEntry[timerNumber].observer[i]->handleTick();
-#endif // CFG_TIMER_USE_QUEUING
+            TickTimer::setAlarm(entry->deadline);
+            now = TickTimer::now();
+            if ((int32_t) (now - entry->deadline) < 0)
+                return;
+            continue; // the deadline passed while the alarm was set
         }
+
+        dispatch(entry);
+        entry->deadline += entry->interval;
+        if ((uint32_t) late >= entry->interval)
+        {
+            uint32_t missed = (uint32_t) late / entry->interval;
+            missedTicks += missed;
+            entry->deadline += missed * entry->interval;
+        }
+        siftDown(0);
+        now = TickTimer::now();
     }
 }
 
 /*
- * Interrupt function for Timer0
- */
-void timer0Interrupt()
-{
-    tickHandler.handleInterrupt(0);
-}
-/*
- * Interrupt function for Timer1
+ * Call (or queue) all observers of a timer in stage order.
  */
-void timer1Interrupt()
+void TickHandler::dispatch(TimerEntry *entry)
 {
-    tickHandler.handleInterrupt(1);
-}
-/*
- * Interrupt function for Timer2
- */
-void timer2Interrupt()
-{
-    tickHandler.handleInterrupt(2);
+    for (int i = 0; i < CFG_TIMER_NUM_OBSERVERS && entry->observer[i] != NULL; i++)
+    {
+#ifdef CFG_TIMER_USE_QUEUING
+        uint16_t next = (bufferHead + 1) % CFG_TIMER_BUFFER_SIZE;
+        if (next == bufferTail)
+        {
+            missedTicks++;
+            continue;
+        }
+        tickBuffer[bufferHead] = entry->observer[i];
+        bufferHead = next;
+// Logger::debug("bufferHead=%d, bufferTail=%d, observer=%d", bufferHead, bufferTail, entry->observer[i]);
+#else
+        entry->observer[i]->handleTick();
+#endif // CFG_TIMER_USE_QUEUING
+    }
 }
+
 /*
- * Interrupt function for Timer3
+ * Heap order: earlier deadline first (wrap safe), the lower timer number on a tie so
+ * timers with the same deadline always fire in the same order.
  */
-void timer3Interrupt()
+bool TickHandler::isBefore(uint8_t a, uint8_t b)
 {
-    tickHandler.handleInterrupt(3);
+    int32_t diff = (int32_t) (timerEntry[a].deadline - timerEntry[b].deadline);
+    return diff < 0 || (diff == 0 && a < b);
 }
-/*
- * Interrupt function for Timer4
- */
-void timer4Interrupt()
+
+void TickHandler::heapInsert(uint8_t timer)
 {
-    tickHandler.handleInterrupt(4);
+    heap[heapSize] = timer;
+    siftUp(heapSize++);
 }
-/*
- * Interrupt function for Timer5
- */
-void timer5Interrupt()
+
+void TickHandler::heapRemove(uint8_t position)
 {
-    tickHandler.handleInterrupt(5);
+    heap[position] = heap[--heapSize];
+    if (position < heapSize)
+    {
+        siftDown(position);
+        siftUp(position);
+    }
 }
-/*
- * Interrupt function for Timer6
- */
-void timer6Interrupt()
+
+void TickHandler::siftDown(uint8_t position)
 {
-    tickHandler.handleInterrupt(6);
+    for (;;)
+    {
+        uint8_t smallest = position;
+        uint8_t left = 2 * position + 1;
+        uint8_t right = left + 1;
+
+        if (left < heapSize && isBefore(heap[left], heap[smallest]))
+            smallest = left;
+        if (right < heapSize && isBefore(heap[right], heap[smallest]))
+            smallest = right;
+        if (smallest == position)
+            return;
+
+        uint8_t temp = heap[position];
+        heap[position] = heap[smallest];
+        heap[smallest] = temp;
+        position = smallest;
+    }
 }
-/*
- * Interrupt function for Timer7
- */
-void timer7Interrupt()
+
+void TickHandler::siftUp(uint8_t position)
 {
-    tickHandler.handleInterrupt(7);
+    while (position > 0)
+    {
+        uint8_t parent = (position - 1) / 2;
+        if (!isBefore(heap[position], heap[parent]))
+            return;
+
+        uint8_t temp = heap[position];
+        heap[position] = heap[parent];
+        heap[parent] = temp;
+        position = parent;
+    }
 }
+
 /*
- * Interrupt function for Timer8
+ * Interrupt function of the TickTimer
  */
-void timer8Interrupt()
+void tickInterrupt()
 {
-    tickHandler.handleInterrupt(8);
+    tickHandler.handleInterrupt();
 }
 
 /*
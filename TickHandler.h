@@ -31,10 +31,21 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define TICKHANDLER_H_
 
 #include "config.h"
-#include "evTimer.h"
+#include "TickTimer.h"
 #include "Logger.h"
 
-#define NUM_TIMERS 9
+#define NUM_TIMERS 9 // number of different intervals
+
+/*
+ * Order in which the observers of one timer are ticked. Devices forming a control
+ * pipeline share an interval, so the pedals are sampled right before the motor
+ * controller computes and sends its command in the same tick.
+ */
+enum TickStage {
+    TICK_STAGE_INPUT = 0,   // acquire input signals (e.g. pedals)
+    TICK_STAGE_CONTROL = 1, // compute and send commands from the inputs (e.g. motor controller)
+    TICK_STAGE_OTHER = 2    // everything else
+};
 
 class TickObserver {
 public:
@@ -45,9 +56,11 @@ public:
 class TickHandler {
 public:
     TickHandler();
-    void attach(TickObserver *observer, uint32_t interval);
+    void attach(TickObserver *observer, uint32_t interval, TickStage stage = TICK_STAGE_OTHER);
     void detach(TickObserver *observer);
-    void handleInterrupt(int timerNumber); // must be public when from the non-class functions
+    int32_t align(uint32_t interval, uint32_t reference, uint32_t maxStep);
+    void handleInterrupt(); // must be public when from the non-class functions
+    uint32_t getMissedTickCount();
 #ifdef CFG_TIMER_USE_QUEUING
     void cleanBuffer();
     void process();
@@ -57,10 +70,16 @@ protected:
 
 private:
     struct TimerEntry {
-        long interval; // interval of timer
-        TickObserver *observer[CFG_TIMER_NUM_OBSERVERS]; // array of pointers to observers with this interval
+        uint32_t interval; // interval of timer in microseconds (0 = unused)
+        uint32_t deadline; // TickTimer time of the next tick
+        TickObserver *observer[CFG_TIMER_NUM_OBSERVERS]; // array of pointers to observers with this interval, ordered by stage
+        uint8_t stage[CFG_TIMER_NUM_OBSERVERS]; // TickStage of each observer
     };
-    TimerEntry timerEntry[NUM_TIMERS]; // array of timer entries (9 as there are 9 timers)
+    TimerEntry timerEntry[NUM_TIMERS]; // array of timer entries (one per interval)
+    uint8_t heap[NUM_TIMERS]; // indexes of the timerEntry in use, as min-heap on the deadline
+    uint8_t heapSize;
+    bool timerStarted;
+    volatile uint32_t missedTicks; // ticks skipped because the handler was late or the buffer full
 #ifdef CFG_TIMER_USE_QUEUING
     TickObserver *tickBuffer[CFG_TIMER_BUFFER_SIZE];
     volatile uint16_t bufferHead, bufferTail;
@@ -68,20 +87,17 @@ private:
     
     int findTimer(long interval);
     int findObserver(int timerNumber, TickObserver *observer);
+    void dispatch(TimerEntry *entry);
+    void compactObservers(TimerEntry *entry);
+    bool isBefore(uint8_t a, uint8_t b);
+    void heapInsert(uint8_t timer);
+    void heapRemove(uint8_t position);
+    void siftDown(uint8_t position);
+    void siftUp(uint8_t position);
 };
 
-void timer0Interrupt();
-void timer1Interrupt();
-void timer2Interrupt();
-void timer3Interrupt();
-void timer4Interrupt();
-void timer5Interrupt();
-void timer6Interrupt();
-void timer7Interrupt();
-void timer8Interrupt();
+void tickInterrupt();
 
 extern TickHandler tickHandler;
 
 #endif /* TICKHANDLER_H_ */
-
-
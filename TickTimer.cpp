@@ -0,0 +1,105 @@
+/*
+ * TickTimer.cpp
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "TickTimer.h"
+
+#ifdef ARDUINO_ARCH_SAMD
+
+static void (*tickTimerIsr)();
+
+/*
+ * Start the counter and connect the compare interrupt to isr.
+ * GCLK4 divides the 48MHz DFLL down to 1MHz for TC4, which runs as the master of the
+ * 32 bit counter pair TC4/TC5 (TC3 drives the AdcScanner, the TCCs are left to analogWrite()).
+ */
+void TickTimer::begin(void (*isr)())
+{
+    tickTimerIsr = isr;
+
+    GCLK->GENDIV.reg = GCLK_GENDIV_ID(4) | GCLK_GENDIV_DIV(48);
+    while (GCLK->STATUS.bit.SYNCBUSY);
+    GCLK->GENCTRL.reg = GCLK_GENCTRL_ID(4) | GCLK_GENCTRL_SRC_DFLL48M | GCLK_GENCTRL_GENEN;
+    while (GCLK->STATUS.bit.SYNCBUSY);
+    GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_TC4_TC5 | GCLK_CLKCTRL_GEN_GCLK4 | GCLK_CLKCTRL_CLKEN;
+    while (GCLK->STATUS.bit.SYNCBUSY);
+    PM->APBCMASK.reg |= PM_APBCMASK_TC4 | PM_APBCMASK_TC5;
+
+    TC4->COUNT32.CTRLA.reg = TC_CTRLA_SWRST;
+    while (TC4->COUNT32.CTRLA.bit.SWRST);
+    TC4->COUNT32.CTRLA.reg = TC_CTRLA_MODE_COUNT32 | TC_CTRLA_WAVEGEN_NFRQ | TC_CTRLA_PRESCALER_DIV1;
+    while (TC4->COUNT32.STATUS.bit.SYNCBUSY);
+    TC4->COUNT32.READREQ.reg = TC_READREQ_RCONT | TC_READREQ_ADDR(TC_COUNT32_COUNT_OFFSET); // keep COUNT readable without waiting
+    TC4->COUNT32.INTFLAG.reg = TC_INTFLAG_MC0;
+    TC4->COUNT32.INTENSET.reg = TC_INTENSET_MC0;
+
+    NVIC_ClearPendingIRQ(TC4_IRQn);
+    NVIC_EnableIRQ(TC4_IRQn);
+
+    TC4->COUNT32.CTRLA.bit.ENABLE = 1;
+    while (TC4->COUNT32.STATUS.bit.SYNCBUSY);
+}
+
+/*
+ * Current time in microseconds, wraps after about 71 minutes.
+ */
+uint32_t TickTimer::now()
+{
+    return TC4->COUNT32.COUNT.reg;
+}
+
+/*
+ * Raise the interrupt when the counter reaches time. A time which already passed
+ * only matches after the counter wrapped, the caller has to check for that.
+ */
+void TickTimer::setAlarm(uint32_t time)
+{
+    TC4->COUNT32.CC[0].reg = time;
+    while (TC4->COUNT32.STATUS.bit.SYNCBUSY);
+}
+
+/*
+ * CPU cycles for profiling, taken from the SysTick which the core reloads every
+ * millisecond. Wraps after about 89 seconds. With interrupts disabled a pending
+ * SysTick wrap is missed, so measure outside of critical sections.
+ */
+uint32_t TickTimer::cycles()
+{
+    uint32_t ms, value;
+
+    do {
+        ms = millis();
+        value = SysTick->VAL;
+    } while (ms != millis()); // the SysTick wrapped meanwhile
+    return ms * (SysTick->LOAD + 1) + (SysTick->LOAD - value);
+}
+
+void TC4_Handler()
+{
+    TC4->COUNT32.INTFLAG.reg = TC_INTFLAG_MC0;
+    tickTimerIsr();
+}
+
+#endif // ARDUINO_ARCH_SAMD
@@ -0,0 +1,45 @@
+/*
+ * TickTimer.h
+ *
+ * Free running microsecond counter with one compare interrupt, the time base of the
+ * TickHandler. On the Feather M0 it's TC4/TC5 of the SAMD21 chained to a 32 bit counter
+ * and clocked with 1MHz, the host build provides a backend on the virtual clock.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef TICK_TIMER_H_
+#define TICK_TIMER_H_
+
+#include <Arduino.h>
+
+class TickTimer
+{
+public:
+    static void begin(void (*isr)());
+    static uint32_t now();
+    static void setAlarm(uint32_t time);
+    static uint32_t cycles();
+};
+
+#endif /* TICK_TIMER_H_ */
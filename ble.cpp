@@ -26,6 +26,9 @@ int32_t config1;
 int32_t config2;
 int32_t config3;
 
+int32_t telemetryStatus;
+int32_t telemetryRequest;
+
 void Ble::setup() {
 
   if ( !ble.begin(VERBOSE_MODE) )
@@ -47,134 +50,24 @@ void Ble::setup() {
   ble.info();
 
   /* Change the device name to make it easier to find */
-  Logger::debug("Setting device name to %s': pao EVCU");
+  Logger::debug("Setting device name to 'Pao EVCU'");
 
   if (! ble.sendCommandCheckOK(F("AT+GAPDEVNAME=Pao EVCU")) ) {
     Logger::debug("Could not set device name?");
   }
+#ifdef CFG_BLE_PACKED_TELEMETRY
+  Ble::setup_telemetry();
+#else
   Ble::setup_main();
   Ble::setup_io();
   Ble::setup_config();
-
-  // ble.sendCommandCheckOK( F("AT+GAPSETADVDATA=02-01-06-05-02-0d-18-0a-18") );
-
-  // DMOC REQUESTED
-  // 0x232
-  // speed 
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF01, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &reqSpeed);
-
-  // state
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF02, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &reqState);
-
-  //0x233
-  // torque
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF03, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &reqTorque);
-
-  //0x234
-  // accelerate
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF04, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &reqAccel);
-  
-  //regen
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF05, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &reqRegen);
-
-  // DMOC RECEIVED
-  // temprature status 0x651
-  // motor temp
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF07, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &resMotorTemp);
-
-  // inv temp
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF08, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &resInvTemp);
-
-
-  //torque report 0x23A
-  // actual torque
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF09, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &resTorque);
-
-  // speed and current 0x23B
-  // speed
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF0A, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &resSpeed);
-
-  // state
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF0B, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &resState);
-
-  // HV bus state 0x650
-  // dc voltage
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF0C, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &resDcVolt);
-
-  // dc current
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF0D, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &resDcCurrent);
-
-  // OUTPUTS
-  // main contactor
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF0E, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=1, VALUE=0"), &outMainCon);
-
-  //precharge contactor
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF0F, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=1, VALUE=0"), &outPreCon);
-
-  //brake
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF10, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=1, VALUE=0"), &outBrake);
-
-  //cooling
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF11, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=1, VALUE=0"), &outCooling);
-
-  //reverse light
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF12, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=1, VALUE=0"), &outReverseLight);
-
-
-  // INPUTS
-
-  // reverse
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF13, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=1, VALUE=0"), &inReverse);
-
-  //enable
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF14, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=1, VALUE=0"), &inEnable);
-
-  //throttle 1
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF15, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &inThrottle);
-
-
-  // brake 
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF17, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &inBrake);
-
-  // STATUS
-  // running
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF18, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=1, VALUE=0"), &isRunning);
-  // fault
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF19, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=1, VALUE=0"), &isFaulted);
-  // warning
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF1A, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=1, VALUE=0"), &isWarning);
-
-  
-  //CONFIG
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF1B, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &configSpeedMax);
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF1C, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &configTorqueMax);
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF1D, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &configSpeedSlewRate);
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF1E, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &configTorqueSlewRate);
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF1F, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &configReversePercent);
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF20, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &configKilowattHrs);
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF21, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &configPrechargeR);
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF22, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &configNominalVolt);
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF23, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &configPrechargeRelay);
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF24, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &configMainContactorRelay);
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF25, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &configCoolFan);
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF26, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &configCoolOn);
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF27, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &configCoolOff);
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF28, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &configBrakeLight);
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF29, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &configRevLight);
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF2A, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &configEnableIn);
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF2B, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &configReverseIn);
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF2C, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &configRegenTaperLower);
-  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF2D, PROPERTIES=0x10, MIN_LEN=1, MAX_LEN=5, VALUE=0"), &configRegenTaperUpper);
-
-  ble.sendCommandCheckOK( F("AT+GAPSETADVDATA=02-01-06-05-02-0d-18-0a-18") );
-
-  /* Reset the device for the new service setting changes to take effect */
-  Serial.print(F("Performing a SW reset (service changes require a reset): "));
-  ble.reset();
-
+#endif
 }
 
 void Ble::updateValues(Ble::BleData *data) {
+#ifdef CFG_BLE_PACKED_TELEMETRY
+  Ble::sendTelemetry(data);
+#else
   Ble::sendValue(data->reqSpeed, reqSpeed);
   Ble::sendValue(data->reqState, reqState);
   Ble::sendValue(data->reqTorque, reqTorque);
@@ -220,6 +113,7 @@ void Ble::updateValues(Ble::BleData *data) {
   Ble::sendValue(data->configSpeedMax, config1);
   Ble::sendValue(data->configTorqueMax, config2);
   Ble::sendValue(data->configSpeedSlewRate, config3);
+#endif
 }
 
 
@@ -293,6 +187,27 @@ void Ble::setup_config() {
   ble.reset();
 }
 
+/*
+ * One service with two byte array characteristics which carry the whole BleData
+ * snapshot (see ble.h for the layout), used instead of the three services above.
+ */
+void Ble::setup_telemetry() {
+  Logger::debug("Adding the Service definition (UUID = 0x27B7): ");
+  bool success = ble.sendCommandWithIntReply( F("AT+GATTADDSERVICE=UUID=0x27B7"), &serviceId);
+  if (! success) {
+    Logger::debug("Could not add service");
+  }
+
+  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF31, PROPERTIES=0x10, MIN_LEN=20, MAX_LEN=20, DATATYPE=2, VALUE=0"), &telemetryStatus);
+  ble.sendCommandWithIntReply( F("AT+GATTADDCHAR=UUID=0xFF32, PROPERTIES=0x10, MIN_LEN=15, MAX_LEN=15, DATATYPE=2, VALUE=0"), &telemetryRequest);
+
+  ble.sendCommandCheckOK( F("AT+GAPSETADVDATA=02-01-06-05-02-0d-18-0a-18") );
+
+  /* Reset the device for the new service setting changes to take effect */
+  Serial.print(F("Performing a SW reset (service changes require a reset): "));
+  ble.reset();
+}
+
 // PRIVATE
 
 
@@ -318,6 +233,65 @@ void Ble::sendValue(byte value, int id) {
   ble.println(value, HEX);
 }
 
+/*
+ * Pack the snapshot and send it with one command per characteristic.
+ */
+void Ble::sendTelemetry(Ble::BleData *data) {
+  byte buffer[BLE_TELEMETRY_STATUS_SIZE];
+
+  pack16(buffer, data->resTorque);
+  pack16(buffer + 2, data->resSpeed);
+  buffer[4] = data->resState;
+  pack16(buffer + 5, data->resDcVolt);
+  pack16(buffer + 7, data->resDcCurrent);
+  pack16(buffer + 9, data->resMotorTemp);
+  pack16(buffer + 11, data->resInvTemp);
+  pack16(buffer + 13, data->inThrottle);
+  pack16(buffer + 15, data->inBrake);
+  buffer[17] = Ble::convertToBinary(data->inEnable, data->inReverse, 0, 0, 0, 0, 0, 0);
+  buffer[18] = Ble::convertToBinary(data->outPreCon, data->outMainCon, data->outBrake, data->outCooling,
+                                    data->outReverseLight, 0, 0, 0);
+  buffer[19] = Ble::convertToBinary(data->isFaulted, data->isRunning, data->isWarning, 0, 0, 0, 0, 0);
+  Ble::sendBytes(buffer, BLE_TELEMETRY_STATUS_SIZE, telemetryStatus);
+
+  pack16(buffer, data->reqSpeed);
+  buffer[2] = data->reqState;
+  pack16(buffer + 3, data->reqTorque);
+  pack16(buffer + 5, data->reqAccel);
+  pack16(buffer + 7, data->reqRegen);
+  pack16(buffer + 9, data->configSpeedMax);
+  pack16(buffer + 11, data->configTorqueMax);
+  pack16(buffer + 13, data->configSpeedSlewRate);
+  Ble::sendBytes(buffer, BLE_TELEMETRY_REQUEST_SIZE, telemetryRequest);
+}
+
+/*
+ * Set a byte array characteristic, the values are sent as "AT+GATTCHAR=id,00-11-22".
+ */
+void Ble::sendBytes(byte *values, int length, int id) {
+  static const char hex[] = "0123456789ABCDEF";
+  char text[3 * BLE_TELEMETRY_STATUS_SIZE];
+  int pos = 0;
+
+  for (int i = 0; i < length && i < BLE_TELEMETRY_STATUS_SIZE; i++) {
+    if (i > 0)
+      text[pos++] = '-';
+    text[pos++] = hex[values[i] >> 4];
+    text[pos++] = hex[values[i] & 0x0F];
+  }
+  text[pos] = 0;
+
+  ble.print( F("AT+GATTCHAR=") );
+  ble.print( id );
+  ble.print( F(",") );
+  ble.println(text);
+}
+
+void Ble::pack16(byte *buffer, int value) {
+  buffer[0] = value & 0xFF;
+  buffer[1] = (value >> 8) & 0xFF;
+}
+
 byte Ble::convertToBinary(bool in1, bool in2, bool in3, bool in4, bool in5, bool in6, bool in7, bool in8){
   byte output = 0;
 
@@ -13,6 +13,21 @@
   #include <SoftwareSerial.h>
 #endif
 
+/*
+ * Layout of the packed telemetry (CFG_BLE_PACKED_TELEMETRY), all 16 bit values are
+ * little endian in the units of BleData:
+ *
+ * status characteristic (0xFF31, 20 bytes):
+ *   0 resTorque, 2 resSpeed, 4 resState (8 bit), 5 resDcVolt, 7 resDcCurrent,
+ *   9 resMotorTemp, 11 resInvTemp, 13 inThrottle, 15 inBrake,
+ *   17 input bits, 18 output bits, 19 status bits (see Ble::updateValues())
+ * request characteristic (0xFF32, 15 bytes):
+ *   0 reqSpeed, 2 reqState (8 bit), 3 reqTorque, 5 reqAccel, 7 reqRegen,
+ *   9 configSpeedMax, 11 configTorqueMax, 13 configSpeedSlewRate
+ */
+#define BLE_TELEMETRY_STATUS_SIZE  20
+#define BLE_TELEMETRY_REQUEST_SIZE 15
+
 class Ble {
 public:
     struct BleData {
@@ -66,12 +81,16 @@ public:
     void setup_main();
     void setup_io();
     void setup_config();
+    void setup_telemetry();
 
     void updateValues(BleData *data);
 private:
     void sendValue(int value, int id);
     void sendValue(bool value, int id);
     void sendValue(byte value, int id);
+    void sendBytes(byte *values, int length, int id);
+    void sendTelemetry(BleData *data);
+    static void pack16(byte *buffer, int value);
     byte convertToBinary(bool in1, bool in2, bool in3, bool in4, bool in5, bool in6, bool in7, bool in8);
 };
 
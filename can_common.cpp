@@ -14,6 +14,19 @@ CAN_FRAME::CAN_FRAME()
 	data.value = 0;
 }
 
+CAN_FRAME_FD::CAN_FRAME_FD()
+{
+	id = 0;
+	fid = 0;
+	rrs = 0;
+	priority = 15;
+	extended = false;
+	fdMode = 0;
+	timestamp = 0;
+	length = 0;
+	for (int i = 0; i < 8; i++) data.uint64[i] = 0;
+}
+
 
 CANListener::CANListener()
 {
@@ -41,6 +41,11 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 #define CFG_SERIAL_SPEED 115200
 
+/*
+ * BLE CONFIGURATION
+ */
+//#define CFG_BLE_PACKED_TELEMETRY // if defined, BleData is sent packed into two characteristics (2 instead of 23 commands per update), the existing phone apps only know the single ones
+
 
 //The defines that used to be here to configure devices are gone now.
 //The EEPROM stores which devices to bring up at start up and all
@@ -51,7 +56,10 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  *
  * specify the intervals (microseconds) at which each device type should be "ticked"
  * try to use the same numbers for several devices because then they will share
- * the same timer (out of a limited number of 9 timers).
+ * the same timer (out of a limited number of 9 timers) and are ticked in the same interrupt.
+ * The pedals and the motor controller must share an interval: the pedals are then
+ * sampled right before the motor controller sends its command in the same tick
+ * (see TickStage) instead of up to one interval earlier.
  */
 #define CFG_TICK_INTERVAL_HEARTBEAT                 2000000
 #define CFG_TICK_INTERVAL_POT_THROTTLE              40000
@@ -60,14 +68,30 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define CFG_TICK_INTERVAL_MEM_CACHE                 40000
 #define CFG_TICK_INTERVAL_EVIC                      100000
 #define CFG_TICK_INTERVAL_VEHICLE                   100000
+#define CFG_TICK_INTERVAL_NMT                       10000 // heartbeat supervision, a lost node is detected at most this late
+#ifdef CFG_BLE_PACKED_TELEMETRY
+#define CFG_TICK_INTERVAL_BLE                       100000
+#else
+#define CFG_TICK_INTERVAL_BLE                       1000000
+#endif
 
-#define ble_interval 1000
+#if CFG_TICK_INTERVAL_POT_THROTTLE != CFG_TICK_INTERVAL_MOTOR_CONTROLLER_DMOC
+#error "the pedals and the motor controller have to be ticked at the same interval"
+#endif
 
 /*
  * CAN BUS CONFIGURATION
  */
 #define CFG_CAN0_SPEED                              500 // specify the speed of the CAN0 bus (EV) in thousands. 
 #define CFG_CAN1_SPEED                              500 // specify the speed of the CAN1 bus (Car) in thousands
+#define CFG_CAN_NUM_BUSES                           2   // 1 = only the EV bus (CAN0), 2 = also the car bus (CAN1) on a second controller
+//#define CFG_CAN_MCP2518FD                         // if defined, CanHandler drives an MCP2518FD (CAN-FD) instead of the MCP2515
+#define CFG_CAN_FD_DATA_FACTOR                      4   // the data phase of CAN-FD frames runs at CFG_CAN0_SPEED times this factor (bit rate switching)
+#define CFG_ISOTP_BLOCK_SIZE                        8   // consecutive frames we accept before sending the next ISO-TP flow control (0 = all)
+#define CFG_ISOTP_STMIN                             0   // min. time between the ISO-TP consecutive frames we receive (0-127ms, 0xF1-0xF9 = 100-900us)
+#define CFG_CANOPEN_HEARTBEAT_TIME                  1000 // heartbeat period of the EVCU in ms (0 = none), the heartbeats of other nodes are supervised via 0x1016
+#define CFG_CANOPEN_SYNC_PERIOD                     0   // if not 0, the EVCU produces the CANopen SYNC with this period in us (a multiple of the control tick), else it follows the SYNC of another node
+#define CFG_CANOPEN_SYNC_DELAY                      2000 // time from the reception of a SYNC to the control tick which is aligned to it in us, must cover one pass through loop()
 
 /*
  * MISCELLANEOUS
@@ -147,10 +171,30 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  * These values should normally not be changed.
  */
 #define CFG_DEV_MGR_MAX_DEVICES 30 // the maximum number of devices supported by the DeviceManager
-#define CFG_CAN_NUM_OBSERVERS	7 // maximum number of device subscriptions per CAN bus
+#define CFG_CAN_NUM_OBSERVERS	12 // maximum number of device subscriptions per CAN bus (the first 8 are resolved by a 2k dispatch table, the others are matched one by one)
+//#define CFG_CAN1_DISPATCH_TABLE	// if defined, the car bus (CAN1) also gets a 2k dispatch table for its first 8 observers (2k more RAM budget), else they are matched one by one
+#define CFG_CAN_USE_INTERRUPT	// if defined, the MCP2515 interrupt reads received frames into a buffer instead of polling from loop()
+#define CFG_CAN_RX_BUFFER_SIZE	32 // the size of the receive buffer of each CAN bus (in frames)
+#define CFG_CAN_TX_BUFFER_SIZE	16 // the size of each of the transmit queues of a CAN bus (one per priority, in frames)
+#define CFG_CAN_FD_RX_BUFFER_SIZE	8 // the size of the receive buffer for CAN-FD frames with more than 8 bytes (in frames, MCP2518FD only)
+#define CFG_CAN_FD_TX_BUFFER_SIZE	4 // the size of the transmit queue for CAN-FD frames with more than 8 bytes (in frames, MCP2518FD only)
+#define CFG_CAN_NUM_RX_MONITORS	8 // maximum number of CAN ids per bus for which CanHandler keeps reception statistics and deadlines
+#define CFG_CAN_NUM_GATEWAY_RULES	8 // maximum number of rules which forward frames from one CAN bus to the other
+#define CFG_CAN_RAM_BUDGET	9216 // max. size of CanHandler in bytes with the MCP2515 (of the 32k RAM of the SAMD21), checked when compiling, the options add their share (CanHandler.h)
+#define CFG_ISOTP_NUM_SESSIONS	2 // maximum number of concurrent ISO-TP sessions (each uses one CAN observer)
+#define CFG_CANOPEN_NUM_RPDOS	2 // number of CANopen receive PDOs (1-4, each uses one CAN observer while enabled)
+#define CFG_CANOPEN_NUM_TPDOS	4 // number of CANopen transmit PDOs (1-4)
+#define CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS	8 // number of CANopen nodes whose heartbeat can be supervised (1-8)
 #define CFG_TIMER_NUM_OBSERVERS	7 // the maximum number of supported observers per timer
 #define CFG_TIMER_USE_QUEUING	// if defined, TickHandler uses a queuing buffer instead of direct calls from interrupts
 #define CFG_TIMER_BUFFER_SIZE	100 // the size of the queuing buffer for TickHandler
+#define CFG_LOG_DEFERRED	// if defined, Logger only records messages into a buffer after setup() and loop() prints them
+#define CFG_LOG_BUFFER_SIZE	64 // the size of the deferred log buffer (in messages)
+#define CFG_LOG_MAX_ARGS	10 // the maximum number of parameters of one log message
+#define CFG_LOG_RECORDS_PER_PASS	4 // the maximum number of deferred messages printed per pass through loop()
+#define CFG_ADC_SCAN	// if defined, SystemIO samples the pedal inputs in the background (timer -> ADC -> DMA) instead of a blocking analogRead()
+#define CFG_ADC_SCAN_INTERVAL	2000 // the interval of the background scan (in microseconds)
+#define CFG_ADC_OVERSAMPLING	2 // the ADC averages 2^n samples per conversion of the background scan (0-4)
 #define CFG_FAULT_HISTORY_SIZE	50 //number of faults to store in eeprom. A circular buffer so the last 50 faults are always stored.
 
 /*
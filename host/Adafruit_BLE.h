@@ -0,0 +1,65 @@
+/*
+ * Adafruit_BLE.h
+ *
+ * Host replacement for the Adafruit BLE library.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef HOST_ADAFRUIT_BLE_H_
+#define HOST_ADAFRUIT_BLE_H_
+
+#include <Arduino.h>
+
+#define HOST_BLE_COMMAND_TIME 3000 // time of one AT command round trip over SDEP in us
+
+/*
+ * Common base of the Bluefruit modules. On the host there is no module attached,
+ * every command succeeds without doing anything but takes HOST_BLE_COMMAND_TIME
+ * of virtual time (the firmware waits for the module to answer), so the time the
+ * main loop stalls in BLE updates shows up in the simulation.
+ */
+class Adafruit_BLE : public Stream
+{
+public:
+    Adafruit_BLE() : commands(0) {}
+    bool begin(bool verbose = false) { (void) verbose; return true; }
+    bool factoryReset() { return command(); }
+    bool reset() { return command(); }
+    void echo(bool enable) { (void) enable; command(); }
+    bool info() { return command(); }
+    bool isConnected() { return false; }
+    bool sendCommandCheckOK(const char *cmd) { (void) cmd; return command(); }
+    bool sendCommandCheckOK(const __FlashStringHelper *cmd) { (void) cmd; return command(); }
+    bool sendCommandWithIntReply(const char *cmd, int32_t *reply) { (void) cmd; *reply = 0; return command(); }
+    bool sendCommandWithIntReply(const __FlashStringHelper *cmd, int32_t *reply) { (void) cmd; *reply = 0; return command(); }
+    size_t write(uint8_t c) { if (c == '\n') command(); return 1; }
+    using Print::write;
+    uint32_t getCommandCount() { return commands; }
+
+private:
+    bool command() { commands++; delayMicroseconds(HOST_BLE_COMMAND_TIME); return true; }
+    uint32_t commands;
+};
+
+#endif /* HOST_ADAFRUIT_BLE_H_ */
@@ -0,0 +1,56 @@
+/*
+ * Adafruit_SleepyDog.h
+ *
+ * Host replacement for the Adafruit SleepyDog watchdog library.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef HOST_SLEEPYDOG_H_
+#define HOST_SLEEPYDOG_H_
+
+#include <Arduino.h>
+
+/*
+ * The watchdog only counts how often it was serviced so the simulation can verify
+ * that the main loop keeps feeding it.
+ */
+class WatchdogType
+{
+public:
+    WatchdogType() : timeout(0), resets(0), lastReset(0) {}
+    int enable(int maxPeriodMS = 0) { timeout = maxPeriodMS; lastReset = millis(); return maxPeriodMS; }
+    void disable() { timeout = 0; }
+    void reset() { resets++; lastReset = millis(); }
+    uint32_t getResetCount() { return resets; }
+    uint32_t getLastReset() { return lastReset; }
+
+private:
+    int timeout;
+    uint32_t resets;
+    uint32_t lastReset;
+};
+
+extern WatchdogType Watchdog;
+
+#endif /* HOST_SLEEPYDOG_H_ */
@@ -0,0 +1,82 @@
+/*
+ * CanFaultInjector.cpp
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+ */
+
+#include "CanFaultInjector.h"
+
+CanFaultInjector::CanFaultInjector(mcp2515_can *controller)
+{
+    this->controller = controller;
+    busOffTime = 0;
+    missingUntil = 0;
+    busOffDone = false;
+}
+
+/*
+ * Drive the controller bus-off at the given virtual time (TEC above 255).
+ */
+void CanFaultInjector::setBusOff(uint64_t time)
+{
+    busOffTime = time;
+    busOffDone = false;
+}
+
+/*
+ * Take the controller off the SPI bus right away, it answers again at the given time.
+ */
+void CanFaultInjector::setMissing(uint64_t until)
+{
+    missingUntil = until;
+    controller->setPresent(false);
+}
+
+uint64_t CanFaultInjector::update(uint64_t now)
+{
+    uint64_t next = now + 1000000;
+
+    if (missingUntil) {
+        if (now >= missingUntil) {
+            controller->setPresent(true);
+            missingUntil = 0;
+        } else if (missingUntil < next) {
+            next = missingUntil;
+        }
+    }
+    if (busOffTime && !busOffDone) {
+        if (now >= busOffTime) {
+            controller->setErrorCounters(256, 0);
+            busOffDone = true;
+        } else if (busOffTime < next) {
+            next = busOffTime;
+        }
+    }
+    return next;
+}
+
+uint64_t CanFaultInjector::getBusOffTime()
+{
+    return (busOffDone ? busOffTime : 0);
+}
@@ -0,0 +1,55 @@
+/*
+ * CanFaultInjector.h
+ *
+ * Breaks a CAN controller model at given virtual times: it can drive the chip into
+ * bus-off (as a shorted bus or a wrong bit rate would) or leave it unanswered on the
+ * SPI bus for a while (not soldered, no power). Used to check that the firmware
+ * keeps running and brings the bus back.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+ */
+
+#ifndef CAN_FAULT_INJECTOR_H_
+#define CAN_FAULT_INJECTOR_H_
+
+#include "HostHal.h"
+#include "mcp2515_can.h"
+
+class CanFaultInjector : public HostDevice
+{
+public:
+    CanFaultInjector(mcp2515_can *controller);
+    void setBusOff(uint64_t time);
+    void setMissing(uint64_t until);
+    uint64_t update(uint64_t now);
+    uint64_t getBusOffTime();
+
+private:
+    mcp2515_can *controller;
+    uint64_t busOffTime;    // when to drive the controller bus-off (0 = never)
+    uint64_t missingUntil;  // when the controller starts to answer again (0 = it's there)
+    bool busOffDone;
+};
+
+#endif /* CAN_FAULT_INJECTOR_H_ */
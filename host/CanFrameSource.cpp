@@ -0,0 +1,82 @@
+/*
+ * CanFrameSource.cpp
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "CanFrameSource.h"
+
+CanFrameSource::CanFrameSource(VirtualCanBus *bus, uint32_t period)
+{
+    this->bus = bus;
+    this->period = period;
+    numIds = 0;
+    nextId = 0;
+    counter = 0;
+    sent = 0;
+    bus->attach(this);
+}
+
+bool CanFrameSource::addId(uint32_t id)
+{
+    if (numIds >= CAN_FRAME_SOURCE_MAX_IDS)
+        return false;
+    ids[numIds++] = id;
+    return true;
+}
+
+/*
+ * Send the frames round robin, spread evenly over the period (like a node which
+ * sends its status frames one after the other).
+ */
+uint64_t CanFrameSource::update(uint64_t now)
+{
+    if (numIds == 0 || period == 0)
+        return now + 1000000;
+
+    CAN_FRAME frame;
+    frame.id = ids[nextId];
+    frame.extended = (frame.id > 0x7FF);
+    frame.rtr = 0;
+    frame.length = 8;
+    frame.data.value = 0;
+    frame.data.bytes[0] = counter;
+    bus->transmit(this, frame);
+    sent++;
+
+    if (++nextId >= numIds) {
+        nextId = 0;
+        counter++;
+    }
+    return now + period / numIds;
+}
+
+void CanFrameSource::receiveFrame(CAN_FRAME &frame)
+{
+    (void) frame;
+}
+
+uint32_t CanFrameSource::getSentCount()
+{
+    return sent;
+}
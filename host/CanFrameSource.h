@@ -0,0 +1,58 @@
+/*
+ * CanFrameSource.h
+ *
+ * Puts a set of frames on the virtual CAN bus at a fixed period, e.g. to load the bus
+ * with the status traffic of a motor controller. Byte 0 of each frame carries a
+ * running counter so lost frames can be spotted in a log.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef CAN_FRAME_SOURCE_H_
+#define CAN_FRAME_SOURCE_H_
+
+#include "HostHal.h"
+#include "VirtualCanBus.h"
+
+#define CAN_FRAME_SOURCE_MAX_IDS 8
+
+class CanFrameSource : public HostDevice, public VirtualCanNode
+{
+public:
+    CanFrameSource(VirtualCanBus *bus, uint32_t period);
+    bool addId(uint32_t id);
+    uint64_t update(uint64_t now);
+    void receiveFrame(CAN_FRAME &frame);
+    uint32_t getSentCount();
+
+private:
+    VirtualCanBus *bus;
+    uint32_t period;
+    uint32_t ids[CAN_FRAME_SOURCE_MAX_IDS];
+    uint8_t numIds;
+    uint8_t nextId;
+    uint8_t counter;
+    uint32_t sent;
+};
+
+#endif /* CAN_FRAME_SOURCE_H_ */
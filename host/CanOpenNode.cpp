@@ -0,0 +1,140 @@
+/*
+ * CanOpenNode.cpp
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "CanOpenNode.h"
+
+CanOpenNode::CanOpenNode(VirtualCanBus *bus, uint8_t nodeId, uint32_t period)
+{
+    this->bus = bus;
+    this->nodeId = nodeId;
+    this->period = period;
+    state = 0;
+    bootTime = 0;
+    nextHeartbeat = 0;
+    hangTime = 0;
+    hung = false;
+    boots = 0;
+    commands = 0;
+    lastHeartbeat = 0;
+    bus->attach(this);
+}
+
+/*
+ * Power on: the boot-up message follows at the given time.
+ */
+void CanOpenNode::start(uint64_t time)
+{
+    bootTime = time;
+}
+
+/*
+ * Let the application hang at the given time.
+ */
+void CanOpenNode::hang(uint64_t time)
+{
+    hangTime = time;
+}
+
+uint64_t CanOpenNode::update(uint64_t now)
+{
+    if (hangTime != 0 && now >= hangTime) {
+        hangTime = 0;
+        hung = true;
+    }
+    if (bootTime != 0) {
+        if (now < bootTime)
+            return bootTime;
+        bootTime = 0;
+        hung = false;
+        boots++;
+        send(0); // boot-up
+        state = 0x7F; // pre-operational
+        nextHeartbeat = now + period;
+    }
+    if (hung || state == 0)
+        return (hangTime != 0 ? hangTime : now + 1000000);
+    if (now >= nextHeartbeat) {
+        send(state);
+        lastHeartbeat = now;
+        nextHeartbeat += period;
+    }
+    return (hangTime != 0 && hangTime < nextHeartbeat ? hangTime : nextHeartbeat);
+}
+
+void CanOpenNode::send(uint8_t data)
+{
+    CAN_FRAME frame;
+    frame.id = 0x700 + nodeId;
+    frame.length = 1;
+    frame.data.bytes[0] = data;
+    bus->transmit(this, frame);
+}
+
+void CanOpenNode::receiveFrame(CAN_FRAME &frame)
+{
+    if (frame.extended || frame.id != 0 || frame.length < 2 || (frame.data.bytes[1] != 0 && frame.data.bytes[1] != nodeId))
+        return;
+
+    commands++;
+    uint8_t command = frame.data.bytes[0];
+    if (command == 0x81 || command == 0x82) { // reset node / communication
+        state = 0;
+        bootTime = hostHal.getMicros() + CAN_OPEN_NODE_BOOT_TIME;
+        hostHal.wakeDevice(this, bootTime);
+        return;
+    }
+    if (hung || state == 0)
+        return;
+    if (command == 0x01)
+        state = 0x05;
+    else if (command == 0x02)
+        state = 0x04;
+    else if (command == 0x80)
+        state = 0x7F;
+}
+
+uint8_t CanOpenNode::getState()
+{
+    return state;
+}
+
+uint32_t CanOpenNode::getBootCount()
+{
+    return boots;
+}
+
+/*
+ * Get the number of NMT commands which were addressed to this node (or to all nodes).
+ */
+uint32_t CanOpenNode::getCommandCount()
+{
+    return commands;
+}
+
+uint64_t CanOpenNode::getLastHeartbeatTime()
+{
+    return lastHeartbeat;
+}
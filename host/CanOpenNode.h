@@ -0,0 +1,69 @@
+/*
+ * CanOpenNode.h
+ *
+ * A CANopen slave on the virtual CAN bus (e.g. a BMS) for the heartbeat supervision of
+ * the EVCU: it boots into pre-operational with a boot-up message, sends its heartbeat
+ * with its NMT state and follows the NMT commands. Its application can be made to hang:
+ * the heartbeat stops, only an NMT reset (handled by its CAN driver) brings it back.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef CAN_OPEN_NODE_H_
+#define CAN_OPEN_NODE_H_
+
+#include "HostHal.h"
+#include "VirtualCanBus.h"
+
+#define CAN_OPEN_NODE_BOOT_TIME 50000 // time from a reset to the boot-up message in us
+
+class CanOpenNode : public HostDevice, public VirtualCanNode
+{
+public:
+    CanOpenNode(VirtualCanBus *bus, uint8_t nodeId, uint32_t period);
+    void start(uint64_t time);
+    void hang(uint64_t time);
+    uint64_t update(uint64_t now);
+    void receiveFrame(CAN_FRAME &frame);
+    uint8_t getState();
+    uint32_t getBootCount();
+    uint32_t getCommandCount();
+    uint64_t getLastHeartbeatTime();
+
+private:
+    VirtualCanBus *bus;
+    uint8_t nodeId;
+    uint32_t period;        // heartbeat period in us
+    uint8_t state;          // NMT state, 0 = booting
+    uint64_t bootTime;      // when the boot-up message is due (0 = booted)
+    uint64_t nextHeartbeat;
+    uint64_t hangTime;      // when the application hangs (0 = never)
+    bool hung;
+    uint32_t boots;
+    uint32_t commands;      // NMT commands to this node
+    uint64_t lastHeartbeat;
+
+    void send(uint8_t data);
+};
+
+#endif /* CAN_OPEN_NODE_H_ */
@@ -0,0 +1,342 @@
+/*
+ * DmocEmulator.cpp
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include <math.h>
+#include "DmocEmulator.h"
+
+#define NOMINAL_VOLTAGE   332.0  // open circuit voltage of the pack in V
+#define PACK_RESISTANCE   0.05   // in Ohm
+#define TORQUE_TIME_CONST 0.005  // response of the current loop in s
+#define RPM_PER_NM_S      10.0   // acceleration in rpm/s per Nm (inertia of motor and vehicle)
+#define DRAG_NM_PER_RPM   0.02   // speed dependent losses
+#define EFFICIENCY        0.9
+#define AMBIENT_TEMP      25.0
+
+DmocEmulator::DmocEmulator(VirtualCanBus *bus)
+{
+    this->bus = bus;
+    state = INITIALIZING;
+    requestedState = 0;
+    gear = 0;
+    keyOn = false;
+    for (int i = 0; i < 3; i++)
+        lastAlive[i] = 0xFF;
+    alive = 0;
+    lastCommand = 0;
+    lastUpdate = 0;
+    nextStatus = 0;
+    nextTemperature = 0;
+
+    torqueCommand = 0;
+    torque = 0;
+    speed = 0;
+    dcVoltage = NOMINAL_VOLTAGE;
+    dcCurrent = 0;
+    inverterTemp = AMBIENT_TEMP;
+    motorTemp = AMBIENT_TEMP;
+
+    enableTime = 0;
+    firstTorqueTime = 0;
+    torqueResponseTime = 0;
+    firstTorque = 0;
+    commands = 0;
+    checksumErrors = 0;
+    aliveErrors = 0;
+    timeouts = 0;
+    bus->attach(this);
+}
+
+/*
+ * The checksum of all DMOC frames (see DmocMotorController::calcChecksum()).
+ */
+uint8_t DmocEmulator::checksum(CAN_FRAME &frame)
+{
+    uint8_t cs = frame.id;
+
+    for (int i = 0; i < 7; i++)
+        cs += frame.data.bytes[i];
+    return (uint8_t) (256 - (uint8_t) (cs + 3));
+}
+
+/*
+ * Advance the model and send the status frames which are due.
+ */
+uint64_t DmocEmulator::update(uint64_t now)
+{
+    simulate(now);
+
+    if (state == INITIALIZING && now >= DMOC_EMULATOR_INIT_TIME)
+        changeState(DISABLED, now);
+    if ((state == STANDBY || state == ENABLED) && now - lastCommand > DMOC_EMULATOR_COMMAND_TIMEOUT) {
+        timeouts++;
+        changeState(DISABLED, now);
+    }
+
+    if (now >= nextStatus) {
+        sendStatus();
+        nextStatus = now + DMOC_EMULATOR_STATUS_PERIOD;
+    }
+    if (now >= nextTemperature) {
+        sendTemperatures();
+        nextTemperature = now + DMOC_EMULATOR_TEMPERATURE_PERIOD;
+    }
+    return (nextStatus < nextTemperature ? nextStatus : nextTemperature);
+}
+
+/*
+ * Accept a command frame only if its checksum is right and its alive counter differs
+ * from the one of the previous frame with the same id (the sender is still alive).
+ */
+void DmocEmulator::receiveFrame(CAN_FRAME &frame)
+{
+    if (frame.extended || frame.id < 0x232 || frame.id > 0x234 || frame.length != 8)
+        return;
+
+    if (frame.data.bytes[7] != checksum(frame)) {
+        checksumErrors++;
+        return;
+    }
+    uint8_t *last = &lastAlive[frame.id - 0x232];
+    uint8_t frameAlive = frame.data.bytes[6] & 0x0F;
+    if (frameAlive == *last) {
+        aliveErrors++;
+        return;
+    }
+    *last = frameAlive;
+    commands++;
+    handleCommand(frame);
+}
+
+void DmocEmulator::handleCommand(CAN_FRAME &frame)
+{
+    uint64_t now = hostHal.getMicros();
+
+    simulate(now);
+    switch (frame.id) {
+    case 0x232:
+        lastCommand = now;
+        keyOn = (frame.data.bytes[5] == 1);
+        gear = (frame.data.bytes[6] >> 4) & 0x03;
+        requestedState = frame.data.bytes[6] >> 6;
+
+        // the inverter only moves one step at a time: DISABLED <-> STANDBY <-> ENABLED
+        if (state == INITIALIZING || state == FAULT)
+            break;
+        if (!keyOn) {
+            changeState(DISABLED, now);
+            break;
+        }
+        switch (requestedState) {
+        case 0:
+            changeState(DISABLED, now);
+            break;
+        case 1:
+            if (state == DISABLED || state == ENABLED)
+                changeState(STANDBY, now);
+            break;
+        case 2:
+            if (state == STANDBY)
+                changeState(ENABLED, now);
+            break;
+        case 3:
+            changeState(POWERDOWN, now);
+            break;
+        }
+        break;
+
+    case 0x233: {
+        lastCommand = now;
+        // bytes 0-1 hold the upper torque limit, torque mode sets both limits to the same value
+        int32_t command = ((frame.data.bytes[0] << 8) | frame.data.bytes[1]) - 30000;
+        torqueCommand = (state == ENABLED && gear != 0) ? command / 10.0 : 0;
+        if (torqueCommand != 0 && firstTorqueTime == 0) {
+            firstTorqueTime = now;
+            firstTorque = torqueCommand;
+        }
+        break;
+    }
+    case 0x234: // power limits and ambient temperature are not modelled
+        break;
+    }
+}
+
+void DmocEmulator::changeState(State newState, uint64_t now)
+{
+    if (newState == state)
+        return;
+    state = newState;
+    if (state != ENABLED)
+        torqueCommand = 0;
+    if (state == ENABLED && enableTime == 0)
+        enableTime = now;
+}
+
+/*
+ * Integrate the motor (torque lag, speed, drag), the pack and the temperatures up to now.
+ */
+void DmocEmulator::simulate(uint64_t now)
+{
+    if (now <= lastUpdate)
+        return;
+    double dt = (now - lastUpdate) / 1e6;
+    double oldTorque = torque;
+
+    torque += (torqueCommand - torque) * (1 - exp(-dt / TORQUE_TIME_CONST));
+    if (firstTorqueTime != 0 && torqueResponseTime == 0 && fabs(torque) >= 0.9 * fabs(firstTorque)) {
+        // interpolate the exact moment the exponential crossed 90% within this step
+        double gap = torqueCommand - 0.9 * firstTorque;
+        double remaining = (gap != 0 ? (torqueCommand - oldTorque) / gap : 1);
+        torqueResponseTime = lastUpdate + (remaining > 1 ? (uint64_t) (TORQUE_TIME_CONST * log(remaining) * 1e6) : 0);
+        if (torqueResponseTime > now)
+            torqueResponseTime = now;
+    }
+    lastUpdate = now;
+
+    double direction = (gear == 2 ? -1 : 1);
+    double newSpeed = speed + (torque - DRAG_NM_PER_RPM * speed) * RPM_PER_NM_S * dt;
+    if ((speed > 0 && newSpeed < 0) || (speed < 0 && newSpeed > 0) || (speed == 0 && newSpeed * direction < 0))
+        newSpeed = 0; // regen brakes the vehicle but does not drive it backwards
+    speed = newSpeed;
+
+    double mechanicalPower = torque * speed * 2 * M_PI / 60;
+    double electricalPower = (mechanicalPower > 0 ? mechanicalPower / EFFICIENCY : mechanicalPower * EFFICIENCY);
+    dcCurrent = electricalPower / dcVoltage;
+    dcVoltage = NOMINAL_VOLTAGE - PACK_RESISTANCE * dcCurrent;
+
+    double losses = fabs(mechanicalPower) * (1 - EFFICIENCY);
+    inverterTemp += (losses * 2e-4 - (inverterTemp - AMBIENT_TEMP) / 300) * dt;
+    motorTemp += (losses * 1e-4 - (motorTemp - AMBIENT_TEMP) / 1200) * dt;
+}
+
+void DmocEmulator::sendStatus()
+{
+    uint8_t data[8];
+    uint16_t value;
+
+    alive = (alive + 2) & 0x0F;
+
+    value = (uint16_t) lround(torque * 10) + 30000;
+    memset(data, 0, sizeof(data));
+    data[0] = value >> 8;
+    data[1] = value & 0xFF;
+    data[2] = data[0];
+    data[3] = data[1];
+    transmit(0x23A, data);
+
+    value = (uint16_t) lround(speed) + 20000;
+    memset(data, 0, sizeof(data));
+    data[0] = value >> 8;
+    data[1] = value & 0xFF;
+    data[6] = state << 4;
+    transmit(0x23B, data);
+
+    memset(data, 0, sizeof(data));
+    value = (uint16_t) lround(dcVoltage * 10);
+    data[0] = value >> 8;
+    data[1] = value & 0xFF;
+    value = (uint16_t) lround(dcCurrent * 10) + 5000;
+    data[2] = value >> 8;
+    data[3] = value & 0xFF;
+    transmit(0x650, data);
+}
+
+void DmocEmulator::sendTemperatures()
+{
+    uint8_t data[8];
+
+    memset(data, 0, sizeof(data));
+    data[0] = (uint8_t) lround(motorTemp) + 40; // rotor
+    data[1] = (uint8_t) lround(inverterTemp) + 40;
+    data[2] = (uint8_t) lround(motorTemp) + 40; // stator
+    transmit(0x651, data);
+}
+
+/*
+ * Send a status frame, bytes 6 (low nibble) and 7 carry the alive counter and checksum.
+ */
+void DmocEmulator::transmit(uint32_t id, uint8_t *data)
+{
+    CAN_FRAME frame;
+
+    frame.id = id;
+    frame.extended = false;
+    frame.rtr = 0;
+    frame.length = 8;
+    memcpy(frame.data.bytes, data, 8);
+    frame.data.bytes[6] |= alive;
+    frame.data.bytes[7] = checksum(frame);
+    bus->transmit(this, frame);
+}
+
+DmocEmulator::State DmocEmulator::getState()
+{
+    return state;
+}
+
+uint64_t DmocEmulator::getEnableTime()
+{
+    return enableTime;
+}
+
+uint64_t DmocEmulator::getFirstTorqueTime()
+{
+    return firstTorqueTime;
+}
+
+uint64_t DmocEmulator::getTorqueResponseTime()
+{
+    return torqueResponseTime;
+}
+
+uint32_t DmocEmulator::getCommandCount()
+{
+    return commands;
+}
+
+uint32_t DmocEmulator::getChecksumErrors()
+{
+    return checksumErrors;
+}
+
+uint32_t DmocEmulator::getAliveErrors()
+{
+    return aliveErrors;
+}
+
+uint32_t DmocEmulator::getTimeoutCount()
+{
+    return timeouts;
+}
+
+double DmocEmulator::getTorque()
+{
+    return torque;
+}
+
+double DmocEmulator::getSpeed()
+{
+    return speed;
+}
@@ -0,0 +1,113 @@
+/*
+ * DmocEmulator.h
+ *
+ * A DMOC645 on the virtual CAN bus. It consumes the command frames 0x232 (speed,
+ * key, gear and requested state), 0x233 (torque) and 0x234 (power limits), checks
+ * their checksum and alive counter and walks through DISABLED -> STANDBY -> ENABLE
+ * like the real inverter (see DMOC.txt). It reports 0x23A (torque), 0x23B (speed
+ * and state), 0x650 (HV bus) and 0x651 (temperatures) driven by a simple motor and
+ * battery model, so state transitions, time-to-enable and the torque response can be
+ * measured without an inverter.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef DMOC_EMULATOR_H_
+#define DMOC_EMULATOR_H_
+
+#include "HostHal.h"
+#include "VirtualCanBus.h"
+
+#define DMOC_EMULATOR_STATUS_PERIOD      10000  // 0x23A, 0x23B and 0x650 in us
+#define DMOC_EMULATOR_TEMPERATURE_PERIOD 100000 // 0x651 in us
+#define DMOC_EMULATOR_INIT_TIME          100000 // time spent initializing after power up in us
+#define DMOC_EMULATOR_COMMAND_TIMEOUT    500000 // drop to DISABLED without valid 0x232/0x233 for this long in us
+
+class DmocEmulator : public HostDevice, public VirtualCanNode
+{
+public:
+    // the operation state as reported in byte 6 of 0x23B
+    enum State {
+        INITIALIZING = 0,
+        DISABLED = 1,
+        STANDBY = 2,
+        ENABLED = 3,
+        POWERDOWN = 4,
+        FAULT = 5
+    };
+
+    DmocEmulator(VirtualCanBus *bus);
+    uint64_t update(uint64_t now);
+    void receiveFrame(CAN_FRAME &frame);
+    static uint8_t checksum(CAN_FRAME &frame);
+
+    State getState();
+    uint64_t getEnableTime();
+    uint64_t getFirstTorqueTime();
+    uint64_t getTorqueResponseTime();
+    uint32_t getCommandCount();
+    uint32_t getChecksumErrors();
+    uint32_t getAliveErrors();
+    uint32_t getTimeoutCount();
+    double getTorque();
+    double getSpeed();
+
+private:
+    void handleCommand(CAN_FRAME &frame);
+    void changeState(State newState, uint64_t now);
+    void simulate(uint64_t now);
+    void sendStatus();
+    void sendTemperatures();
+    void transmit(uint32_t id, uint8_t *data);
+
+    VirtualCanBus *bus;
+    State state;
+    uint8_t requestedState; // DMOC encoding: 0=disabled, 1=standby, 2=enable, 3=powerdown
+    uint8_t gear;           // 0=neutral, 1=drive, 2=reverse
+    bool keyOn;
+    uint8_t lastAlive[3];   // last alive counter of 0x232, 0x233, 0x234 (0xFF = none yet)
+    uint8_t alive;          // alive counter of the status frames
+    uint64_t lastCommand;   // time of the last valid command frame
+    uint64_t lastUpdate;
+    uint64_t nextStatus, nextTemperature;
+
+    // motor and battery model
+    double torqueCommand;   // requested torque in Nm
+    double torque;          // actual torque in Nm (follows the command with a first order lag)
+    double speed;           // in rpm
+    double dcVoltage;       // in V
+    double dcCurrent;       // in A
+    double inverterTemp, motorTemp; // in degree C
+
+    // statistics
+    uint64_t enableTime;    // first time ENABLED was reached (0 = never)
+    uint64_t firstTorqueTime; // first non-zero torque command while enabled (0 = never)
+    uint64_t torqueResponseTime; // time when the torque reached 90% of that command (0 = never)
+    double firstTorque;
+    uint32_t commands;
+    uint32_t checksumErrors;
+    uint32_t aliveErrors;
+    uint32_t timeouts;
+};
+
+#endif /* DMOC_EMULATOR_H_ */
@@ -0,0 +1,130 @@
+/*
+ * HostAdcScanner.cpp
+ *
+ * AdcScanner on the virtual clock: a device which copies the analog values of the
+ * pins into the double buffer every interval, without blocking the firmware.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "AdcScanner.h"
+#include "HostHal.h"
+
+class HostAdcScanner : public HostDevice
+{
+public:
+    HostAdcScanner()
+    {
+        numPins = 0;
+        interval = 0;
+        running = false;
+        latestBuffer = 0;
+        scanCount = 0;
+        scanTime = 0;
+    }
+
+    uint64_t update(uint64_t now)
+    {
+        if (!running)
+            return now + 1000000;
+
+        uint8_t buffer = latestBuffer ^ 1;
+        for (uint8_t i = 0; i < numPins; i++)
+            samples[buffer][i] = hostHal.getAnalogIn(pins[i]);
+        latestBuffer = buffer;
+        scanCount++;
+        scanTime = (uint32_t) now;
+        return now + interval;
+    }
+
+    uint8_t pins[ADC_SCAN_MAX_PINS];
+    uint8_t numPins;
+    uint32_t interval;
+    bool running;
+    int16_t samples[2][ADC_SCAN_MAX_PINS];
+    uint8_t latestBuffer;
+    uint32_t scanCount;
+    uint32_t scanTime;
+};
+
+static HostAdcScanner hostAdcScanner;
+
+/*
+ * The oversampling is ignored, the virtual inputs are free of noise.
+ */
+bool AdcScanner::begin(const uint8_t *pins, uint8_t count, uint32_t interval, uint8_t oversampling)
+{
+    (void) oversampling;
+    if (count == 0 || count > ADC_SCAN_MAX_PINS || interval == 0)
+        return false;
+
+    stop();
+    if (hostAdcScanner.interval == 0)
+        hostHal.attachDevice(&hostAdcScanner);
+    for (uint8_t i = 0; i < count; i++)
+        hostAdcScanner.pins[i] = pins[i];
+    hostAdcScanner.numPins = count;
+    hostAdcScanner.interval = interval;
+    start();
+    return true;
+}
+
+void AdcScanner::start()
+{
+    if (hostAdcScanner.numPins == 0 || hostAdcScanner.running)
+        return;
+    hostAdcScanner.running = true;
+    // the first scan completes right away, like begin() waits for it on the SAMD21
+    hostHal.wakeDevice(&hostAdcScanner, hostAdcScanner.update(hostHal.getMicros()));
+}
+
+void AdcScanner::stop()
+{
+    hostAdcScanner.running = false;
+}
+
+bool AdcScanner::isRunning()
+{
+    return hostAdcScanner.running;
+}
+
+int16_t AdcScanner::getSample(uint8_t pin)
+{
+    if (hostAdcScanner.scanCount == 0)
+        return -1;
+    for (uint8_t i = 0; i < hostAdcScanner.numPins; i++) {
+        if (hostAdcScanner.pins[i] == pin)
+            return hostAdcScanner.samples[hostAdcScanner.latestBuffer][i];
+    }
+    return -1;
+}
+
+uint32_t AdcScanner::getScanTime()
+{
+    return hostAdcScanner.scanTime;
+}
+
+uint32_t AdcScanner::getScanCount()
+{
+    return hostAdcScanner.scanCount;
+}
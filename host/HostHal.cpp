@@ -0,0 +1,474 @@
+/*
+ * HostHal.cpp
+ *
+ * Implementation of the host Arduino shim on top of the virtual hardware.
+ *
+ * Time only moves when the simulation advances the clock (or when the firmware
+ * blocks in delay()/delayMicroseconds() or another blocking peripheral access), so a
+ * control loop can be run far faster than real time and the virtual time spent in
+ * blocking calls shows up in the profile.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "HostHal.h"
+#include <SPI.h>
+#include <Wire.h>
+#include <Adafruit_SleepyDog.h>
+
+HostSerial Serial;
+SPIClass SPI;
+TwoWire Wire;
+WatchdogType Watchdog;
+HostHal hostHal;
+
+HostHal::HostHal()
+{
+    for (int i = 0; i < HOST_NUM_PINS; i++) {
+        pins[i].level = HIGH;
+        pins[i].analogValue = 0;
+        pins[i].mode = INPUT;
+        pins[i].isr = NULL;
+        pins[i].isrMode = 0;
+    }
+    for (int i = 0; i < HOST_NUM_PINS / 32; i++)
+        pendingInterrupts[i] = 0;
+    for (int i = 0; i < HOST_MAX_DEVICES; i++)
+        devices[i] = NULL;
+    advancing = false;
+    now = 0;
+    interruptsEnabled = true;
+    serialMuted = false;
+    serialBytes = 0;
+    analogReads = 0;
+    analogReadTime = 0;
+    serialByteTime = 0;
+}
+
+uint64_t HostHal::getMicros()
+{
+    return now;
+}
+
+void HostHal::setMicros(uint64_t now)
+{
+    this->now = now;
+}
+
+/*
+ * Let time pass. Attached devices get their update() calls at the exact times they
+ * asked for. Time spent by code which runs from such an update (e.g. an ISR reading
+ * a frame) is simply added, it does not move the end of the interval.
+ */
+void HostHal::advance(uint32_t us)
+{
+    if (advancing) {
+        now += us;
+        return;
+    }
+
+    uint64_t target = now + us;
+    advancing = true;
+    for (;;) {
+        int next = -1;
+        for (int i = 0; i < HOST_MAX_DEVICES; i++) {
+            if (devices[i] != NULL && deadlines[i] <= target && (next == -1 || deadlines[i] < deadlines[next]))
+                next = i;
+        }
+        if (next == -1)
+            break;
+        if (now < deadlines[next])
+            now = deadlines[next];
+        deadlines[next] = devices[next]->update(now);
+        if (deadlines[next] <= now)
+            deadlines[next] = now + 1;
+    }
+    if (now < target)
+        now = target;
+    advancing = false;
+}
+
+bool HostHal::attachDevice(HostDevice *device)
+{
+    for (int i = 0; i < HOST_MAX_DEVICES; i++) {
+        if (devices[i] == NULL) {
+            devices[i] = device;
+            deadlines[i] = now;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Move the next update() of a device, e.g. because the firmware re-programmed it.
+ */
+void HostHal::wakeDevice(HostDevice *device, uint64_t time)
+{
+    for (int i = 0; i < HOST_MAX_DEVICES; i++) {
+        if (devices[i] == device)
+            deadlines[i] = time;
+    }
+}
+
+void HostHal::setAnalogIn(uint8_t pin, int value)
+{
+    if (pin < HOST_NUM_PINS)
+        pins[pin].analogValue = value;
+}
+
+int HostHal::getAnalogIn(uint8_t pin)
+{
+    if (pin < HOST_NUM_PINS)
+        return pins[pin].analogValue;
+    return 0;
+}
+
+/*
+ * Sample an analog input the way analogRead() does: blocking for the conversion time.
+ */
+int HostHal::sampleAnalog(uint8_t pin)
+{
+    analogReads++;
+    advance(analogReadTime);
+    return getAnalogIn(pin);
+}
+
+uint32_t HostHal::getAnalogReadCount()
+{
+    return analogReads;
+}
+
+/*
+ * Drive a pin from the outside (e.g. a switch or the INT line of a peripheral).
+ * Interrupts attached to the pin are triggered according to their mode.
+ */
+void HostHal::setPinLevel(uint8_t pin, int level)
+{
+    if (pin >= HOST_NUM_PINS)
+        return;
+    int oldLevel = pins[pin].level;
+    pins[pin].level = level;
+    raiseInterrupt(pin, oldLevel, level);
+}
+
+int HostHal::getPinLevel(uint8_t pin)
+{
+    if (pin < HOST_NUM_PINS)
+        return pins[pin].level;
+    return LOW;
+}
+
+void HostHal::setPinMode(uint8_t pin, int mode)
+{
+    if (pin < HOST_NUM_PINS)
+        pins[pin].mode = mode;
+}
+
+int HostHal::getPinMode(uint8_t pin)
+{
+    if (pin < HOST_NUM_PINS)
+        return pins[pin].mode;
+    return INPUT;
+}
+
+void HostHal::attachInterrupt(uint8_t pin, voidFuncPtr isr, uint32_t mode)
+{
+    if (pin >= HOST_NUM_PINS)
+        return;
+    pins[pin].isr = isr;
+    pins[pin].isrMode = mode;
+    // a level interrupt fires right away if the line is already asserted
+    if ((mode == LOW && pins[pin].level == LOW) || (mode == HIGH && pins[pin].level == HIGH))
+        raiseInterrupt(pin, !pins[pin].level, pins[pin].level);
+}
+
+void HostHal::detachInterrupt(uint8_t pin)
+{
+    if (pin >= HOST_NUM_PINS)
+        return;
+    pins[pin].isr = NULL;
+    pendingInterrupts[pin / 32] &= ~(1ul << (pin % 32));
+}
+
+void HostHal::setInterruptsEnabled(bool enabled)
+{
+    interruptsEnabled = enabled;
+    if (enabled)
+        runPendingInterrupts();
+}
+
+bool HostHal::isInterruptsEnabled()
+{
+    return interruptsEnabled;
+}
+
+void HostHal::raiseInterrupt(uint8_t pin, int oldLevel, int newLevel)
+{
+    PinState *state = &pins[pin];
+
+    if (state->isr == NULL)
+        return;
+
+    bool fire = false;
+    switch (state->isrMode) {
+    case LOW:
+        fire = (newLevel == LOW);
+        break;
+    case HIGH:
+        fire = (newLevel == HIGH);
+        break;
+    case CHANGE:
+        fire = (oldLevel != newLevel);
+        break;
+    case FALLING:
+        fire = (oldLevel == HIGH && newLevel == LOW);
+        break;
+    case RISING:
+        fire = (oldLevel == LOW && newLevel == HIGH);
+        break;
+    }
+    if (!fire)
+        return;
+
+    pendingInterrupts[pin / 32] |= (1ul << (pin % 32));
+    if (interruptsEnabled)
+        runPendingInterrupts();
+}
+
+/*
+ * Run the ISRs of all pending interrupt lines. An ISR runs with interrupts disabled,
+ * just like on the real hardware, so nested interrupts are deferred until it returns.
+ */
+void HostHal::runPendingInterrupts()
+{
+    for (int pin = 0; pin < HOST_NUM_PINS; pin++) {
+        if (!interruptsEnabled)
+            return;
+        if (!(pendingInterrupts[pin / 32] & (1ul << (pin % 32))))
+            continue;
+        pendingInterrupts[pin / 32] &= ~(1ul << (pin % 32));
+        if (pins[pin].isr) {
+            interruptsEnabled = false;
+            pins[pin].isr();
+            interruptsEnabled = true;
+        }
+        // level triggered interrupts re-fire for as long as the line is asserted
+        if (pins[pin].isr && ((pins[pin].isrMode == LOW && pins[pin].level == LOW)
+                              || (pins[pin].isrMode == HIGH && pins[pin].level == HIGH)))
+            pin--;
+    }
+}
+
+void HostHal::setSerialMuted(bool muted)
+{
+    serialMuted = muted;
+}
+
+bool HostHal::isSerialMuted()
+{
+    return serialMuted;
+}
+
+uint32_t HostHal::getSerialBytes()
+{
+    return serialBytes;
+}
+
+void HostHal::countSerialByte()
+{
+    serialBytes++;
+}
+
+/*
+ * Arduino core API
+ */
+
+uint32_t millis()
+{
+    return (uint32_t) (hostHal.getMicros() / 1000);
+}
+
+uint32_t micros()
+{
+    return (uint32_t) hostHal.getMicros();
+}
+
+void delay(uint32_t ms)
+{
+    hostHal.advance(ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    hostHal.advance(us);
+}
+
+void pinMode(uint32_t pin, uint32_t mode)
+{
+    hostHal.setPinMode(pin, mode);
+    if (mode == INPUT_PULLUP)
+        hostHal.setPinLevel(pin, HIGH);
+}
+
+void digitalWrite(uint32_t pin, uint32_t value)
+{
+    hostHal.setPinLevel(pin, value ? HIGH : LOW);
+}
+
+int digitalRead(uint32_t pin)
+{
+    return hostHal.getPinLevel(pin);
+}
+
+int analogRead(uint32_t pin)
+{
+    return hostHal.sampleAnalog(pin);
+}
+
+void analogReadResolution(int bits)
+{
+    (void) bits;
+}
+
+void analogWrite(uint32_t pin, int value)
+{
+    hostHal.setAnalogIn(pin, value);
+}
+
+int digitalPinToInterrupt(uint32_t pin)
+{
+    if (pin >= HOST_NUM_PINS)
+        return NOT_AN_INTERRUPT;
+    return pin;
+}
+
+void attachInterrupt(uint32_t interrupt, voidFuncPtr callback, uint32_t mode)
+{
+    hostHal.attachInterrupt(interrupt, callback, mode);
+}
+
+void detachInterrupt(uint32_t interrupt)
+{
+    hostHal.detachInterrupt(interrupt);
+}
+
+void noInterrupts()
+{
+    hostHal.setInterruptsEnabled(false);
+}
+
+void interrupts()
+{
+    hostHal.setInterruptsEnabled(true);
+}
+
+uint32_t __get_PRIMASK()
+{
+    return hostHal.isInterruptsEnabled() ? 0 : 1;
+}
+
+void __set_PRIMASK(uint32_t priMask)
+{
+    hostHal.setInterruptsEnabled((priMask & 1) == 0);
+}
+
+void __disable_irq()
+{
+    hostHal.setInterruptsEnabled(false);
+}
+
+void __enable_irq()
+{
+    hostHal.setInterruptsEnabled(true);
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+    if (in_max == in_min)
+        return out_min;
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+/*
+ * Print
+ */
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+    while (size--)
+        n += write(*buffer++);
+    return n;
+}
+
+size_t Print::print(long value, int base)
+{
+    if (base == DEC && value < 0) {
+        size_t n = print('-');
+        return n + printNumber((unsigned long) -value, DEC);
+    }
+    if (base != DEC)
+        return printNumber((unsigned long) (uint32_t) value, base); // 32bit two's complement like the target
+    return printNumber((unsigned long) value, base);
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+    return printNumber(value, base);
+}
+
+size_t Print::print(double value, int digits)
+{
+    char format[8];
+    char buffer[64];
+    snprintf(format, sizeof(format), "%%.%df", digits);
+    snprintf(buffer, sizeof(buffer), format, value);
+    return write(buffer);
+}
+
+size_t Print::printNumber(unsigned long value, uint8_t base)
+{
+    char buffer[8 * sizeof(long) + 1];
+    char *str = &buffer[sizeof(buffer) - 1];
+
+    if (base < 2)
+        base = 10;
+    *str = '\0';
+    do {
+        char c = value % base;
+        value /= base;
+        *--str = c < 10 ? c + '0' : c + 'A' - 10;
+    } while (value);
+
+    return write(str);
+}
+
+size_t HostSerial::write(uint8_t c)
+{
+    hostHal.countSerialByte();
+    hostHal.advance(hostHal.serialByteTime);
+    if (!hostHal.isSerialMuted())
+        putchar(c);
+    return 1;
+}
@@ -0,0 +1,118 @@
+/*
+ * HostHal.h
+ *
+ * Virtual hardware behind the host Arduino shim: a controllable clock, the pin and
+ * ADC tables and the external interrupt lines. The firmware never sees this class,
+ * it is used by the host main program (and the virtual peripherals) to drive the
+ * simulation.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef HOST_HAL_H_
+#define HOST_HAL_H_
+
+#include <Arduino.h>
+
+#define HOST_NUM_PINS 64
+#define HOST_MAX_DEVICES 12
+#define HOST_TIMER_IRQ (HOST_NUM_PINS - 1) // interrupt line of the TickTimer, not a real pin
+
+/*
+ * A simulated peripheral or remote node which has to act while time passes (e.g. send
+ * CAN frames at a fixed rate). update() is called whenever the clock reaches the time
+ * it returned the last time, so events happen at the right moment even while the
+ * firmware blocks in delay().
+ */
+class HostDevice
+{
+public:
+    virtual ~HostDevice() {}
+    virtual uint64_t update(uint64_t now) = 0; // returns the time of the next event
+};
+
+class HostHal
+{
+public:
+    HostHal();
+
+    // virtual clock
+    uint64_t getMicros();
+    void setMicros(uint64_t now);
+    void advance(uint32_t us);
+    bool attachDevice(HostDevice *device);
+    void wakeDevice(HostDevice *device, uint64_t time);
+
+    // pins and ADC
+    void setAnalogIn(uint8_t pin, int value);
+    int getAnalogIn(uint8_t pin);
+    void setPinLevel(uint8_t pin, int level);
+    int getPinLevel(uint8_t pin);
+    void setPinMode(uint8_t pin, int mode);
+    int getPinMode(uint8_t pin);
+    int sampleAnalog(uint8_t pin);
+    uint32_t getAnalogReadCount();
+
+    // external interrupts
+    void attachInterrupt(uint8_t pin, voidFuncPtr isr, uint32_t mode);
+    void detachInterrupt(uint8_t pin);
+    void setInterruptsEnabled(bool enabled);
+    bool isInterruptsEnabled();
+
+    // serial port
+    void setSerialMuted(bool muted);
+    bool isSerialMuted();
+    uint32_t getSerialBytes();
+    void countSerialByte();
+
+    // cost (in virtual microseconds) of a blocking analogRead() and of one byte written to Serial
+    uint32_t analogReadTime;
+    uint32_t serialByteTime;
+
+private:
+    struct PinState {
+        int level;
+        int analogValue;
+        int mode;
+        voidFuncPtr isr;
+        uint32_t isrMode;
+    };
+
+    void raiseInterrupt(uint8_t pin, int oldLevel, int newLevel);
+    void runPendingInterrupts();
+
+    PinState pins[HOST_NUM_PINS];
+    HostDevice *devices[HOST_MAX_DEVICES];
+    uint64_t deadlines[HOST_MAX_DEVICES];
+    bool advancing;
+    uint64_t now;
+    bool interruptsEnabled;
+    uint32_t pendingInterrupts[HOST_NUM_PINS / 32];
+    bool serialMuted;
+    uint32_t serialBytes;
+    uint32_t analogReads;
+};
+
+extern HostHal hostHal;
+
+#endif /* HOST_HAL_H_ */
@@ -0,0 +1,97 @@
+/*
+ * HostTickTimer.cpp
+ *
+ * TickTimer on the virtual clock: the counter is the clock itself and the compare
+ * match raises the (otherwise unused) interrupt line HOST_TIMER_IRQ, so the ISR is
+ * deferred while interrupts are disabled just like on the SAMD21.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include <time.h>
+#include "TickTimer.h"
+#include "HostHal.h"
+
+class HostTickTimer : public HostDevice
+{
+public:
+    HostTickTimer()
+    {
+        armed = false;
+        alarm = 0;
+    }
+
+    uint64_t update(uint64_t now)
+    {
+        if (armed && alarm <= now) {
+            armed = false;
+            hostHal.setPinLevel(HOST_TIMER_IRQ, HIGH);  // the ISR may arm the next alarm
+            hostHal.setPinLevel(HOST_TIMER_IRQ, LOW);
+        }
+        return (armed ? alarm : now + 1000000);
+    }
+
+    void setAlarm(uint32_t time)
+    {
+        uint64_t now = hostHal.getMicros();
+
+        // the counter has 32 bits like the hardware, a time in the past matches after the wrap
+        alarm = now + (uint32_t) (time - (uint32_t) now);
+        armed = true;
+        hostHal.wakeDevice(this, alarm);
+    }
+
+    bool armed;
+    uint64_t alarm;
+};
+
+static HostTickTimer hostTickTimer;
+
+void TickTimer::begin(void (*isr)())
+{
+    hostHal.setPinLevel(HOST_TIMER_IRQ, LOW);
+    hostHal.attachInterrupt(HOST_TIMER_IRQ, isr, RISING);
+    hostHal.attachDevice(&hostTickTimer);
+}
+
+uint32_t TickTimer::now()
+{
+    return (uint32_t) hostHal.getMicros();
+}
+
+void TickTimer::setAlarm(uint32_t time)
+{
+    hostTickTimer.setAlarm(time);
+}
+
+/*
+ * The virtual clock does not advance while the firmware computes, so profiling uses
+ * the monotonic clock of the host instead, in nanoseconds. Unlike the thread's CPU
+ * time it's read without a system call, which would cost more than the code measured.
+ */
+uint32_t TickTimer::cycles()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ((uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec);
+}
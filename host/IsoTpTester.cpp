@@ -0,0 +1,392 @@
+/*
+ * IsoTpTester.cpp
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+ */
+
+#include "IsoTpTester.h"
+
+IsoTpEcho::IsoTpEcho()
+{
+    session = -1;
+    messages = 0;
+    memset(receiveErrors, 0, sizeof(receiveErrors));
+    memset(sent, 0, sizeof(sent));
+    lastEventTime = 0;
+}
+
+/*
+ * Open the session in the EVCU, to be called after setup().
+ */
+bool IsoTpEcho::open(uint32_t txId, uint32_t rxId)
+{
+    session = isoTpHandler.open(this, txId, rxId, false, rxBuffer, sizeof(rxBuffer));
+    return session >= 0;
+}
+
+void IsoTpEcho::handleIsoTpMessage(int8_t session, uint8_t *data, uint16_t length)
+{
+    messages++;
+    lastEventTime = hostHal.getMicros();
+    memcpy(txBuffer, data, length);
+    isoTpHandler.send(session, txBuffer, length);
+}
+
+void IsoTpEcho::handleIsoTpReceiveError(int8_t, IsoTpResult result)
+{
+    receiveErrors[result]++;
+    lastEventTime = hostHal.getMicros();
+}
+
+void IsoTpEcho::handleIsoTpSent(int8_t, IsoTpResult result)
+{
+    sent[result]++;
+    lastEventTime = hostHal.getMicros();
+}
+
+uint32_t IsoTpEcho::getMessageCount()
+{
+    return messages;
+}
+
+uint32_t IsoTpEcho::getReceiveErrorCount(IsoTpResult result)
+{
+    return receiveErrors[result];
+}
+
+uint32_t IsoTpEcho::getSentCount(IsoTpResult result)
+{
+    return sent[result];
+}
+
+uint64_t IsoTpEcho::getLastEventTime()
+{
+    return lastEventTime;
+}
+
+IsoTpTester::IsoTpTester(VirtualCanBus *bus, IsoTpEcho *echo)
+{
+    this->bus = bus;
+    this->echo = echo;
+    memset(results, 0, sizeof(results));
+    step = 0;
+    running = false;
+    startTime = 0;
+    bus->attach(this);
+}
+
+/*
+ * Start the first step at the given time (e.g. once the filters of the EVCU are programmed).
+ */
+void IsoTpTester::start(uint64_t time)
+{
+    startTime = time;
+}
+
+uint64_t IsoTpTester::update(uint64_t now)
+{
+    if (step >= ISOTP_TEST_STEPS)
+        return now + 1000000;
+    if (!running) {
+        if (now < startTime)
+            return startTime;
+        beginStep(now);
+    }
+    uint64_t next = now + 1000; // poll the counters of the echo
+
+    // the request: the next consecutive frame once STmin passed
+    if (step == ISOTP_TEST_UNEXPECTED && flowCount == 1 && txLength == ISOTP_TESTER_LENGTH) {
+        sendFirstFrame(ISOTP_TESTER_TOO_LONG, 6);
+        referenceTime = now;
+    }
+    if (txClear && txOffset < txLimit) {
+        if (now >= txTime) {
+            uint32_t duration = sendConsecutiveFrame(now);
+            txTime = now + (duration > txSeparation ? duration : txSeparation);
+        }
+        if (txClear && txOffset < txLimit && txTime < next)
+            next = txTime;
+    }
+
+    // the echo: WAITs first in the exchange, refused in the overflow step
+    if (rxFlowPending && now >= rxFlowTime) {
+        rxFlowPending = false;
+        if (step == ISOTP_TEST_TX_OVERFLOW) {
+            sendFlowControl(ISOTP_OVERFLOW);
+            referenceTime = now;
+        } else if (step == ISOTP_TEST_EXCHANGE && rxWaits < ISOTP_TESTER_WAITS) {
+            sendFlowControl(ISOTP_WAIT);
+            rxWaits++;
+            rxFlowPending = true;
+            rxFlowTime = now + ISOTP_TESTER_WAIT_TIME;
+        } else {
+            sendFlowControl(ISOTP_CONTINUE_TO_SEND);
+        }
+    }
+    if (rxFlowPending && rxFlowTime < next)
+        next = rxFlowTime;
+
+    if (eventTime == 0 && (step == ISOTP_TEST_TX_OVERFLOW || step == ISOTP_TEST_TIMEOUT_CR) && echoReported())
+        eventTime = echo->getLastEventTime();
+    if (eventTime == 0) {
+        if (now - startTime >= ISOTP_TESTER_TIMEOUT) {
+            finishStep(now, false);
+            return startTime;
+        }
+        return next;
+    }
+    if (now < eventTime + ISOTP_TESTER_SETTLE)
+        return (eventTime + ISOTP_TESTER_SETTLE < next ? eventTime + ISOTP_TESTER_SETTLE : next);
+
+    bool passed = false;
+    switch (step) {
+    case ISOTP_TEST_EXCHANGE:
+        passed = rxLength == ISOTP_TESTER_LENGTH && rxOffset == rxLength && !memcmp(response, request, rxLength)
+                && rxWaits == ISOTP_TESTER_WAITS && checkEcho(1, ISOTP_OK, -1);
+        break;
+    case ISOTP_TEST_TX_OVERFLOW:
+        passed = rxFrames == 1 && checkEcho(1, ISOTP_BUFFER_OVFLW, -1); // no consecutive frame after the overflow
+        break;
+    case ISOTP_TEST_RX_OVERFLOW:
+        passed = flowCount == 1 && checkEcho(0, -1, ISOTP_BUFFER_OVFLW);
+        break;
+    case ISOTP_TEST_UNEXPECTED:
+        passed = flowCount == 2 && checkEcho(0, -1, ISOTP_UNEXP_PDU);
+        break;
+    case ISOTP_TEST_TIMEOUT_CR:
+        passed = txOffset == txLimit && checkEcho(0, -1, ISOTP_TIMEOUT_CR);
+        break;
+    }
+    finishStep(now, passed);
+    return startTime;
+}
+
+/*
+ * Frames of the EVCU: flow controls for the request and the segments of the echo.
+ */
+void IsoTpTester::receiveFrame(CAN_FRAME &frame)
+{
+    if (!running || frame.extended || frame.id != ISOTP_TESTER_RX_ID || frame.length != 8)
+        return;
+
+    uint64_t now = hostHal.getMicros();
+    uint16_t count;
+
+    switch (frame.data.bytes[0] & 0xF0) {
+    case ISOTP_FLOW_CONTROL:
+        flowCount++;
+        flowStatus = frame.data.bytes[0] & 0x0F;
+        txClear = (flowStatus == ISOTP_CONTINUE_TO_SEND);
+        if (txClear) {
+            txBlockSize = frame.data.bytes[1];
+            txBlockCount = 0;
+            uint8_t stMin = frame.data.bytes[2];
+            txSeparation = (stMin <= 0x7F ? stMin * 1000 : (stMin >= 0xF1 && stMin <= 0xF9 ? (stMin - 0xF0) * 100 : 127000));
+            txTime = now;
+        }
+        if (flowStatus == ISOTP_OVERFLOW && eventTime == 0)
+            eventTime = now;
+        break;
+    case ISOTP_FIRST:
+        rxFrames++;
+        rxLength = ((frame.data.bytes[0] & 0x0F) << 8) | frame.data.bytes[1];
+        if (rxLength > sizeof(response))
+            rxLength = sizeof(response); // the comparison with the request fails anyway
+        memcpy(response, &frame.data.bytes[2], 6);
+        rxOffset = 6;
+        rxSequence = 1;
+        rxBlockCount = 0;
+        rxFlowPending = true;
+        rxFlowTime = now;
+        break;
+    case ISOTP_CONSECUTIVE:
+        rxFrames++;
+        if ((frame.data.bytes[0] & 0x0F) != rxSequence || rxOffset >= rxLength)
+            break;
+        count = rxLength - rxOffset;
+        if (count > 7)
+            count = 7;
+        memcpy(response + rxOffset, &frame.data.bytes[1], count);
+        rxOffset += count;
+        rxSequence = (rxSequence + 1) & 0x0F;
+        if (rxOffset >= rxLength) {
+            if (step == ISOTP_TEST_EXCHANGE && eventTime == 0)
+                eventTime = now;
+        } else if (++rxBlockCount >= ISOTP_TESTER_BLOCK_SIZE) {
+            rxBlockCount = 0;
+            rxFlowPending = true;
+            rxFlowTime = now;
+        }
+        break;
+    }
+    hostHal.wakeDevice(this, now);
+}
+
+IsoTpTestResult *IsoTpTester::getResult(uint8_t step)
+{
+    return (step < ISOTP_TEST_STEPS ? &results[step] : NULL);
+}
+
+const char *IsoTpTester::getStepName(uint8_t step)
+{
+    static const char *names[] = { "exchange after WAITs", "overflow of the tester", "overflow of the EVCU",
+            "first frame while receiving", "N_Cr timeout" };
+    return (step < ISOTP_TEST_STEPS ? names[step] : "");
+}
+
+/*
+ * Remember the counters of the echo and send the first frame of the step's request.
+ */
+void IsoTpTester::beginStep(uint64_t now)
+{
+    running = true;
+    startTime = now;
+    referenceTime = now;
+    eventTime = 0;
+    messages = echo->getMessageCount();
+    for (int i = 0; i < ISOTP_NUM_RESULTS; i++) {
+        receiveErrors[i] = echo->getReceiveErrorCount((IsoTpResult) i);
+        sent[i] = echo->getSentCount((IsoTpResult) i);
+    }
+    for (int i = 0; i < ISOTP_TESTER_LENGTH; i++)
+        request[i] = (step << 5) + i;
+
+    flowCount = 0;
+    flowStatus = -1;
+    rxLength = 0;
+    rxOffset = 0;
+    rxFrames = 0;
+    rxWaits = 0;
+    rxFlowPending = false;
+
+    switch (step) {
+    case ISOTP_TEST_RX_OVERFLOW:
+        sendFirstFrame(ISOTP_TESTER_TOO_LONG, 6);
+        break;
+    case ISOTP_TEST_UNEXPECTED:
+        sendFirstFrame(ISOTP_TESTER_LENGTH, 6); // followed by a too long one after the flow control
+        break;
+    case ISOTP_TEST_TIMEOUT_CR:
+        sendFirstFrame(ISOTP_TESTER_LENGTH, 6 + 2 * 7);
+        break;
+    default:
+        sendFirstFrame(ISOTP_TESTER_LENGTH, ISOTP_TESTER_LENGTH);
+        break;
+    }
+}
+
+void IsoTpTester::finishStep(uint64_t now, bool passed)
+{
+    results[step].done = true;
+    results[step].passed = passed;
+    results[step].time = (eventTime ? eventTime - referenceTime : 0);
+    running = false;
+    startTime = now + 1000;
+    step++;
+}
+
+/*
+ * Check if the echo reported a sent message or a receive error since the step started.
+ */
+bool IsoTpTester::echoReported()
+{
+    for (int i = 0; i < ISOTP_NUM_RESULTS; i++) {
+        if (echo->getSentCount((IsoTpResult) i) != sent[i] || echo->getReceiveErrorCount((IsoTpResult) i) != receiveErrors[i])
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Check what the echo got since the step started: the number of complete messages and
+ * exactly one sent result and receive error (-1 = none).
+ */
+bool IsoTpTester::checkEcho(uint32_t newMessages, int sentResult, int receiveResult)
+{
+    if (echo->getMessageCount() - messages != newMessages)
+        return false;
+    for (int i = 0; i < ISOTP_NUM_RESULTS; i++) {
+        if (echo->getSentCount((IsoTpResult) i) - sent[i] != (i == sentResult ? 1u : 0u))
+            return false;
+        if (echo->getReceiveErrorCount((IsoTpResult) i) - receiveErrors[i] != (i == receiveResult ? 1u : 0u))
+            return false;
+    }
+    return true;
+}
+
+void IsoTpTester::sendFirstFrame(uint16_t length, uint16_t limit)
+{
+    CAN_FRAME frame;
+
+    prepareFrame(frame);
+    frame.data.bytes[0] = ISOTP_FIRST | (length >> 8);
+    frame.data.bytes[1] = length & 0xFF;
+    memcpy(&frame.data.bytes[2], request, 6);
+    bus->transmit(this, frame);
+    txLength = length;
+    txLimit = limit;
+    txOffset = 6;
+    txSequence = 1;
+    txClear = false;
+}
+
+/*
+ * \retval the time the frame occupies the bus
+ */
+uint32_t IsoTpTester::sendConsecutiveFrame(uint64_t now)
+{
+    CAN_FRAME frame;
+    uint16_t count = txLength - txOffset;
+
+    if (count > 7)
+        count = 7;
+    prepareFrame(frame);
+    frame.data.bytes[0] = ISOTP_CONSECUTIVE | txSequence;
+    memcpy(&frame.data.bytes[1], request + txOffset, count);
+    txOffset += count;
+    txSequence = (txSequence + 1) & 0x0F;
+    if (txBlockSize != 0 && ++txBlockCount >= txBlockSize)
+        txClear = false;
+    referenceTime = now;
+    return bus->transmit(this, frame);
+}
+
+void IsoTpTester::sendFlowControl(IsoTpFlowStatus status)
+{
+    CAN_FRAME frame;
+
+    prepareFrame(frame);
+    frame.data.bytes[0] = ISOTP_FLOW_CONTROL | status;
+    frame.data.bytes[1] = ISOTP_TESTER_BLOCK_SIZE;
+    frame.data.bytes[2] = ISOTP_TESTER_STMIN;
+    bus->transmit(this, frame);
+}
+
+void IsoTpTester::prepareFrame(CAN_FRAME &frame)
+{
+    frame.id = ISOTP_TESTER_TX_ID;
+    frame.extended = false;
+    frame.length = 8;
+    memset(frame.data.bytes, ISOTP_PADDING, 8);
+}
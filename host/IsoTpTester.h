@@ -0,0 +1,159 @@
+/*
+ * IsoTpTester.h
+ *
+ * A diagnostic tester on the virtual CAN bus which talks ISO-TP to an echo session of
+ * the EVCU: a segmented request is echoed back (answered with WAIT flow controls first),
+ * an echo is refused with an overflow flow control, a request too long for the EVCU is
+ * announced (also while another one is in progress) and one stops before it's complete
+ * so the EVCU has to detect N_Cr. Each step checks the frames on the bus and the
+ * results the EVCU reported to its observer.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+ */
+
+#ifndef ISO_TP_TESTER_H_
+#define ISO_TP_TESTER_H_
+
+#include "HostHal.h"
+#include "VirtualCanBus.h"
+#include "IsoTp.h"
+
+#define ISOTP_TESTER_TX_ID      0x7E1   // requests of the tester, received by the EVCU
+#define ISOTP_TESTER_RX_ID      0x7E9   // responses of the EVCU
+#define ISOTP_TESTER_LENGTH     100     // length of a request (first frame and 14 consecutive frames)
+#define ISOTP_TESTER_TOO_LONG   200     // announced length which doesn't fit into the buffer of the EVCU
+#define ISOTP_TESTER_BLOCK_SIZE 4       // consecutive frames the tester accepts per flow control
+#define ISOTP_TESTER_STMIN      0x02    // STmin the tester asks for (2ms)
+#define ISOTP_TESTER_WAITS      2       // WAIT flow controls before the tester accepts the echo
+#define ISOTP_TESTER_WAIT_TIME  20000   // time between the flow controls while waiting (in us)
+#define ISOTP_TESTER_SETTLE     100000  // time after the expected event in which nothing else may happen (in us)
+#define ISOTP_TESTER_TIMEOUT    2000000 // max time of a step (in us)
+#define ISOTP_ECHO_BUFFER_SIZE  128     // receive buffer of the EVCU's echo session
+#define ISOTP_NUM_RESULTS       (ISOTP_BUFFER_OVFLW + 1)
+
+/*
+ * The application side in the EVCU: sends every received message back on its session
+ * and counts what the IsoTpHandler reports.
+ */
+class IsoTpEcho : public IsoTpObserver
+{
+public:
+    IsoTpEcho();
+    bool open(uint32_t txId, uint32_t rxId);
+    void handleIsoTpMessage(int8_t session, uint8_t *data, uint16_t length);
+    void handleIsoTpReceiveError(int8_t session, IsoTpResult result);
+    void handleIsoTpSent(int8_t session, IsoTpResult result);
+    uint32_t getMessageCount();
+    uint32_t getReceiveErrorCount(IsoTpResult result);
+    uint32_t getSentCount(IsoTpResult result);
+    uint64_t getLastEventTime();
+
+private:
+    int8_t session;
+    uint8_t rxBuffer[ISOTP_ECHO_BUFFER_SIZE];
+    uint8_t txBuffer[ISOTP_ECHO_BUFFER_SIZE]; // the echo, rxBuffer may be reused while it is sent
+    uint32_t messages;
+    uint32_t receiveErrors[ISOTP_NUM_RESULTS];
+    uint32_t sent[ISOTP_NUM_RESULTS];
+    uint64_t lastEventTime; // of the last call by the IsoTpHandler
+};
+
+enum IsoTpTestStep
+{
+    ISOTP_TEST_EXCHANGE,    // a segmented request is echoed, the echo is delayed by WAIT flow controls
+    ISOTP_TEST_TX_OVERFLOW, // the echo is refused with an overflow flow control
+    ISOTP_TEST_RX_OVERFLOW, // a request too long for the EVCU is refused with an overflow flow control
+    ISOTP_TEST_UNEXPECTED,  // the same while a request is in progress, reported once
+    ISOTP_TEST_TIMEOUT_CR,  // a request stops after two consecutive frames
+    ISOTP_TEST_STEPS
+};
+
+struct IsoTpTestResult
+{
+    bool done;
+    bool passed;
+    uint32_t time;      // from the last frame of the tester until the expected reaction (in us)
+};
+
+class IsoTpTester : public HostDevice, public VirtualCanNode
+{
+public:
+    IsoTpTester(VirtualCanBus *bus, IsoTpEcho *echo);
+    void start(uint64_t time);
+    uint64_t update(uint64_t now);
+    void receiveFrame(CAN_FRAME &frame);
+    IsoTpTestResult *getResult(uint8_t step);
+    static const char *getStepName(uint8_t step);
+
+private:
+    VirtualCanBus *bus;
+    IsoTpEcho *echo;
+    IsoTpTestResult results[ISOTP_TEST_STEPS];
+    uint8_t step;
+    bool running;           // the current step has been started
+    uint64_t startTime;     // of the current step
+    uint64_t referenceTime; // the frame of the tester the expected reaction refers to
+    uint64_t eventTime;     // when the expected reaction happened, 0 = not yet
+
+    // the counters of the echo at the start of the step
+    uint32_t messages;
+    uint32_t receiveErrors[ISOTP_NUM_RESULTS];
+    uint32_t sent[ISOTP_NUM_RESULTS];
+
+    // the request
+    uint8_t request[ISOTP_TESTER_LENGTH];
+    uint16_t txLength;      // announced in the first frame
+    uint16_t txLimit;       // bytes to send before the tester stops
+    uint16_t txOffset;
+    uint8_t txSequence;
+    uint8_t txBlockSize;
+    uint8_t txBlockCount;
+    uint32_t txSeparation;
+    uint64_t txTime;        // when the next consecutive frame may be sent
+    bool txClear;           // a flow control "continue to send" allows the next block
+    uint8_t flowCount;      // flow controls received in this step
+    int8_t flowStatus;      // of the last one, -1 = none
+
+    // the echo
+    uint8_t response[ISOTP_ECHO_BUFFER_SIZE];
+    uint16_t rxLength;
+    uint16_t rxOffset;
+    uint8_t rxSequence;
+    uint8_t rxBlockCount;
+    uint8_t rxFrames;       // frames of the echo received in this step
+    uint8_t rxWaits;        // WAIT flow controls sent
+    bool rxFlowPending;     // a flow control has to be sent for the echo
+    uint64_t rxFlowTime;    // when to send it
+
+    void beginStep(uint64_t now);
+    void finishStep(uint64_t now, bool passed);
+    bool echoReported();
+    bool checkEcho(uint32_t newMessages, int sentResult, int receiveResult);
+    void sendFirstFrame(uint16_t length, uint16_t limit);
+    uint32_t sendConsecutiveFrame(uint64_t now);
+    void sendFlowControl(IsoTpFlowStatus status);
+    void prepareFrame(CAN_FRAME &frame);
+};
+
+#endif /* ISO_TP_TESTER_H_ */
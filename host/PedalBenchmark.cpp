@@ -0,0 +1,115 @@
+/*
+ * PedalBenchmark.cpp
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include "PedalBenchmark.h"
+#include "HostHal.h"
+#include "DeviceManager.h"
+#include "PotThrottle.h"
+#include "TickTimer.h"
+
+#define PEDAL_BENCHMARK_RUNS 10 // the fastest run counts, the others were disturbed by the host
+
+struct PedalScenario {
+    const char *name;
+    uint8_t pots;
+    int throttle1, throttle2, brake; // raw ADC values
+};
+
+static const PedalScenario scenarios[] = {
+    { "1 pot, released",        1, Throttle1MinValue, 0, BrakeMinValue },
+    { "1 pot, half",            1, 800, 0, BrakeMinValue },
+    { "1 pot, out of range",    1, 1200, 0, BrakeMinValue },
+    { "2 pots, half",           2, 800, 800, BrakeMinValue },
+    { "2 pots, mismatch",       2, 800, 1000, BrakeMinValue },
+    { "brake, pressed",         1, Throttle1MinValue, 0, 1600 },
+};
+
+/*
+ * Host time per handleTick() of device in ns, the fastest of a few runs.
+ */
+static double measure(Device *device, uint32_t iterations)
+{
+    double best = 0;
+
+    for (int run = 0; run < PEDAL_BENCHMARK_RUNS; run++) {
+        uint32_t start = TickTimer::cycles();
+        for (uint32_t i = 0; i < iterations; i++)
+            device->handleTick();
+        double time = (double) (TickTimer::cycles() - start) / iterations;
+        if (run == 0 || time < best)
+            best = time;
+    }
+    return best;
+}
+
+/*
+ * To be called after setup(). Changes the throttle configuration for the dual pot
+ * scenarios and restores it afterwards.
+ */
+void runPedalBenchmark(uint32_t iterations)
+{
+    Throttle *accelerator = deviceManager.getAccelerator();
+    Throttle *brake = deviceManager.getBrake();
+
+    if (accelerator == NULL || iterations == 0)
+        return;
+
+    PotThrottleConfiguration *config = (PotThrottleConfiguration *) accelerator->getConfiguration();
+    PotThrottleConfiguration saved = *config;
+
+    fprintf(stderr, "pedal benchmark, %u ticks per run:\n", iterations);
+    for (uint8_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        const PedalScenario *scenario = &scenarios[i];
+
+        config->numberPotMeters = scenario->pots;
+        if (scenario->pots > 1) {
+            config->minimumLevel2 = config->minimumLevel1;
+            config->maximumLevel2 = config->maximumLevel1;
+        } else {
+            config->minimumLevel2 = saved.minimumLevel2;
+            config->maximumLevel2 = saved.maximumLevel2;
+        }
+        accelerator->updateScaling();
+
+        hostHal.setAnalogIn(config->AdcPin1, scenario->throttle1);
+        hostHal.setAnalogIn(config->AdcPin2, scenario->throttle2);
+        hostHal.setAnalogIn(BrakeADC, scenario->brake);
+        hostHal.advance(CFG_ADC_SCAN_INTERVAL); // let the background scan pick the values up
+
+        double acceleratorTime = measure(accelerator, iterations);
+        fprintf(stderr, "  %-20s accelerator %6.1f ns/tick, level %5d, status %d", scenario->name,
+                acceleratorTime, accelerator->getLevel(), accelerator->getStatus());
+        if (brake != NULL) {
+            double brakeTime = measure(brake, iterations);
+            fprintf(stderr, ", brake %6.1f ns/tick, level %5d", brakeTime, brake->getLevel());
+        }
+        fprintf(stderr, "\n");
+    }
+
+    *config = saved;
+    accelerator->updateScaling();
+}
@@ -0,0 +1,139 @@
+/*
+ * SdoClient.cpp
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+ */
+
+#include "SdoClient.h"
+
+SdoClient::SdoClient(VirtualCanBus *bus, uint8_t nodeId)
+{
+    this->bus = bus;
+    this->nodeId = nodeId;
+    numRequests = 0;
+    current = 0;
+    waiting = false;
+    startTime = 0;
+    sentTime = 0;
+    bus->attach(this);
+}
+
+bool SdoClient::addRequest(uint16_t index, uint8_t subIndex, bool write, uint32_t value, uint8_t size)
+{
+    if (numRequests >= SDO_CLIENT_MAX_REQUESTS || size < 1 || size > 4)
+        return false;
+    SdoClientRequest *request = &requests[numRequests++];
+    request->index = index;
+    request->subIndex = subIndex;
+    request->write = write;
+    request->value = (write ? value : 0);
+    request->size = size;
+    request->done = false;
+    request->aborted = false;
+    request->abortCode = 0;
+    request->responseTime = 0;
+    return true;
+}
+
+/*
+ * Send the first request at the given time (e.g. once the node is up).
+ */
+void SdoClient::start(uint64_t time)
+{
+    startTime = time;
+}
+
+uint64_t SdoClient::update(uint64_t now)
+{
+    if (now < startTime)
+        return startTime;
+    if (current >= numRequests)
+        return now + 1000000;
+    if (waiting) {
+        if (now - sentTime < SDO_CLIENT_TIMEOUT)
+            return sentTime + SDO_CLIENT_TIMEOUT;
+        waiting = false; // no response, the request stays not done
+        if (++current >= numRequests)
+            return now + 1000000;
+    }
+
+    SdoClientRequest *request = &requests[current];
+    CAN_FRAME frame;
+    frame.id = 0x600 + nodeId;
+    frame.length = 8;
+    if (request->write) {
+        frame.data.bytes[0] = 0x23 | ((4 - request->size) << 2); // expedited download, size indicated
+        for (int i = 0; i < request->size; i++)
+            frame.data.bytes[4 + i] = request->value >> (8 * i);
+    } else {
+        frame.data.bytes[0] = 0x40; // upload
+    }
+    frame.data.bytes[1] = request->index & 0xFF;
+    frame.data.bytes[2] = request->index >> 8;
+    frame.data.bytes[3] = request->subIndex;
+    bus->transmit(this, frame);
+    waiting = true;
+    sentTime = now;
+    return now + SDO_CLIENT_TIMEOUT;
+}
+
+void SdoClient::receiveFrame(CAN_FRAME &frame)
+{
+    if (!waiting || frame.extended || frame.id != 0x580u + nodeId || frame.length != 8)
+        return;
+
+    SdoClientRequest *request = &requests[current];
+    uint8_t command = frame.data.bytes[0];
+    uint32_t data = frame.data.bytes[4] | (frame.data.bytes[5] << 8) | (frame.data.bytes[6] << 16) | ((uint32_t) frame.data.bytes[7] << 24);
+
+    if (frame.data.bytes[1] != (request->index & 0xFF) || frame.data.bytes[2] != (request->index >> 8)
+            || frame.data.bytes[3] != request->subIndex)
+        return;
+
+    if (command == 0x80) {
+        request->aborted = true;
+        request->abortCode = data;
+    } else if (!request->write && (command & 0xE0) == 0x40) {
+        uint8_t size = ((command & 0x01) ? 4 - ((command >> 2) & 0x03) : 4);
+        request->value = (size == 4 ? data : data & ((1UL << (8 * size)) - 1));
+        request->size = size;
+    } else if (!(request->write && command == 0x60)) {
+        return;
+    }
+    request->done = true;
+    request->responseTime = hostHal.getMicros() - sentTime;
+    waiting = false;
+    current++;
+    hostHal.wakeDevice(this, hostHal.getMicros());
+}
+
+uint8_t SdoClient::getNumRequests()
+{
+    return numRequests;
+}
+
+SdoClientRequest *SdoClient::getRequest(uint8_t index)
+{
+    return (index < numRequests ? &requests[index] : NULL);
+}
@@ -0,0 +1,76 @@
+/*
+ * SdoClient.h
+ *
+ * A service tool on the virtual CAN bus: sends a list of expedited SDO requests to a
+ * node one after the other and records the responses (value, write acknowledge or
+ * abort code) and how long each took.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+ */
+
+#ifndef SDO_CLIENT_H_
+#define SDO_CLIENT_H_
+
+#include "HostHal.h"
+#include "VirtualCanBus.h"
+
+#define SDO_CLIENT_MAX_REQUESTS 16
+#define SDO_CLIENT_TIMEOUT 100000 // time to wait for a response in us
+
+struct SdoClientRequest
+{
+    uint16_t index;
+    uint8_t subIndex;
+    bool write;
+    uint32_t value;         // the value to write, the value read
+    uint8_t size;           // number of bytes to write (1-4)
+    bool done;              // a response was received
+    bool aborted;           // the response was an abort
+    uint32_t abortCode;
+    uint32_t responseTime;  // in us
+};
+
+class SdoClient : public HostDevice, public VirtualCanNode
+{
+public:
+    SdoClient(VirtualCanBus *bus, uint8_t nodeId);
+    bool addRequest(uint16_t index, uint8_t subIndex, bool write, uint32_t value, uint8_t size);
+    void start(uint64_t time);
+    uint64_t update(uint64_t now);
+    void receiveFrame(CAN_FRAME &frame);
+    uint8_t getNumRequests();
+    SdoClientRequest *getRequest(uint8_t index);
+
+private:
+    VirtualCanBus *bus;
+    uint8_t nodeId;
+    SdoClientRequest requests[SDO_CLIENT_MAX_REQUESTS];
+    uint8_t numRequests;
+    uint8_t current;        // the request in flight or to be sent next
+    bool waiting;           // the current request was sent
+    uint64_t startTime;
+    uint64_t sentTime;
+};
+
+#endif /* SDO_CLIENT_H_ */
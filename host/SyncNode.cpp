@@ -0,0 +1,122 @@
+/*
+ * SyncNode.cpp
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "SyncNode.h"
+
+SyncNode::SyncNode(VirtualCanBus *bus, uint32_t period, uint32_t tpdoId)
+{
+    this->bus = bus;
+    this->period = period;
+    this->tpdoId = tpdoId;
+    nextSync = 0;
+    lastSync = 0;
+    answered = false;
+    syncs = 0;
+    tpdos = 0;
+    firstLatency = 0;
+    lastLatency = 0;
+    maxSettledLatency = 0;
+    bus->attach(this);
+}
+
+/*
+ * Send the first SYNC at the given time, the phase against the ticks of the EVCU is
+ * whatever it happens to be.
+ */
+void SyncNode::start(uint64_t time)
+{
+    nextSync = time;
+}
+
+uint64_t SyncNode::update(uint64_t now)
+{
+    if (period == 0)
+        return now + 1000000;
+    if (now < nextSync)
+        return nextSync;
+
+    CAN_FRAME frame;
+    frame.id = 0x80;
+    frame.length = 0;
+    bus->transmit(this, frame);
+    lastSync = now;
+    answered = false;
+    syncs++;
+    nextSync += period;
+    return nextSync;
+}
+
+void SyncNode::receiveFrame(CAN_FRAME &frame)
+{
+    if (frame.extended)
+        return;
+    if (frame.id == 0x80) { // the EVCU is the producer
+        lastSync = hostHal.getMicros();
+        answered = false;
+        syncs++;
+        return;
+    }
+    if (frame.id != tpdoId || lastSync == 0 || answered)
+        return;
+
+    lastLatency = (uint32_t) (hostHal.getMicros() - lastSync);
+    if (tpdos++ == 0)
+        firstLatency = lastLatency;
+    if (syncs > SYNC_NODE_SETTLE && lastLatency > maxSettledLatency)
+        maxSettledLatency = lastLatency;
+    answered = true;
+}
+
+uint32_t SyncNode::getSyncCount()
+{
+    return syncs;
+}
+
+/*
+ * Get the number of SYNCs which were answered with the TPDO.
+ */
+uint32_t SyncNode::getTpdoCount()
+{
+    return tpdos;
+}
+
+/*
+ * Get the time from a SYNC to the TPDO which answered it (in us).
+ */
+uint32_t SyncNode::getFirstLatency()
+{
+    return firstLatency;
+}
+
+uint32_t SyncNode::getLastLatency()
+{
+    return lastLatency;
+}
+
+uint32_t SyncNode::getMaxSettledLatency()
+{
+    return maxSettledLatency;
+}
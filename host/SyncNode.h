@@ -0,0 +1,66 @@
+/*
+ * SyncNode.h
+ *
+ * Another CANopen node on the virtual CAN bus which takes part in the SYNC: it sends
+ * the SYNC itself with a period (the EVCU follows it) or just watches the one of the
+ * EVCU, and measures how long after each SYNC a synchronous TPDO of the EVCU arrives.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef SYNC_NODE_H_
+#define SYNC_NODE_H_
+
+#include "HostHal.h"
+#include "VirtualCanBus.h"
+
+#define SYNC_NODE_SETTLE 10 // SYNCs it takes the EVCU to align its control tick
+
+class SyncNode : public HostDevice, public VirtualCanNode
+{
+public:
+    SyncNode(VirtualCanBus *bus, uint32_t period, uint32_t tpdoId);
+    void start(uint64_t time);
+    uint64_t update(uint64_t now);
+    void receiveFrame(CAN_FRAME &frame);
+    uint32_t getSyncCount();
+    uint32_t getTpdoCount();
+    uint32_t getFirstLatency();
+    uint32_t getLastLatency();
+    uint32_t getMaxSettledLatency();
+
+private:
+    VirtualCanBus *bus;
+    uint32_t period;        // 0 = the EVCU produces the SYNC
+    uint32_t tpdoId;
+    uint64_t nextSync;
+    uint64_t lastSync;      // 0 = none seen yet
+    bool answered;          // the TPDO after the last SYNC arrived
+    uint32_t syncs;
+    uint32_t tpdos;
+    uint32_t firstLatency;
+    uint32_t lastLatency;
+    uint32_t maxSettledLatency; // after the first SYNC_NODE_SETTLE SYNCs
+};
+
+#endif /* SYNC_NODE_H_ */
@@ -0,0 +1,127 @@
+/*
+ * VirtualCanBus.cpp
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "VirtualCanBus.h"
+#include "HostHal.h"
+
+VirtualCanBus virtualCanBus;
+VirtualCanBus virtualCarBus;
+
+VirtualCanBus::VirtualCanBus()
+{
+    for (int i = 0; i < VIRTUAL_CAN_MAX_NODES; i++)
+        nodes[i] = NULL;
+    bitrate = 500000;
+    frameCount = 0;
+    busyUntil = 0;
+    busyTime = 0;
+}
+
+/*
+ * Attach a node to the bus. It will receive all frames sent by other nodes.
+ */
+bool VirtualCanBus::attach(VirtualCanNode *node)
+{
+    for (int i = 0; i < VIRTUAL_CAN_MAX_NODES; i++) {
+        if (nodes[i] == node)
+            return true;
+    }
+    for (int i = 0; i < VIRTUAL_CAN_MAX_NODES; i++) {
+        if (nodes[i] == NULL) {
+            nodes[i] = node;
+            return true;
+        }
+    }
+    return false;
+}
+
+void VirtualCanBus::detach(VirtualCanNode *node)
+{
+    for (int i = 0; i < VIRTUAL_CAN_MAX_NODES; i++) {
+        if (nodes[i] == node)
+            nodes[i] = NULL;
+    }
+}
+
+/*
+ * Put a frame on the bus and deliver it to every other attached node.
+ *
+ * Frames are serialized on the wire: if the bus is still busy with a previous frame,
+ * this one starts when that one ends.
+ *
+ * \retval the virtual time (in us) from now until the frame has been transmitted completely
+ */
+uint32_t VirtualCanBus::transmit(VirtualCanNode *sender, CAN_FRAME &frame)
+{
+    uint64_t now = hostHal.getMicros();
+    uint32_t duration = frameTime(frame, bitrate);
+
+    if (busyUntil < now)
+        busyUntil = now;
+    busyUntil += duration;
+    busyTime += duration;
+    frameCount++;
+
+    for (int i = 0; i < VIRTUAL_CAN_MAX_NODES; i++) {
+        if (nodes[i] != NULL && nodes[i] != sender)
+            nodes[i]->receiveFrame(frame);
+    }
+    return (uint32_t) (busyUntil - now);
+}
+
+/*
+ * Calculate the time a frame occupies the bus, including a worst case estimate of
+ * the stuff bits and the inter frame space.
+ */
+uint32_t VirtualCanBus::frameTime(CAN_FRAME &frame, uint32_t bitrate)
+{
+    uint32_t bits = (frame.extended ? 67 : 47) + (frame.rtr ? 0 : frame.length * 8);
+    bits += (bits - 13) / 4; // worst case bit stuffing (not applied to CRC delimiter, ACK, EOF)
+
+    if (bitrate == 0)
+        return 0;
+    return (bits * 1000000ul + bitrate - 1) / bitrate;
+}
+
+void VirtualCanBus::setBitrate(uint32_t bitrate)
+{
+    this->bitrate = bitrate;
+}
+
+uint32_t VirtualCanBus::getBitrate()
+{
+    return bitrate;
+}
+
+uint32_t VirtualCanBus::getFrameCount()
+{
+    return frameCount;
+}
+
+uint64_t VirtualCanBus::getBusyTime()
+{
+    return busyTime;
+}
@@ -0,0 +1,71 @@
+/*
+ * VirtualCanBus.h
+ *
+ * A simulated CAN bus for the host build. Nodes (the virtual MCP2515 of the EVCU,
+ * emulated ECUs, loggers) attach to the bus and every frame transmitted by one node
+ * is delivered to all other nodes. The bus keeps track of the arbitration time so a
+ * transmitter knows when its frame has left the wire.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef VIRTUAL_CAN_BUS_H_
+#define VIRTUAL_CAN_BUS_H_
+
+#include <Arduino.h>
+#include "can_common.h"
+
+#define VIRTUAL_CAN_MAX_NODES 8
+
+class VirtualCanNode
+{
+public:
+    virtual ~VirtualCanNode() {}
+    virtual void receiveFrame(CAN_FRAME &frame) = 0;
+};
+
+class VirtualCanBus
+{
+public:
+    VirtualCanBus();
+    bool attach(VirtualCanNode *node);
+    void detach(VirtualCanNode *node);
+    uint32_t transmit(VirtualCanNode *sender, CAN_FRAME &frame);
+    static uint32_t frameTime(CAN_FRAME &frame, uint32_t bitrate);
+    void setBitrate(uint32_t bitrate);
+    uint32_t getBitrate();
+    uint32_t getFrameCount();
+    uint64_t getBusyTime();
+
+private:
+    VirtualCanNode *nodes[VIRTUAL_CAN_MAX_NODES];
+    uint32_t bitrate;
+    uint32_t frameCount;
+    uint64_t busyUntil; // end of the frame currently on the wire (in virtual us)
+    uint64_t busyTime;  // accumulated time the bus was occupied (in us)
+};
+
+extern VirtualCanBus virtualCanBus;    // the EV bus (CAN0)
+extern VirtualCanBus virtualCarBus;    // the body bus of the car (CAN1)
+
+#endif /* VIRTUAL_CAN_BUS_H_ */
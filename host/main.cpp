@@ -0,0 +1,431 @@
+/*
+ * main.cpp
+ *
+ * The virtual EVCU: runs the firmware (setup() / loop() of pao_evcu.ino) on the host
+ * against the virtual hardware. The clock only advances while the firmware blocks
+ * and by a fixed step after each pass through loop(), so a simulation runs as fast
+ * as the host allows and is fully deterministic.
+ *
+ * usage: gevcu [-t seconds] [-s step_us] [-a throttle_adc] [-b brake_adc] [-c period_us] [-d] [-n period_us] [-e period_us] [-g interval_us] [-o ms] [-x ms] [-p index:sub[=value[/size]]] [-y period_us] [-k period_ms[/hang_ms]] [-i] [-w us] [-r us] [-m ticks] [-q]
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include <time.h>
+#include <unistd.h>
+#include "HostHal.h"
+#include "VirtualCanBus.h"
+#include "CanFrameSource.h"
+#include "DmocEmulator.h"
+#include "CanFaultInjector.h"
+#include "SdoClient.h"
+#include "SyncNode.h"
+#include "CanOpenNode.h"
+#include "IsoTpTester.h"
+#include "PedalBenchmark.h"
+
+// prototypes which the Arduino IDE would generate for the sketch
+void send_ble_info();
+
+#include "pao_evcu.ino"
+
+#ifdef CFG_CAN_MCP2518FD
+#error "the virtual EVCU models an MCP2515, undefine CFG_CAN_MCP2518FD"
+#endif
+
+extern Adafruit_BluefruitLE_SPI ble;
+
+static double wallClock()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Print the counters of one bus: the virtual bus, the controller model and CanHandler.
+ */
+static void printCanStatistics(uint8_t number, VirtualCanBus *bus, mcp2515_can *controller, CanBusId id)
+{
+    fprintf(stderr, "CAN%d:       %u frames on bus, %u sent, %u received, %u rejected, %u overflows, bus load %.1f%%\n",
+            number, bus->getFrameCount(), controller->getTransmittedCount(), controller->getReceivedCount(),
+            controller->getRejectedCount(), controller->getOverflowCount(),
+            hostHal.getMicros() ? 100.0 * bus->getBusyTime() / hostHal.getMicros() : 0);
+#ifdef CFG_CAN_USE_INTERRUPT
+    fprintf(stderr, "CAN%d rx:    interrupt, buffer high water mark %u of %u, %u dropped\n", number,
+            canHandler.getRxHighWaterMark(id), CFG_CAN_RX_BUFFER_SIZE - 1, canHandler.getRxOverflowCount(id));
+#else
+    fprintf(stderr, "CAN%d rx:    polling\n", number);
+#endif
+    static const char *stateNames[] = { "init", "running", "error passive", "bus-off" };
+    fprintf(stderr, "CAN%d state: %s, %u bus-offs\n", number, stateNames[canHandler.getBusState(id)],
+            canHandler.getBusOffCount(id));
+    fprintf(stderr, "CAN%d tx:    queue high water mark %u, %u dropped\n", number,
+            canHandler.getTxHighWaterMark(id), canHandler.getTxOverflowCount(id));
+    for (uint8_t i = 0; i < canHandler.getNumRxStatistics(id); i++) {
+        CanRxStatistics *stats = canHandler.getRxStatistics(i, id);
+        fprintf(stderr, "CAN%d %-7X %u frames, period %u us, jitter %u us, %u timeouts%s\n", number, stats->id,
+                stats->count, stats->meanPeriod, stats->jitter, stats->timeouts, stats->timedOut ? ", lost" : "");
+    }
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-t seconds] [-s step_us] [-a throttle_adc] [-b brake_adc] [-c period_us] [-d] [-n period_us] [-e period_us] [-g interval_us] [-o ms] [-x ms] [-p index:sub[=value[/size]]] [-y period_us] [-k period_ms[/hang_ms]] [-i] [-w us] [-r us] [-m ticks] [-q]\n", name);
+    fprintf(stderr, "  -t  virtual time to simulate in seconds (default 10)\n");
+    fprintf(stderr, "  -s  virtual time added after each pass through loop() in us (default 100)\n");
+    fprintf(stderr, "  -a  raw ADC value of the throttle pedal (default %d = released)\n", Throttle1MinValue);
+    fprintf(stderr, "  -b  raw ADC value of the brake pedal (default %d = released)\n", BrakeMinValue);
+    fprintf(stderr, "  -c  send the DMOC status frames (0x23A, 0x23B, 0x650, 0x651) with this period\n");
+    fprintf(stderr, "  -d  emulate a DMOC645 which answers the commands of the EVCU (instead of -c)\n");
+    fprintf(stderr, "  -n  send frames nobody listens to (0x100, 0x3E8, 0x7E8, 0x18FF50E5) with this period\n");
+    fprintf(stderr, "  -e  send body frames of the car (0x1A0, 0x2C4, 0x3D0, 0x4F1) on the car bus (CAN1) with this period\n");
+    fprintf(stderr, "  -g  forward the DMOC speed (0x23B bytes 0-1) to the car bus as 0x316 at most once per interval\n");
+    fprintf(stderr, "  -o  drive the EV bus controller (CAN0) bus-off this many ms after setup\n");
+    fprintf(stderr, "  -x  leave the EV bus controller (CAN0) unanswered on SPI for the first ms after power-on\n");
+    fprintf(stderr, "  -p  read (or write) an object of the EVCU with an SDO request after setup, hex index and sub-index (value: decimal or 0x hex), may be repeated\n");
+    fprintf(stderr, "  -y  send a CANopen SYNC (0x80) with this period which the EVCU follows, and time the synchronous TPDO 0x385 (enable it with -p 1802:1=0x385)\n");
+    fprintf(stderr, "  -k  add CANopen node 16 with this heartbeat period, its application hangs hang_ms after setup (supervise it with -p 1016:1=0x0010<ms in hex>)\n");
+    fprintf(stderr, "  -i  run an ISO-TP tester against an echo session of the EVCU (0x%X -> 0x%X): a segmented exchange after WAIT flow controls, overflows and the N_Cr timeout\n", ISOTP_TESTER_TX_ID, ISOTP_TESTER_RX_ID);
+    fprintf(stderr, "  -w  time it takes to write one byte to the serial port in us (default 0)\n");
+    fprintf(stderr, "  -r  time a blocking analogRead() takes in us (default 0)\n");
+    fprintf(stderr, "  -m  run the pedal micro-benchmark with this many ticks per run after setup() instead of the simulation\n");
+    fprintf(stderr, "  -q  quiet, suppress the serial output of the firmware\n");
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 10;
+    uint32_t step = 100;
+    int throttle = Throttle1MinValue;
+    int brake = BrakeMinValue;
+    uint32_t statusPeriod = 0;
+    uint32_t noisePeriod = 0;
+    uint32_t bodyPeriod = 0;
+    uint32_t gatewayInterval = 0;
+    int8_t gatewayRule = -1;
+    uint32_t busOffTime = 0;
+    uint32_t missingTime = 0;
+    uint32_t syncPeriod = 0;
+    unsigned int nodePeriod = 0, nodeHang = 0;
+    bool emulateDmoc = false;
+    bool isoTp = false;
+    SdoClient sdoClient(&virtualCanBus, canHandler.getMasterID());
+    unsigned int sdoIndex, sdoSubIndex, sdoSize;
+    char sdoValue[32];
+    uint32_t benchmarkTicks = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:s:a:b:c:dn:e:g:o:x:p:y:k:iw:r:m:qh")) != -1) {
+        switch (opt) {
+        case 't':
+            seconds = atof(optarg);
+            break;
+        case 's':
+            step = strtoul(optarg, NULL, 10);
+            break;
+        case 'a':
+            throttle = atoi(optarg);
+            break;
+        case 'b':
+            brake = atoi(optarg);
+            break;
+        case 'c':
+            statusPeriod = strtoul(optarg, NULL, 10);
+            break;
+        case 'd':
+            emulateDmoc = true;
+            break;
+        case 'n':
+            noisePeriod = strtoul(optarg, NULL, 10);
+            break;
+        case 'e':
+            bodyPeriod = strtoul(optarg, NULL, 10);
+            break;
+        case 'g':
+            gatewayInterval = strtoul(optarg, NULL, 10);
+            break;
+        case 'o':
+            busOffTime = strtoul(optarg, NULL, 10);
+            break;
+        case 'x':
+            missingTime = strtoul(optarg, NULL, 10);
+            break;
+        case 'p':
+            sdoSize = 4;
+            if (sscanf(optarg, "%x:%x=%31[^/]/%u", &sdoIndex, &sdoSubIndex, sdoValue, &sdoSize) >= 3)
+                sdoClient.addRequest(sdoIndex, sdoSubIndex, true, strtoul(sdoValue, NULL, 0), sdoSize);
+            else if (sscanf(optarg, "%x:%x", &sdoIndex, &sdoSubIndex) == 2)
+                sdoClient.addRequest(sdoIndex, sdoSubIndex, false, 0, 4);
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'y':
+            syncPeriod = strtoul(optarg, NULL, 10);
+            break;
+        case 'k':
+            if (sscanf(optarg, "%u/%u", &nodePeriod, &nodeHang) < 1) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'i':
+            isoTp = true;
+            break;
+        case 'w':
+            hostHal.serialByteTime = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            hostHal.analogReadTime = strtoul(optarg, NULL, 10);
+            break;
+        case 'm':
+            benchmarkTicks = strtoul(optarg, NULL, 10);
+            break;
+        case 'q':
+            hostHal.setSerialMuted(true);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    hostHal.setAnalogIn(ThrottleADC1, throttle);
+    hostHal.setAnalogIn(BrakeADC, brake);
+    CAN.setInterruptPin(CAN_INT_PIN);
+#if CFG_CAN_NUM_BUSES > 1
+    CAN1.setBus(&virtualCarBus);
+    CAN1.setInterruptPin(CAN1_INT_PIN);
+#endif
+
+    CanFrameSource dmocStatus(&virtualCanBus, statusPeriod);
+    if (statusPeriod) {
+        dmocStatus.addId(0x23A);
+        dmocStatus.addId(0x23B);
+        dmocStatus.addId(0x650);
+        dmocStatus.addId(0x651);
+        hostHal.attachDevice(&dmocStatus);
+    }
+    DmocEmulator dmoc(&virtualCanBus);
+    if (emulateDmoc)
+        hostHal.attachDevice(&dmoc);
+    else
+        virtualCanBus.detach(&dmoc);
+    CanFrameSource noise(&virtualCanBus, noisePeriod);
+    if (noisePeriod) {
+        noise.addId(0x100);
+        noise.addId(0x3E8);
+        noise.addId(0x7E8);
+        noise.addId(0x18FF50E5);
+        hostHal.attachDevice(&noise);
+    }
+    CanFrameSource body(&virtualCarBus, bodyPeriod);
+    if (bodyPeriod) {
+        body.addId(0x1A0);
+        body.addId(0x2C4);
+        body.addId(0x3D0);
+        body.addId(0x4F1);
+        hostHal.attachDevice(&body);
+    }
+    if (gatewayInterval) {
+        CanGatewayRule rule;
+        memset(&rule, 0, sizeof(rule));
+        rule.source = CAN_BUS_EV;
+        rule.id = 0x23B;
+        rule.mask = 0x7FF;
+        rule.target = CAN_BUS_CAR;
+        rule.targetId = 0x316;
+        rule.remapData = true;
+        memset(rule.remap, CAN_GATEWAY_ZERO, sizeof(rule.remap));
+        rule.remap[2] = 1; // speed low byte
+        rule.remap[3] = 0; // speed high byte
+        rule.length = 8;
+        rule.minInterval = gatewayInterval;
+        rule.priority = CAN_TX_NORMAL;
+        gatewayRule = canHandler.addGatewayRule(&rule);
+    }
+
+    SyncNode syncNode(&virtualCanBus, syncPeriod, 0x385);
+    CanOpenNode canOpenNode(&virtualCanBus, 0x10, nodePeriod * 1000);
+    IsoTpEcho isoTpEcho;
+    IsoTpTester isoTpTester(&virtualCanBus, &isoTpEcho);
+
+    CanFaultInjector canFault(&CAN);
+    if (missingTime)
+        canFault.setMissing((uint64_t) missingTime * 1000);
+
+    double start = wallClock();
+    setup();
+    uint64_t setupTime = hostHal.getMicros();
+    if (missingTime || busOffTime) {
+        if (busOffTime)
+            canFault.setBusOff(setupTime + (uint64_t) busOffTime * 1000);
+        hostHal.attachDevice(&canFault);
+    }
+    if (nodePeriod) {
+        canOpenNode.start(setupTime + CAN_OPEN_NODE_BOOT_TIME);
+        if (nodeHang)
+            canOpenNode.hang(setupTime + (uint64_t) nodeHang * 1000);
+        hostHal.attachDevice(&canOpenNode);
+    }
+    if (syncPeriod) {
+        syncNode.start(setupTime + 131700); // an arbitrary phase against the control tick
+        hostHal.attachDevice(&syncNode);
+    }
+    if (isoTp && isoTpEcho.open(ISOTP_TESTER_RX_ID, ISOTP_TESTER_TX_ID)) {
+        isoTpTester.start(setupTime + 500000); // once the filters are programmed
+        hostHal.attachDevice(&isoTpTester);
+    }
+    if (sdoClient.getNumRequests()) {
+        sdoClient.start(setupTime + 500000); // once the filters are programmed
+        hostHal.attachDevice(&sdoClient);
+    }
+    if (benchmarkTicks) {
+        hostHal.setSerialMuted(true);
+        runPedalBenchmark(benchmarkTicks);
+        return 0;
+    }
+    uint64_t end = setupTime + (uint64_t) (seconds * 1000000);
+    uint32_t iterations = 0;
+    uint64_t canRunning = (canHandler.getBusState(CAN_BUS_EV) == CAN_STATE_RUNNING ? setupTime : 0);
+    uint64_t canRecovered = 0;
+
+    while (hostHal.getMicros() < end) {
+        if (canRunning == 0 && canHandler.getBusState(CAN_BUS_EV) == CAN_STATE_RUNNING)
+            canRunning = hostHal.getMicros();
+        if (canFault.getBusOffTime() && canRecovered == 0 && canHandler.getBusOffCount(CAN_BUS_EV) > 0
+                && canHandler.getBusState(CAN_BUS_EV) == CAN_STATE_RUNNING)
+            canRecovered = hostHal.getMicros();
+        loop();
+        CAN.service();
+#if CFG_CAN_NUM_BUSES > 1
+        CAN1.service();
+#endif
+        hostHal.advance(step);
+        iterations++;
+    }
+    double elapsed = wallClock() - start;
+    fflush(stdout);
+
+    fprintf(stderr, "setup:      %.3f ms virtual\n", setupTime / 1000.0);
+    fprintf(stderr, "simulated:  %.3f s virtual in %.3f s wall (%.1fx real time)\n",
+            (hostHal.getMicros() - setupTime) / 1e6, elapsed,
+            elapsed > 0 ? (hostHal.getMicros() - setupTime) / 1e6 / elapsed : 0);
+    fprintf(stderr, "loop():     %u passes\n", iterations);
+    printCanStatistics(0, &virtualCanBus, &CAN, CAN_BUS_EV);
+    if (missingTime && canRunning)
+        fprintf(stderr, "CAN0:       running %.3f ms after power-on (controller missing for %u ms)\n",
+                canRunning / 1000.0, missingTime);
+    if (canRecovered)
+        fprintf(stderr, "CAN0:       running again %.3f ms after bus-off\n",
+                (canRecovered - canFault.getBusOffTime()) / 1000.0);
+#if CFG_CAN_NUM_BUSES > 1
+    printCanStatistics(1, &virtualCarBus, &CAN1, CAN_BUS_CAR);
+#endif
+    CanGatewayStatistics *gateway = canHandler.getGatewayStatistics(gatewayRule);
+    if (gateway != NULL)
+        fprintf(stderr, "gateway:    0x23B -> 0x316 %u forwarded, %u rate limited, %u dropped\n",
+                gateway->forwarded, gateway->limited, gateway->dropped);
+    for (uint8_t i = 0; i < sdoClient.getNumRequests(); i++) {
+        SdoClientRequest *request = sdoClient.getRequest(i);
+        fprintf(stderr, "SDO:        %04X:%02X %s ", request->index, request->subIndex, request->write ? "write" : "read ");
+        if (!request->done)
+            fprintf(stderr, "timed out\n");
+        else if (request->aborted)
+            fprintf(stderr, "aborted with %08X after %u us\n", request->abortCode, request->responseTime);
+        else
+            fprintf(stderr, "%u (%u bytes) after %u us\n", request->value, request->size, request->responseTime);
+    }
+    if (sdoClient.getNumRequests())
+        fprintf(stderr, "SDO server: %u requests, %u aborted\n", sdoServer.getRequestCount(), sdoServer.getAbortCount());
+    for (uint8_t i = 0; i < CFG_CANOPEN_NUM_TPDOS; i++) {
+        PdoParameters *params = &pdoHandler.getParameters()->tpdo[i];
+        PdoStatistics *stats = pdoHandler.getStatistics(true, i);
+        if (!(params->cobId & PDO_COB_ID_INVALID) || stats->count)
+            fprintf(stderr, "TPDO%d:      id %X, type %u, %u sent, %u dropped\n", i + 1, params->cobId & 0x7FF,
+                    params->transmissionType, stats->count, stats->dropped);
+    }
+    for (uint8_t i = 0; i < CFG_CANOPEN_NUM_RPDOS; i++) {
+        PdoParameters *params = &pdoHandler.getParameters()->rpdo[i];
+        PdoStatistics *stats = pdoHandler.getStatistics(false, i);
+        if (!(params->cobId & PDO_COB_ID_INVALID) || stats->count)
+            fprintf(stderr, "RPDO%d:      id %X, type %u, %u received, %u too short\n", i + 1, params->cobId & 0x7FF,
+                    params->transmissionType, stats->count, stats->dropped);
+    }
+    if (syncNode.getSyncCount())
+        fprintf(stderr, "SYNC:       %s, %u SYNCs, %u received by the EVCU, %u overruns, phase error %d us\n",
+                syncHandler.isProducer() ? "EVCU produces" : "EVCU follows", syncNode.getSyncCount(),
+                syncHandler.isProducer() ? 0 : syncHandler.getSyncCount(), syncHandler.getOverrunCount(),
+                syncHandler.getPhaseError());
+    if (syncNode.getTpdoCount())
+        fprintf(stderr, "SYNC:       0x385 answered %u SYNCs, %u us after the first, %u us after the last, %u us max once settled\n",
+                syncNode.getTpdoCount(), syncNode.getFirstLatency(), syncNode.getLastLatency(),
+                syncNode.getMaxSettledLatency());
+    if (nodePeriod)
+        fprintf(stderr, "NMT:        EVCU state %02X, node 16 state %02X after %u boots and %u NMT commands\n",
+                nmtHandler.getState(), canOpenNode.getState(), canOpenNode.getBootCount(), canOpenNode.getCommandCount());
+    for (uint8_t i = 0; i < CFG_CANOPEN_NUM_HEARTBEAT_CONSUMERS; i++) {
+        NmtNodeStatus *node = nmtHandler.getNodeStatus(i);
+        if (node->nodeId != 0)
+            fprintf(stderr, "NMT:        node %u supervised, state %02X, heartbeat lost %u times (last detected %.3f ms after its last heartbeat), %u restarts\n",
+                    node->nodeId, nmtHandler.getNodeState(i), node->timeouts, node->detectionDelay / 1000.0, node->restarts);
+    }
+    for (uint8_t i = 0; isoTp && i < ISOTP_TEST_STEPS; i++) {
+        IsoTpTestResult *result = isoTpTester.getResult(i);
+        if (!result->done)
+            fprintf(stderr, "ISO-TP:     %s not run\n", IsoTpTester::getStepName(i));
+        else
+            fprintf(stderr, "ISO-TP:     %s %s, EVCU reacted %.3f ms after the last frame of the tester\n",
+                    IsoTpTester::getStepName(i), result->passed ? "passed" : "FAILED", result->time / 1000.0);
+    }
+    fprintf(stderr, "ticks:      %u missed\n", tickHandler.getMissedTickCount());
+    fprintf(stderr, "log:        %u messages dropped\n", Logger::getDroppedCount());
+    if (emulateDmoc) {
+        fprintf(stderr, "DMOC:       state %d, %u commands, %u checksum errors, %u alive errors, %u timeouts\n",
+                dmoc.getState(), dmoc.getCommandCount(), dmoc.getChecksumErrors(), dmoc.getAliveErrors(),
+                dmoc.getTimeoutCount());
+        if (dmoc.getEnableTime())
+            fprintf(stderr, "DMOC:       enabled %.3f ms after setup\n", ((int64_t) dmoc.getEnableTime() - (int64_t) setupTime) / 1000.0);
+        if (dmoc.getTorqueResponseTime())
+            fprintf(stderr, "DMOC:       first torque command %.3f ms after enable, 90%% of it reached %.3f ms later\n",
+                    (dmoc.getFirstTorqueTime() - dmoc.getEnableTime()) / 1000.0,
+                    (dmoc.getTorqueResponseTime() - dmoc.getFirstTorqueTime()) / 1000.0);
+        fprintf(stderr, "DMOC:       %.1f Nm, %.0f rpm\n", dmoc.getTorque(), dmoc.getSpeed());
+    }
+    MotorController *motorController = deviceManager.getMotorController();
+    if (motorController != NULL)
+        fprintf(stderr, "pedal->CAN: %u us last, %u us max\n",
+                motorController->getPedalLatency(), motorController->getMaxPedalLatency());
+    if (motorController != NULL)
+        fprintf(stderr, "control:    %u ns average, %u ns max host time per tick\n",
+                motorController->getControlCycles(), motorController->getMaxControlCycles());
+    fprintf(stderr, "ADC:        %u blocking reads, %u background scans\n", hostHal.getAnalogReadCount(),
+            AdcScanner::getScanCount());
+    fprintf(stderr, "BLE:        %u commands, %.1f ms blocked\n", ble.getCommandCount(),
+            ble.getCommandCount() * HOST_BLE_COMMAND_TIME / 1000.0);
+    fprintf(stderr, "serial:     %u bytes\n", hostHal.getSerialBytes());
+
+    return 0;
+}
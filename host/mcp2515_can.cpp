@@ -0,0 +1,617 @@
+/*
+ * mcp2515_can.cpp
+ *
+ * Model of the MCP2515 CAN controller for the host build.
+ *
+ * Acceptance filtering follows the data sheet: RXB0 uses mask 0 with filters 0-1,
+ * RXB1 uses mask 1 with filters 2-5. A frame accepted by RXB0 rolls over into RXB1
+ * if RXB0 is still full (the library always enables BUKT). A frame for which no
+ * buffer is free is lost and the RXnOVR flag is set in EFLG.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "mcp2515_can.h"
+#include "HostHal.h"
+
+#define MCP_ID_ANY 0xff     // filter state after reset: matches standard and extended frames
+#define MCP_SID_BITS 0x1FFC0000ul
+
+mcp2515_can::mcp2515_can(byte _CS) : MCP_CAN(_CS)
+{
+    nReservedTx = 0;
+    bus = &virtualCanBus;
+    present = true;
+    interruptPin = 0;
+    spiByteTime = 1;
+    received = 0;
+    rejected = 0;
+    overflows = 0;
+    transmitted = 0;
+    mcpMode = MODE_NORMAL;
+    reset();
+}
+
+/*
+ * Bring the model into its power-on state (configuration mode, buffers empty).
+ */
+void mcp2515_can::reset()
+{
+    opMode = MODE_CONFIG;
+    canInte = 0;
+    canIntf = 0;
+    eflg = 0;
+    tec = 0;
+    rec = 0;
+    for (int i = 0; i < 2; i++) {
+        masks[i].id = 0;
+        masks[i].extended = false;
+        rxBuffers[i].full = false;
+    }
+    for (int i = 0; i < 6; i++) {
+        filters[i].id = 0;
+        filters[i].extended = MCP_ID_ANY;
+    }
+    for (int i = 0; i < MCP_N_TXBUFFERS; i++) {
+        txPending[i] = false;
+        txBusyUntil[i] = 0;
+    }
+}
+
+/*
+ * Charge the time of a SPI transfer of the given length to the virtual clock.
+ */
+void mcp2515_can::spi(uint16_t bytes)
+{
+    hostHal.advance(bytes * spiByteTime);
+}
+
+byte mcp2515_can::begin(uint32_t speedset, const byte clockset)
+{
+    (void) clockset;
+
+    pSPI->begin();
+    reset();
+    delay(10);  // the library waits after each step of the init sequence
+    if (!present)
+        return CAN_FAILINIT;
+    delay(10);
+
+    switch (speedset) {
+    case CAN_125KBPS: bus->setBitrate(125000); break;
+    case CAN_250KBPS: bus->setBitrate(250000); break;
+    case CAN_500KBPS: bus->setBitrate(500000); break;
+    case CAN_1000KBPS: bus->setBitrate(1000000); break;
+    }
+    canInte = MCP_RX0IF | MCP_RX1IF;
+    delay(10);
+    setMode(MODE_NORMAL);
+    delay(10);
+    bus->attach(this);
+    updateInterruptPin();
+
+    return CAN_OK;
+}
+
+void mcp2515_can::enableTxInterrupt(bool enable)
+{
+    spi(6);
+    if (enable)
+        canInte |= MCP_TX_INT;
+    else
+        canInte &= ~MCP_TX_INT;
+    updateInterruptPin();
+}
+
+/*
+ * Masks and filters can only be written in configuration mode. Like the library,
+ * switch to configuration mode and back to the selected mode, which takes 20ms.
+ */
+byte mcp2515_can::init_Mask(byte num, byte ext, unsigned long ulData)
+{
+    byte res = MCP2515_OK;
+
+    delay(10);
+    if (!present)
+        return MCP2515_FAIL;
+    opMode = MODE_CONFIG;
+    spi(6);
+    if (num < 2) {
+        masks[num].extended = ext;
+        masks[num].id = (ext ? ulData & 0x1FFFFFFFul : (ulData & 0x7FF) << 18);
+    } else {
+        res = MCP2515_FAIL;
+    }
+    opMode = mcpMode;
+    delay(10);
+    return res;
+}
+
+byte mcp2515_can::init_Filt(byte num, byte ext, unsigned long ulData)
+{
+    byte res = MCP2515_OK;
+
+    delay(10);
+    if (!present)
+        return MCP2515_FAIL;
+    opMode = MODE_CONFIG;
+    spi(6);
+    if (num < 6) {
+        filters[num].extended = ext;
+        filters[num].id = (ext ? ulData & 0x1FFFFFFFul : (ulData & 0x7FF) << 18);
+    } else {
+        res = MCP2515_FAIL;
+    }
+    opMode = mcpMode;
+    delay(10);
+    return res;
+}
+
+void mcp2515_can::setSleepWakeup(byte enable)
+{
+    (void) enable;
+    spi(4);
+}
+
+byte mcp2515_can::sleep()
+{
+    if (getMode() != MODE_SLEEP)
+        return setMode(MODE_SLEEP);
+    return CAN_OK;
+}
+
+byte mcp2515_can::wake()
+{
+    if (getMode() == MODE_SLEEP)
+        opMode = mcpMode;
+    return CAN_OK;
+}
+
+byte mcp2515_can::setMode(byte opMode)
+{
+    if (opMode != MODE_SLEEP)
+        mcpMode = opMode;
+    spi(6);
+    if (!present)
+        return MCP2515_FAIL;
+    this->opMode = opMode;
+    return MCP2515_OK;
+}
+
+byte mcp2515_can::getMode()
+{
+    spi(3);
+    return opMode;
+}
+
+byte mcp2515_can::checkError(uint8_t* err_ptr)
+{
+    spi(3);
+    byte flags = (present ? eflg : 0xFF); // the MISO line floats high without a chip
+    if (err_ptr)
+        *err_ptr = flags;
+    return ((flags & MCP_EFLG_ERRORMASK) ? CAN_CTRLERROR : CAN_OK);
+}
+
+byte mcp2515_can::checkReceive(void)
+{
+    spi(2);
+    return ((canIntf & (MCP_RX0IF | MCP_RX1IF)) ? CAN_MSGAVAIL : CAN_NOMSG);
+}
+
+/*
+ * Read the receive buffer selected by status. Reading a buffer clears its RXnIF flag,
+ * like the READ RX BUFFER instruction of the chip does.
+ */
+byte mcp2515_can::readMsgBufID(byte status, volatile unsigned long* id, volatile byte* ext, volatile byte* rtrBit,
+                               volatile byte* len, volatile byte* buf)
+{
+    int n;
+
+    if ((status & MCP_RX0IF) && rxBuffers[0].full)
+        n = 0;
+    else if ((status & MCP_RX1IF) && rxBuffers[1].full)
+        n = 1;
+    else {
+        *len = 0;
+        return CAN_NOMSG;
+    }
+
+    CAN_FRAME &frame = rxBuffers[n].frame;
+    spi(1 + 5 + frame.length);
+    *id = frame.id;
+    *ext = frame.extended;
+    *rtrBit = frame.rtr;
+    *len = frame.length;
+    for (int i = 0; i < frame.length; i++)
+        buf[i] = frame.data.bytes[i];
+    rtr = *rtrBit;
+    ext_flg = *ext;
+    can_id = *id;
+
+    rxBuffers[n].full = false;
+    canIntf &= ~(n == 0 ? MCP_RX0IF : MCP_RX1IF);
+    updateInterruptPin();
+
+    return CAN_OK;
+}
+
+/*
+ * Find a transmit buffer which is not pending (skipping reserved buffers).
+ */
+byte mcp2515_can::getNextFreeTxBuffer(byte *txBuf)
+{
+    service();
+    spi(2);
+    for (byte i = 0; i < MCP_N_TXBUFFERS - nReservedTx; i++) {
+        if (!txPending[i]) {
+            *txBuf = i;
+            canIntf &= ~txIfFlag(i);
+            return MCP2515_OK;
+        }
+    }
+    return MCP_ALLTXBUSY;
+}
+
+/*
+ * Load a transmit buffer and request its transmission. The frame is put on the
+ * virtual bus right away, the buffer stays pending until the frame has left the wire.
+ */
+void mcp2515_can::writeTxBuffer(byte txBuf, unsigned long id, byte ext, byte rtrBit, byte len, volatile const byte *buf)
+{
+    CAN_FRAME frame;
+
+    if (len > CAN_MAX_CHAR_IN_MESSAGE)
+        len = CAN_MAX_CHAR_IN_MESSAGE;
+    spi(1 + 5 + (rtrBit ? 0 : len) + 1);
+
+    frame.id = id;
+    frame.extended = ext;
+    frame.rtr = rtrBit;
+    frame.length = len;
+    frame.fid = 0;
+    frame.priority = 0;
+    frame.timestamp = micros();
+    frame.data.value = 0;
+    for (int i = 0; i < len && !rtrBit; i++)
+        frame.data.bytes[i] = buf[i];
+
+    transmitted++;
+    if (opMode == MODE_LOOPBACK) {
+        txPending[txBuf] = true;
+        txBusyUntil[txBuf] = hostHal.getMicros() + VirtualCanBus::frameTime(frame, bus->getBitrate());
+        receiveFrame(frame);
+        return;
+    }
+    if (opMode != MODE_NORMAL || !present || tec > 255)
+        return; // stays pending, just like a chip which is not allowed to transmit
+    txPending[txBuf] = true;
+    txBusyUntil[txBuf] = hostHal.getMicros() + bus->transmit(this, frame);
+}
+
+byte mcp2515_can::trySendMsgBuf(unsigned long id, byte ext, byte rtrBit, byte len, const byte* buf, byte iTxBuf)
+{
+    byte txBuf;
+
+    if (iTxBuf < MCP_N_TXBUFFERS) {
+        service();
+        spi(2);
+        if (txPending[iTxBuf])
+            return CAN_FAILTX;
+        txBuf = iTxBuf;
+        canIntf &= ~txIfFlag(txBuf);
+    } else if (getNextFreeTxBuffer(&txBuf) != MCP2515_OK) {
+        return CAN_FAILTX;
+    }
+    writeTxBuffer(txBuf, id, ext, rtrBit, len, buf);
+    updateInterruptPin();
+
+    return CAN_OK;
+}
+
+byte mcp2515_can::sendMsgBuf(byte status, unsigned long id, byte ext, byte rtrBit, byte len, volatile const byte* buf)
+{
+    byte txBuf;
+
+    switch (status) {
+    case MCP_TX0IF: txBuf = 0; break;
+    case MCP_TX1IF: txBuf = 1; break;
+    case MCP_TX2IF: txBuf = 2; break;
+    default:
+        return CAN_FAILTX;
+    }
+    canIntf &= ~status;
+    writeTxBuffer(txBuf, id, ext, rtrBit, len, buf);
+    updateInterruptPin();
+
+    return CAN_OK;
+}
+
+/*
+ * Blocking send like the library: poll for a free buffer and (optionally) for the end
+ * of the transmission in steps of 10us, giving up after TIMEOUTVALUE polls.
+ */
+byte mcp2515_can::sendMsgBuf(unsigned long id, byte ext, byte rtrBit, byte len, const byte* buf, bool wait_sent)
+{
+    byte txBuf;
+    uint16_t timeout = 0;
+
+    can_id = id;
+    ext_flg = ext;
+    rtr = rtrBit;
+
+    byte res;
+    do {
+        if (timeout > 0)
+            delayMicroseconds(10);
+        res = getNextFreeTxBuffer(&txBuf);
+        timeout++;
+    } while (res == MCP_ALLTXBUSY && timeout < TIMEOUTVALUE);
+
+    if (timeout == TIMEOUTVALUE)
+        return CAN_GETTXBFTIMEOUT;
+    writeTxBuffer(txBuf, id, ext, rtrBit, len, buf);
+
+    if (wait_sent) {
+        timeout = 0;
+        do {
+            if (timeout > 0)
+                delayMicroseconds(10);
+            timeout++;
+            service();
+            spi(3);
+        } while (txPending[txBuf] && timeout < TIMEOUTVALUE);
+
+        if (timeout == TIMEOUTVALUE)
+            return CAN_SENDMSGTIMEOUT;
+    }
+
+    return CAN_OK;
+}
+
+void mcp2515_can::clearBufferTransmitIfFlags(byte flags)
+{
+    flags &= MCP_TX_INT;
+    if (flags == 0)
+        return;
+    spi(4);
+    canIntf &= ~flags;
+    updateInterruptPin();
+}
+
+byte mcp2515_can::readRxTxStatus(void)
+{
+    service();
+    spi(2);
+    return canIntf & (MCP_RX0IF | MCP_RX1IF | MCP_TX_INT);
+}
+
+byte mcp2515_can::checkClearRxStatus(byte* status)
+{
+    byte ret = *status & MCP_RX0IF;
+    *status &= ~MCP_RX0IF;
+
+    if (ret == 0) {
+        ret = *status & MCP_RX1IF;
+        *status &= ~MCP_RX1IF;
+    }
+    return ret;
+}
+
+byte mcp2515_can::checkClearTxStatus(byte* status, byte iTxBuf)
+{
+    byte ret = 0;
+
+    if (iTxBuf < MCP_N_TXBUFFERS) {
+        ret = *status & txIfFlag(iTxBuf);
+        *status &= ~txIfFlag(iTxBuf);
+        return ret;
+    }
+    for (byte i = 0; i < MCP_N_TXBUFFERS - nReservedTx; i++) {
+        ret = *status & txIfFlag(i);
+        if (ret != 0) {
+            *status &= ~txIfFlag(i);
+            return ret;
+        }
+    }
+    return ret;
+}
+
+bool mcp2515_can::mcpPinMode(const byte pin, const byte mode)
+{
+    (void) pin;
+    (void) mode;
+    spi(4);
+    return true;
+}
+
+bool mcp2515_can::mcpDigitalWrite(const byte pin, const byte mode)
+{
+    (void) pin;
+    (void) mode;
+    spi(4);
+    return true;
+}
+
+byte mcp2515_can::mcpDigitalRead(const byte pin)
+{
+    (void) pin;
+    spi(3);
+    return HIGH;
+}
+
+/*
+ * Check if a frame passes the given mask / filter pair. Masks and filters are kept in
+ * the register layout (standard ids in the upper 11 bits), a standard frame is only
+ * compared on the SID bits.
+ */
+bool mcp2515_can::acceptedBy(byte mask, byte filter, CAN_FRAME &frame)
+{
+    if (filters[filter].extended != MCP_ID_ANY && (bool) filters[filter].extended != (bool) frame.extended)
+        return false;
+
+    unsigned long id = (frame.extended ? frame.id & 0x1FFFFFFFul : (frame.id & 0x7FF) << 18);
+    unsigned long bits = masks[mask].id;
+    if (!frame.extended)
+        bits &= MCP_SID_BITS;
+
+    return ((id ^ filters[filter].id) & bits) == 0;
+}
+
+/*
+ * Called by the virtual bus for every frame sent by another node.
+ */
+void mcp2515_can::receiveFrame(CAN_FRAME &frame)
+{
+    if (!present || tec > 255 || (opMode != MODE_NORMAL && opMode != MODE_LISTENONLY && opMode != MODE_LOOPBACK))
+        return;
+
+    bool rxb0 = acceptedBy(0, 0, frame) || acceptedBy(0, 1, frame);
+    bool rxb1 = false;
+    for (byte i = 2; i < 6 && !rxb0 && !rxb1; i++)
+        rxb1 = acceptedBy(1, i, frame);
+
+    if (!rxb0 && !rxb1) {
+        rejected++;
+        return;
+    }
+
+    int n = -1;
+    if (rxb0 && !rxBuffers[0].full)
+        n = 0;
+    else if (!rxBuffers[1].full) // rollover of RXB0 or match on RXB1
+        n = 1;
+
+    if (n < 0) {
+        overflows++;
+        eflg |= MCP_EFLG_RX1OVR; // with rollover enabled RXB1 is always the one to overflow
+        return;
+    }
+
+    received++;
+    rxBuffers[n].full = true;
+    rxBuffers[n].frame = frame;
+    if (rxBuffers[n].frame.length > CAN_MAX_CHAR_IN_MESSAGE)
+        rxBuffers[n].frame.length = CAN_MAX_CHAR_IN_MESSAGE;
+    canIntf |= (n == 0 ? MCP_RX0IF : MCP_RX1IF);
+    updateInterruptPin();
+}
+
+/*
+ * Advance the transmit state machine: buffers whose frame has left the wire become
+ * free again and raise their TXnIF flag. Called by the host main loop as well as
+ * from every driver call which reads the status.
+ */
+void mcp2515_can::service()
+{
+    uint64_t now = hostHal.getMicros();
+
+    for (int i = 0; i < MCP_N_TXBUFFERS && tec <= 255; i++) { // nothing leaves a bus-off chip
+        if (txPending[i] && txBusyUntil[i] <= now) {
+            txPending[i] = false;
+            canIntf |= txIfFlag(i);
+        }
+    }
+    updateInterruptPin();
+}
+
+/*
+ * Connect the (active low) INT output of the chip to a pin of the micro controller.
+ */
+void mcp2515_can::setInterruptPin(byte pin)
+{
+    interruptPin = pin;
+    updateInterruptPin();
+}
+
+/*
+ * Wire the controller to another bus, e.g. to give the EVCU a second, separate bus.
+ * Takes effect with the next begin().
+ */
+void mcp2515_can::setBus(VirtualCanBus *bus)
+{
+    this->bus->detach(this);
+    this->bus = bus;
+}
+
+void mcp2515_can::updateInterruptPin()
+{
+    if (interruptPin == 0)
+        return;
+    bool asserted = (canIntf & canInte) != 0;
+    if (hostHal.getPinLevel(interruptPin) != (asserted ? LOW : HIGH))
+        hostHal.setPinLevel(interruptPin, asserted ? LOW : HIGH);
+}
+
+/*
+ * Set the transmit and receive error counters, e.g. to simulate a faulty bus. The
+ * flags in EFLG follow the counters: warning at 96, error passive at 128 and bus-off
+ * above 255. A bus-off controller neither sends nor receives until begin() resets it
+ * (the chip would also recover after 128 x 11 recessive bits, which isn't modelled).
+ */
+void mcp2515_can::setErrorCounters(uint16_t tec, byte rec)
+{
+    this->tec = tec;
+    this->rec = rec;
+    eflg &= (MCP_EFLG_RX1OVR | MCP_EFLG_RX0OVR);
+    if (tec >= 96)
+        eflg |= MCP_EFLG_TXWAR;
+    if (rec >= 96)
+        eflg |= MCP_EFLG_RXWAR;
+    if (tec >= 96 || rec >= 96)
+        eflg |= MCP_EFLG_EWARN;
+    if (tec >= 128)
+        eflg |= MCP_EFLG_TXEP;
+    if (rec >= 128)
+        eflg |= MCP_EFLG_RXEP;
+    if (tec > 255)
+        eflg |= MCP_EFLG_TXBO;
+}
+
+/*
+ * Simulate a missing or broken controller (begin() and mode changes will fail).
+ */
+void mcp2515_can::setPresent(bool present)
+{
+    this->present = present;
+}
+
+uint32_t mcp2515_can::getReceivedCount()
+{
+    return received;
+}
+
+uint32_t mcp2515_can::getRejectedCount()
+{
+    return rejected;
+}
+
+uint32_t mcp2515_can::getOverflowCount()
+{
+    return overflows;
+}
+
+uint32_t mcp2515_can::getTransmittedCount()
+{
+    return transmitted;
+}
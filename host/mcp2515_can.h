@@ -0,0 +1,146 @@
+/*
+ * mcp2515_can.h
+ *
+ * Host replacement for the MCP2515 driver of the CAN_BUS_Shield library. Instead of
+ * talking to the chip via SPI, this class models the controller: the two receive
+ * buffers with rollover, masks and acceptance filters, the three transmit buffers,
+ * the interrupt flags and the INT line. It is attached to a VirtualCanBus (virtualCanBus
+ * unless setBus() selects another one).
+ *
+ * The public interface is identical to the library driver, so the firmware builds
+ * unchanged against it. SPI and mode change latencies are charged to the virtual
+ * clock, the way the library blocks on the target.
+ *
+ Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef _MCP2515_H_
+#define _MCP2515_H_
+
+#include "mcp_can.h"
+#include "mcp2515_can_dfs.h"
+#include "VirtualCanBus.h"
+
+#define MAX_CHAR_IN_MESSAGE 8
+
+class mcp2515_can : public MCP_CAN, public VirtualCanNode
+{
+public:
+    mcp2515_can(byte _CS);
+
+    virtual void enableTxInterrupt(bool enable = true);
+    virtual void reserveTxBuffers(byte nTxBuf = 0)
+    {
+        nReservedTx = (nTxBuf < MCP_N_TXBUFFERS ? nTxBuf : MCP_N_TXBUFFERS - 1);
+    }
+    virtual byte getLastTxBuffer()
+    {
+        return MCP_N_TXBUFFERS - 1;
+    }
+    virtual byte begin(uint32_t speedset, const byte clockset = MCP_16MHz);
+    virtual byte init_Mask(byte num, byte ext, unsigned long ulData);
+    virtual byte init_Filt(byte num, byte ext, unsigned long ulData);
+    virtual void setSleepWakeup(byte enable);
+    virtual byte sleep();
+    virtual byte wake();
+    virtual byte setMode(byte opMode);
+    virtual byte getMode();
+    virtual byte checkError(uint8_t* err_ptr = NULL);
+
+    virtual byte checkReceive(void);
+    virtual byte readMsgBufID(byte status, volatile unsigned long *id, volatile byte *ext, volatile byte *rtr, volatile byte *len, volatile byte *buf);
+    byte readMsgBufID(unsigned long *ID, byte *len, byte *buf) {
+        return readMsgBufID(readRxTxStatus(), ID, &ext_flg, &rtr, len, buf);
+    }
+    byte readMsgBuf(byte *len, byte *buf) {
+        return readMsgBufID(readRxTxStatus(), &can_id, &ext_flg, &rtr, len, buf);
+    }
+
+    virtual byte trySendMsgBuf(unsigned long id, byte ext, byte rtrBit, byte len, const byte *buf, byte iTxBuf = 0xff);
+    virtual byte sendMsgBuf(byte status, unsigned long id, byte ext, byte rtrBit, byte len, volatile const byte *buf);
+    virtual byte sendMsgBuf(unsigned long id, byte ext, byte rtrBit, byte len, const byte *buf, bool wait_sent = true);
+    using MCP_CAN::sendMsgBuf;
+    virtual void clearBufferTransmitIfFlags(byte flags = 0);
+    virtual byte readRxTxStatus(void);
+    virtual byte checkClearRxStatus(byte *status);
+    virtual byte checkClearTxStatus(byte *status, byte iTxBuf = 0xff);
+    virtual bool mcpPinMode(const byte pin, const byte mode);
+    virtual bool mcpDigitalWrite(const byte pin, const byte mode);
+    virtual byte mcpDigitalRead(const byte pin);
+
+    /*
+     * simulation interface (host only)
+     */
+    void receiveFrame(CAN_FRAME &frame);
+    void service();
+    void setInterruptPin(byte pin);
+    void setBus(VirtualCanBus *bus);
+    void setPresent(bool present);
+    void setErrorCounters(uint16_t tec, byte rec);
+    uint32_t getReceivedCount();
+    uint32_t getRejectedCount();
+    uint32_t getOverflowCount();
+    uint32_t getTransmittedCount();
+
+    uint32_t spiByteTime; // virtual time (in us) for one byte on the SPI bus
+
+private:
+    struct RxBuffer {
+        bool full;
+        CAN_FRAME frame;
+    };
+    struct IdRegister {
+        unsigned long id;
+        byte extended;
+    };
+
+    void reset();
+    void spi(uint16_t bytes);
+    bool acceptedBy(byte mask, byte filter, CAN_FRAME &frame);
+    byte getNextFreeTxBuffer(byte *txBuf);
+    void writeTxBuffer(byte txBuf, unsigned long id, byte ext, byte rtrBit, byte len, volatile const byte *buf);
+    void updateInterruptPin();
+    byte txIfFlag(byte i) { return MCP_TX0IF << i; }
+
+    VirtualCanBus *bus; // the bus the CANH/CANL pins are wired to
+    bool present;    // false simulates a missing / not responding chip
+    byte nReservedTx;
+    byte opMode;     // mode the controller is actually in
+    byte canInte;    // interrupt enable register
+    byte canIntf;    // interrupt flag register
+    byte eflg;       // error flag register
+    uint16_t tec;    // transmit error counter (above 255 = bus-off)
+    byte rec;        // receive error counter
+    byte interruptPin;
+    IdRegister masks[2];
+    IdRegister filters[6];
+    RxBuffer rxBuffers[2];
+    bool txPending[MCP_N_TXBUFFERS];
+    uint64_t txBusyUntil[MCP_N_TXBUFFERS]; // when the pending frame has left the wire
+    uint32_t received;
+    uint32_t rejected;
+    uint32_t overflows;
+    uint32_t transmitted;
+};
+
+#endif /* _MCP2515_H_ */
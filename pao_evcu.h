@@ -37,6 +37,11 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "DmocMotorController.h"
 #include "sys_io.h"
 #include "CanHandler.h"
+#include "IsoTp.h"
+#include "SdoServer.h"
+#include "PdoHandler.h"
+#include "SyncHandler.h"
+#include "NmtHandler.h"
 #include "ThrottleDetector.h"
 #include "DeviceManager.h"
 #include "Sys_Messages.h"
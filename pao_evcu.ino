@@ -49,12 +49,12 @@ Random comments on things that should be coded up soon:
 	class and not directly in the Dmoc class.
 */
 
-#include "PAO_EVCU.h"
+#include "pao_evcu.h"
 
 // The following includes are required in the .ino file by the Arduino IDE in order to properly
 // identify the required libraries for the build.
 #include <Wire.h>
-#include "evTimer.h"
+#include "TickHandler.h"
 #include "ble.h"
 #include <SPI.h>
 #include <Adafruit_SleepyDog.h>
@@ -68,9 +68,14 @@ template<class T> inline Print &operator <<(Print &obj, T arg) { obj.print(arg);
 byte i = 0;
 uint8_t loglevel;
 Ble *bt;
-SimpleTimer btTimer;
 Ble::BleData *bleData;
 
+// pushes the values to the BLE characteristics at CFG_TICK_INTERVAL_BLE
+class BleUpdater : public TickObserver {
+public:
+	void handleTick() { send_ble_info(); }
+} bleUpdater;
+
 
 
 
@@ -106,7 +111,7 @@ void initializeDevices(Ble::BleData *bleData) {
 
 void setup() {
    
-	// if we are not connected to m2515 faether moddule this will reset forever as it is blocked by while loop waiting for CAN signal. 
+	// setup() no longer waits for the m2515 feather module, CanHandler keeps retrying it from loop().
 	// comment out for debug purposes
 	//Watchdog.enable(3000);	
 
@@ -128,15 +133,15 @@ void setup() {
 	bt->setup();
 
 	initializeDevices(bleData);
+	sdoServer.setup();
+	pdoHandler.setup();
+	syncHandler.setup();
+	nmtHandler.setup();
 
-	systemIO.setup();  
-	Logger::info("SYSIO init ok");	
-
-   
 	Logger::info("System Ready");	
-	initializeDevices(bleData);
 
-  	btTimer.setInterval(ble_interval, send_ble_info);
+	tickHandler.attach(&bleUpdater, CFG_TICK_INTERVAL_BLE);
+	Logger::setDeferred(true);
 }
 
 void send_ble_info(){
@@ -150,18 +155,11 @@ void loop() {
 
 	// check if incoming frames are available in the can buffer and process them
 	canHandler.process();
-	
-	btTimer.run();
-
-	Timer.loop();
-	Timer1.loop();
-	Timer2.loop();
-	Timer3.loop();
-	Timer4.loop();
-	Timer5.loop();
-	Timer6.loop();
-	Timer7.loop();
-	Timer8.loop();
-    
+	isoTpHandler.process();
+	pdoHandler.process();
+
+	// print the log messages recorded meanwhile
+	Logger::process();
+
     Watchdog.reset();
 }
@@ -48,6 +48,7 @@ SystemIO::SystemIO()
     adc2Initialized = false;
     adc3Initialized = false;
     lastInitAttempt = 0;
+    sysioState = SYSSTATE_UNINIT;
 }
 
 void SystemIO::setSystemType(SystemType systemType) {
@@ -112,6 +113,21 @@ void SystemIO::setup() {
     // adjust ADC
     // analogReference(AR_INTERNAL_3_0);
     analogReadResolution(10);
+
+#ifdef CFG_ADC_SCAN
+    static const uint8_t scanPins[] = { BrakeADC, ThrottleADC1, ThrottleADC2 };
+    if (!AdcScanner::begin(scanPins, sizeof(scanPins), CFG_ADC_SCAN_INTERVAL, CFG_ADC_OVERSAMPLING))
+        Logger::info("unable to scan the analog inputs, falling back to analogRead()");
+#endif
+}
+
+/*
+ * The external SPI ADCs (ADE7913) of the original GEVCU hardware are not fitted on the
+ * Feather M0 board, so the SPI readings stay disabled until they are initialized.
+ */
+bool SystemIO::isInitialized()
+{
+    return sysioState == SYSSTATE_INITIALIZED;
 }
 
 int SystemIO::numDigitalInputs()
@@ -140,14 +156,29 @@ On PAO_EVCU6.2 or higher
 Gets reading over SPI which is still pretty fast. The SPI connected chip is 24 bit
 but too much of the code for PAO_EVCU uses 16 bit integers for storage so the 24 bit values returned
 are knocked down to 16 bit values before being passed along.
+On the Feather M0 the pedal inputs are scanned in the background (see AdcScanner), this
+just returns the latest sample. Other pins take a blocking analogRead(), which has to
+pause the scan.
 */
 int16_t SystemIO::getAnalogIn(uint8_t pin) {
-    int base;
+    int16_t value;
     if (pin > MAX_PIN) {
         return 0;
     }
 
-    return analogRead(pin);
+#ifdef CFG_ADC_SCAN
+    value = AdcScanner::getSample(pin);
+    if (value >= 0)
+        return value;
+    if (AdcScanner::isRunning()) {
+        AdcScanner::stop();
+        value = analogRead(pin);
+        AdcScanner::start();
+        return value;
+    }
+#endif
+    value = analogRead(pin);
+    return value;
 }
 
 boolean SystemIO::setAnalogOut(uint8_t which, int32_t level)
@@ -210,7 +241,7 @@ boolean SystemIO::getDigitalIn(uint8_t pin) {
 
 //set output high or not
 void SystemIO::setDigitalOutput(uint8_t pin, boolean active) {
-    Logger::info("SET DIGITAL:  pin %d  numDigOut %d MAX_PIN %d active %s", pin, numDigOut, MAX_PIN, active);
+    Logger::info("SET DIGITAL:  pin %d  numDigOut %d MAX_PIN %d active %T", pin, numDigOut, MAX_PIN, active);
     
     if (pin < MAX_PIN)
     {
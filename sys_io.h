@@ -34,6 +34,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <SPI.h>
 #include "config.h"
 #include "Logger.h"
+#include "AdcScanner.h"
 #include <Adafruit_SleepyDog.h>
 
 